@@ -0,0 +1,353 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "byte_buffer.hpp"
+#include "parallel.hpp"
+#include "arithmetic_encoding.hpp"
+
+/* The stream starts with the number of uncompressed bytes (64 bit)
+ * and the size of each block (32 bit), followed by the size of every
+ * compressed block (32 bit each). The compressed blocks follow.
+ *
+ * Probabilities are 12-bit integers, and all the computations are
+ * done in integer arithmetic: this guarantees that a stream can be
+ * decoded on a machine different from the one that encoded it. */
+
+//////////////////////////////////////////////////////////////////////
+
+struct Logistic_tables_t {
+    // stretch(p) = ln(p / (1 - p)), squash(x) = 1 / (1 + exp(-x)).
+    // Probabilities are in the range 0..4095, stretched values in the
+    // range -2047..2047 (i.e., 8 bits of fractional part).
+    int16_t stretch[4096];
+
+    Logistic_tables_t() {
+	int first_p = 0;
+	for(int x = -2047; x <= 2047; ++x) {
+	    int p = squash(x);
+	    for(int idx = first_p; idx <= p; ++idx)
+		stretch[idx] = x;
+
+	    first_p = p + 1;
+	}
+
+	for(int idx = first_p; idx < 4096; ++idx)
+	    stretch[idx] = 2047;
+    }
+
+    static int squash(int x) {
+	static const int table[33] = {
+	    1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101,
+	    1546, 2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4022,
+	    4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094
+	};
+
+	if(x > 2047)
+	    return 4095;
+	if(x < -2047)
+	    return 1;
+
+	int weight = x & 127;
+	int idx = (x >> 7) + 16;
+	return (table[idx] * (128 - weight) + table[idx + 1] * weight + 64) >> 7;
+    }
+};
+
+static const Logistic_tables_t &
+logistic_tables()
+{
+    static const Logistic_tables_t tables;
+    return tables;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const int NUM_OF_MODELS = 3;
+
+// Weights are fixed-point numbers with 16 bits of fractional part
+const int32_t MAX_WEIGHT = 16 << 16;
+
+class Arith_model_t {
+public:
+    Arith_model_t()
+	: order0(4 * 256, 1 << 15),
+	  order1(4 * 256 * 256, 1 << 15),
+	  word_history(4 * 256 * 256, 1 << 15),
+	  tables(logistic_tables()),
+	  prediction(2048) {
+	for(auto & weight : weights)
+	    weight = (1 << 16) / NUM_OF_MODELS;
+
+	std::fill(stretched, stretched + NUM_OF_MODELS, 0);
+	std::fill(counters, counters + NUM_OF_MODELS, nullptr);
+	weight_set = weights;
+    }
+
+    // Return the probability (0..4095) that the next bit is 1. The
+    // bit is number "bit_idx" (0 is the most significant) of a byte
+    // whose previous bits are encoded in "node" (with a leading 1),
+    // and "lane" is the position of the byte within a 32-bit word
+    int predict(unsigned int lane,
+		unsigned int bit_idx,
+		unsigned int node,
+		uint8_t previous_byte,
+		uint8_t previous_word_byte) {
+
+	counters[0] = &order0[(lane << 8) | node];
+	counters[1] = &order1[(((lane << 8) | previous_byte) << 8) | node];
+	counters[2] = &word_history[(((lane << 8) | previous_word_byte) << 8) | node];
+	weight_set = weights + (lane * 8 + bit_idx) * NUM_OF_MODELS;
+
+	int64_t dot_product = 0;
+	for(int idx = 0; idx < NUM_OF_MODELS; ++idx) {
+	    stretched[idx] = tables.stretch[*counters[idx] >> 4];
+	    dot_product += static_cast<int64_t>(stretched[idx]) * weight_set[idx];
+	}
+
+	int mixed = static_cast<int>(dot_product >> 16);
+	mixed = std::max(-2047, std::min(2047, mixed));
+	prediction = std::max(1, std::min(4095, Logistic_tables_t::squash(mixed)));
+
+	return prediction;
+    }
+
+    void update(int bit) {
+	const int error = ((bit << 12) - prediction);
+	for(int idx = 0; idx < NUM_OF_MODELS; ++idx) {
+	    weight_set[idx] = std::max(-MAX_WEIGHT,
+				       std::min(MAX_WEIGHT,
+						weight_set[idx] + ((stretched[idx] * error) >> 10)));
+
+	    int counter = *counters[idx];
+	    counter += (((bit << 16) - bit) - counter) >> 4;
+	    *counters[idx] = counter;
+	}
+    }
+
+private:
+    std::vector<uint16_t> order0;
+    std::vector<uint16_t> order1;
+    std::vector<uint16_t> word_history;
+    const Logistic_tables_t & tables;
+
+    // One set of weights for each combination of lane and bit index
+    int32_t weights[4 * 8 * NUM_OF_MODELS];
+    int32_t * weight_set;
+    int stretched[NUM_OF_MODELS];
+    uint16_t * counters[NUM_OF_MODELS];
+    int prediction;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+class Arith_encoder_t {
+public:
+    Arith_encoder_t(std::vector<uint8_t> & a_output)
+	: output(a_output), x1(0), x2(0xFFFFFFFF) {}
+
+    void encode(int bit, int probability) {
+	const uint32_t xmid =
+	    x1 + static_cast<uint32_t>((static_cast<uint64_t>(x2 - x1) * probability) >> 12);
+
+	if(bit)
+	    x2 = xmid;
+	else
+	    x1 = xmid + 1;
+
+	while(((x1 ^ x2) & 0xFF000000) == 0) {
+	    output.push_back(x2 >> 24);
+	    x1 <<= 8;
+	    x2 = (x2 << 8) | 0xFF;
+	}
+    }
+
+    void flush() {
+	for(int shift = 24; shift >= 0; shift -= 8)
+	    output.push_back((x1 >> shift) & 0xFF);
+    }
+
+private:
+    std::vector<uint8_t> & output;
+    uint32_t x1, x2;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+class Arith_decoder_t {
+public:
+    Arith_decoder_t(const uint8_t * a_input, size_t a_input_size)
+	: input(a_input), input_size(a_input_size), position(0),
+	  x1(0), x2(0xFFFFFFFF), x(0) {
+	for(int idx = 0; idx < 4; ++idx)
+	    x = (x << 8) | next_byte();
+    }
+
+    int decode(int probability) {
+	const uint32_t xmid =
+	    x1 + static_cast<uint32_t>((static_cast<uint64_t>(x2 - x1) * probability) >> 12);
+
+	int bit = (x <= xmid);
+	if(bit)
+	    x2 = xmid;
+	else
+	    x1 = xmid + 1;
+
+	while(((x1 ^ x2) & 0xFF000000) == 0) {
+	    x1 <<= 8;
+	    x2 = (x2 << 8) | 0xFF;
+	    x = (x << 8) | next_byte();
+	}
+
+	return bit;
+    }
+
+private:
+    const uint8_t * input;
+    size_t input_size;
+    size_t position;
+    uint32_t x1, x2, x;
+
+    uint8_t next_byte() {
+	return (position < input_size) ? input[position++] : 0;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+compress_block(const uint8_t * input, size_t input_size,
+	       std::vector<uint8_t> & output)
+{
+    Arith_model_t model;
+    Arith_encoder_t encoder(output);
+
+    for(size_t byte_idx = 0; byte_idx < input_size; ++byte_idx) {
+	const unsigned int lane = byte_idx & 3;
+	const uint8_t previous_byte = (byte_idx >= 1) ? input[byte_idx - 1] : 0;
+	const uint8_t previous_word_byte = (byte_idx >= 4) ? input[byte_idx - 4] : 0;
+	const uint8_t cur_byte = input[byte_idx];
+
+	unsigned int node = 1;
+	for(unsigned int bit_idx = 0; bit_idx < 8; ++bit_idx) {
+	    const int bit = (cur_byte >> (7 - bit_idx)) & 1;
+
+	    encoder.encode(bit, model.predict(lane, bit_idx, node,
+					      previous_byte, previous_word_byte));
+	    model.update(bit);
+	    node = (node << 1) | bit;
+	}
+    }
+
+    encoder.flush();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+decompress_block(const uint8_t * input, size_t input_size,
+		 uint8_t * output, size_t output_size)
+{
+    Arith_model_t model;
+    Arith_decoder_t decoder(input, input_size);
+
+    for(size_t byte_idx = 0; byte_idx < output_size; ++byte_idx) {
+	const unsigned int lane = byte_idx & 3;
+	const uint8_t previous_byte = (byte_idx >= 1) ? output[byte_idx - 1] : 0;
+	const uint8_t previous_word_byte = (byte_idx >= 4) ? output[byte_idx - 4] : 0;
+
+	unsigned int node = 1;
+	for(unsigned int bit_idx = 0; bit_idx < 8; ++bit_idx) {
+	    const int bit =
+		decoder.decode(model.predict(lane, bit_idx, node,
+					     previous_byte, previous_word_byte));
+	    model.update(bit);
+	    node = (node << 1) | bit;
+	}
+
+	output[byte_idx] = node & 0xFF;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+arith_compression(const uint8_t * input_stream,
+		  size_t input_size,
+		  Byte_buffer_t & output_stream,
+		  unsigned int num_of_threads)
+{
+    const size_t num_of_blocks =
+	(input_size + ARITH_BLOCK_SIZE - 1) / ARITH_BLOCK_SIZE;
+    std::vector<std::vector<uint8_t> > compressed_blocks(num_of_blocks);
+
+    parallel_for(num_of_blocks, num_of_threads, [&](size_t block_idx) {
+	    const size_t first_byte = block_idx * ARITH_BLOCK_SIZE;
+	    compress_block(input_stream + first_byte,
+			   std::min<size_t>(ARITH_BLOCK_SIZE, input_size - first_byte),
+			   compressed_blocks[block_idx]);
+	});
+
+    output_stream.append_uint64(input_size);
+    output_stream.append_uint32(ARITH_BLOCK_SIZE);
+    for(auto & cur_block : compressed_blocks)
+	output_stream.append_uint32(cur_block.size());
+
+    for(auto & cur_block : compressed_blocks)
+	output_stream.append_data_from_buffer(cur_block.size(), cur_block.data());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+arith_decompression(Byte_view_t & input_stream,
+		    Byte_buffer_t & output_stream,
+		    unsigned int num_of_threads)
+{
+    const uint64_t output_size = input_stream.read_uint64();
+    const uint32_t block_size = input_stream.read_uint32();
+    if(block_size == 0)
+	throw std::runtime_error("invalid block size in arithmetic-coded stream");
+
+    const size_t num_of_blocks = (output_size + block_size - 1) / block_size;
+    std::vector<size_t> block_offsets(num_of_blocks + 1);
+    block_offsets[0] = 0;
+    for(size_t idx = 0; idx < num_of_blocks; ++idx)
+	block_offsets[idx + 1] = block_offsets[idx] + input_stream.read_uint32();
+
+    if(block_offsets.back() > input_stream.items_left())
+	throw std::out_of_range("arith_decompression asked for too much data");
+
+    const uint8_t * compressed_data = input_stream.skip(block_offsets.back());
+    const size_t first_output_byte = output_stream.buffer.size();
+    output_stream.buffer.resize(first_output_byte + output_size);
+    uint8_t * output_data = output_stream.buffer.data() + first_output_byte;
+
+    parallel_for(num_of_blocks, num_of_threads, [&](size_t block_idx) {
+	    const size_t first_byte = block_idx * block_size;
+	    decompress_block(compressed_data + block_offsets[block_idx],
+			     block_offsets[block_idx + 1] - block_offsets[block_idx],
+			     output_data + first_byte,
+			     std::min<size_t>(block_size, output_size - first_byte));
+	});
+}
@@ -0,0 +1,53 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef ARITHMETIC_ENCODING_HPP
+#define ARITHMETIC_ENCODING_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "byte_buffer.hpp"
+
+// The input is split in blocks of this size, which are compressed
+// independently (and in parallel) from each other
+const uint32_t ARITH_BLOCK_SIZE = 1024 * 1024;
+
+// Compress a stream of bytes using an adaptive binary arithmetic
+// coder. Each bit is predicted by mixing several context models,
+// which are based on the previous byte, on the same byte of the
+// previous 32-bit word and on the position of the byte within the
+// word. Most encoders in "squeezer" write 32-bit quantities, so these
+// contexts capture most of the redundancy left in a chunk. (The
+// frames of the polynomial encoding used for angles are not aligned
+// to 32 bits, which makes the last context less effective there.)
+// If "num_of_threads" is zero, all the available cores are used.
+void arith_compression(const uint8_t * input_stream,
+		       size_t input_size,
+		       Byte_buffer_t & output_stream,
+		       unsigned int num_of_threads);
+
+// Decode a stream created by "arith_compression" and append the
+// result to "output_stream"
+void arith_decompression(Byte_view_t & input_stream,
+			 Byte_buffer_t & output_stream,
+			 unsigned int num_of_threads);
+
+#endif
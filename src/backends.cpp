@@ -0,0 +1,422 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.hpp"
+
+#include <climits>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "backends.hpp"
+#include "arithmetic_encoding.hpp"
+
+// The payload produced by the zlib, zstd and lz4 backends starts with
+// the size of the decompressed data and the size of the compressed
+// data (two 64-bit integers), followed by the compressed data.
+
+//////////////////////////////////////////////////////////////////////
+
+// Size of the two 64-bit integers at the beginning of the payload
+static const size_t PAYLOAD_HEADER_SIZE = 16;
+
+// Append the header of a zlib/zstd/lz4 payload to "output" and make
+// room for "max_size" bytes of compressed data after it, so that the
+// backend can write directly into the buffer. Return the position of
+// the header.
+static size_t
+start_compression(const Byte_buffer_t & input,
+		  size_t max_size,
+		  Byte_buffer_t & output)
+{
+    const size_t header_pos = output.size();
+    output.append_uint64(input.size());
+    output.append_uint64(0);
+    output.buffer.resize(output.size() + max_size);
+
+    return header_pos;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Save the actual size of the compressed data in the header and drop
+// the unused bytes at the end of "output"
+static void
+finish_compression(size_t header_pos,
+		   uint64_t compressed_size,
+		   Byte_buffer_t & output)
+{
+    output.buffer.resize(header_pos + PAYLOAD_HEADER_SIZE + compressed_size);
+    for(size_t idx = 0; idx < 8; ++idx) {
+	output.buffer[header_pos + 8 + idx] =
+	    (compressed_size >> (56 - 8 * idx)) & 0xFF;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Check the header of a zlib/zstd/lz4 payload and return a pointer to
+// the compressed data. The output buffer is enlarged to make room for
+// the decompressed data, and "dest" points to the first new byte.
+static const uint8_t *
+start_decompression(Byte_view_t & input,
+		    Byte_buffer_t & output,
+		    uint64_t & compressed_size,
+		    uint64_t & decompressed_size,
+		    uint8_t *& dest)
+{
+    decompressed_size = input.read_uint64();
+    compressed_size = input.read_uint64();
+    if(compressed_size > input.items_left())
+	throw std::runtime_error("truncated backend stream");
+
+    const uint8_t * source = input.skip(compressed_size);
+
+    const size_t first_output_byte = output.buffer.size();
+    output.buffer.resize(first_output_byte + decompressed_size);
+    dest = output.buffer.data() + first_output_byte;
+
+    return source;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+arith_backend_compression(const Byte_buffer_t & input,
+			  int level,
+			  Byte_buffer_t & output,
+			  unsigned int num_of_threads)
+{
+    (void) level;
+    arith_compression(input.buffer.data(), input.size(), output,
+		      num_of_threads);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+arith_backend_decompression(Byte_view_t & input,
+			    Byte_buffer_t & output,
+			    unsigned int num_of_threads)
+{
+    arith_decompression(input, output, num_of_threads);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+zlib_backend_compression(const Byte_buffer_t & input,
+			 int level,
+			 Byte_buffer_t & output,
+			 unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    uLongf compressed_size = compressBound(input.size());
+    const size_t header_pos = start_compression(input, compressed_size, output);
+    uint8_t * dest = output.buffer.data() + header_pos + PAYLOAD_HEADER_SIZE;
+
+    if(compress2(dest, &compressed_size,
+		 input.buffer.data(), input.size(), level) != Z_OK)
+	throw std::runtime_error("zlib was unable to compress a chunk");
+
+    finish_compression(header_pos, compressed_size, output);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+zlib_backend_decompression(Byte_view_t & input,
+			   Byte_buffer_t & output,
+			   unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    uint64_t compressed_size;
+    uint64_t decompressed_size;
+    uint8_t * dest;
+    const uint8_t * source = start_decompression(input, output,
+						 compressed_size,
+						 decompressed_size,
+						 dest);
+
+    uLongf dest_size = decompressed_size;
+    if(uncompress(dest, &dest_size, source, compressed_size) != Z_OK ||
+       dest_size != decompressed_size)
+	throw std::runtime_error("corrupted zlib stream");
+}
+
+//////////////////////////////////////////////////////////////////////
+
+#if HAVE_ZSTD
+
+static void
+zstd_backend_compression(const Byte_buffer_t & input,
+			 int level,
+			 Byte_buffer_t & output,
+			 unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    const size_t max_size = ZSTD_compressBound(input.size());
+    const size_t header_pos = start_compression(input, max_size, output);
+    uint8_t * dest = output.buffer.data() + header_pos + PAYLOAD_HEADER_SIZE;
+    size_t compressed_size = ZSTD_compress(dest,
+					   max_size,
+					   input.buffer.data(),
+					   input.size(),
+					   level);
+    if(ZSTD_isError(compressed_size))
+	throw std::runtime_error(std::string("zstd was unable to compress a chunk: ")
+				 + ZSTD_getErrorName(compressed_size));
+
+    finish_compression(header_pos, compressed_size, output);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+zstd_backend_decompression(Byte_view_t & input,
+			   Byte_buffer_t & output,
+			   unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    uint64_t compressed_size;
+    uint64_t decompressed_size;
+    uint8_t * dest;
+    const uint8_t * source = start_decompression(input, output,
+						 compressed_size,
+						 decompressed_size,
+						 dest);
+
+    size_t result = ZSTD_decompress(dest, decompressed_size,
+				    source, compressed_size);
+    if(ZSTD_isError(result) || result != decompressed_size)
+	throw std::runtime_error("corrupted zstd stream");
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+#if HAVE_LZ4
+
+// For lz4, the level is the "acceleration" factor: higher values
+// make compression faster and the output larger
+static void
+lz4_backend_compression(const Byte_buffer_t & input,
+			int level,
+			Byte_buffer_t & output,
+			unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    if(input.size() > LZ4_MAX_INPUT_SIZE)
+	throw std::runtime_error("chunk too large for lz4");
+
+    const int max_size = LZ4_compressBound(input.size());
+    const size_t header_pos = start_compression(input, max_size, output);
+    uint8_t * dest = output.buffer.data() + header_pos + PAYLOAD_HEADER_SIZE;
+    int compressed_size =
+	LZ4_compress_fast(reinterpret_cast<const char *>(input.buffer.data()),
+			  reinterpret_cast<char *>(dest),
+			  input.size(),
+			  max_size,
+			  level);
+    if(compressed_size <= 0 && input.size() > 0)
+	throw std::runtime_error("lz4 was unable to compress a chunk");
+
+    finish_compression(header_pos, compressed_size, output);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+lz4_backend_decompression(Byte_view_t & input,
+			  Byte_buffer_t & output,
+			  unsigned int num_of_threads)
+{
+    (void) num_of_threads;
+    uint64_t compressed_size;
+    uint64_t decompressed_size;
+    uint8_t * dest;
+    const uint8_t * source = start_decompression(input, output,
+						 compressed_size,
+						 decompressed_size,
+						 dest);
+
+    if(compressed_size > INT_MAX || decompressed_size > INT_MAX)
+	throw std::runtime_error("corrupted lz4 stream");
+
+    int result =
+	LZ4_decompress_safe(reinterpret_cast<const char *>(source),
+			    reinterpret_cast<char *>(dest),
+			    compressed_size,
+			    decompressed_size);
+    if(result < 0 || (uint64_t) result != decompressed_size)
+	throw std::runtime_error("corrupted lz4 stream");
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+static const Backend_t list_of_backends[] = {
+    { BACKEND_ARITHMETIC, "arith", 0,
+      arith_backend_compression, arith_backend_decompression },
+    { BACKEND_ZLIB, "zlib", Z_DEFAULT_COMPRESSION,
+      zlib_backend_compression, zlib_backend_decompression },
+#if HAVE_ZSTD
+    { BACKEND_ZSTD, "zstd", 3,
+      zstd_backend_compression, zstd_backend_decompression },
+#endif
+#if HAVE_LZ4
+    { BACKEND_LZ4, "lz4", 1,
+      lz4_backend_compression, lz4_backend_decompression },
+#endif
+};
+
+static const size_t num_of_backends =
+    sizeof(list_of_backends) / sizeof(list_of_backends[0]);
+
+//////////////////////////////////////////////////////////////////////
+
+const Backend_t *
+find_backend(Backend_type_t type)
+{
+    for(size_t idx = 0; idx < num_of_backends; ++idx) {
+	if(list_of_backends[idx].type == type)
+	    return &list_of_backends[idx];
+    }
+
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const Backend_t *
+find_backend(const std::string & name)
+{
+    for(size_t idx = 0; idx < num_of_backends; ++idx) {
+	if(name == list_of_backends[idx].name)
+	    return &list_of_backends[idx];
+    }
+
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+backend_name(Backend_type_t type)
+{
+    switch(type) {
+    case BACKEND_NONE: return "none";
+    case BACKEND_ARITHMETIC: return "arith";
+    case BACKEND_ZLIB: return "zlib";
+    case BACKEND_ZSTD: return "zstd";
+    case BACKEND_LZ4: return "lz4";
+    }
+
+    return "unknown";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+list_of_available_backends()
+{
+    std::string result("none");
+    for(size_t idx = 0; idx < num_of_backends; ++idx) {
+	result += ", ";
+	result += list_of_backends[idx].name;
+    }
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+parse_backend_choice(const std::string & str,
+		     Backend_choice_t & choice)
+{
+    const size_t colon_pos = str.find(':');
+    const std::string name = str.substr(0, colon_pos);
+
+    if(name == "none") {
+	choice = Backend_choice_t();
+	return colon_pos == std::string::npos;
+    }
+
+    const Backend_t * backend = find_backend(name);
+    if(backend == NULL)
+	return false;
+
+    choice.type = backend->type;
+    choice.level = backend->default_level;
+
+    if(colon_pos != std::string::npos) {
+	std::stringstream ss(str.substr(colon_pos + 1));
+	if(! (ss >> choice.level) || ! ss.eof())
+	    return false;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+backend_compression(const Backend_choice_t & choice,
+		    const Byte_buffer_t & input,
+		    Byte_buffer_t & output,
+		    unsigned int num_of_threads)
+{
+    const Backend_t * backend = find_backend(choice.type);
+    if(backend == NULL)
+	throw std::runtime_error("backend \"" + backend_name(choice.type)
+				 + "\" is not available");
+
+    backend->compress(input, choice.level, output, num_of_threads);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+backend_decompression(Backend_type_t type,
+		      Byte_view_t & input,
+		      Byte_buffer_t & output,
+		      unsigned int num_of_threads)
+{
+    const Backend_t * backend = find_backend(type);
+    if(backend == NULL)
+	throw std::runtime_error("backend \"" + backend_name(type)
+				 + "\" is not available in this build of "
+				 PROGRAM_NAME);
+
+    backend->decompress(input, output, num_of_threads);
+}
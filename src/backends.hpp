@@ -0,0 +1,94 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef BACKENDS_HPP
+#define BACKENDS_HPP
+
+#include <string>
+
+#include "common_defs.hpp"
+#include "byte_buffer.hpp"
+
+// A general-purpose compressor that can be applied to the payload of
+// a chunk. Not every backend listed in Backend_type_t is available:
+// zstd and lz4 are included only if "configure" finds them.
+struct Backend_t {
+    Backend_type_t type;
+    const char * name;
+    int default_level;
+
+    // Compress the whole "input" buffer and append the result to
+    // "output". The backend can use up to "num_of_threads" threads
+    // (zero means one per core): callers that already process
+    // several blocks in parallel pass 1. Only the arithmetic coder is
+    // multi-threaded.
+    void (* compress)(const Byte_buffer_t & input,
+		      int level,
+		      Byte_buffer_t & output,
+		      unsigned int num_of_threads);
+
+    // Decode the bytes of "input" from its current position and
+    // append the result to "output"
+    void (* decompress)(Byte_view_t & input,
+			Byte_buffer_t & output,
+			unsigned int num_of_threads);
+};
+
+// Backend and compression level to use for a chunk
+struct Backend_choice_t {
+    Backend_type_t type;
+    int level;
+
+    Backend_choice_t()
+	: type(BACKEND_NONE),
+	  level(0) {}
+    Backend_choice_t(Backend_type_t a_type, int a_level)
+	: type(a_type),
+	  level(a_level) {}
+};
+
+// Return NULL if the backend has not been compiled in
+const Backend_t * find_backend(Backend_type_t type);
+const Backend_t * find_backend(const std::string & name);
+
+// Return a human-readable name even for backends that are not
+// available (e.g., to describe the chunks of a file)
+std::string backend_name(Backend_type_t type);
+
+// Comma-separated list of the names of the available backends
+std::string list_of_available_backends();
+
+// Parse a string like "zlib" or "zstd:19". Return false if the
+// backend is unknown or not available, or if the level is invalid.
+bool parse_backend_choice(const std::string & str,
+			  Backend_choice_t & choice);
+
+// These functions throw a std::runtime_error if the backend is not
+// available
+void backend_compression(const Backend_choice_t & choice,
+			 const Byte_buffer_t & input,
+			 Byte_buffer_t & output,
+			 unsigned int num_of_threads);
+void backend_decompression(Backend_type_t type,
+			   Byte_view_t & input,
+			   Byte_buffer_t & output,
+			   unsigned int num_of_threads);
+
+#endif
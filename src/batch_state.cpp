@@ -0,0 +1,548 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch_state.hpp"
+#include "crc32c.hpp"
+#include "mapped_file.hpp"
+
+// The state file starts with this line, followed by one line for each
+// output file:
+//
+//   OUTPUT INPUT RADIOMETER OD PARAMETERS INPUT_SIZE INPUT_MTIME
+//   INPUT_CHECKSUM OUTPUT_SIZE OUTPUT_MTIME
+//
+// Checksums are written in hexadecimal, times in nanoseconds.
+static const char * state_file_header = "# squeezer state file, version 1";
+
+// The journal starts with this line, followed by the description of
+// the command and options. Then there is one line for each completed
+// line of the parameter file:
+//
+//   OUTPUT_SIZE RADIOMETER OD INPUT OUTPUT
+static const char * journal_header = "# squeezer journal, version 1: ";
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+read_file_status(const std::string & file_name,
+		 File_signature_t & signature)
+{
+    struct stat file_info;
+    if(stat(file_name.c_str(), &file_info) != 0 ||
+       ! S_ISREG(file_info.st_mode))
+	return false;
+
+    signature.size = file_info.st_size;
+    signature.mtime_ns = ((int64_t) file_info.st_mtim.tv_sec) * 1000000000
+	+ file_info.st_mtim.tv_nsec;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+compute_file_checksum(const std::string & file_name,
+		      File_signature_t & signature)
+{
+    FILE * file = std::fopen(file_name.c_str(), "rb");
+    if(file == NULL)
+	throw std::runtime_error("unable to open file \"" + file_name + "\": "
+				 + std::strerror(errno));
+
+    try {
+	Mapped_file_t contents(file);
+	const Byte_view_t view = contents.view();
+	signature.checksum = crc32c(view.cur_data(), view.items_left());
+    }
+    catch(...) {
+	std::fclose(file);
+	throw;
+    }
+
+    std::fclose(file);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+compression_parameters_checksum(const Compression_parameters_t & params)
+{
+    std::ostringstream description;
+    description.precision(17);
+
+    description << PROGRAM_VERSION << ' '
+		<< params.file_type << ' '
+		<< params.elements_per_frame << ' '
+		<< params.number_of_poly_terms << ' '
+		<< params.max_abs_error << ' '
+		<< params.read_calibrated_data << ' '
+		<< params.backend.type << ':' << params.backend.level << ' '
+		<< params.filter << ' '
+		<< params.samples_per_block;
+    for(auto const & column : params.column_backends) {
+	description << ' ' << column.first
+		    << '=' << column.second.type
+		    << ':' << column.second.level;
+    }
+
+    const std::string str = description.str();
+    return crc32c(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+decompression_parameters_checksum(const Decompression_parameters_t & params)
+{
+    std::ostringstream description;
+    description.precision(17);
+
+    description << PROGRAM_VERSION << ' '
+		<< params.column_mask << ' '
+		<< params.obt_range_flag;
+    if(params.obt_range_flag)
+	description << ' ' << params.first_obt << ' ' << params.last_obt;
+
+    const std::string str = description.str();
+    return crc32c(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+Batch_state_t::load(const std::string & file_name)
+{
+    std::ifstream input_stream(file_name);
+    if(! input_stream)
+	return false;
+
+    std::map<std::string, Batch_state_entry_t> new_entries;
+    std::string cur_line;
+    size_t line_number = 0;
+    while(getline(input_stream, cur_line)) {
+	line_number++;
+
+	if(line_number == 1 && cur_line != state_file_header)
+	    throw std::runtime_error("\"" + file_name
+				     + "\" is not a state file");
+
+	if(cur_line.empty() || cur_line.at(0) == '#')
+	    continue;
+
+	std::stringstream ss(cur_line);
+	std::string output_file_name;
+	Batch_state_entry_t entry;
+	ss >> output_file_name
+	   >> entry.input_file_name
+	   >> entry.radiometer_str
+	   >> entry.od_str
+	   >> std::hex >> entry.parameters_checksum >> std::dec
+	   >> entry.input.size
+	   >> entry.input.mtime_ns
+	   >> std::hex >> entry.input.checksum >> std::dec
+	   >> entry.output.size
+	   >> entry.output.mtime_ns;
+	if(! ss) {
+	    std::ostringstream message;
+	    message << "file \"" << file_name << "\", line " << line_number
+		    << ": malformed entry";
+	    throw std::runtime_error(message.str());
+	}
+
+	new_entries[output_file_name] = entry;
+    }
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries.swap(new_entries);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_state_t::save(const std::string & file_name) const
+{
+    const std::string temporary_file_name = file_name + ".tmp";
+
+    {
+	std::ofstream output_stream(temporary_file_name);
+	output_stream << state_file_header << '\n';
+
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	for(auto const & cur_entry : entries) {
+	    const Batch_state_entry_t & entry = cur_entry.second;
+	    output_stream << cur_entry.first << ' '
+			  << entry.input_file_name << ' '
+			  << entry.radiometer_str << ' '
+			  << entry.od_str << ' '
+			  << std::hex << entry.parameters_checksum << std::dec << ' '
+			  << entry.input.size << ' '
+			  << entry.input.mtime_ns << ' '
+			  << std::hex << entry.input.checksum << std::dec << ' '
+			  << entry.output.size << ' '
+			  << entry.output.mtime_ns << '\n';
+	}
+
+	output_stream.close();
+	if(! output_stream)
+	    throw std::runtime_error("unable to write file \""
+				     + temporary_file_name + "\"");
+    }
+
+    if(std::rename(temporary_file_name.c_str(), file_name.c_str()) != 0)
+	throw std::runtime_error("unable to rename \"" + temporary_file_name
+				 + "\" into \"" + file_name + "\": "
+				 + std::strerror(errno));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+Batch_state_t::is_up_to_date(const Parameter_file_line_t & line,
+			     uint32_t parameters_checksum,
+			     File_signature_t & input)
+{
+    Batch_state_entry_t entry;
+    bool entry_found;
+    {
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	auto cur_entry = entries.find(line.output_file_name);
+	entry_found = (cur_entry != entries.end());
+	if(entry_found)
+	    entry = cur_entry->second;
+    }
+
+    const bool same_job = entry_found &&
+	entry.input_file_name == line.input_file_name &&
+	entry.radiometer_str == line.radiometer_str &&
+	entry.od_str == line.od_str &&
+	entry.parameters_checksum == parameters_checksum &&
+	entry.input.size == input.size;
+
+    // Reading the whole input is needed only if it might have changed
+    // (the checksum is also needed to record a new entry)
+    if(same_job && entry.input.mtime_ns == input.mtime_ns)
+	input.checksum = entry.input.checksum;
+    else
+	compute_file_checksum(line.input_file_name, input);
+
+    if(! same_job || input.checksum != entry.input.checksum)
+	return false;
+
+    File_signature_t output;
+    if(! read_file_status(line.output_file_name, output) ||
+       output.size != entry.output.size ||
+       output.mtime_ns != entry.output.mtime_ns)
+	return false;
+
+    // The input has been touched without changing its contents
+    if(input.mtime_ns != entry.input.mtime_ns) {
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	entries[line.output_file_name].input = input;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_state_t::update(const Parameter_file_line_t & line,
+		      uint32_t parameters_checksum,
+		      const File_signature_t & input)
+{
+    Batch_state_entry_t entry;
+    entry.input_file_name = line.input_file_name;
+    entry.radiometer_str = line.radiometer_str;
+    entry.od_str = line.od_str;
+    entry.parameters_checksum = parameters_checksum;
+    entry.input = input;
+    if(! read_file_status(line.output_file_name, entry.output)) {
+	forget(line);
+	return;
+    }
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries[line.output_file_name] = entry;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_state_t::forget(const Parameter_file_line_t & line)
+{
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries.erase(line.output_file_name);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+batch_state_file_name(const std::string & parameter_file_name)
+{
+    return parameter_file_name + ".state";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+journal_key(const Parameter_file_line_t & line)
+{
+    return line.radiometer_str + ' ' + line.od_str + ' '
+	+ line.input_file_name + ' ' + line.output_file_name;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Name of the file written for the output of "line". A leading "!"
+// only tells CFITSIO to overwrite the file (see
+// run_decompression_task_for_one_file).
+static std::string
+output_file_on_disk(const Parameter_file_line_t & line)
+{
+    const std::string & file_name = line.output_file_name;
+    if(! file_name.empty() && file_name[0] == '!')
+	return file_name.substr(1);
+
+    return file_name;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Make sure that the contents of a file have reached the disk
+static void
+sync_file(const std::string & file_name)
+{
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd < 0 || fsync(fd) != 0) {
+	const std::string reason = std::strerror(errno);
+	if(fd >= 0)
+	    ::close(fd);
+	throw std::runtime_error("unable to flush file \"" + file_name + "\" to disk: "
+				 + reason);
+    }
+
+    ::close(fd);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Write all of "str" and flush it to disk
+static void
+write_and_sync(int fd,
+	       const std::string & file_name,
+	       const std::string & str)
+{
+    size_t bytes_written = 0;
+    while(bytes_written < str.size()) {
+	const ssize_t result = ::write(fd,
+				       str.data() + bytes_written,
+				       str.size() - bytes_written);
+	if(result < 0 && errno == EINTR)
+	    continue;
+	if(result < 0)
+	    throw std::runtime_error("unable to write file \"" + file_name + "\": "
+				     + std::strerror(errno));
+	bytes_written += result;
+    }
+
+    if(fsync(fd) != 0)
+	throw std::runtime_error("unable to flush file \"" + file_name + "\" to disk: "
+				 + std::strerror(errno));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Batch_journal_t::~Batch_journal_t()
+{
+    if(file_descriptor >= 0)
+	::close(file_descriptor);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+Batch_journal_t::load(const std::string & a_file_name,
+		      const std::string & description)
+{
+    std::ifstream input_stream(a_file_name);
+    if(! input_stream)
+	return false;
+
+    std::stringstream contents;
+    contents << input_stream.rdbuf();
+    const std::string text = contents.str();
+
+    // Anything after the last newline is a line that was not
+    // completely written
+    std::map<std::string, uint64_t> lines;
+    bool header_found = false;
+    size_t line_start = 0;
+    for(size_t line_end = text.find('\n');
+	line_end != std::string::npos;
+	line_start = line_end + 1, line_end = text.find('\n', line_start)) {
+
+	const std::string cur_line = text.substr(line_start, line_end - line_start);
+	if(! header_found) {
+	    if(cur_line != journal_header + description)
+		return false;
+	    header_found = true;
+	    continue;
+	}
+
+	std::stringstream ss(cur_line);
+	uint64_t output_size;
+	Parameter_file_line_t line;
+	if(ss >> output_size
+	   >> line.radiometer_str
+	   >> line.od_str
+	   >> line.input_file_name
+	   >> line.output_file_name)
+	    lines[journal_key(line)] = output_size;
+    }
+
+    if(! header_found)
+	return false;
+
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    completed_lines.swap(lines);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_journal_t::open(const std::string & a_file_name,
+		      const std::string & description)
+{
+    std::ostringstream contents;
+    contents << journal_header << description << '\n';
+    for(auto const & line : completed_lines)
+	contents << line.second << ' ' << line.first << '\n';
+
+    // The old journal is replaced only once the new one is complete
+    const std::string temporary_file_name = a_file_name + ".tmp";
+    const int fd = ::open(temporary_file_name.c_str(),
+			  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+			  0666);
+    if(fd < 0)
+	throw std::runtime_error("unable to create file \"" + temporary_file_name
+				 + "\": " + std::strerror(errno));
+
+    try {
+	write_and_sync(fd, temporary_file_name, contents.str());
+	if(std::rename(temporary_file_name.c_str(), a_file_name.c_str()) != 0)
+	    throw std::runtime_error("unable to rename \"" + temporary_file_name
+				     + "\" into \"" + a_file_name + "\": "
+				     + std::strerror(errno));
+    }
+    catch(...) {
+	::close(fd);
+	std::remove(temporary_file_name.c_str());
+	throw;
+    }
+
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if(file_descriptor >= 0)
+	::close(file_descriptor);
+    file_name = a_file_name;
+    file_descriptor = fd;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+Batch_journal_t::is_completed(const Parameter_file_line_t & line) const
+{
+    uint64_t output_size;
+    {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	auto cur_line = completed_lines.find(journal_key(line));
+	if(cur_line == completed_lines.end())
+	    return false;
+	output_size = cur_line->second;
+    }
+
+    File_signature_t output;
+    return read_file_status(output_file_on_disk(line), output) &&
+	output.size == output_size;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_journal_t::record(const Parameter_file_line_t & line)
+{
+    {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	if(file_descriptor < 0)
+	    return;
+    }
+
+    // Only regular files can be checked by "is_completed"
+    const std::string output_file_name = output_file_on_disk(line);
+    File_signature_t output;
+    if(! read_file_status(output_file_name, output))
+	return;
+
+    // If the journal reached the disk before the output, a crash could
+    // leave a damaged file that "--resume" would not recreate
+    sync_file(output_file_name);
+
+    std::ostringstream entry;
+    entry << output.size << ' ' << journal_key(line) << '\n';
+
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    write_and_sync(file_descriptor, file_name, entry.str());
+    completed_lines[journal_key(line)] = output.size;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Batch_journal_t::remove()
+{
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    if(file_descriptor < 0)
+	return;
+
+    ::close(file_descriptor);
+    file_descriptor = -1;
+    std::remove(file_name.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+batch_journal_file_name(const std::string & parameter_file_name)
+{
+    return parameter_file_name + ".journal";
+}
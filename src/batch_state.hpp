@@ -0,0 +1,179 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef BATCH_STATE_HPP
+#define BATCH_STATE_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "tasks.hpp"
+
+// Size, modification time and CRC-32C checksum of a file
+struct File_signature_t {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint32_t checksum;
+
+    File_signature_t()
+	: size(0),
+	  mtime_ns(0),
+	  checksum(0) {}
+};
+
+// Fill the size and the modification time of "signature". Return
+// false if "file_name" is not a regular file (e.g., it is the name of
+// a TOODI object).
+bool read_file_status(const std::string & file_name,
+		      File_signature_t & signature);
+
+// Compute the checksum of the whole file. Throw a std::runtime_error
+// if the file cannot be read.
+void compute_file_checksum(const std::string & file_name,
+			   File_signature_t & signature);
+
+// Checksum of the parameters that affect the content of the files
+// produced by "compress" (but not, e.g., the number of threads)
+uint32_t compression_parameters_checksum(const Compression_parameters_t & params);
+
+// The same for "decompress" and "extract"
+uint32_t decompression_parameters_checksum(const Decompression_parameters_t & params);
+
+// What was used to produce one of the files listed in a parameter
+// file. Checksums are not computed for output files.
+struct Batch_state_entry_t {
+    std::string input_file_name;
+    std::string radiometer_str;
+    std::string od_str;
+    uint32_t parameters_checksum;
+    File_signature_t input;
+    File_signature_t output;
+
+    Batch_state_entry_t()
+	: parameters_checksum(0) {}
+};
+
+// The state of an incremental "compress" run: for every output file,
+// the input and the parameters used to create it. The state is saved
+// in a text file next to the parameter file, so that the next run can
+// skip the lines that have not changed. All the methods can be called
+// by many threads at the same time.
+class Batch_state_t {
+public:
+    // Return false if the file does not exist; throw a
+    // std::runtime_error if it is not a valid state file
+    bool load(const std::string & file_name);
+
+    // Write the state to a temporary file and rename it to
+    // "file_name", so that an interrupted write never leaves a
+    // truncated state behind
+    void save(const std::string & file_name) const;
+
+    // Return true if the output of "line" was created from the same
+    // input using the same parameters, and it has not been modified
+    // since. The input is compared using its size and modification
+    // time, and its checksum is computed only if the time changed.
+    // In any case, on return "input" contains the signature of the
+    // input file, which must be a regular file.
+    bool is_up_to_date(const Parameter_file_line_t & line,
+		       uint32_t parameters_checksum,
+		       File_signature_t & input);
+
+    // Record that the output of "line" has been created from "input"
+    void update(const Parameter_file_line_t & line,
+		uint32_t parameters_checksum,
+		const File_signature_t & input);
+
+    // Drop the entry for the output of "line", e.g., because it could
+    // not be created
+    void forget(const Parameter_file_line_t & line);
+
+private:
+    // The key is the name of the output file
+    std::map<std::string, Batch_state_entry_t> entries;
+    mutable std::mutex entries_mutex;
+};
+
+// Name of the state file used by "compress --incremental"
+std::string batch_state_file_name(const std::string & parameter_file_name);
+
+// The lines of a parameter file that have been completed by a batch
+// run. Each line is appended to the journal file and flushed to disk
+// as soon as its output is in place, so that a run that gets killed
+// can be resumed without processing them again. All the methods but
+// "load" and "open" can be called by many threads at the same time.
+class Batch_journal_t {
+public:
+    Batch_journal_t()
+	: file_descriptor(-1) {}
+    ~Batch_journal_t();
+
+    // Read the lines completed by a previous run. Return false if
+    // there is no journal, or if it was written by a run whose
+    // command and options (summarized by "description") were
+    // different. A line that was being written when the previous run
+    // stopped is ignored.
+    bool load(const std::string & file_name,
+	      const std::string & description);
+
+    // Rewrite the journal with the lines loaded so far and prepare it
+    // for new lines. Throw a std::runtime_error if this is not
+    // possible.
+    void open(const std::string & file_name,
+	      const std::string & description);
+
+    // Return true if "line" has been completed and its output still
+    // has the size it had at that time
+    bool is_completed(const Parameter_file_line_t & line) const;
+
+    // Flush the output file of "line" to disk, then add the line to
+    // the journal. Do nothing if the journal is not open. Throw a
+    // std::runtime_error if the journal cannot be written.
+    void record(const Parameter_file_line_t & line);
+
+    // Close the journal and delete its file
+    void remove();
+
+    bool is_open() const {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	return file_descriptor >= 0;
+    }
+
+private:
+    Batch_journal_t(const Batch_journal_t &);
+    Batch_journal_t & operator=(const Batch_journal_t &);
+
+    std::string file_name;
+    // The key contains all the fields of the line, the value is the
+    // size of the output file
+    std::map<std::string, uint64_t> completed_lines;
+    int file_descriptor;
+    mutable std::mutex journal_mutex;
+};
+
+// Name of the journal kept while the lines of a parameter file are
+// being processed
+std::string batch_journal_file_name(const std::string & parameter_file_name);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdexcept>
+
+#include "bit_stream.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Bit_writer_t::flush()
+{
+    if(num_of_bits == 0)
+	return;
+
+    const unsigned int num_of_bytes = (num_of_bits + 7) / 8;
+    const uint64_t padded = accumulator << (num_of_bytes * 8 - num_of_bits);
+
+    for(unsigned int idx = num_of_bytes; idx > 0; --idx)
+	output.append_uint8((padded >> ((idx - 1) * 8)) & 0xFF);
+
+    accumulator = 0;
+    num_of_bits = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Bit_reader_t::finish()
+{
+    const size_t bytes_read = (bit_pos + 7) / 8;
+    if(bytes_read > stream_size)
+	throw std::out_of_range("attempt to read past the end of a bit stream");
+
+    input.skip(bytes_read);
+
+    stream += bytes_read;
+    stream_size -= bytes_read;
+    bit_pos = 0;
+}
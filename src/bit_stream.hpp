@@ -0,0 +1,152 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef BIT_STREAM_HPP
+#define BIT_STREAM_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "byte_buffer.hpp"
+
+/* Bit streams are written starting from the most significant bit of
+ * each byte, and they are always padded with zeroes up to the next
+ * byte boundary. Therefore, a bit stream can be embedded in a
+ * Byte_buffer_t together with other data: call "flush" on the writer
+ * and "finish" on the reader to go back to whole bytes. */
+
+// Maximum number of bits that can be read at once
+const unsigned int MAX_BITS_PER_READ = 57;
+
+class Bit_writer_t {
+public:
+    explicit Bit_writer_t(Byte_buffer_t & a_output)
+	: output(a_output),
+	  accumulator(0),
+	  num_of_bits(0) {}
+
+    // Append the "width" least significant bits of "value"
+    // (0 <= width <= 64). Whenever 64 bits have been accumulated, they
+    // are appended to the buffer as one big-endian word.
+    void write_bits(uint64_t value, unsigned int width) {
+	if(width == 0)
+	    return;
+
+	if(width < 64)
+	    value &= (UINT64_C(1) << width) - 1;
+
+	const unsigned int free_bits = 64 - num_of_bits;
+	if(width < free_bits) {
+	    accumulator = (accumulator << width) | value;
+	    num_of_bits += width;
+	} else {
+	    const unsigned int remaining_bits = width - free_bits;
+	    const uint64_t word = ((free_bits == 64) ? 0 : (accumulator << free_bits)) |
+		(value >> remaining_bits);
+	    output.append_uint64(word);
+
+	    accumulator = value & ((UINT64_C(1) << remaining_bits) - 1);
+	    num_of_bits = remaining_bits;
+	}
+    }
+
+    void write_bit(bool value) {
+	write_bits(value ? 1 : 0, 1);
+    }
+
+    // Write all the pending bits to the buffer, padding them with
+    // zeroes up to the next byte boundary
+    void flush();
+
+private:
+    Byte_buffer_t & output;
+    uint64_t accumulator;
+    unsigned int num_of_bits;
+};
+
+class Bit_reader_t {
+public:
+    // Start reading from the current position of "a_input"
+    explicit Bit_reader_t(Byte_view_t & a_input)
+	: input(a_input),
+	  stream(a_input.cur_data()),
+	  stream_size(a_input.items_left()),
+	  bit_pos(0) {}
+
+    // Return the next 64 bits of the stream without consuming them.
+    // Only the first MAX_BITS_PER_READ bits are guaranteed to be
+    // meaningful. Bits past the end of the stream are zero.
+    uint64_t peek_bits() const {
+	const size_t byte_pos = bit_pos >> 3;
+	uint64_t window = 0;
+
+	if(byte_pos + 8 <= stream_size) {
+	    std::memcpy(&window, stream + byte_pos, sizeof(window));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	    window = __builtin_bswap64(window);
+#endif
+	} else {
+	    for(size_t idx = 0; idx < 8; ++idx) {
+		const uint8_t byte = (byte_pos + idx < stream_size) ?
+		    stream[byte_pos + idx] : 0;
+		window = (window << 8) | byte;
+	    }
+	}
+
+	return window << (bit_pos & 7);
+    }
+
+    void skip_bits(unsigned int width) {
+	bit_pos += width;
+    }
+
+    // Read "width" bits (0 <= width <= MAX_BITS_PER_READ)
+    uint64_t read_bits(unsigned int width) {
+	if(width == 0)
+	    return 0;
+
+	const uint64_t result = peek_bits() >> (64 - width);
+	bit_pos += width;
+	return result;
+    }
+
+    bool read_bit() {
+	return read_bits(1) != 0;
+    }
+
+    // Number of bits read so far
+    size_t position() const {
+	return bit_pos;
+    }
+
+    // Skip the padding up to the next byte boundary and move the
+    // position of the Byte_view_t past the bit stream. Throw
+    // std::out_of_range if more bits than available have been read.
+    void finish();
+
+private:
+    Byte_view_t & input;
+    const uint8_t * stream;
+    size_t stream_size;
+    size_t bit_pos;
+};
+
+#endif
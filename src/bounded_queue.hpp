@@ -0,0 +1,91 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// A FIFO queue that connects the stages of a pipeline running in
+// different threads. "push" waits while the queue is full, so that a
+// fast producer cannot fill the memory with items that the consumer
+// is not ready to handle yet.
+template <typename T>
+class Bounded_queue_t {
+public:
+    explicit Bounded_queue_t(size_t a_capacity)
+	: items(),
+	  capacity(a_capacity > 0 ? a_capacity : 1),
+	  closed(false) {}
+
+    // Wait until there is room for "item" and append it to the queue.
+    // Return false (and drop "item") if the queue has been closed.
+    bool push(T && item) {
+	std::unique_lock<std::mutex> lock(mutex);
+	not_full.wait(lock, [this]() { return closed || items.size() < capacity; });
+	if(closed)
+	    return false;
+
+	items.push_back(std::move(item));
+	not_empty.notify_one();
+	return true;
+    }
+
+    // Wait until an item is available and move it into "item". Items
+    // pushed before "close" are still returned; once the queue is
+    // closed and empty, return false.
+    bool pop(T & item) {
+	std::unique_lock<std::mutex> lock(mutex);
+	not_empty.wait(lock, [this]() { return closed || ! items.empty(); });
+	if(items.empty())
+	    return false;
+
+	item = std::move(items.front());
+	items.pop_front();
+	not_full.notify_one();
+	return true;
+    }
+
+    // No more items can be pushed. Threads waiting in "push" or "pop"
+    // are woken up.
+    void close() {
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+	not_full.notify_all();
+	not_empty.notify_all();
+    }
+
+private:
+    Bounded_queue_t(const Bounded_queue_t &);
+    Bounded_queue_t & operator=(const Bounded_queue_t &);
+
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+#endif
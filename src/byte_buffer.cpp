@@ -21,10 +21,100 @@
 #include <algorithm>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 #include "byte_buffer.hpp"
 
 //////////////////////////////////////////////////////////////////////
 
+// Convert between the native byte order and the big-endian order used
+// in the buffer (the conversion is symmetric)
+static inline uint16_t
+swap_big_endian(uint16_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint32_t
+swap_big_endian(uint32_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint64_t
+swap_big_endian(uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// "Word_t" is the unsigned integer type with the same size as
+// "Value_t". The loops are simple enough to be vectorized by the
+// compiler, and memcpy keeps them free of aliasing issues.
+template<typename Word_t, typename Value_t>
+static void
+append_big_endian(std::vector<uint8_t> & buffer,
+		  const Value_t * values,
+		  size_t count)
+{
+    static_assert(sizeof(Word_t) == sizeof(Value_t),
+		  "Mismatch between the size of the value and of the word");
+
+    const size_t first_byte = buffer.size();
+    buffer.resize(first_byte + count * sizeof(Value_t));
+    uint8_t * dest = buffer.data() + first_byte;
+
+    for(size_t idx = 0; idx < count; ++idx) {
+	Word_t word;
+	std::memcpy(&word, values + idx, sizeof(word));
+	word = swap_big_endian(word);
+	std::memcpy(dest + idx * sizeof(word), &word, sizeof(word));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+template<typename Word_t, typename Value_t>
+static void
+read_big_endian(const uint8_t * data,
+		size_t size,
+		size_t & cur_position,
+		Value_t * values,
+		size_t count)
+{
+    static_assert(sizeof(Word_t) == sizeof(Value_t),
+		  "Mismatch between the size of the value and of the word");
+
+    if(cur_position > size ||
+       count > (size - cur_position) / sizeof(Value_t)) {
+	throw std::out_of_range("attempt to read past the end of a buffer");
+    }
+
+    const uint8_t * source = data + cur_position;
+    for(size_t idx = 0; idx < count; ++idx) {
+	Word_t word;
+	std::memcpy(&word, source + idx * sizeof(word), sizeof(word));
+	word = swap_big_endian(word);
+	std::memcpy(values + idx, &word, sizeof(word));
+    }
+
+    cur_position += count * sizeof(Value_t);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 Byte_buffer_t::Byte_buffer_t(size_t length, const uint8_t * raw_buffer)
 {
     buffer.resize(length);
@@ -95,7 +185,7 @@ Byte_buffer_t::read_double()
 void
 Byte_buffer_t::read_buffer(size_t length, uint8_t * raw_buffer)
 {
-    if(cur_position + length >= buffer.size()) {
+    if(length > buffer.size() - cur_position) {
 	throw std::out_of_range("Byte_buffer_t::read_buffer asked "
 				"for too much data");
     }
@@ -110,37 +200,52 @@ Byte_buffer_t::read_buffer(size_t length, uint8_t * raw_buffer)
 //////////////////////////////////////////////////////////////////////
 
 void
-Byte_buffer_t::append_uint16(uint16_t value)
+Byte_buffer_t::read_uint32s(uint32_t * values, size_t count)
 {
-    uint8_t byte1 = (value & 0xFF00U) >> 8;
-    uint8_t byte2 = value & 0xFFU;
+    read_big_endian<uint32_t>(buffer.data(), buffer.size(), cur_position,
+			      values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
 
-    append_uint8(byte1);
-    append_uint8(byte2);
+void
+Byte_buffer_t::read_floats(float * values, size_t count)
+{
+    read_big_endian<uint32_t>(buffer.data(), buffer.size(), cur_position,
+			      values, count);
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-Byte_buffer_t::append_uint32(uint32_t value)
+Byte_buffer_t::read_doubles(double * values, size_t count)
 {
-    uint16_t word1 = (value & 0xFFFF0000U) >> 16;
-    uint16_t word2 = value & 0xFFFFU;
+    read_big_endian<uint64_t>(buffer.data(), buffer.size(), cur_position,
+			      values, count);
+}
 
-    append_uint16(word1);
-    append_uint16(word2);
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_t::append_uint16(uint16_t value)
+{
+    append_big_endian<uint16_t>(buffer, &value, 1);
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-Byte_buffer_t::append_uint64(uint64_t value)
+Byte_buffer_t::append_uint32(uint32_t value)
 {
-    uint32_t dword1 = (value & 0xFFFFFFFF00000000UL) >> 32;
-    uint32_t dword2 = value & 0xFFFFFFFFUL;
+    append_big_endian<uint32_t>(buffer, &value, 1);
+}
 
-    append_uint32(dword1);
-    append_uint32(dword2);
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_t::append_uint64(uint64_t value)
+{
+    append_big_endian<uint64_t>(buffer, &value, 1);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -174,31 +279,167 @@ Byte_buffer_t::append_double(double value)
 void
 Byte_buffer_t::append_data_from_buffer(size_t length, const uint8_t * buffer)
 {
-    for(size_t idx = 0; idx < length; ++idx)
-	append_uint8(buffer[idx]);
+    this->buffer.insert(this->buffer.end(), buffer, buffer + length);
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-Byte_buffer_t::append_data_from_file(FILE * input, size_t length)
+Byte_buffer_t::append_uint32s(const uint32_t * values, size_t count)
+{
+    append_big_endian<uint32_t>(buffer, values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_t::append_floats(const float * values, size_t count)
 {
-    for(size_t idx = 0; idx < length; ++idx) {
-	int character = fgetc(input);
-	if(character == EOF)
-	    throw std::runtime_error("unexpected end of file");
+    append_big_endian<uint32_t>(buffer, values, count);
+}
 
-	append_uint8(character);
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_t::append_doubles(const double * values, size_t count)
+{
+    append_big_endian<uint64_t>(buffer, values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_t::append_data_from_file(FILE * input, size_t length)
+{
+    const size_t old_size = buffer.size();
+    buffer.resize(old_size + length);
+    if(fread(buffer.data() + old_size, 1, length, input) < length) {
+	buffer.resize(old_size);
+	throw std::runtime_error("unexpected end of file");
     }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-Byte_buffer_t::write_to_file(FILE * out)
+Byte_buffer_t::write_to_file(FILE * out) const
 {
     assert(out != NULL);
     if(fwrite(buffer.data(), 1, buffer.size(), out) < buffer.size()) {
 	throw std::runtime_error("unable to write the byte buffer to the file");
     }
 }
+
+//////////////////////////////////////////////////////////////////////
+
+uint8_t
+Byte_view_t::read_uint8()
+{
+    if(cur_position >= length)
+	throw std::out_of_range("attempt to read past the end of a buffer");
+
+    return data[cur_position++];
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint16_t
+Byte_view_t::read_uint16()
+{
+    uint16_t value;
+    read_big_endian<uint16_t>(data, length, cur_position, &value, 1);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+Byte_view_t::read_uint32()
+{
+    uint32_t value;
+    read_big_endian<uint32_t>(data, length, cur_position, &value, 1);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint64_t
+Byte_view_t::read_uint64()
+{
+    uint64_t value;
+    read_big_endian<uint64_t>(data, length, cur_position, &value, 1);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+float
+Byte_view_t::read_float()
+{
+    float value;
+    read_big_endian<uint32_t>(data, length, cur_position, &value, 1);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+double
+Byte_view_t::read_double()
+{
+    double value;
+    read_big_endian<uint64_t>(data, length, cur_position, &value, 1);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_view_t::read_buffer(size_t num_of_bytes, uint8_t * raw_buffer)
+{
+    std::memcpy(raw_buffer, skip(num_of_bytes), num_of_bytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_view_t::read_uint32s(uint32_t * values, size_t count)
+{
+    read_big_endian<uint32_t>(data, length, cur_position, values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_view_t::read_floats(float * values, size_t count)
+{
+    read_big_endian<uint32_t>(data, length, cur_position, values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_view_t::read_doubles(double * values, size_t count)
+{
+    read_big_endian<uint64_t>(data, length, cur_position, values, count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const uint8_t *
+Byte_view_t::skip(size_t num_of_bytes)
+{
+    if(cur_position > length || num_of_bytes > length - cur_position)
+	throw std::out_of_range("attempt to read past the end of a buffer");
+
+    const uint8_t * result = data + cur_position;
+    cur_position += num_of_bytes;
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Byte_view_t
+Byte_view_t::read_view(size_t num_of_bytes)
+{
+    return Byte_view_t(skip(num_of_bytes), num_of_bytes);
+}
@@ -57,6 +57,12 @@ public:
     double read_double();
     void read_buffer(size_t length, uint8_t * buffer);
 
+    // Read "count" values at once. These are much faster than
+    // calling read_uint32/read_float/read_double in a loop.
+    void read_uint32s(uint32_t * values, size_t count);
+    void read_floats(float * values, size_t count);
+    void read_doubles(double * values, size_t count);
+
     // Append operations do not update the current position
     void append_uint8(uint8_t value) {
 	buffer.push_back(value);
@@ -68,10 +74,75 @@ public:
     void append_float(float value);
     void append_double(double value);
     void append_data_from_buffer(size_t length, const uint8_t * buffer);
+
+    // Bulk versions of append_uint32/append_float/append_double
+    void append_uint32s(const uint32_t * values, size_t count);
+    void append_floats(const float * values, size_t count);
+    void append_doubles(const double * values, size_t count);
     void append_data_from_file(FILE * input, size_t length);
 
     // Write the *whole* buffer to disk, irrespective of the current position
-    void write_to_file(FILE * out);
+    void write_to_file(FILE * out) const;
+};
+
+// A read-only window over memory owned by someone else (a
+// Byte_buffer_t, a memory-mapped file...). It provides the same read
+// API as Byte_buffer_t, but it never copies the data. The owner must
+// outlive the view and must not be modified while the view is in use.
+class Byte_view_t {
+public:
+    const uint8_t * data;
+    size_t length;
+    size_t cur_position;
+
+    Byte_view_t()
+	: data(NULL),
+	  length(0),
+	  cur_position(0) {}
+
+    Byte_view_t(const uint8_t * a_data, size_t a_length)
+	: data(a_data),
+	  length(a_length),
+	  cur_position(0) {}
+
+    // The view starts from the current position of "buffer"
+    Byte_view_t(const Byte_buffer_t & buffer)
+	: data(buffer.buffer.data() + buffer.cur_position),
+	  length(buffer.size() - buffer.cur_position),
+	  cur_position(0) {}
+
+    size_t size() const {
+	return length;
+    }
+
+    size_t items_left() const {
+	return length - cur_position;
+    }
+
+    // Pointer to the first byte that has not been read yet
+    const uint8_t * cur_data() const {
+	return data + cur_position;
+    }
+
+    uint8_t read_uint8();
+    uint16_t read_uint16();
+    uint32_t read_uint32();
+    uint64_t read_uint64();
+    float read_float();
+    double read_double();
+    void read_buffer(size_t num_of_bytes, uint8_t * raw_buffer);
+
+    void read_uint32s(uint32_t * values, size_t count);
+    void read_floats(float * values, size_t count);
+    void read_doubles(double * values, size_t count);
+
+    // Move the current position forward and return a pointer to the
+    // bytes that have been skipped. Throw std::out_of_range if there
+    // are not enough bytes left.
+    const uint8_t * skip(size_t num_of_bytes);
+
+    // Like skip, but return the skipped bytes as a new view
+    Byte_view_t read_view(size_t num_of_bytes);
 };
 
 #endif
@@ -0,0 +1,87 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <utility>
+
+#include "byte_buffer_pool.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+Byte_buffer_t
+Byte_buffer_pool_t::acquire(size_t capacity_hint)
+{
+    if(free_buffers.empty()) {
+	Byte_buffer_t result;
+	result.buffer.reserve(capacity_hint);
+	return result;
+    }
+
+    // Look for the smallest buffer that is large enough, or for the
+    // largest one if none is
+    size_t best_idx = 0;
+    for(size_t idx = 1; idx < free_buffers.size(); ++idx) {
+	const size_t best_capacity = free_buffers[best_idx].buffer.capacity();
+	const size_t cur_capacity = free_buffers[idx].buffer.capacity();
+
+	if(best_capacity < capacity_hint) {
+	    if(cur_capacity > best_capacity)
+		best_idx = idx;
+	} else if(cur_capacity >= capacity_hint && cur_capacity < best_capacity) {
+	    best_idx = idx;
+	}
+    }
+
+    Byte_buffer_t result(std::move(free_buffers[best_idx]));
+    free_buffers.erase(free_buffers.begin() + best_idx);
+
+    result.buffer.reserve(capacity_hint);
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Byte_buffer_pool_t::release(Byte_buffer_t & buffer)
+{
+    if(buffer.buffer.capacity() == 0)
+	return;
+
+    buffer.buffer.clear();
+    buffer.cur_position = 0;
+
+    if(free_buffers.size() < max_free_buffers) {
+	free_buffers.push_back(std::move(buffer));
+	return;
+    }
+
+    // The pool is full: keep the larger buffers
+    size_t smallest_idx = 0;
+    for(size_t idx = 1; idx < free_buffers.size(); ++idx) {
+	if(free_buffers[idx].buffer.capacity() <
+	   free_buffers[smallest_idx].buffer.capacity())
+	    smallest_idx = idx;
+    }
+
+    if(free_buffers.empty() ||
+       free_buffers[smallest_idx].buffer.capacity() >= buffer.buffer.capacity())
+	return;
+
+    free_buffers[smallest_idx] = std::move(buffer);
+}
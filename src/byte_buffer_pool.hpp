@@ -0,0 +1,85 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef BYTE_BUFFER_POOL_HPP
+#define BYTE_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "byte_buffer.hpp"
+
+// A set of Byte_buffer_t objects whose memory is recycled: buffers
+// that are given back to the pool keep their capacity, so that
+// encoding the next chunk (or the next file) does not need to
+// allocate and fault in the same amount of memory again. The pool is
+// not thread-safe: use one pool per thread.
+class Byte_buffer_pool_t {
+public:
+    explicit Byte_buffer_pool_t(size_t a_max_free_buffers = 8)
+	: free_buffers(),
+	  max_free_buffers(a_max_free_buffers) {}
+
+    // Return an empty buffer with at least "capacity_hint" bytes of
+    // capacity. The smallest free buffer that is large enough is
+    // used; if there is none, the largest one is enlarged.
+    Byte_buffer_t acquire(size_t capacity_hint = 0);
+
+    // Give "buffer" back to the pool. Its contents are lost.
+    void release(Byte_buffer_t & buffer);
+
+    size_t num_of_free_buffers() const {
+	return free_buffers.size();
+    }
+
+private:
+    std::vector<Byte_buffer_t> free_buffers;
+    size_t max_free_buffers;
+};
+
+// A buffer taken from a pool, which is automatically given back when
+// the object goes out of scope
+class Pooled_buffer_t {
+public:
+    Pooled_buffer_t(Byte_buffer_pool_t & a_pool, size_t capacity_hint = 0)
+	: pool(a_pool),
+	  buffer(a_pool.acquire(capacity_hint)) {}
+
+    ~Pooled_buffer_t() {
+	pool.release(buffer);
+    }
+
+    Byte_buffer_t & operator*() {
+	return buffer;
+    }
+
+    Byte_buffer_t * operator->() {
+	return &buffer;
+    }
+
+private:
+    Pooled_buffer_t(const Pooled_buffer_t &);
+    Pooled_buffer_t & operator=(const Pooled_buffer_t &);
+
+    Byte_buffer_pool_t & pool;
+    Byte_buffer_t buffer;
+};
+
+#endif
@@ -19,9 +19,18 @@
  */
 
 #include <cmath>
+#include <cstdio>
+#include <memory>
 #include <vector>
 #include <regex>
+#include <thread>
 #include <algorithm>
+#include <fstream>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utime.h>
 
 #include <cppunit/TestAssert.h>
 #include <cppunit/TestCaller.h>
@@ -31,9 +40,27 @@
 #include "common_defs.hpp"
 #include "statistics.hpp"
 #include "run_length_encoding.hpp"
+#include "rice_encoding.hpp"
+#include "arithmetic_encoding.hpp"
+#include "shuffle.hpp"
+#include "backends.hpp"
 #include "poly_fit_encoding.hpp"
 #include "byte_buffer.hpp"
+#include "bit_stream.hpp"
+#include "byte_buffer_pool.hpp"
+#include "crc32c.hpp"
+#include "bounded_queue.hpp"
+#include "parallel.hpp"
+#include "batch_state.hpp"
 #include "data_structures.hpp"
+#include "mapped_file.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "datadiff.hpp"
+#include "detpoint.hpp"
+#include "verify.hpp"
+#include "commands.hpp"
+#include "serve.hpp"
 
 //////////////////////////////////////////////////////////////////////
 
@@ -270,6 +297,314 @@ public:
 
 ////////////////////////////////////////////////////////////////////
 
+class Rice_test : public CppUnit::TestFixture {
+public:
+    void testZigzag() {
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0, zigzag_encode(0));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 1, zigzag_encode(-1));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 2, zigzag_encode(1));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 3, zigzag_encode(-2));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) UINT32_MAX, zigzag_encode(INT32_MIN));
+
+	CPPUNIT_ASSERT_EQUAL((int32_t) INT32_MIN, zigzag_decode(UINT32_MAX));
+	CPPUNIT_ASSERT_EQUAL((int32_t) INT32_MAX, zigzag_decode(UINT32_MAX - 1));
+	CPPUNIT_ASSERT_EQUAL((int32_t) -2, zigzag_decode(3));
+    }
+
+    void testSmallResiduals() {
+	std::vector<int32_t> input_stream;
+	for(int idx = 0; idx < 1000; ++idx)
+	    input_stream.push_back((idx * 7) % 11 - 5);
+
+	Byte_buffer_t buffer;
+	rice_compression(input_stream.data(), input_stream.size(), buffer);
+
+	// Values in the range -5..5 need no more than 5 bits each
+	CPPUNIT_ASSERT(buffer.size() < input_stream.size() * 5 / 8 + 16);
+
+	std::vector<int32_t> output_stream;
+	Byte_view_t view(buffer);
+	rice_decompression(view, input_stream.size(), output_stream);
+
+	CPPUNIT_ASSERT(output_stream == input_stream);
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, view.items_left());
+    }
+
+    void testEscapes() {
+	// Large outliers among small values must be escaped, and the
+	// extreme values of the range must survive the round trip
+	std::vector<int32_t> input_stream { 0, 1, -1, INT32_MAX, 2, INT32_MIN,
+					    3, 1000000, -3, 0 };
+
+	Byte_buffer_t buffer;
+	rice_compression(input_stream.data(), input_stream.size(), buffer);
+	buffer.append_uint8(0xAB);
+
+	std::vector<int32_t> output_stream;
+	Byte_view_t view(buffer);
+	rice_decompression(view, input_stream.size(), output_stream);
+
+	CPPUNIT_ASSERT(output_stream == input_stream);
+	// The decoder must stop at the end of the Rice stream
+	CPPUNIT_ASSERT_EQUAL((int) 0xAB, (int) view.read_uint8());
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Rice_test");
+	suite->addTest(new CppUnit::TestCaller<Rice_test>(
+			   "testZigzag",
+			   &Rice_test::testZigzag));
+	suite->addTest(new CppUnit::TestCaller<Rice_test>(
+			   "testSmallResiduals",
+			   &Rice_test::testSmallResiduals));
+	suite->addTest(new CppUnit::TestCaller<Rice_test>(
+			   "testEscapes",
+			   &Rice_test::testEscapes));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Arithmetic_coder_test : public CppUnit::TestFixture {
+public:
+    void check_round_trip(const Byte_buffer_t & input,
+			  unsigned int num_of_threads) {
+	Byte_buffer_t compressed;
+	arith_compression(input.buffer.data(), input.size(),
+			  compressed, num_of_threads);
+
+	Byte_buffer_t decompressed;
+	Byte_view_t view(compressed);
+	arith_decompression(view, decompressed, num_of_threads);
+
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, view.items_left());
+	CPPUNIT_ASSERT(decompressed.buffer == input.buffer);
+    }
+
+    void testEmptyStream() {
+	Byte_buffer_t input;
+	check_round_trip(input, 1);
+    }
+
+    void testSmoothData() {
+	// A slowly-varying sequence of floating-point numbers, like the
+	// output of the SCET encoder
+	Byte_buffer_t input;
+	for(int idx = 0; idx < 10000; ++idx)
+	    input.append_float(1.0e-3 * std::sin(idx * 1.0e-3));
+
+	Byte_buffer_t compressed;
+	arith_compression(input.buffer.data(), input.size(), compressed, 1);
+	// The two least significant bytes of each number are noise, but
+	// the sign and the exponent are very predictable
+	CPPUNIT_ASSERT(compressed.size() < input.size() * 3 / 4);
+
+	check_round_trip(input, 1);
+    }
+
+    void testManyBlocks() {
+	Byte_buffer_t input;
+	for(uint32_t idx = 0; idx < ARITH_BLOCK_SIZE; ++idx)
+	    input.append_uint8((idx * 2654435761U) >> 24);
+	input.append_uint32(0xDEADBEEF);
+
+	check_round_trip(input, 2);
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Arithmetic_coder_test");
+	suite->addTest(new CppUnit::TestCaller<Arithmetic_coder_test>(
+			   "testEmptyStream",
+			   &Arithmetic_coder_test::testEmptyStream));
+	suite->addTest(new CppUnit::TestCaller<Arithmetic_coder_test>(
+			   "testSmoothData",
+			   &Arithmetic_coder_test::testSmoothData));
+	suite->addTest(new CppUnit::TestCaller<Arithmetic_coder_test>(
+			   "testManyBlocks",
+			   &Arithmetic_coder_test::testManyBlocks));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Shuffle_test : public CppUnit::TestFixture {
+public:
+    // Fill "buffer" with "size" bytes; the number of elements is
+    // large enough to exercise both the vectorized and the scalar
+    // code, and "size" is not a multiple of SHUFFLE_ELEMENT_SIZE
+    void fill_buffer(size_t size, Byte_buffer_t & buffer) {
+	buffer.buffer.resize(size);
+	for(size_t idx = 0; idx < size; ++idx)
+	    buffer.buffer[idx] = (idx * 2654435761U) >> 13;
+    }
+
+    void testByteShuffle() {
+	const uint8_t input[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	const uint8_t expected[] = { 1, 5, 2, 6, 3, 7, 4, 8, 9, 10, 11 };
+	uint8_t output[sizeof(input)];
+
+	shuffle_bytes(input, sizeof(input), 4, output);
+	for(size_t idx = 0; idx < sizeof(input); ++idx)
+	    CPPUNIT_ASSERT_EQUAL((int) expected[idx], (int) output[idx]);
+
+	Byte_buffer_t buffer;
+	fill_buffer(16 * 37 + 3, buffer);
+	std::vector<uint8_t> shuffled(buffer.size());
+	shuffle_bytes(buffer.buffer.data(), buffer.size(), 4, shuffled.data());
+
+	const size_t num_of_elements = buffer.size() / 4;
+	for(size_t elem = 0; elem < num_of_elements; ++elem) {
+	    for(size_t byte = 0; byte < 4; ++byte)
+		CPPUNIT_ASSERT_EQUAL((int) buffer.buffer[elem * 4 + byte],
+				     (int) shuffled[byte * num_of_elements + elem]);
+	}
+
+	Byte_buffer_t filtered, unfiltered;
+	apply_filter(FILTER_BYTE_SHUFFLE, buffer, filtered);
+	undo_filter(FILTER_BYTE_SHUFFLE, filtered, unfiltered);
+	CPPUNIT_ASSERT(filtered.buffer == shuffled);
+	CPPUNIT_ASSERT(unfiltered.buffer == buffer.buffer);
+    }
+
+    void testBitShuffle() {
+	// Eight elements whose first byte is 0x80 or 0x00: after the
+	// transposition, the first byte must contain all the MSBs
+	uint8_t input[32] = { 0 };
+	for(size_t idx = 0; idx < 8; ++idx)
+	    input[idx * 4] = (idx % 2 == 0) ? 0x80 : 0x00;
+
+	uint8_t output[32];
+	shuffle_bits(input, sizeof(input), 4, output);
+	CPPUNIT_ASSERT_EQUAL(0xAA, (int) output[0]);
+	for(size_t idx = 1; idx < sizeof(output); ++idx)
+	    CPPUNIT_ASSERT_EQUAL(0, (int) output[idx]);
+
+	for(size_t size : { 0, 5, 64, 16 * 37 + 3, 4 * 1001 + 2 }) {
+	    Byte_buffer_t buffer, filtered, unfiltered;
+	    fill_buffer(size, buffer);
+	    apply_filter(FILTER_BIT_SHUFFLE, buffer, filtered);
+	    undo_filter(FILTER_BIT_SHUFFLE, filtered, unfiltered);
+	    CPPUNIT_ASSERT(unfiltered.buffer == buffer.buffer);
+	}
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Shuffle_test");
+	suite->addTest(new CppUnit::TestCaller<Shuffle_test>(
+			   "testByteShuffle",
+			   &Shuffle_test::testByteShuffle));
+	suite->addTest(new CppUnit::TestCaller<Shuffle_test>(
+			   "testBitShuffle",
+			   &Shuffle_test::testBitShuffle));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Backend_test : public CppUnit::TestFixture {
+public:
+    void testRoundTrip() {
+	Byte_buffer_t input;
+	for(int idx = 0; idx < 10000; ++idx)
+	    input.append_float(1.0e-3 * std::sin(idx * 1.0e-3));
+
+	for(int type = BACKEND_ARITHMETIC; type <= BACKEND_LZ4; ++type) {
+	    const Backend_t * backend = find_backend((Backend_type_t) type);
+	    if(backend == NULL)
+		continue;
+
+	    for(size_t size : { (size_t) 0, input.size() }) {
+		Byte_buffer_t cur_input(size, input.buffer.data());
+		Byte_buffer_t compressed;
+		backend_compression(Backend_choice_t(backend->type,
+						     backend->default_level),
+				    cur_input, compressed, 0);
+
+		// Make sure that the decoder does not read past the end
+		// of the stream
+		compressed.append_uint8(0xAB);
+
+		Byte_buffer_t decompressed;
+		Byte_view_t view(compressed);
+		backend_decompression(backend->type, view, decompressed, 0);
+		CPPUNIT_ASSERT(decompressed.buffer == cur_input.buffer);
+		CPPUNIT_ASSERT_EQUAL((size_t) 1, view.items_left());
+	    }
+	}
+    }
+
+    void testShuffleAndZlib() {
+	Byte_buffer_t input;
+	for(int idx = 0; idx < 10000; ++idx)
+	    input.append_float(1.0e-3 * std::sin(idx * 1.0e-3));
+
+	const Backend_choice_t zlib(BACKEND_ZLIB, 6);
+	Byte_buffer_t plain_compressed;
+	backend_compression(zlib, input, plain_compressed, 1);
+
+	Byte_buffer_t filtered, shuffled_compressed;
+	apply_filter(FILTER_BYTE_SHUFFLE, input, filtered);
+	backend_compression(zlib, filtered, shuffled_compressed, 1);
+
+	CPPUNIT_ASSERT(shuffled_compressed.size() < plain_compressed.size());
+    }
+
+    void testParseChoice() {
+	Backend_choice_t choice;
+
+	CPPUNIT_ASSERT(parse_backend_choice("zlib", choice));
+	CPPUNIT_ASSERT_EQUAL((int) BACKEND_ZLIB, (int) choice.type);
+	CPPUNIT_ASSERT_EQUAL(find_backend(BACKEND_ZLIB)->default_level,
+			     choice.level);
+
+	CPPUNIT_ASSERT(parse_backend_choice("zlib:9", choice));
+	CPPUNIT_ASSERT_EQUAL((int) BACKEND_ZLIB, (int) choice.type);
+	CPPUNIT_ASSERT_EQUAL(9, choice.level);
+
+	CPPUNIT_ASSERT(parse_backend_choice("none", choice));
+	CPPUNIT_ASSERT_EQUAL((int) BACKEND_NONE, (int) choice.type);
+
+	CPPUNIT_ASSERT(! parse_backend_choice("zlib:", choice));
+	CPPUNIT_ASSERT(! parse_backend_choice("zlib:9x", choice));
+	CPPUNIT_ASSERT(! parse_backend_choice("foo", choice));
+
+	Chunk_type_t column;
+	CPPUNIT_ASSERT(parse_column_name("theta", column));
+	CPPUNIT_ASSERT_EQUAL((int) CHUNK_THETA, (int) column);
+	CPPUNIT_ASSERT_EQUAL(std::string("flags"),
+			     column_name(CHUNK_QUALITY_FLAGS));
+	CPPUNIT_ASSERT(! parse_column_name("foo", column));
+
+	unsigned int mask;
+	CPPUNIT_ASSERT(parse_column_list("theta,phi", mask));
+	CPPUNIT_ASSERT_EQUAL(column_bit(CHUNK_THETA) | column_bit(CHUNK_PHI),
+			     mask);
+	CPPUNIT_ASSERT(parse_column_list("obt", mask));
+	CPPUNIT_ASSERT_EQUAL(column_bit(CHUNK_DELTA_OBT), mask);
+	CPPUNIT_ASSERT(! parse_column_list("theta,", mask));
+	CPPUNIT_ASSERT(! parse_column_list("theta,foo", mask));
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Backend_test");
+	suite->addTest(new CppUnit::TestCaller<Backend_test>(
+			   "testRoundTrip",
+			   &Backend_test::testRoundTrip));
+	suite->addTest(new CppUnit::TestCaller<Backend_test>(
+			   "testShuffleAndZlib",
+			   &Backend_test::testShuffleAndZlib));
+	suite->addTest(new CppUnit::TestCaller<Backend_test>(
+			   "testParseChoice",
+			   &Backend_test::testParseChoice));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
 class Poly_fit_encoder_test : public CppUnit::TestFixture {
 private:
     Vector_of_frames_t vector_of_frames;
@@ -332,11 +667,12 @@ public:
 	}
 
 	Frame_t test_frame;
+	Byte_view_t view(raw_buffer);
 
-	test_frame.read_from_buffer(raw_buffer);
+	test_frame.read_from_buffer(view);
 	compare_frames(vector_of_frames[0], test_frame);
 
-	test_frame.read_from_buffer(raw_buffer);
+	test_frame.read_from_buffer(view);
 	compare_frames(vector_of_frames[1], test_frame);
     }
 
@@ -402,7 +738,8 @@ public:
 	poly_fit_encode(values, 3, 2, 1e6, buffer, dummy1, dummy2);
 
 	std::vector<double> reconstructed;
-	poly_fit_decode(values.size(), buffer, reconstructed);
+	Byte_view_t view(buffer);
+	poly_fit_decode(values.size(), view, reconstructed);
 
 	CPPUNIT_ASSERT_MESSAGE("The reconstructed data stream does not "
 			       "match the original",
@@ -457,6 +794,8 @@ public:
 	source.number_of_chunks = 5;
 
 	source.write_to_file(f);
+	CPPUNIT_ASSERT_EQUAL((long) Squeezer_file_header_t::SIZE_IN_BYTES,
+			     ftell(f));
 	fclose(f);
 
 	f = fopen("./delete_me.bin", "rb");
@@ -474,6 +813,8 @@ public:
 	CHECK_FIELD(file_type_mark[2], int);
 	CHECK_FIELD(file_type_mark[3], int);
 
+	CHECK_FIELD(program_version, int);
+
 	CHECK_FIELD(date_year, int);
 	CHECK_FIELD(date_month, int);
 	CHECK_FIELD(date_day, int);
@@ -506,6 +847,8 @@ public:
 	source.number_of_bytes = 16532;
 	source.number_of_samples = 723465;
 	source.chunk_type = 15;
+	source.backend = BACKEND_ARITHMETIC;
+	source.filter = FILTER_BIT_SHUFFLE;
 
 	source.compression_error.min_abs_error = 1.0;
 	source.compression_error.max_abs_error = 2.0;
@@ -513,6 +856,8 @@ public:
 	source.compression_error.mean_error = 4.0;
 
 	source.write_to_file(f);
+	CPPUNIT_ASSERT_EQUAL((long) Squeezer_chunk_header_t::SIZE_IN_BYTES,
+			     ftell(f));
 	fclose(f);
 
 	f = fopen("./delete_me.bin", "rb");
@@ -533,6 +878,8 @@ public:
 	CHECK_FIELD(number_of_bytes, uint64_t);
 	CHECK_FIELD(number_of_samples, uint32_t);
 	CHECK_FIELD(chunk_type, uint32_t);
+	CHECK_FIELD(backend, int);
+	CHECK_FIELD(filter, int);
 
 	CHECK_FIELD(compression_error.min_abs_error, double);
 	CHECK_FIELD(compression_error.max_abs_error, double);
@@ -542,6 +889,172 @@ public:
 #undef CHECK_FIELD
     }
 
+    void testMappedFile() {
+	FILE * f = fopen("./delete_me.bin", "wb");
+
+	Squeezer_file_header_t file_header(SQZ_DETECTOR_POINTINGS);
+	file_header.od = 91;
+	file_header.first_obt = 1.5;
+	file_header.number_of_chunks = 1;
+	file_header.write_to_file(f);
+
+	Squeezer_chunk_header_t chunk_header;
+	chunk_header.number_of_bytes = 4;
+	chunk_header.compression_error.mean_error = 0.25;
+	chunk_header.write_to_file(f);
+
+	Byte_buffer_t payload;
+	payload.append_float(123.0);
+	payload.write_to_file(f);
+	fclose(f);
+
+	f = fopen("./delete_me.bin", "rb");
+	// The mapping must start from the current position of the stream
+	fgetc(f);
+	Mapped_file_t mapped_file(f);
+	fclose(f);
+
+	CPPUNIT_ASSERT(mapped_file.is_memory_mapped());
+	Byte_view_t view = mapped_file.view();
+	CPPUNIT_ASSERT_EQUAL((int) 'D', (int) view.read_uint8());
+	view.cur_position = 0;
+	Byte_view_t whole_file(view.data - 1, view.size() + 1);
+
+	Squeezer_file_header_t test_file_header(SQZ_NO_DATA);
+	test_file_header.read_from_buffer(whole_file);
+	CPPUNIT_ASSERT(std::strcmp((const char *) test_file_header.file_type_mark,
+				   "PDP") == 0);
+	CPPUNIT_ASSERT_EQUAL(91, (int) test_file_header.od);
+	CPPUNIT_ASSERT_EQUAL(1.5, test_file_header.first_obt);
+	CPPUNIT_ASSERT_EQUAL(1, (int) test_file_header.number_of_chunks);
+
+	Squeezer_chunk_header_t test_chunk_header;
+	test_chunk_header.read_from_buffer(whole_file);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 4, test_chunk_header.number_of_bytes);
+	CPPUNIT_ASSERT_EQUAL(0.25, test_chunk_header.compression_error.mean_error);
+
+	Byte_view_t payload_view = whole_file.read_view(4);
+	CPPUNIT_ASSERT_EQUAL((float) 123.0, payload_view.read_float());
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, whole_file.items_left());
+	CPPUNIT_ASSERT_THROW(whole_file.read_uint8(), std::out_of_range);
+
+	// Pipes cannot be mapped, so they are read in memory
+	FILE * pipe = popen("printf abc", "r");
+	Mapped_file_t pipe_contents(pipe);
+	pclose(pipe);
+
+	CPPUNIT_ASSERT(! pipe_contents.is_memory_mapped());
+	Byte_view_t pipe_view = pipe_contents.view();
+	CPPUNIT_ASSERT_EQUAL((size_t) 3, pipe_view.size());
+	CPPUNIT_ASSERT_EQUAL((int) 'c', (int) pipe_view.data[2]);
+    }
+
+    void testOldFileHeader() {
+	Squeezer_file_header_t source(SQZ_DIFFERENCED_DATA);
+	source.program_version = 0x0103;
+	source.number_of_chunks = 4;
+	source.toc_offset = 1234;
+
+	uint8_t bytes[Squeezer_file_header_t::SIZE_IN_BYTES + 1];
+	source.write_to_buffer(bytes);
+	// Files written before FIRST_VERSION_WITH_TOC lack the last field
+	bytes[Squeezer_file_header_t::SIZE_WITHOUT_TOC] = 'C';
+
+	FILE * f = fopen("./delete_me.bin", "wb");
+	fwrite(bytes, 1, Squeezer_file_header_t::SIZE_WITHOUT_TOC + 1, f);
+	fclose(f);
+
+	f = fopen("./delete_me.bin", "rb");
+	Squeezer_file_header_t test(SQZ_NO_DATA);
+	test.read_from_file(f);
+	CPPUNIT_ASSERT_EQUAL((int) 'C', fgetc(f));
+	fclose(f);
+
+	CPPUNIT_ASSERT_EQUAL(4, (int) test.number_of_chunks);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0, test.toc_offset);
+	CPPUNIT_ASSERT_EQUAL((size_t) Squeezer_file_header_t::SIZE_WITHOUT_TOC,
+			     test.size_in_bytes());
+    }
+
+    void testBlockHeader() {
+	Squeezer_block_header_t source;
+	source.number_of_samples = 1048576;
+	source.number_of_bytes = 123456;
+	source.first_obt = 1.5e+12;
+	source.checksum = 0xDEADBEEF;
+
+	Byte_buffer_t buffer;
+	source.append_to_buffer(buffer);
+	CPPUNIT_ASSERT_EQUAL((size_t) Squeezer_block_header_t::SIZE_IN_BYTES,
+			     buffer.size());
+
+	Byte_view_t view(buffer);
+	Squeezer_block_header_t test;
+	test.read_from_buffer(view);
+	CPPUNIT_ASSERT_EQUAL(source.number_of_samples, test.number_of_samples);
+	CPPUNIT_ASSERT_EQUAL(source.number_of_bytes, test.number_of_bytes);
+	CPPUNIT_ASSERT_EQUAL(source.first_obt, test.first_obt);
+	CPPUNIT_ASSERT_EQUAL(source.checksum, test.checksum);
+
+	// Older files have no checksum
+	Byte_view_t old_view(buffer);
+	test.read_from_buffer(old_view, FIRST_VERSION_WITH_BLOCKS);
+	CPPUNIT_ASSERT_EQUAL(source.first_obt, test.first_obt);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0, test.checksum);
+	CPPUNIT_ASSERT_EQUAL((size_t) 4, old_view.items_left());
+    }
+
+    void testTableOfContents() {
+	Squeezer_file_header_t file_header(SQZ_DETECTOR_POINTINGS);
+	file_header.number_of_chunks = 2;
+
+	Squeezer_toc_t source;
+	Squeezer_chunk_header_t chunk_header;
+	chunk_header.chunk_type = CHUNK_DELTA_OBT;
+	chunk_header.number_of_bytes = 100;
+	chunk_header.number_of_samples = 1000;
+	source.add_chunk(chunk_header);
+
+	chunk_header.chunk_type = CHUNK_PHI;
+	chunk_header.number_of_bytes = 200;
+	chunk_header.backend = BACKEND_ZLIB;
+	chunk_header.filter = FILTER_BYTE_SHUFFLE;
+	source.add_chunk(chunk_header);
+
+	const uint64_t second_offset = Squeezer_file_header_t::SIZE_IN_BYTES
+	    + Squeezer_chunk_header_t::SIZE_IN_BYTES + 100;
+	CPPUNIT_ASSERT_EQUAL((uint64_t) Squeezer_file_header_t::SIZE_IN_BYTES,
+			     source.entries[0].offset);
+	CPPUNIT_ASSERT_EQUAL(second_offset, source.entries[1].offset);
+	CPPUNIT_ASSERT_EQUAL(second_offset + Squeezer_chunk_header_t::SIZE_IN_BYTES + 200,
+			     source.end_offset());
+	file_header.toc_offset = source.end_offset();
+
+	FILE * f = fopen("./delete_me.bin", "wb");
+	source.write_to_file(f);
+	fclose(f);
+
+	f = fopen("./delete_me.bin", "rb");
+	Squeezer_toc_t test;
+	test.read_from_file(f);
+	fclose(f);
+
+	CPPUNIT_ASSERT(test.is_valid(file_header));
+	CPPUNIT_ASSERT(test.find(CHUNK_THETA) == NULL);
+
+	const Toc_entry_t * phi = test.find(CHUNK_PHI);
+	CPPUNIT_ASSERT(phi != NULL);
+	CPPUNIT_ASSERT_EQUAL(second_offset, phi->offset);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 200, phi->number_of_bytes);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 1000, phi->number_of_samples);
+	CPPUNIT_ASSERT_EQUAL((int) BACKEND_ZLIB, (int) phi->backend);
+	CPPUNIT_ASSERT_EQUAL((int) FILTER_BYTE_SHUFFLE, (int) phi->filter);
+
+	// The chunks cannot overlap the table of contents
+	file_header.toc_offset = second_offset;
+	CPPUNIT_ASSERT(! test.is_valid(file_header));
+    }
+
     static CppUnit::Test * suite() {
 	CppUnit::TestSuite * suite = new CppUnit::TestSuite("File_IO_test");
 	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
@@ -550,6 +1063,18 @@ public:
 	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
 			   "testChunkHeaderIO", 
 			   &File_IO_test::testChunkHeaderIO));
+	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
+			   "testMappedFile",
+			   &File_IO_test::testMappedFile));
+	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
+			   "testOldFileHeader",
+			   &File_IO_test::testOldFileHeader));
+	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
+			   "testBlockHeader",
+			   &File_IO_test::testBlockHeader));
+	suite->addTest(new CppUnit::TestCaller<File_IO_test>(
+			   "testTableOfContents",
+			   &File_IO_test::testTableOfContents));
 	return suite;
     }
 };
@@ -603,6 +1128,46 @@ public:
 	CPPUNIT_ASSERT_EQUAL((double) 456.0, buffer.read_double());
     }
 
+    void testBulkIO() {
+	const uint32_t ints[] = { 0x01020304, 0xDEADBEEF, 0 };
+	const float floats[] = { 123.0, -1.5e-7 };
+	const double doubles[] = { 456.0, M_PI };
+
+	Byte_buffer_t buffer;
+	buffer.append_uint32s(ints, 3);
+	buffer.append_floats(floats, 2);
+	buffer.append_doubles(doubles, 2);
+
+	// The bulk methods must produce the same layout as the
+	// single-value ones
+	Byte_buffer_t reference;
+	for(auto value : ints)
+	    reference.append_uint32(value);
+	for(auto value : floats)
+	    reference.append_float(value);
+	for(auto value : doubles)
+	    reference.append_double(value);
+	CPPUNIT_ASSERT(buffer.buffer == reference.buffer);
+
+	uint32_t read_ints[3];
+	float read_floats[2];
+	double read_doubles[2];
+	buffer.read_uint32s(read_ints, 3);
+	buffer.read_floats(read_floats, 2);
+	buffer.read_doubles(read_doubles, 2);
+
+	for(size_t idx = 0; idx < 3; ++idx)
+	    CPPUNIT_ASSERT_EQUAL(ints[idx], read_ints[idx]);
+	for(size_t idx = 0; idx < 2; ++idx) {
+	    CPPUNIT_ASSERT_EQUAL(floats[idx], read_floats[idx]);
+	    CPPUNIT_ASSERT_EQUAL(doubles[idx], read_doubles[idx]);
+	}
+
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, buffer.items_left());
+	CPPUNIT_ASSERT_THROW(buffer.read_uint32s(read_ints, 1),
+			     std::out_of_range);
+    }
+
     void testReadAfterEnd() {
 	Byte_buffer_t buffer;
 	buffer.append_uint8(0);
@@ -610,6 +1175,14 @@ public:
 	buffer.read_uint8();
 	CPPUNIT_ASSERT_THROW(buffer.read_uint8(),
 			     std::out_of_range);
+
+	// Reading the whole buffer at once is allowed
+	uint8_t raw_data[2];
+	buffer.append_uint8(1);
+	buffer.cur_position = 0;
+	buffer.read_buffer(2, raw_data);
+	CPPUNIT_ASSERT_THROW(buffer.read_buffer(1, raw_data),
+			     std::out_of_range);
     }
 
     static CppUnit::Test * suite() {
@@ -623,6 +1196,9 @@ public:
 	suite->addTest(new CppUnit::TestCaller<Byte_buffer_test>(
 			   "testFloatingPoint",
 			   &Byte_buffer_test::testFloatingPoint));
+	suite->addTest(new CppUnit::TestCaller<Byte_buffer_test>(
+			   "testBulkIO",
+			   &Byte_buffer_test::testBulkIO));
 	suite->addTest(new CppUnit::TestCaller<Byte_buffer_test>(
 			   "testReadAfterEnd",
 			   &Byte_buffer_test::testReadAfterEnd));
@@ -633,6 +1209,1327 @@ public:
 
 ////////////////////////////////////////////////////////////////////
 
+class Bit_stream_test : public CppUnit::TestFixture {
+public:
+    void testLayout() {
+	Byte_buffer_t buffer;
+	buffer.append_uint8(0x11);
+
+	Bit_writer_t writer(buffer);
+	writer.write_bits(5, 3);	// 101
+	writer.write_bits(0xFF, 4);	// 1111 (the upper bits are ignored)
+	writer.write_bit(false);	// 0
+	writer.write_bits(1, 2);	// 01, then six bits of padding
+	writer.flush();
+	buffer.append_uint8(0x22);
+
+	CPPUNIT_ASSERT_EQUAL((size_t) 4, buffer.size());
+	CPPUNIT_ASSERT_EQUAL(0x11, (int) buffer.buffer[0]);
+	CPPUNIT_ASSERT_EQUAL(0xBE, (int) buffer.buffer[1]);
+	CPPUNIT_ASSERT_EQUAL(0x40, (int) buffer.buffer[2]);
+	CPPUNIT_ASSERT_EQUAL(0x22, (int) buffer.buffer[3]);
+
+	Byte_view_t view(buffer);
+	CPPUNIT_ASSERT_EQUAL(0x11, (int) view.read_uint8());
+
+	Bit_reader_t reader(view);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 5, reader.read_bits(3));
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0xF, reader.read_bits(4));
+	CPPUNIT_ASSERT(! reader.read_bit());
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 1, reader.read_bits(2));
+	reader.finish();
+
+	CPPUNIT_ASSERT_EQUAL(0x22, (int) view.read_uint8());
+    }
+
+    void testRoundTrip() {
+	// Mix all the widths, so that values straddle the boundaries of
+	// the 64-bit words in every possible way
+	std::vector<std::pair<uint64_t, unsigned int>> values;
+	uint64_t seed = 12345;
+	for(int idx = 0; idx < 5000; ++idx) {
+	    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	    const unsigned int width = idx % (MAX_BITS_PER_READ + 1);
+	    const uint64_t mask = (width == 0) ? 0 : (~UINT64_C(0) >> (64 - width));
+	    values.push_back(std::make_pair(seed & mask, width));
+	}
+
+	Byte_buffer_t buffer;
+	Bit_writer_t writer(buffer);
+	size_t num_of_bits = 0;
+	for(auto cur_value : values) {
+	    writer.write_bits(cur_value.first, cur_value.second);
+	    num_of_bits += cur_value.second;
+	}
+	// 64-bit values are written at once, but must be read in two steps
+	writer.write_bits(0xFEDCBA9876543210ULL, 64);
+	num_of_bits += 64;
+	writer.flush();
+
+	CPPUNIT_ASSERT_EQUAL((num_of_bits + 7) / 8, buffer.size());
+
+	Byte_view_t view(buffer);
+	Bit_reader_t reader(view);
+	for(auto cur_value : values)
+	    CPPUNIT_ASSERT_EQUAL(cur_value.first, reader.read_bits(cur_value.second));
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0xFEDCBA98, reader.read_bits(32));
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0x76543210, reader.read_bits(32));
+	CPPUNIT_ASSERT_EQUAL(num_of_bits, reader.position());
+
+	reader.finish();
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, view.items_left());
+    }
+
+    void testReadAfterEnd() {
+	Byte_buffer_t buffer;
+	buffer.append_uint8(0xFF);
+
+	Byte_view_t view(buffer);
+	Bit_reader_t reader(view);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0x7F, reader.read_bits(7));
+	// Bits past the end read as zero, but "finish" complains
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0x4, reader.read_bits(3));
+	CPPUNIT_ASSERT_THROW(reader.finish(), std::out_of_range);
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Bit_stream_test");
+	suite->addTest(new CppUnit::TestCaller<Bit_stream_test>(
+			   "testLayout",
+			   &Bit_stream_test::testLayout));
+	suite->addTest(new CppUnit::TestCaller<Bit_stream_test>(
+			   "testRoundTrip",
+			   &Bit_stream_test::testRoundTrip));
+	suite->addTest(new CppUnit::TestCaller<Bit_stream_test>(
+			   "testReadAfterEnd",
+			   &Bit_stream_test::testReadAfterEnd));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Byte_buffer_pool_test : public CppUnit::TestFixture {
+public:
+    void testReuse() {
+	Byte_buffer_pool_t pool;
+	const uint8_t * first_data;
+
+	{
+	    Pooled_buffer_t buffer(pool, 1000);
+	    CPPUNIT_ASSERT(buffer->buffer.capacity() >= 1000);
+	    buffer->append_uint32(1);
+	    first_data = buffer->buffer.data();
+	}
+	CPPUNIT_ASSERT_EQUAL((size_t) 1, pool.num_of_free_buffers());
+
+	// The same memory is given back, empty
+	Pooled_buffer_t buffer(pool, 500);
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, pool.num_of_free_buffers());
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, buffer->size());
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, buffer->cur_position);
+	CPPUNIT_ASSERT(buffer->buffer.data() == first_data);
+    }
+
+    void testBestFit() {
+	Byte_buffer_pool_t pool;
+	for(size_t capacity : { 100, 10000, 1000 }) {
+	    Byte_buffer_t buffer = pool.acquire(capacity);
+	    pool.release(buffer);
+	}
+	CPPUNIT_ASSERT_EQUAL((size_t) 1, pool.num_of_free_buffers());
+
+	Byte_buffer_t small = pool.acquire(100);
+	Byte_buffer_t medium = pool.acquire(1000);
+	Byte_buffer_t large = pool.acquire(10000);
+	pool.release(small);
+	pool.release(medium);
+	pool.release(large);
+	CPPUNIT_ASSERT_EQUAL((size_t) 3, pool.num_of_free_buffers());
+
+	Byte_buffer_t buffer = pool.acquire(500);
+	CPPUNIT_ASSERT(buffer.buffer.capacity() >= 1000);
+	CPPUNIT_ASSERT(buffer.buffer.capacity() < 10000);
+    }
+
+    void testMaxFreeBuffers() {
+	Byte_buffer_pool_t pool(2);
+	std::vector<Byte_buffer_t> buffers;
+	for(size_t capacity : { 10, 30, 20 })
+	    buffers.push_back(pool.acquire(capacity));
+
+	for(auto & cur_buffer : buffers)
+	    pool.release(cur_buffer);
+	CPPUNIT_ASSERT_EQUAL((size_t) 2, pool.num_of_free_buffers());
+
+	// The smallest buffer must have been dropped
+	Byte_buffer_t first = pool.acquire();
+	Byte_buffer_t second = pool.acquire();
+	CPPUNIT_ASSERT(std::min(first.buffer.capacity(),
+				second.buffer.capacity()) >= 20);
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Byte_buffer_pool_test");
+	suite->addTest(new CppUnit::TestCaller<Byte_buffer_pool_test>(
+			   "testReuse",
+			   &Byte_buffer_pool_test::testReuse));
+	suite->addTest(new CppUnit::TestCaller<Byte_buffer_pool_test>(
+			   "testBestFit",
+			   &Byte_buffer_pool_test::testBestFit));
+	suite->addTest(new CppUnit::TestCaller<Byte_buffer_pool_test>(
+			   "testMaxFreeBuffers",
+			   &Byte_buffer_pool_test::testMaxFreeBuffers));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Crc32c_test : public CppUnit::TestFixture {
+public:
+    void testKnownValues() {
+	// Check values from RFC 3720, appendix B.4
+	std::vector<uint8_t> zeroes(32, 0);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0x8A9136AA,
+			     crc32c(zeroes.data(), zeroes.size()));
+
+	std::vector<uint8_t> ones(32, 0xFF);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0x62A8AB43,
+			     crc32c(ones.data(), ones.size()));
+
+	const char * digits = "123456789";
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0xE3069283,
+			     crc32c((const uint8_t *) digits, 9));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0xE3069283,
+			     crc32c_portable((const uint8_t *) digits, 9));
+    }
+
+    void testPieces() {
+	std::vector<uint8_t> data(1000);
+	for(size_t idx = 0; idx < data.size(); ++idx)
+	    data[idx] = (idx * 7 + 3) & 0xFF;
+
+	// Odd sizes and offsets exercise all the code paths
+	for(size_t split = 0; split < 20; ++split) {
+	    const uint32_t first = crc32c(data.data() + 1, split);
+	    CPPUNIT_ASSERT_EQUAL(crc32c(data.data() + 1, data.size() - 1),
+				 crc32c(data.data() + 1 + split,
+					data.size() - 1 - split,
+					first));
+	    CPPUNIT_ASSERT_EQUAL(crc32c_portable(data.data() + split,
+						 data.size() - split),
+				 crc32c(data.data() + split,
+					data.size() - split));
+	}
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Crc32c_test");
+	suite->addTest(new CppUnit::TestCaller<Crc32c_test>(
+			   "testKnownValues",
+			   &Crc32c_test::testKnownValues));
+	suite->addTest(new CppUnit::TestCaller<Crc32c_test>(
+			   "testPieces",
+			   &Crc32c_test::testPieces));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Bounded_queue_test : public CppUnit::TestFixture {
+public:
+    void testOrder() {
+	Bounded_queue_t<int> queue(2);
+	const int num_of_items = 1000;
+
+	// The producer must wait for the consumer most of the time
+	std::thread producer([&]() {
+		for(int idx = 0; idx < num_of_items; ++idx)
+		    queue.push(int(idx));
+		queue.close();
+	    });
+
+	std::vector<int> items;
+	int item;
+	while(queue.pop(item))
+	    items.push_back(item);
+	producer.join();
+
+	CPPUNIT_ASSERT_EQUAL((size_t) num_of_items, items.size());
+	for(int idx = 0; idx < num_of_items; ++idx)
+	    CPPUNIT_ASSERT_EQUAL(idx, items[idx]);
+    }
+
+    void testClose() {
+	Bounded_queue_t<int> queue(3);
+	CPPUNIT_ASSERT(queue.push(1));
+	CPPUNIT_ASSERT(queue.push(2));
+	queue.close();
+
+	// Items pushed before "close" can still be popped
+	int item;
+	CPPUNIT_ASSERT(! queue.push(3));
+	CPPUNIT_ASSERT(queue.pop(item));
+	CPPUNIT_ASSERT_EQUAL(1, item);
+	CPPUNIT_ASSERT(queue.pop(item));
+	CPPUNIT_ASSERT_EQUAL(2, item);
+	CPPUNIT_ASSERT(! queue.pop(item));
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Bounded_queue_test");
+	suite->addTest(new CppUnit::TestCaller<Bounded_queue_test>(
+			   "testOrder",
+			   &Bounded_queue_test::testOrder));
+	suite->addTest(new CppUnit::TestCaller<Bounded_queue_test>(
+			   "testClose",
+			   &Bounded_queue_test::testClose));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Balance_test : public CppUnit::TestFixture {
+public:
+    void testLoads() {
+	const std::vector<uint64_t> weights { 2, 10, 1, 8, 1 };
+	const std::vector<unsigned int> workers = balance_by_weight(weights, 2);
+
+	CPPUNIT_ASSERT_EQUAL(weights.size(), workers.size());
+
+	uint64_t loads[2] = { 0, 0 };
+	for(size_t idx = 0; idx < weights.size(); ++idx) {
+	    CPPUNIT_ASSERT(workers[idx] < 2);
+	    loads[workers[idx]] += weights[idx];
+	}
+
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 11, loads[0]);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 11, loads[1]);
+    }
+
+    void testMoreWorkersThanItems() {
+	const std::vector<uint64_t> weights { 5, 5, 5 };
+	const std::vector<unsigned int> workers = balance_by_weight(weights, 4);
+
+	// Every item goes to a different worker
+	CPPUNIT_ASSERT_EQUAL(0U, workers[0]);
+	CPPUNIT_ASSERT_EQUAL(1U, workers[1]);
+	CPPUNIT_ASSERT_EQUAL(2U, workers[2]);
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Balance_test");
+	suite->addTest(new CppUnit::TestCaller<Balance_test>(
+			   "testLoads",
+			   &Balance_test::testLoads));
+	suite->addTest(new CppUnit::TestCaller<Balance_test>(
+			   "testMoreWorkersThanItems",
+			   &Balance_test::testMoreWorkersThanItems));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Batch_state_test : public CppUnit::TestFixture {
+    Parameter_file_line_t line;
+
+    void write_file(const std::string & file_name,
+		    const std::string & contents,
+		    time_t mtime) {
+	std::ofstream(file_name) << contents;
+
+	struct utimbuf times;
+	times.actime = times.modtime = mtime;
+	utime(file_name.c_str(), &times);
+    }
+
+    bool is_up_to_date(Batch_state_t & state, uint32_t parameters) {
+	File_signature_t input;
+	CPPUNIT_ASSERT(read_file_status(line.input_file_name, input));
+	return state.is_up_to_date(line, parameters, input);
+    }
+
+public:
+    void setUp() {
+	line.line_number = 1;
+	line.radiometer_str = "LFI27M";
+	line.od_str = "91";
+	line.input_file_name = "./delete_me.in";
+	line.output_file_name = "./delete_me.out";
+
+	write_file(line.input_file_name, "abcd", 1000000);
+	write_file(line.output_file_name, "xyz", 1000000);
+    }
+
+    void tearDown() {
+	std::remove("./delete_me.in");
+	std::remove("./delete_me.out");
+	std::remove("./delete_me.state");
+	std::remove("./delete_me.journal");
+    }
+
+    void testSaveAndLoad() {
+	Batch_state_t state;
+	File_signature_t input;
+	CPPUNIT_ASSERT(read_file_status(line.input_file_name, input));
+	CPPUNIT_ASSERT(! state.is_up_to_date(line, 1, input));
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 4, input.size);
+	CPPUNIT_ASSERT_EQUAL(crc32c(reinterpret_cast<const uint8_t *>("abcd"), 4),
+			     input.checksum);
+
+	state.update(line, 1, input);
+	state.save("./delete_me.state");
+
+	Batch_state_t loaded_state;
+	CPPUNIT_ASSERT(loaded_state.load("./delete_me.state"));
+	CPPUNIT_ASSERT(is_up_to_date(loaded_state, 1));
+	CPPUNIT_ASSERT(! is_up_to_date(loaded_state, 2));
+
+	Batch_state_t missing_state;
+	CPPUNIT_ASSERT(! missing_state.load("./delete_me.nonexistent"));
+    }
+
+    void testChanges() {
+	Batch_state_t state;
+	File_signature_t input;
+	CPPUNIT_ASSERT(read_file_status(line.input_file_name, input));
+	state.is_up_to_date(line, 1, input);
+	state.update(line, 1, input);
+
+	// Touching the input does not change its checksum
+	write_file(line.input_file_name, "abcd", 2000000);
+	CPPUNIT_ASSERT(is_up_to_date(state, 1));
+
+	write_file(line.input_file_name, "abce", 3000000);
+	CPPUNIT_ASSERT(! is_up_to_date(state, 1));
+
+	write_file(line.input_file_name, "abcd", 2000000);
+	CPPUNIT_ASSERT(is_up_to_date(state, 1));
+
+	write_file(line.output_file_name, "xyzw", 1000000);
+	CPPUNIT_ASSERT(! is_up_to_date(state, 1));
+
+	write_file(line.output_file_name, "xyz", 1000000);
+	state.forget(line);
+	CPPUNIT_ASSERT(! is_up_to_date(state, 1));
+    }
+
+    void testJournal() {
+	{
+	    Batch_journal_t journal;
+	    journal.open("./delete_me.journal", "compress 1");
+	    CPPUNIT_ASSERT(! journal.is_completed(line));
+	    journal.record(line);
+	    CPPUNIT_ASSERT(journal.is_completed(line));
+	}
+
+	// Simulate a run killed while writing a line
+	std::ofstream("./delete_me.journal", std::ios::app) << "3 LFI27M 92 a";
+
+	Batch_journal_t journal;
+	CPPUNIT_ASSERT(! journal.load("./delete_me.journal", "compress 2"));
+	CPPUNIT_ASSERT(journal.load("./delete_me.journal", "compress 1"));
+	CPPUNIT_ASSERT(journal.is_completed(line));
+
+	// Rewriting the journal drops the incomplete line
+	journal.open("./delete_me.journal", "compress 1");
+	std::ifstream journal_file("./delete_me.journal");
+	std::string header, entry, rest;
+	getline(journal_file, header);
+	getline(journal_file, entry);
+	CPPUNIT_ASSERT_EQUAL(std::string("3 LFI27M 91 ./delete_me.in ./delete_me.out"),
+			     entry);
+	CPPUNIT_ASSERT(! getline(journal_file, rest));
+
+	// A damaged output must be created again
+	write_file(line.output_file_name, "xy", 1000000);
+	CPPUNIT_ASSERT(! journal.is_completed(line));
+
+	journal.remove();
+	CPPUNIT_ASSERT(! journal.load("./delete_me.journal", "compress 1"));
+    }
+
+    void testJournalOverwrite() {
+	// "decompress" accepts CFITSIO's "!" prefix, which is not part of
+	// the name of the file on disk
+	line.output_file_name = "!./delete_me.out";
+
+	Batch_journal_t journal;
+	journal.open("./delete_me.journal", "decompress 1");
+	journal.record(line);
+	CPPUNIT_ASSERT(journal.is_completed(line));
+
+	write_file("./delete_me.out", "xy", 1000000);
+	CPPUNIT_ASSERT(! journal.is_completed(line));
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Batch_state_test");
+	suite->addTest(new CppUnit::TestCaller<Batch_state_test>(
+			   "testSaveAndLoad",
+			   &Batch_state_test::testSaveAndLoad));
+	suite->addTest(new CppUnit::TestCaller<Batch_state_test>(
+			   "testChanges",
+			   &Batch_state_test::testChanges));
+	suite->addTest(new CppUnit::TestCaller<Batch_state_test>(
+			   "testJournal",
+			   &Batch_state_test::testJournal));
+	suite->addTest(new CppUnit::TestCaller<Batch_state_test>(
+			   "testJournalOverwrite",
+			   &Batch_state_test::testJournalOverwrite));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+// Fill "pointings" and, if it is not NULL, "datadiff" with the same
+// 5000 smoothly varying samples. A gap in the OBT times makes the
+// deltas differ across blocks.
+static void
+fill_sample_data(Detector_pointings_t & pointings,
+		 Differenced_data_t * datadiff)
+{
+    const size_t num_of_samples = 5000;
+    for(size_t idx = 0; idx < num_of_samples; ++idx) {
+	const double obt = 1.0e10 + idx * 1024.0 + (idx >= 2500 ? 4096.0 : 0.0);
+	const double scet = 1.6e15 + idx * 15625.0 + 3.0 * std::sin(idx * 0.01);
+
+	pointings.obt_times.push_back(obt);
+	pointings.scet_times.push_back(scet);
+	pointings.theta.push_back(1.5 + 0.3 * std::sin(idx * 1e-3));
+	pointings.phi.push_back(3.0 + 0.2 * std::cos(idx * 7e-4));
+	pointings.psi.push_back(0.5 * std::sin(idx * 2e-3));
+
+	if(datadiff != NULL) {
+	    datadiff->obt_times.push_back(obt);
+	    datadiff->scet_times.push_back(scet);
+	    datadiff->sky_load.push_back(1.0e-3 * std::cos(idx * 0.37) + 2.5);
+	    datadiff->quality_flags.push_back((idx / 300) % 3 == 0 ? 0 : idx % 7);
+	}
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+
+class Memory_codec_test : public CppUnit::TestFixture {
+    Detector_pointings_t pointings;
+    Compression_parameters_t params;
+
+public:
+    void setUp() {
+	fill_sample_data(pointings, NULL);
+
+	params.file_type = SQZ_DETECTOR_POINTINGS;
+	params.radiometer.horn = 27;
+	params.radiometer.arm = 0;
+	params.od_number = 91;
+	params.samples_per_block = 1000;
+    }
+
+    void testRoundTrip() {
+	std::vector<uint8_t> buffer;
+	compress_data_to_buffer(pointings, params, buffer);
+
+	Squeezer_buffer_info_t info;
+	read_buffer_info(buffer.data(), buffer.size(), info);
+	CPPUNIT_ASSERT(info.file_type == SQZ_DETECTOR_POINTINGS);
+	CPPUNIT_ASSERT_EQUAL(91, (int) info.od);
+	CPPUNIT_ASSERT_EQUAL(pointings.obt_times.size(), info.number_of_samples);
+
+	// Only the columns with an array are decoded
+	std::vector<double> obt_times(info.number_of_samples);
+	std::vector<double> theta(info.number_of_samples);
+	Decompressed_arrays_t arrays;
+	arrays.obt_times = obt_times.data();
+	arrays.theta = theta.data();
+	arrays.capacity = info.number_of_samples;
+
+	Decompression_parameters_t decompression_params;
+	CPPUNIT_ASSERT_EQUAL(info.number_of_samples,
+			     decompress_buffer_to_arrays(buffer.data(),
+							 buffer.size(),
+							 decompression_params,
+							 arrays));
+	for(size_t idx = 0; idx < info.number_of_samples; ++idx) {
+	    CPPUNIT_ASSERT_EQUAL(pointings.obt_times[idx], obt_times[idx]);
+	    CPPUNIT_ASSERT(std::fabs(pointings.theta[idx] - theta[idx])
+			   <= params.max_abs_error * 1.001);
+	}
+
+	// Without an array for OBT times, they are still used to select
+	// the samples in the range
+	decompression_params.obt_range_flag = true;
+	decompression_params.first_obt = pointings.obt_times[1500];
+	decompression_params.last_obt = pointings.obt_times[3200];
+	std::vector<double> scet_times(info.number_of_samples);
+	std::vector<double> psi(info.number_of_samples);
+	Decompressed_arrays_t range_arrays;
+	range_arrays.scet_times = scet_times.data();
+	range_arrays.psi = psi.data();
+	range_arrays.capacity = info.number_of_samples;
+	CPPUNIT_ASSERT_EQUAL((size_t) 1701,
+			     decompress_buffer_to_arrays(buffer.data(),
+							 buffer.size(),
+							 decompression_params,
+							 range_arrays));
+
+	Byte_view_t input(buffer.data(), buffer.size());
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	auto & decoded = dynamic_cast<const Detector_pointings_t &>(*data);
+	CPPUNIT_ASSERT_EQUAL((size_t) 1701, decoded.psi.size());
+	for(size_t idx = 0; idx < decoded.psi.size(); ++idx) {
+	    CPPUNIT_ASSERT_EQUAL(decoded.scet_times[idx], scet_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(decoded.psi[idx], psi[idx]);
+	}
+    }
+
+    void testErrors() {
+	std::vector<uint8_t> buffer;
+	compress_data_to_buffer(pointings, params, buffer);
+
+	std::vector<double> obt_times(pointings.obt_times.size());
+	std::vector<double> sky_load(pointings.obt_times.size());
+	Decompressed_arrays_t arrays;
+	arrays.obt_times = obt_times.data();
+	arrays.capacity = obt_times.size() - 1;
+
+	Decompression_parameters_t decompression_params;
+	CPPUNIT_ASSERT_THROW(decompress_buffer_to_arrays(buffer.data(), buffer.size(),
+							 decompression_params, arrays),
+			     std::runtime_error);
+
+	// Pointings have no differenced data
+	arrays.capacity = obt_times.size();
+	arrays.sky_load = sky_load.data();
+	CPPUNIT_ASSERT_THROW(decompress_buffer_to_arrays(buffer.data(), buffer.size(),
+							 decompression_params, arrays),
+			     std::runtime_error);
+
+	Squeezer_buffer_info_t info;
+	CPPUNIT_ASSERT_THROW(read_buffer_info(buffer.data(), 20, info),
+			     std::runtime_error);
+
+	pointings.psi.pop_back();
+	CPPUNIT_ASSERT_THROW(compress_data_to_buffer(pointings, params, buffer),
+			     std::runtime_error);
+    }
+
+    // Return true if both "verify_file" and "decompress_from_buffer"
+    // reject the file in "buffer"
+    static bool is_rejected(const std::vector<uint8_t> & buffer) {
+	FILE * f = fopen("./delete_me.bin", "wb");
+	fwrite(buffer.data(), 1, buffer.size(), f);
+	fclose(f);
+
+	bool verify_error = false;
+	f = fopen("./delete_me.bin", "rb");
+	try {
+	    verify_file(f);
+	}
+	catch(std::runtime_error &) {
+	    verify_error = true;
+	}
+	fclose(f);
+
+	bool decompress_error = false;
+	Byte_view_t input(buffer.data(), buffer.size());
+	Decompression_parameters_t decompression_params;
+	try {
+	    delete decompress_from_buffer(input, decompression_params);
+	}
+	catch(std::runtime_error &) {
+	    decompress_error = true;
+	}
+
+	return verify_error && decompress_error;
+    }
+
+    void testChecksums() {
+	std::vector<uint8_t> buffer;
+	compress_data_to_buffer(pointings, params, buffer);
+	CPPUNIT_ASSERT(! is_rejected(buffer));
+
+	// Find the second block of the OBT times, which is the first chunk
+	const size_t first_block = Squeezer_file_header_t::SIZE_IN_BYTES
+	    + Squeezer_chunk_header_t::SIZE_IN_BYTES;
+	Byte_view_t view(buffer.data() + first_block, buffer.size() - first_block);
+	Squeezer_block_header_t block_header;
+	block_header.read_from_buffer(view);
+	const size_t second_block = first_block
+	    + Squeezer_block_header_t::SIZE_IN_BYTES
+	    + block_header.number_of_bytes;
+
+	// The least significant bit of "first_obt" changes the time of
+	// every sample in the block by a tiny amount
+	std::vector<uint8_t> damaged_header(buffer);
+	damaged_header[second_block + Squeezer_block_header_t::SIZE_WITHOUT_CHECKSUM - 1] ^= 1;
+	CPPUNIT_ASSERT(is_rejected(damaged_header));
+
+	std::vector<uint8_t> damaged_samples(buffer);
+	damaged_samples[second_block + 1] ^= 0x10;
+	CPPUNIT_ASSERT(is_rejected(damaged_samples));
+
+	std::vector<uint8_t> damaged_payload(buffer);
+	damaged_payload[second_block + Squeezer_block_header_t::SIZE_IN_BYTES] ^= 0x04;
+	CPPUNIT_ASSERT(is_rejected(damaged_payload));
+
+	// The statistics in the chunk header are not needed to decode
+	// the samples, but they are protected by the table of contents
+	std::vector<uint8_t> damaged_chunk_header(buffer);
+	damaged_chunk_header[first_block - 1] ^= 1;
+	CPPUNIT_ASSERT(is_rejected(damaged_chunk_header));
+    }
+
+    // Check that extracting the OBT range [first_obt, last_obt] from
+    // "buffer" returns the samples [first_sample, end_sample) of
+    // "all_samples", which contains the whole file
+    void check_obt_range(const std::vector<uint8_t> & buffer,
+			 const Detector_pointings_t & all_samples,
+			 double first_obt,
+			 double last_obt,
+			 size_t first_sample,
+			 size_t end_sample) {
+	Decompression_parameters_t decompression_params;
+	decompression_params.obt_range_flag = true;
+	decompression_params.first_obt = first_obt;
+	decompression_params.last_obt = last_obt;
+
+	Byte_view_t input(buffer.data(), buffer.size());
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	auto & extracted = dynamic_cast<const Detector_pointings_t &>(*data);
+
+	const size_t num_of_samples = end_sample - first_sample;
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, extracted.obt_times.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, extracted.scet_times.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, extracted.theta.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, extracted.phi.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, extracted.psi.size());
+	for(size_t idx = 0; idx < num_of_samples; ++idx) {
+	    const size_t sample = first_sample + idx;
+	    CPPUNIT_ASSERT_EQUAL(all_samples.obt_times[sample], extracted.obt_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(all_samples.scet_times[sample], extracted.scet_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(all_samples.theta[sample], extracted.theta[idx]);
+	    CPPUNIT_ASSERT_EQUAL(all_samples.phi[sample], extracted.phi[idx]);
+	    CPPUNIT_ASSERT_EQUAL(all_samples.psi[sample], extracted.psi[idx]);
+	}
+
+	// "extract" decodes the file one block at a time
+	FILE * f = fopen("./delete_me.bin", "wb");
+	fwrite(buffer.data(), 1, buffer.size(), f);
+	fclose(f);
+
+	std::remove("./delete_me.fits");
+	f = fopen("./delete_me.bin", "rb");
+	if(num_of_samples == 0) {
+	    CPPUNIT_ASSERT_THROW(decompress_file_from_file(f, "./delete_me.fits",
+							   decompression_params),
+				 std::runtime_error);
+	    fclose(f);
+	    return;
+	}
+
+	CPPUNIT_ASSERT_EQUAL(num_of_samples,
+			     decompress_file_from_file(f, "./delete_me.fits",
+						       decompression_params));
+	fclose(f);
+
+	Detector_pointings_t fits_samples;
+	fits_samples.read_from_fits_file("./delete_me.fits");
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, fits_samples.obt_times.size());
+	CPPUNIT_ASSERT_EQUAL(all_samples.obt_times[first_sample],
+			     fits_samples.obt_times.front());
+	CPPUNIT_ASSERT_EQUAL(all_samples.obt_times[end_sample - 1],
+			     fits_samples.obt_times.back());
+	CPPUNIT_ASSERT_EQUAL(all_samples.psi[end_sample - 1],
+			     fits_samples.psi.back());
+    }
+
+    void testObtRange() {
+	std::vector<uint8_t> buffer;
+	compress_data_to_buffer(pointings, params, buffer);
+
+	Byte_view_t input(buffer.data(), buffer.size());
+	Decompression_parameters_t decompression_params;
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	auto & all_samples = dynamic_cast<const Detector_pointings_t &>(*data);
+	const std::vector<double> & obt = pointings.obt_times;
+
+	// Blocks start at samples 0, 1000, 2000...
+	check_obt_range(buffer, all_samples, obt[1200], obt[1800], 1200, 1801);
+	check_obt_range(buffer, all_samples, obt[1900] + 512, obt[2100], 1901, 2101);
+	check_obt_range(buffer, all_samples, obt[1000], obt[3000], 1000, 3001);
+	check_obt_range(buffer, all_samples, obt[0], obt[999] + 1023, 0, 1000);
+
+	// No samples are in the range
+	check_obt_range(buffer, all_samples, obt.front() - 1.0e6, obt.front() - 1.0, 0, 0);
+	check_obt_range(buffer, all_samples, obt.back() + 1.0, obt.back() + 1.0e6, 0, 0);
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Memory_codec_test");
+	suite->addTest(new CppUnit::TestCaller<Memory_codec_test>(
+			   "testRoundTrip",
+			   &Memory_codec_test::testRoundTrip));
+	suite->addTest(new CppUnit::TestCaller<Memory_codec_test>(
+			   "testErrors",
+			   &Memory_codec_test::testErrors));
+	suite->addTest(new CppUnit::TestCaller<Memory_codec_test>(
+			   "testChecksums",
+			   &Memory_codec_test::testChecksums));
+	suite->addTest(new CppUnit::TestCaller<Memory_codec_test>(
+			   "testObtRange",
+			   &Memory_codec_test::testObtRange));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Block_test : public CppUnit::TestFixture {
+    Differenced_data_t datadiff;
+    Detector_pointings_t pointings;
+    Compression_parameters_t params;
+
+public:
+    Block_test() : datadiff(false), pointings(), params() {}
+
+    void setUp() {
+	fill_sample_data(pointings, &datadiff);
+
+	params.radiometer.horn = 27;
+	params.radiometer.arm = 1;
+	params.od_number = 91;
+    }
+
+    // Return the SCET times that the decoder reconstructs from the
+    // single-precision differences with the straight line connecting
+    // the first and the last sample
+    static std::vector<double> expected_scet_times(const Data_container_t & data) {
+	const double first_obt = data.obt_times.front();
+	const double first_scet = data.scet_times.front();
+	const double slope = (data.scet_times.back() - first_scet) /
+	    (data.obt_times.back() - first_obt);
+
+	std::vector<double> result;
+	for(size_t idx = 0; idx < data.obt_times.size(); ++idx) {
+	    const double interpolated_scet =
+		first_scet + slope * (data.obt_times[idx] - first_obt);
+	    const float scet_interp_error = data.scet_times[idx] - interpolated_scet;
+	    result.push_back(interpolated_scet + scet_interp_error);
+	}
+
+	return result;
+    }
+
+    // Decoded angles are brought within [0, 2pi]
+    static double angle_error(double angle, double decoded_angle) {
+	const double error = std::fmod(std::fabs(angle - decoded_angle), 2 * M_PI);
+	return std::min(error, 2 * M_PI - error);
+    }
+
+    void check_differenced_data(const std::vector<uint8_t> & buffer) {
+	Byte_view_t input(buffer.data(), buffer.size());
+	Decompression_parameters_t decompression_params;
+	decompression_params.num_of_threads = 4;
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	CPPUNIT_ASSERT(data.get() != NULL);
+	auto & decoded = dynamic_cast<const Differenced_data_t &>(*data);
+
+	const size_t num_of_samples = datadiff.obt_times.size();
+	const std::vector<double> scet_times = expected_scet_times(datadiff);
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, decoded.obt_times.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, decoded.scet_times.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, decoded.sky_load.size());
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, decoded.quality_flags.size());
+	for(size_t idx = 0; idx < num_of_samples; ++idx) {
+	    CPPUNIT_ASSERT_EQUAL(datadiff.obt_times[idx], decoded.obt_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(scet_times[idx], decoded.scet_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL((double) (float) datadiff.sky_load[idx],
+				 decoded.sky_load[idx]);
+	    CPPUNIT_ASSERT_EQUAL(datadiff.quality_flags[idx],
+				 decoded.quality_flags[idx]);
+	}
+    }
+
+    void testBlockSizes() {
+	const size_t num_of_samples = datadiff.obt_times.size();
+	const size_t block_sizes[] = { 0, 1, 333, 1000, 2500, 4096, 5000, 8192 };
+
+	for(size_t block_size : block_sizes) {
+	    const size_t samples_per_block =
+		(block_size == 0 || block_size > num_of_samples)
+		? num_of_samples
+		: block_size;
+	    const size_t num_of_blocks =
+		(num_of_samples + samples_per_block - 1) / samples_per_block;
+
+	    params.samples_per_block = block_size;
+	    params.filter = (block_size % 2 == 0) ? FILTER_NONE : FILTER_BYTE_SHUFFLE;
+
+	    std::vector<uint8_t> buffer;
+	    params.file_type = SQZ_DIFFERENCED_DATA;
+	    compress_data_to_buffer(datadiff, params, buffer);
+	    check_differenced_data(buffer);
+
+	    FILE * f = fopen("./delete_me.bin", "wb");
+	    fwrite(buffer.data(), 1, buffer.size(), f);
+	    fclose(f);
+	    f = fopen("./delete_me.bin", "rb");
+	    CPPUNIT_ASSERT_EQUAL(4 * num_of_blocks, verify_file(f));
+	    fclose(f);
+
+	    // Angles are fitted block by block, so the error must stay
+	    // within the limit even where a block is split
+	    params.file_type = SQZ_DETECTOR_POINTINGS;
+	    compress_data_to_buffer(pointings, params, buffer);
+
+	    // The frames of the angles are not made of 32-bit elements, so
+	    // they are never filtered
+	    Byte_view_t chunks(buffer.data(), buffer.size());
+	    Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	    file_header.read_from_buffer(chunks);
+	    for(size_t idx = 0; idx < file_header.number_of_chunks; ++idx) {
+		Squeezer_chunk_header_t chunk_header;
+		chunk_header.read_from_buffer(chunks);
+		chunks.skip(chunk_header.number_of_bytes);
+
+		const bool angle_flag = chunk_header.chunk_type >= CHUNK_THETA &&
+		    chunk_header.chunk_type <= CHUNK_PSI;
+		CPPUNIT_ASSERT_EQUAL((int) (angle_flag ? FILTER_NONE : params.filter),
+				     (int) chunk_header.filter);
+	    }
+
+	    Byte_view_t input(buffer.data(), buffer.size());
+	    Decompression_parameters_t decompression_params;
+	    decompression_params.num_of_threads = 4;
+	    std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	    auto & decoded = dynamic_cast<const Detector_pointings_t &>(*data);
+
+	    const std::vector<double> scet_times = expected_scet_times(pointings);
+	    CPPUNIT_ASSERT_EQUAL(num_of_samples, decoded.psi.size());
+	    for(size_t idx = 0; idx < num_of_samples; ++idx) {
+		CPPUNIT_ASSERT_EQUAL(pointings.obt_times[idx], decoded.obt_times[idx]);
+		CPPUNIT_ASSERT_EQUAL(scet_times[idx], decoded.scet_times[idx]);
+		CPPUNIT_ASSERT(angle_error(pointings.theta[idx], decoded.theta[idx])
+			       <= params.max_abs_error * 1.001);
+		CPPUNIT_ASSERT(angle_error(pointings.phi[idx], decoded.phi[idx])
+			       <= params.max_abs_error * 1.001);
+		CPPUNIT_ASSERT(angle_error(pointings.psi[idx], decoded.psi[idx])
+			       <= params.max_abs_error * 1.001);
+	    }
+	}
+    }
+
+    // Append a chunk without blocks, as written before
+    // FIRST_VERSION_WITH_BLOCKS
+    static void append_old_chunk(Chunk_type_t chunk_type,
+				 size_t num_of_samples,
+				 const Byte_buffer_t & payload,
+				 Byte_buffer_t & file) {
+	Squeezer_chunk_header_t chunk_header;
+	chunk_header.chunk_type = chunk_type;
+	chunk_header.number_of_samples = num_of_samples;
+	chunk_header.number_of_bytes = payload.size();
+
+	uint8_t header_bytes[Squeezer_chunk_header_t::SIZE_IN_BYTES];
+	chunk_header.write_to_buffer(header_bytes);
+	file.append_data_from_buffer(sizeof(header_bytes), header_bytes);
+	file.append_data_from_buffer(payload.size(), payload.buffer.data());
+    }
+
+    void testOldFile() {
+	const size_t num_of_samples = datadiff.obt_times.size();
+	Squeezer_file_header_t file_header(SQZ_DIFFERENCED_DATA);
+	file_header.program_version = FIRST_VERSION_WITH_TOC;
+	file_header.radiometer = params.radiometer;
+	file_header.od = params.od_number;
+	file_header.first_obt = datadiff.obt_times.front();
+	file_header.last_obt = datadiff.obt_times.back();
+	file_header.first_scet_in_ms = datadiff.scet_times.front();
+	file_header.last_scet_in_ms = datadiff.scet_times.back();
+	file_header.number_of_chunks = 4;
+
+	Byte_buffer_t file;
+	file.buffer.resize(Squeezer_file_header_t::SIZE_IN_BYTES);
+	file_header.write_to_buffer(file.buffer.data());
+
+	// OBT times are saved as differences from the time in the file
+	// header
+	std::vector<uint32_t> obt_delta;
+	for(size_t idx = 1; idx < num_of_samples; ++idx)
+	    obt_delta.push_back(datadiff.obt_times[idx] - datadiff.obt_times[idx - 1]);
+	Byte_buffer_t payload;
+	rle_compression(obt_delta.data(), obt_delta.size(), payload);
+	append_old_chunk(CHUNK_DELTA_OBT, obt_delta.size(), payload, file);
+
+	const std::vector<double> scet_times = expected_scet_times(datadiff);
+	const double slope =
+	    (file_header.last_scet_in_ms - file_header.first_scet_in_ms) /
+	    (file_header.last_obt - file_header.first_obt);
+	payload = Byte_buffer_t();
+	for(size_t idx = 0; idx < num_of_samples; ++idx) {
+	    payload.append_float(datadiff.scet_times[idx]
+				 - (file_header.first_scet_in_ms
+				    + slope * (datadiff.obt_times[idx] - file_header.first_obt)));
+	}
+	append_old_chunk(CHUNK_SCET_ERROR, num_of_samples, payload, file);
+
+	payload = Byte_buffer_t();
+	for(double sample : datadiff.sky_load)
+	    payload.append_float(sample);
+	append_old_chunk(CHUNK_DIFFERENCED_DATA, num_of_samples, payload, file);
+
+	payload = Byte_buffer_t();
+	rle_compression(datadiff.quality_flags.data(), num_of_samples, payload);
+	append_old_chunk(CHUNK_QUALITY_FLAGS, num_of_samples, payload, file);
+
+	check_differenced_data(file.buffer);
+    }
+
+    // File written by version 1.0 on a little-endian machine. It has
+    // no version number in the file header and no backend or filter in
+    // the chunk headers.
+    static const std::vector<uint8_t> & version_1_0_file() {
+	static const std::vector<uint8_t> bytes = {
+	    0x50, 0x44, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x90, 0x3a, 0x0c, 0x41,
+	    0x07, 0xdd, 0x0a, 0x12, 0x0c, 0x00, 0x00, 0x1b, 0x00, 0x00, 0x5b, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x40, 0x8f, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x40, 0x90, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x9f, 0x40, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0xe0, 0x9f, 0x40, 0x00, 0x00, 0x00, 0x04, 0x43,
+	    0x4e, 0x4b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+	    0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0a, 0x00,
+	    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0a, 0x43, 0x4e, 0x4b, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x05, 0x00,
+	    0x00, 0x00, 0x0b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e,
+	    0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0x4e, 0x4b, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x05, 0x00,
+	    0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3f,
+	    0x00, 0x00, 0x00, 0xbf, 0xa0, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x40,
+	    0x60, 0x00, 0x00, 0xbf, 0x40, 0x00, 0x00, 0x43, 0x4e, 0x4b, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x05, 0x00,
+	    0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	    0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+	    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+	};
+	return bytes;
+    }
+
+    void testVersion10File() {
+	const std::vector<uint8_t> & bytes = version_1_0_file();
+	Byte_view_t input(bytes.data(), bytes.size());
+	Decompression_parameters_t decompression_params;
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	CPPUNIT_ASSERT(data.get() != NULL);
+	auto & decoded = dynamic_cast<const Differenced_data_t &>(*data);
+
+	const double obt_times[] = { 1000.0, 1010.0, 1020.0, 1030.0, 1040.0 };
+	const double scet_times[] = { 2000.0, 2010.5, 2020.0, 2030.25, 2040.0 };
+	const double sky_load[] = { 0.5, -1.25, 2.0, 3.5, -0.75 };
+	const uint32_t quality_flags[] = { 0, 0, 1, 1, 0 };
+	CPPUNIT_ASSERT_EQUAL(27, (int) decoded.radiometer.horn);
+	CPPUNIT_ASSERT_EQUAL(91, (int) decoded.od);
+	CPPUNIT_ASSERT_EQUAL((size_t) 5, decoded.obt_times.size());
+	CPPUNIT_ASSERT_EQUAL((size_t) 5, decoded.quality_flags.size());
+	for(size_t idx = 0; idx < 5; ++idx) {
+	    CPPUNIT_ASSERT_EQUAL(obt_times[idx], decoded.obt_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(scet_times[idx], decoded.scet_times[idx]);
+	    CPPUNIT_ASSERT_EQUAL(sky_load[idx], decoded.sky_load[idx]);
+	    CPPUNIT_ASSERT_EQUAL(quality_flags[idx], decoded.quality_flags[idx]);
+	}
+
+	Squeezer_buffer_info_t info;
+	read_buffer_info(bytes.data(), bytes.size(), info);
+	CPPUNIT_ASSERT_EQUAL((size_t) 5, info.number_of_samples);
+
+	// The headers are shorter than in newer files
+	FILE * f = fopen("./delete_me.bin", "wb");
+	fwrite(bytes.data(), 1, bytes.size(), f);
+	fclose(f);
+
+	f = fopen("./delete_me.bin", "rb");
+	Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	file_header.read_from_file(f);
+	CPPUNIT_ASSERT(file_header.is_valid());
+	CPPUNIT_ASSERT(file_header.is_compatible_version());
+	CPPUNIT_ASSERT_EQUAL((int) UNVERSIONED_FILE_VERSION,
+			     (int) file_header.program_version);
+	CPPUNIT_ASSERT_EQUAL((long) Squeezer_file_header_t::SIZE_WITHOUT_VERSION,
+			     ftell(f));
+
+	std::vector<Squeezer_chunk_header_t> chunk_headers;
+	read_chunk_headers(f, file_header, chunk_headers);
+	CPPUNIT_ASSERT_EQUAL((size_t) 4, chunk_headers.size());
+	CPPUNIT_ASSERT_EQUAL((uint32_t) CHUNK_QUALITY_FLAGS,
+			     chunk_headers[3].chunk_type);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 24, chunk_headers[3].number_of_bytes);
+	CPPUNIT_ASSERT_EQUAL((int) BACKEND_NONE, (int) chunk_headers[3].backend);
+
+	fseek(f, 0, SEEK_SET);
+	CPPUNIT_ASSERT_EQUAL((size_t) 0, verify_file(f));
+	fclose(f);
+    }
+
+    static std::vector<uint8_t> read_whole_file(const char * file_name) {
+	std::vector<uint8_t> result;
+	FILE * f = fopen(file_name, "rb");
+	uint8_t bytes[4096];
+	size_t count;
+	while((count = fread(bytes, 1, sizeof(bytes), f)) > 0)
+	    result.insert(result.end(), bytes, bytes + count);
+	fclose(f);
+
+	return result;
+    }
+
+    void testChunkGroups() {
+	const size_t num_of_samples = datadiff.obt_times.size();
+	params.file_type = SQZ_DIFFERENCED_DATA;
+	params.samples_per_block = 333;
+	// Every group of blocks is saved as soon as it is encoded
+	params.chunk_group_size = 1;
+
+	std::vector<uint8_t> buffer;
+	params.num_of_threads = 4;
+	compress_data_to_buffer(datadiff, params, buffer);
+	check_differenced_data(buffer);
+
+	// With one thread, blocks are encoded without the pipeline
+	std::vector<uint8_t> single_thread_buffer;
+	params.num_of_threads = 1;
+	compress_data_to_buffer(datadiff, params, single_thread_buffer);
+	CPPUNIT_ASSERT(buffer == single_thread_buffer);
+
+	const size_t num_of_blocks = (num_of_samples + 332) / 333;
+	Byte_view_t view(buffer.data(), buffer.size());
+	Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	file_header.read_from_buffer(view);
+	CPPUNIT_ASSERT(file_header.number_of_chunks > 4);
+	CPPUNIT_ASSERT(file_header.number_of_chunks <= 4 * num_of_blocks);
+
+	Squeezer_buffer_info_t info;
+	read_buffer_info(buffer.data(), buffer.size(), info);
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, (size_t) info.number_of_samples);
+
+	FILE * f = fopen("./delete_me.bin", "wb");
+	fwrite(buffer.data(), 1, buffer.size(), f);
+	fclose(f);
+	f = fopen("./delete_me.bin", "rb");
+	CPPUNIT_ASSERT_EQUAL(4 * num_of_blocks, verify_file(f));
+
+	// Statistics are reported once per column
+	std::vector<Squeezer_chunk_header_t> chunk_headers;
+	fseek(f, 0, SEEK_SET);
+	file_header.read_from_file(f);
+	read_chunk_headers(f, file_header, chunk_headers);
+	CPPUNIT_ASSERT_EQUAL((size_t) 4, chunk_headers.size());
+	for(auto & cur_header : chunk_headers)
+	    CPPUNIT_ASSERT_EQUAL(num_of_samples, (size_t) cur_header.number_of_samples);
+
+	fclose(f);
+
+	// Decoding one block at a time must join the chunks as well
+	params.file_type = SQZ_DETECTOR_POINTINGS;
+	compress_data_to_buffer(pointings, params, buffer);
+	f = fopen("./delete_me.bin", "wb");
+	fwrite(buffer.data(), 1, buffer.size(), f);
+	fclose(f);
+
+	std::remove("./delete_me.fits");
+	f = fopen("./delete_me.bin", "rb");
+	Decompression_parameters_t decompression_params;
+	CPPUNIT_ASSERT_EQUAL(num_of_samples,
+			     decompress_file_from_file(f, "./delete_me.fits",
+						       decompression_params));
+	fclose(f);
+
+	// A file that can be rewound gets its header at the end, while
+	// a file opened for appending is written through a temporary
+	// file: the result must be the same
+	FILE * seekable_file = fopen("./delete_me.sqz", "wb");
+	compress_file_to_file("./delete_me.fits", seekable_file, params);
+	fclose(seekable_file);
+
+	std::remove("./delete_me.bin");
+	FILE * append_file = fopen("./delete_me.bin", "ab");
+	compress_file_to_file("./delete_me.fits", append_file, params);
+	fclose(append_file);
+
+	const std::vector<uint8_t> seekable_bytes = read_whole_file("./delete_me.sqz");
+	CPPUNIT_ASSERT(seekable_bytes == read_whole_file("./delete_me.bin"));
+
+	Byte_view_t input(seekable_bytes.data(), seekable_bytes.size());
+	std::unique_ptr<Data_container_t> data(decompress_from_buffer(input, decompression_params));
+	CPPUNIT_ASSERT(data.get() != NULL);
+	CPPUNIT_ASSERT_EQUAL(num_of_samples, data->obt_times.size());
+	CPPUNIT_ASSERT_EQUAL(pointings.obt_times.back(), data->obt_times.back());
+
+	// An OBT range must select the blocks across chunk boundaries
+	decompression_params.obt_range_flag = true;
+	decompression_params.first_obt = datadiff.obt_times[1000];
+	decompression_params.last_obt = datadiff.obt_times[2700];
+	input = Byte_view_t(seekable_bytes.data(), seekable_bytes.size());
+	data.reset(decompress_from_buffer(input, decompression_params));
+	CPPUNIT_ASSERT_EQUAL((size_t) 1701, data->obt_times.size());
+	CPPUNIT_ASSERT_EQUAL(datadiff.obt_times[1000], data->obt_times.front());
+	CPPUNIT_ASSERT_EQUAL(datadiff.obt_times[2700], data->obt_times.back());
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Block_test");
+	suite->addTest(new CppUnit::TestCaller<Block_test>(
+			   "testBlockSizes",
+			   &Block_test::testBlockSizes));
+	suite->addTest(new CppUnit::TestCaller<Block_test>(
+			   "testOldFile",
+			   &Block_test::testOldFile));
+	suite->addTest(new CppUnit::TestCaller<Block_test>(
+			   "testVersion10File",
+			   &Block_test::testVersion10File));
+	suite->addTest(new CppUnit::TestCaller<Block_test>(
+			   "testChunkGroups",
+			   &Block_test::testChunkGroups));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
+class Serve_test : public CppUnit::TestFixture {
+    // Both ends of a connected socket
+    int fds[2];
+
+public:
+    void setUp() {
+	CPPUNIT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    }
+
+    void tearDown() {
+	close(fds[0]);
+	if(fds[1] >= 0)
+	    close(fds[1]);
+    }
+
+    void close_writer() {
+	close(fds[1]);
+	fds[1] = -1;
+    }
+
+    void write_uint32(uint32_t value) {
+	const uint32_t big_endian_value = htonl(value);
+	CPPUNIT_ASSERT_EQUAL((ssize_t) sizeof(value),
+			     write(fds[1], &big_endian_value, sizeof(value)));
+    }
+
+    void testFraming() {
+	std::vector<std::string> message {
+	    "squeezer-1", "", std::string("a\0b\n", 4), "compress"
+	};
+	write_message(fds[1], message);
+	write_message(fds[1], std::vector<std::string>());
+
+	std::vector<std::string> result;
+	CPPUNIT_ASSERT(read_message(fds[0], result));
+	CPPUNIT_ASSERT(message == result);
+	CPPUNIT_ASSERT(read_message(fds[0], result));
+	CPPUNIT_ASSERT(result.empty());
+
+	// A connection closed between two messages is not an error
+	close_writer();
+	CPPUNIT_ASSERT(! read_message(fds[0], result));
+    }
+
+    void testTruncatedMessage() {
+	write_uint32(2);
+	write_uint32(3);
+	CPPUNIT_ASSERT_EQUAL((ssize_t) 2, write(fds[1], "ab", 2));
+	close_writer();
+
+	std::vector<std::string> result;
+	CPPUNIT_ASSERT_THROW(read_message(fds[0], result), std::runtime_error);
+    }
+
+    void testTooManyFields() {
+	write_uint32(MAX_MESSAGE_SIZE);
+
+	std::vector<std::string> result;
+	CPPUNIT_ASSERT_THROW(read_message(fds[0], result), std::runtime_error);
+    }
+
+    void testTooLongFields() {
+	// The size of a field is checked before reading its bytes, so
+	// they are never sent
+	write_uint32(3);
+	write_uint32(1);
+	CPPUNIT_ASSERT_EQUAL((ssize_t) 1, write(fds[1], "a", 1));
+	write_uint32(MAX_MESSAGE_SIZE);
+
+	std::vector<std::string> result;
+	CPPUNIT_ASSERT_THROW(read_message(fds[0], result), std::runtime_error);
+
+	const std::vector<std::string> message { std::string(MAX_MESSAGE_SIZE, 'x') };
+	CPPUNIT_ASSERT_THROW(write_message(fds[1], message), std::runtime_error);
+    }
+
+    void testPath() {
+	Command_context_t context;
+	CPPUNIT_ASSERT_EQUAL(std::string("a.fits"), context.path("a.fits"));
+
+	context.working_directory = "/home/user";
+	CPPUNIT_ASSERT_EQUAL(std::string("/home/user/a.fits"), context.path("a.fits"));
+	CPPUNIT_ASSERT_EQUAL(std::string("!/home/user/dir/a.fits"),
+			     context.path("!dir/a.fits"));
+	CPPUNIT_ASSERT_EQUAL(std::string("/data/a.fits"), context.path("/data/a.fits"));
+	CPPUNIT_ASSERT_EQUAL(std::string("!/data/a.fits"), context.path("!/data/a.fits"));
+	CPPUNIT_ASSERT_EQUAL(std::string("!"), context.path("!"));
+	CPPUNIT_ASSERT_EQUAL(std::string(""), context.path(""));
+	CPPUNIT_ASSERT_EQUAL(std::string("TOODI%a%b"), context.path("TOODI%a%b"));
+	CPPUNIT_ASSERT_EQUAL(std::string("ftp://host/a.fits"),
+			     context.path("ftp://host/a.fits"));
+	CPPUNIT_ASSERT_EQUAL(std::string("-"), context.path("-"));
+
+	context.standard_streams_flag = false;
+	CPPUNIT_ASSERT_THROW(context.path("-"), std::runtime_error);
+	CPPUNIT_ASSERT_EQUAL(std::string("/home/user/-a"), context.path("-a"));
+    }
+
+    static CppUnit::Test * suite() {
+	CppUnit::TestSuite * suite = new CppUnit::TestSuite("Serve_test");
+	suite->addTest(new CppUnit::TestCaller<Serve_test>(
+			   "testFraming",
+			   &Serve_test::testFraming));
+	suite->addTest(new CppUnit::TestCaller<Serve_test>(
+			   "testTruncatedMessage",
+			   &Serve_test::testTruncatedMessage));
+	suite->addTest(new CppUnit::TestCaller<Serve_test>(
+			   "testTooManyFields",
+			   &Serve_test::testTooManyFields));
+	suite->addTest(new CppUnit::TestCaller<Serve_test>(
+			   "testTooLongFields",
+			   &Serve_test::testTooLongFields));
+	suite->addTest(new CppUnit::TestCaller<Serve_test>(
+			   "testPath",
+			   &Serve_test::testPath));
+	return suite;
+    }
+};
+
+////////////////////////////////////////////////////////////////////
+
 int
 main(void)
 {
@@ -641,8 +2538,21 @@ main(void)
     runner.addTest(Bytestream_test::suite());
     runner.addTest(Frequency_table_test::suite());
     runner.addTest(RLE_test::suite());
+    runner.addTest(Rice_test::suite());
+    runner.addTest(Arithmetic_coder_test::suite());
+    runner.addTest(Shuffle_test::suite());
+    runner.addTest(Backend_test::suite());
     runner.addTest(Poly_fit_encoder_test::suite());
     runner.addTest(Byte_buffer_test::suite());
+    runner.addTest(Bit_stream_test::suite());
+    runner.addTest(Byte_buffer_pool_test::suite());
+    runner.addTest(Crc32c_test::suite());
+    runner.addTest(Bounded_queue_test::suite());
+    runner.addTest(Balance_test::suite());
+    runner.addTest(Batch_state_test::suite());
+    runner.addTest(Memory_codec_test::suite());
+    runner.addTest(Block_test::suite());
+    runner.addTest(Serve_test::suite());
     runner.addTest(File_IO_test::suite());
     runner.run();
     return 0;
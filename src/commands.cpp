@@ -0,0 +1,746 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+
+#include "data_structures.hpp"
+#include "backends.hpp"
+#include "batch_state.hpp"
+#include "commands.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "common_defs.hpp"
+#include "parallel.hpp"
+#include "tasks.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+Command_context_t::path(const std::string & file_name) const
+{
+    if(file_name == "-" && ! standard_streams_flag)
+	throw std::runtime_error("the standard input and output cannot be "
+				 "used here, please specify a file name");
+
+    if(working_directory.empty() ||
+       file_name.empty() ||
+       file_name == "-" ||
+       file_name.compare(0, 6, "TOODI%") == 0 ||
+       file_name.find("://") != std::string::npos)
+	return file_name;
+
+    const size_t start = (file_name[0] == '!') ? 1 : 0;
+    if(start == file_name.size() || file_name[start] == '/')
+	return file_name;
+
+    return file_name.substr(0, start)
+	+ working_directory + "/" + file_name.substr(start);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Start the journal of the lines of "file_name" that will be
+// completed. With "--resume", the lines completed by the previous
+// run are loaded first.
+static void
+open_journal(const std::string & file_name,
+	     const std::string & command,
+	     uint32_t parameters_checksum,
+	     const Batch_options_t & batch_options,
+	     const Command_context_t & context,
+	     Batch_journal_t & journal)
+{
+    const std::string journal_file_name = batch_journal_file_name(file_name);
+    std::ostringstream description;
+    description << command << ' ' << std::hex << parameters_checksum;
+
+    if(batch_options.resume &&
+       ! journal.load(journal_file_name, description.str())) {
+	context.log() << PROGRAM_NAME
+		      << ": there is no journal of a previous \""
+		      << command
+		      << "\" run with the same options, all the files in "
+		      << file_name
+		      << " will be processed\n";
+    }
+
+    try {
+	journal.open(journal_file_name, description.str());
+    }
+    catch(std::runtime_error & exc) {
+	context.log() << PROGRAM_NAME
+		      << ": "
+		      << exc.what()
+		      << ", it will not be possible to use --resume\n";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// The journal is useless once all the lines have been completed
+static void
+close_journal(size_t num_of_failed_jobs,
+	      const Command_context_t & context,
+	      Batch_journal_t & journal)
+{
+    if(num_of_failed_jobs == 0) {
+	journal.remove();
+    } else if(journal.is_open()) {
+	context.log() << PROGRAM_NAME
+		      << ": use --resume to process only the files that were "
+		      << "not completed\n";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Compress the files listed in "file_name", running up to
+// "batch_options.num_of_threads" of them at the same time (zero means
+// one per core). A file that cannot be compressed does not stop the
+// others. In incremental mode, lines whose output is up to date are
+// skipped; with --resume, so are the lines completed by the previous
+// run. Return the number of files that could not be compressed.
+static size_t
+compress_using_a_parameter_file(const std::string & file_name,
+				const Batch_options_t & batch_options,
+				Compression_parameters_t & params,
+				const Command_context_t & context)
+{
+    if(params.verbose_flag) {
+      context.log() << PROGRAM_NAME
+		    << ": reading the list of files from "
+		    << file_name
+		    << '\n';
+    }
+
+    std::vector<Parameter_file_line_t> jobs;
+    read_parameter_file(file_name, jobs);
+    const unsigned int num_of_jobs =
+	number_of_fits_jobs(batch_options.num_of_threads, context.log());
+
+    Batch_state_t state;
+    const std::string state_file_name = batch_state_file_name(file_name);
+    const uint32_t parameters_checksum = compression_parameters_checksum(params);
+    if(batch_options.incremental) {
+	try {
+	    state.load(state_file_name);
+	}
+	catch(std::runtime_error & exc) {
+	    context.log() << PROGRAM_NAME
+			  << ": "
+			  << exc.what()
+			  << ", all the files will be compressed\n";
+	}
+    }
+
+    Batch_journal_t journal;
+    open_journal(file_name, "compress", parameters_checksum,
+		 batch_options, context, journal);
+
+    // When many files are compressed at the same time, each of them
+    // uses just one thread to encode its blocks
+    const bool parallel_jobs = (num_of_jobs != 1);
+    size_t num_of_failed_jobs = 0;
+    size_t num_of_skipped_jobs = 0;
+    std::mutex output_mutex;
+
+    parallel_for(jobs.size(), num_of_jobs,
+		 [&](size_t idx) {
+		     Parameter_file_line_t job(jobs[idx]);
+		     Compression_parameters_t job_params(params);
+		     std::ostringstream job_log;
+		     std::string error_message;
+		     bool job_failed = false;
+		     bool job_skipped = false;
+
+		     // Verbose messages are printed together once the
+		     // job is over, so that they do not get mixed
+		     job_params.log_stream = &job_log;
+		     if(parallel_jobs)
+			 job_params.num_of_threads = 1;
+
+		     File_signature_t input;
+		     bool track_job = false;
+
+		     try {
+			 job.input_file_name = context.path(job.input_file_name);
+			 job.output_file_name = context.path(job.output_file_name);
+
+			 // TOODI objects and the standard output are never
+			 // considered up to date
+			 track_job = batch_options.incremental &&
+			     job.output_file_name != "-" &&
+			     read_file_status(job.input_file_name, input);
+
+			 if(job.output_file_name.empty())
+			     throw std::runtime_error("expected RADIOMETER OD "
+						      "INPUT_FILE OUTPUT_FILE");
+			 if(parallel_jobs && job.output_file_name == "-")
+			     throw std::runtime_error("standard output cannot be "
+						      "used when files are compressed "
+						      "in parallel");
+
+			 if(batch_options.resume && journal.is_completed(job)) {
+			     job_skipped = true;
+			     if(params.verbose_flag) {
+				 job_log << PROGRAM_NAME
+					 << ": \""
+					 << job.output_file_name
+					 << "\" was completed by the previous run\n";
+			     }
+			 } else if(track_job &&
+				   state.is_up_to_date(job, parameters_checksum, input)) {
+			     job_skipped = true;
+			     if(params.verbose_flag) {
+				 job_log << PROGRAM_NAME
+					 << ": \""
+					 << job.output_file_name
+					 << "\" is up to date\n";
+			     }
+			     journal.record(job);
+			 } else {
+			     run_compression_task_for_one_file(job.radiometer_str,
+							       job.od_str,
+							       job.input_file_name,
+							       job.output_file_name,
+							       job_params);
+			     if(track_job)
+				 state.update(job, parameters_checksum, input);
+			     journal.record(job);
+			 }
+		     }
+		     catch(std::exception & exc) {
+			 error_message = exc.what();
+			 job_failed = true;
+			 state.forget(job);
+		     }
+
+		     std::lock_guard<std::mutex> lock(output_mutex);
+		     context.log() << job_log.str();
+		     if(job_failed) {
+			 context.log() << PROGRAM_NAME
+				       << ": "
+				       << file_name
+				       << ", line "
+				       << job.line_number
+				       << ": unable to compress \""
+				       << job.input_file_name
+				       << "\": "
+				       << error_message
+				       << '\n';
+			 num_of_failed_jobs++;
+		     }
+		     if(job_skipped)
+			 num_of_skipped_jobs++;
+		 });
+
+    if(batch_options.incremental) {
+	try {
+	    state.save(state_file_name);
+	}
+	catch(std::runtime_error & exc) {
+	    context.log() << PROGRAM_NAME
+			  << ": "
+			  << exc.what()
+			  << '\n';
+	}
+    }
+
+    if(params.verbose_flag) {
+      context.log() << PROGRAM_NAME
+		    << ": "
+		    << jobs.size() - num_of_failed_jobs
+		    << " objects specified in file "
+		    << file_name
+		    << " have been processed ("
+		    << num_of_skipped_jobs
+		    << " skipped), "
+		    << num_of_failed_jobs
+		    << " failed.\n";
+    }
+
+    close_journal(num_of_failed_jobs, context, journal);
+    return num_of_failed_jobs;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+compress_command(const std::vector<std::string> & list_of_arguments,
+		 const Command_context_t & context)
+{
+    Compression_parameters_t params;
+    Batch_options_t batch_options;
+
+    params.log_stream = context.log_stream;
+    params.num_of_threads = context.default_num_of_threads;
+    params.use_temporary_files = context.use_temporary_files;
+    const size_t cur_argument =
+	parse_compression_flags(list_of_arguments, params, batch_options);
+
+    if(list_of_arguments.size() - cur_argument != 4 &&
+       list_of_arguments.size() - cur_argument != 1) {
+	throw std::runtime_error("wrong number of arguments. "
+				 "Run \"squeezer help compress\".");
+    }
+
+    if(list_of_arguments.size() - cur_argument == 1) {
+	const std::string file_name =
+	    context.path(list_of_arguments.at(cur_argument));
+	try {
+	    if(compress_using_a_parameter_file(file_name,
+					       batch_options,
+					       params,
+					       context) > 0)
+		return 1;
+	}
+	catch(std::runtime_error & exc) {
+	    context.log() << PROGRAM_NAME << ": " << exc.what() << '\n';
+	    return 1;
+	}
+
+	return 0;
+    }
+
+    if(batch_options.incremental || batch_options.resume) {
+	throw std::runtime_error("--incremental and --resume can only be "
+				 "used with a parameter file");
+    }
+
+    // There is just one file, so all the threads encode its blocks
+    if(batch_options.num_of_threads_specified)
+	params.num_of_threads = batch_options.num_of_threads;
+
+    const std::string input_file_name = list_of_arguments.at(cur_argument + 2);
+    try {
+	run_compression_task_for_one_file(list_of_arguments.at(cur_argument),
+					  list_of_arguments.at(cur_argument + 1),
+					  context.path(input_file_name),
+					  context.path(list_of_arguments.at(cur_argument + 3)),
+					  params);
+    }
+    catch(std::runtime_error & exc) {
+	context.log() << PROGRAM_NAME
+		      << ": unable to compress \""
+		      << input_file_name
+		      << "\": "
+		      << exc.what()
+		      << '\n';
+	return 1;
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decompress the files listed in "file_name", running up to
+// "num_of_jobs" of them at the same time (zero means one per core).
+// The file has the same format used by "squeezer compress", but
+// INPUT_FILE is the compressed file and OUTPUT_FILE is the FITS file
+// to create. Every file is decoded one block at a time, so the memory
+// used grows with the number of jobs but not with the size of the
+// files. Return the number of files that could not be decompressed.
+static size_t
+decompress_using_a_parameter_file(const std::string & file_name,
+				  const Batch_options_t & batch_options,
+				  const Decompression_parameters_t & params,
+				  const Command_context_t & context)
+{
+    std::vector<Parameter_file_line_t> jobs;
+    read_parameter_file(file_name, jobs);
+    const unsigned int num_of_jobs =
+	number_of_fits_jobs(batch_options.num_of_threads, context.log());
+
+    Batch_journal_t journal;
+    open_journal(file_name, "decompress",
+		 decompression_parameters_checksum(params),
+		 batch_options, context, journal);
+
+    // When many files are decompressed at the same time, each of them
+    // uses just one thread to decode its blocks
+    const bool parallel_jobs = (num_of_jobs != 1);
+    size_t num_of_failed_jobs = 0;
+    size_t num_of_skipped_jobs = 0;
+    uint64_t total_num_of_rows = 0;
+    uint64_t total_input_size = 0;
+    std::mutex output_mutex;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    parallel_for(jobs.size(), num_of_jobs,
+		 [&](size_t idx) {
+		     Parameter_file_line_t job(jobs[idx]);
+		     Decompression_parameters_t job_params(params);
+		     std::ostringstream job_log;
+		     std::string error_message;
+		     bool job_failed = false;
+		     bool job_skipped = false;
+		     size_t num_of_rows = 0;
+
+		     job_params.log_stream = &job_log;
+		     if(parallel_jobs)
+			 job_params.num_of_threads = 1;
+
+		     try {
+			 if(job.output_file_name.empty())
+			     throw std::runtime_error("expected RADIOMETER OD "
+						      "INPUT_FILE OUTPUT_FILE");
+			 if(job.input_file_name == "-")
+			     throw std::runtime_error("standard input cannot be "
+						      "used in a parameter file");
+
+			 job.input_file_name = context.path(job.input_file_name);
+			 job.output_file_name = context.path(job.output_file_name);
+
+			 if(batch_options.resume && journal.is_completed(job)) {
+			     job_skipped = true;
+			 } else {
+			     num_of_rows =
+				 run_decompression_task_for_one_file(job.input_file_name,
+								     job.output_file_name,
+								     job_params);
+			     journal.record(job);
+			 }
+		     }
+		     catch(std::exception & exc) {
+			 error_message = exc.what();
+			 job_failed = true;
+		     }
+
+		     std::lock_guard<std::mutex> lock(output_mutex);
+		     context.log() << job_log.str();
+		     if(job_failed) {
+			 context.log() << PROGRAM_NAME
+				       << ": "
+				       << file_name
+				       << ", line "
+				       << job.line_number
+				       << ": unable to decompress \""
+				       << job.input_file_name
+				       << "\": "
+				       << error_message
+				       << '\n';
+			 num_of_failed_jobs++;
+		     } else if(job_skipped) {
+			 num_of_skipped_jobs++;
+		     } else {
+			 total_num_of_rows += num_of_rows;
+			 total_input_size += size_of_file(job.input_file_name);
+		     }
+		 });
+
+    const std::chrono::duration<double> elapsed_time =
+	std::chrono::steady_clock::now() - start_time;
+    const double seconds = std::max(elapsed_time.count(), 1e-6);
+    const double megabytes = total_input_size / (1024.0 * 1024.0);
+
+    context.log() << PROGRAM_NAME
+		  << ": "
+		  << jobs.size() - num_of_failed_jobs - num_of_skipped_jobs
+		  << " files decompressed ("
+		  << num_of_failed_jobs
+		  << " failed, "
+		  << num_of_skipped_jobs
+		  << " skipped) in "
+		  << std::fixed << std::setprecision(1)
+		  << seconds
+		  << " s: "
+		  << megabytes
+		  << " MB read ("
+		  << megabytes / seconds
+		  << " MB/s), "
+		  << total_num_of_rows
+		  << " rows written ("
+		  << std::setprecision(0)
+		  << total_num_of_rows / seconds
+		  << " rows/s)\n";
+
+    close_journal(num_of_failed_jobs, context, journal);
+    return num_of_failed_jobs;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+decompress_command(const std::vector<std::string> & list_of_arguments,
+		   bool extract_flag,
+		   const Command_context_t & context)
+{
+    Decompression_parameters_t params;
+    Batch_options_t batch_options;
+
+    params.log_stream = context.log_stream;
+    params.num_of_threads = context.default_num_of_threads;
+    const size_t cur_argument =
+	parse_decompression_flags(list_of_arguments, extract_flag, params,
+				  batch_options);
+
+    if(list_of_arguments.size() - cur_argument == 1) {
+	const std::string file_name =
+	    context.path(list_of_arguments.at(cur_argument));
+	try {
+	    if(decompress_using_a_parameter_file(file_name,
+						 batch_options,
+						 params,
+						 context) > 0)
+		return 1;
+	}
+	catch(std::runtime_error & exc) {
+	    context.log() << PROGRAM_NAME << ": " << exc.what() << '\n';
+	    return 1;
+	}
+
+	return 0;
+    }
+
+    if(list_of_arguments.size() - cur_argument != 2) {
+	throw std::runtime_error(std::string("wrong number of arguments. "
+					     "Run \"squeezer help ")
+				 + (extract_flag ? "extract" : "decompress")
+				 + "\".");
+    }
+
+    if(batch_options.resume)
+	throw std::runtime_error("--resume can only be used with a parameter file");
+
+    // There is just one file, so all the threads decode its blocks
+    if(batch_options.num_of_threads_specified)
+	params.num_of_threads = batch_options.num_of_threads;
+
+    const std::string output_file_name = list_of_arguments.at(cur_argument + 1);
+    try {
+	run_decompression_task_for_one_file(context.path(list_of_arguments.at(cur_argument)),
+					    context.path(output_file_name),
+					    params);
+    }
+    catch(std::runtime_error & exc) {
+	context.log() << PROGRAM_NAME
+		      << ": unable to write file \""
+		      << output_file_name
+		      << "\": "
+		      << exc.what()
+		      << '\n';
+	return 1;
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+dump_file_header(FILE * out,
+		 const Squeezer_file_header_t & file_header)
+{
+    std::fprintf(out, "File format version: %d.%d (0x%04x)\n",
+		 MAJOR_VERSION_FROM_UINT16(file_header.program_version),
+		 MINOR_VERSION_FROM_UINT16(file_header.program_version),
+		 file_header.program_version);
+
+    std::fprintf(out, "Creation date: %04d-%02d-%02d %02d:%02d:%02d\n",
+		 file_header.date_year,
+		 file_header.date_month,
+		 file_header.date_day,
+		 file_header.time_hour,
+		 file_header.time_minute,
+		 file_header.time_second);
+
+    std::fprintf(out, "Radiometer: %s\n", file_header.radiometer.to_str().c_str());
+    std::fprintf(out, "Operational day: %d\n", file_header.od);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+sensible_size(uint32_t size)
+{
+    std::stringstream ss;
+    std::vector<std::string> measure_units { "bytes", "kB", "MB", "GB", "TB" };
+
+    uint32_t scaled_size = size;
+    auto cur_unit = measure_units.begin();
+    while(1) {
+	if(cur_unit + 1 == measure_units.end() || scaled_size < 1024) {
+
+	    ss << scaled_size << ' ' << *cur_unit;
+	    break;
+
+	}
+
+	scaled_size /= 1024;
+	++cur_unit;
+    }
+
+    if(scaled_size != size) {
+
+	ss << " (" << size << " bytes)";
+    }
+
+    return ss.str();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+dump_toc_entry(FILE * out,
+	       size_t index,
+	       const Toc_entry_t & entry)
+{
+    std::fprintf(out, "Chunk #%lu: ", index + 1);
+    switch(entry.chunk_type) {
+    case CHUNK_DELTA_OBT:
+	std::fprintf(out, "OBT times (consecutive differences)\n");
+	break;
+    case CHUNK_SCET_ERROR:
+	std::fprintf(out, "SCET times (deviation from linear interpolation with OBT times)\n");
+	break;
+    case CHUNK_THETA:
+	std::fprintf(out, "theta angle (polynomial compression)\n");
+	break;
+    case CHUNK_PHI:
+	std::fprintf(out, "phi angle (polynomial compression)\n");
+	break;
+    case CHUNK_PSI:
+	std::fprintf(out, "psi angle (polynomial compression)\n");
+	break;
+    case CHUNK_DIFFERENCED_DATA:
+	std::fprintf(out, "Scientific data (differenced)\n");
+	break;
+    case CHUNK_QUALITY_FLAGS:
+	std::fprintf(out, "Scientific flags\n");
+	break;
+    default:
+	std::fprintf(out, "Unknown chunk type, I will skip it.\n");
+	return;
+    }
+
+    std::fprintf(out, "    Position in the file: %llu\n",
+		 (unsigned long long) entry.offset);
+    std::fprintf(out, "    Size of the chunk: %s\n",
+		 sensible_size(entry.number_of_bytes).c_str());
+    std::fprintf(out, "    Number of samples: %u\n",
+		 entry.number_of_samples);
+
+    std::fprintf(out, "    Backend compressor: %s\n",
+		 backend_name(static_cast<Backend_type_t>(entry.backend)).c_str());
+
+    switch(entry.filter) {
+    case FILTER_NONE:
+	std::fprintf(out, "    Filter: none\n");
+	break;
+    case FILTER_BYTE_SHUFFLE:
+	std::fprintf(out, "    Filter: byte shuffle\n");
+	break;
+    case FILTER_BIT_SHUFFLE:
+	std::fprintf(out, "    Filter: bit shuffle\n");
+	break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+statistics_command(const std::vector<std::string> & list_of_arguments,
+		   const Command_context_t & context)
+{
+    if(list_of_arguments.empty()) {
+	throw std::runtime_error("you must supply at least one file name on "
+				 "the command line. Run \"squeezer help "
+				 "statistics\" for more information.");
+    }
+    const std::string input_file_name = list_of_arguments.at(0);
+
+    FILE * input_file = std::fopen(context.path(input_file_name).c_str(), "rb");
+    if(input_file == NULL) {
+
+	context.log() << PROGRAM_NAME
+		      << ": unable to open file \""
+		      << input_file_name
+		      << "\", reason:\n";
+	context.log() << PROGRAM_NAME
+		      << ": "
+		      << std::strerror(errno)
+		      << '\n';
+	return 1;
+
+    }
+
+    Squeezer_file_header_t file_header(SQZ_NO_DATA);
+    bool truncated_header = false;
+    try {
+	file_header.read_from_file(input_file);
+    }
+    catch(std::runtime_error & exc) {
+	truncated_header = true;
+    }
+
+    if(truncated_header || ! file_header.is_valid()) {
+	context.log() << PROGRAM_NAME
+		      << ": file \""
+		      << input_file_name
+		      << "\" does not seem to have been created by \"squeezer\".\n";
+	std::fclose(input_file);
+	return 1;
+    }
+
+    if(! file_header.is_compatible_version()) {
+	context.log() << PROGRAM_NAME
+		      << ": file \""
+		      << input_file_name
+		      << "\" has been created by an incompatible version of \"squeezer\".\n";
+	std::fclose(input_file);
+	return 1;
+    }
+
+    dump_file_header(context.output, file_header);
+
+    Squeezer_toc_t toc;
+    try {
+	read_table_of_contents(input_file, file_header, toc);
+    }
+    catch(std::runtime_error & exc) {
+	context.log() << PROGRAM_NAME
+		      << ": file \""
+		      << input_file_name
+		      << "\" seems to have been damaged: "
+		      << exc.what()
+		      << ".\n";
+	std::fclose(input_file);
+	return 1;
+    }
+    std::fclose(input_file);
+
+    for(size_t chunk_idx = 0; chunk_idx < toc.entries.size(); ++chunk_idx)
+	dump_toc_entry(context.output, chunk_idx, toc.entries[chunk_idx]);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef COMMANDS_HPP
+#define COMMANDS_HPP
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The "compress", "decompress", "extract" and "statistics" commands,
+// which are run either from the command line or by "squeezer serve"
+// on behalf of a client
+
+// Where a command reads its files and writes its messages
+struct Command_context_t {
+    // Warnings, errors and verbose messages
+    std::ostream * log_stream;
+    // The output of "statistics"
+    FILE * output;
+    // Relative file names are resolved against this directory. If it
+    // is empty, the current directory of the process is used.
+    std::string working_directory;
+    // Threads used to process a single file when -j is not specified
+    // (zero means one per core). Parameter files are processed one
+    // file at a time unless -j is used.
+    unsigned int default_num_of_threads;
+    // If false, "-" cannot be used to read from the standard input or
+    // to write to the standard output
+    bool standard_streams_flag;
+    // See Compression_parameters_t::use_temporary_files
+    bool use_temporary_files;
+
+    Command_context_t()
+	: log_stream(&std::cerr),
+	  output(stdout),
+	  working_directory(),
+	  default_num_of_threads(0),
+	  standard_streams_flag(true),
+	  use_temporary_files(true) {}
+
+    std::ostream & log() const {
+	return *log_stream;
+    }
+
+    // Return "file_name" prefixed by the working directory, unless it
+    // is absolute or it is not the name of a local file ("-", TOODI
+    // objects, URLs). A leading "!" (used to overwrite FITS files) is
+    // kept in front. Throw a std::runtime_error if "file_name" is "-"
+    // and "standard_streams_flag" is false.
+    std::string path(const std::string & file_name) const;
+};
+
+// Each command takes its arguments without the name of the command
+// and returns the exit status of the program. Errors in the
+// arguments are reported by throwing a std::runtime_error; all the
+// other errors are written to "context.log()".
+int compress_command(const std::vector<std::string> & list_of_arguments,
+		     const Command_context_t & context);
+
+// If "extract_flag" is true, this implements the "extract" command,
+// which requires the --obt-range flag
+int decompress_command(const std::vector<std::string> & list_of_arguments,
+		       bool extract_flag,
+		       const Command_context_t & context);
+
+int statistics_command(const std::vector<std::string> & list_of_arguments,
+		       const Command_context_t & context);
+
+#endif
@@ -75,3 +75,68 @@ std::string Radiometer_t::to_str() const
 
     return ss.str();
 }
+
+//////////////////////////////////////////////////////////////////////
+
+static const struct {
+    Chunk_type_t type;
+    const char * name;
+} column_names[] = {
+    { CHUNK_DELTA_OBT, "obt" },
+    { CHUNK_SCET_ERROR, "scet" },
+    { CHUNK_THETA, "theta" },
+    { CHUNK_PHI, "phi" },
+    { CHUNK_PSI, "psi" },
+    { CHUNK_DIFFERENCED_DATA, "data" },
+    { CHUNK_QUALITY_FLAGS, "flags" }
+};
+
+bool
+parse_column_name(const std::string & name, Chunk_type_t & type)
+{
+    for(const auto & cur_column : column_names) {
+	if(name == cur_column.name) {
+	    type = cur_column.type;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+column_name(Chunk_type_t type)
+{
+    for(const auto & cur_column : column_names) {
+	if(cur_column.type == type)
+	    return cur_column.name;
+    }
+
+    return "unknown";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+parse_column_list(const std::string & list, unsigned int & mask)
+{
+    mask = 0;
+
+    size_t start = 0;
+    while(true) {
+	const size_t comma_pos = list.find(',', start);
+	Chunk_type_t type;
+	if(! parse_column_name(list.substr(start, comma_pos - start), type))
+	    return false;
+
+	mask |= column_bit(type);
+	if(comma_pos == std::string::npos)
+	    break;
+
+	start = comma_pos + 1;
+    }
+
+    return true;
+}
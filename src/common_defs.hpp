@@ -25,7 +25,29 @@
 #include <cstdint>
 
 #define PROGRAM_NAME "squeezer"
-#define PROGRAM_VERSION 0x0100
+#define PROGRAM_VERSION 0x0106
+
+// Files written by versions of the program older than this one use a
+// different layout and cannot be decompressed, with the exception of
+// version 1.0 (see UNVERSIONED_FILE_VERSION)
+#define OLDEST_COMPATIBLE_VERSION 0x0102
+
+// Version 1.0 saved neither its version number in the file header nor
+// the backend and the filter in the chunk headers. Its files are
+// recognized because the floating-point check follows the file mark.
+#define UNVERSIONED_FILE_VERSION 0x0100
+
+// Starting from this version, the file header contains the position
+// of the table of contents (see Squeezer_toc_t)
+#define FIRST_VERSION_WITH_TOC 0x0104
+
+// Starting from this version, the payload of each chunk is split into
+// blocks (see Squeezer_block_header_t)
+#define FIRST_VERSION_WITH_BLOCKS 0x0105
+
+// Starting from this version, each block header contains the CRC-32C
+// checksum of the block and of the header itself
+#define FIRST_VERSION_WITH_CHECKSUMS 0x0106
 
 #define MAJOR_VERSION_FROM_UINT16(x) ((int) ((x) & 0xFF00) >> 8)
 #define MINOR_VERSION_FROM_UINT16(x) ((int) (x) & 0xFF)
@@ -62,4 +84,43 @@ enum Chunk_type_t {
     CHUNK_QUALITY_FLAGS = 16
 };
 
+// Short names of the columns ("obt", "theta"...), used to specify
+// per-column options on the command line. Return false if "name" is
+// not recognized.
+bool parse_column_name(const std::string & name, Chunk_type_t & type);
+std::string column_name(Chunk_type_t type);
+
+// Sets of columns are represented as bit masks, e.g.
+// column_bit(CHUNK_THETA) | column_bit(CHUNK_PHI)
+inline unsigned int
+column_bit(Chunk_type_t type)
+{
+    return 1U << (type - CHUNK_DELTA_OBT);
+}
+
+const unsigned int ALL_COLUMNS = ~0U;
+
+// Parse a comma-separated list of column names, like "theta,phi".
+// Return false if any of the names is not recognized.
+bool parse_column_list(const std::string & list, unsigned int & mask);
+
+// General-purpose compressor applied to the payload of a chunk, after
+// the domain-specific encoding (run-length, polynomial fitting...)
+enum Backend_type_t {
+    BACKEND_NONE = 0,
+    BACKEND_ARITHMETIC = 1,
+    BACKEND_ZLIB = 2,
+    BACKEND_ZSTD = 3,
+    BACKEND_LZ4 = 4
+};
+
+// Reversible transformation applied to the payload of a chunk before
+// the backend compressor, in order to group together bytes (or bits)
+// with the same significance
+enum Filter_type_t {
+    FILTER_NONE = 0,
+    FILTER_BYTE_SHUFFLE = 1,
+    FILTER_BIT_SHUFFLE = 2
+};
+
 #endif
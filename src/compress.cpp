@@ -18,12 +18,22 @@
  * 02110-1301, USA.
  */
 
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
 #include <cmath>
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <future>
 #include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <gsl/gsl_math.h>
 
@@ -31,13 +41,16 @@
 #include "file_io.hpp"
 #include "run_length_encoding.hpp"
 #include "poly_fit_encoding.hpp"
+#include "backends.hpp"
+#include "byte_buffer_pool.hpp"
+#include "bounded_queue.hpp"
+#include "parallel.hpp"
+#include "shuffle.hpp"
 #include "compress.hpp"
 #include "datadiff.hpp"
 #include "detpoint.hpp"
 #include "data_structures.hpp"
 
-const uint32_t OPTIMAL_CHUNK_SIZE = 128 * 1024 * 1024; // 128 MB
-
 //////////////////////////////////////////////////////////////////////
 
 double
@@ -67,376 +80,1245 @@ initialize_file_header(Squeezer_file_header_t & file_header,
 
 //////////////////////////////////////////////////////////////////////
 
-void
-compress_obt(const std::vector<double> & obt,
-	     FILE * output_file,
-	     const Compression_parameters_t & params)
+// Buffers used to encode chunks are recycled across chunks and files
+static thread_local Byte_buffer_pool_t buffer_pool;
+
+//////////////////////////////////////////////////////////////////////
+
+// Number of samples to put in each block of a column with
+// "num_of_samples" elements
+static size_t
+samples_per_block(size_t num_of_samples,
+		  const Compression_parameters_t & params)
 {
-    std::vector<uint32_t> obt_delta;
-    obt_delta.resize(obt.size() - 1);
-    for(size_t idx = 0; idx < obt_delta.size(); ++idx) {
-	obt_delta[idx] = obt[idx + 1] - obt[idx];
+    size_t result = params.samples_per_block;
+    if(result == 0 || result > num_of_samples)
+	result = num_of_samples;
+
+    // The number of samples must fit in the block header
+    if(result > UINT32_MAX)
+	result = UINT32_MAX;
+
+    return (result > 0) ? result : 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Statistics about the difference between the original samples and
+// the ones that will be reconstructed by the decompressor
+class Error_accumulator_t {
+public:
+    Error_accumulator_t()
+	: num_of_samples(0),
+	  min_abs_error(0.0),
+	  max_abs_error(0.0),
+	  sum_of_abs_errors(0.0),
+	  sum_of_errors(0.0) {}
+
+    void add(double error) {
+	const double abs_error = std::fabs(error);
+	if(num_of_samples == 0 || abs_error < min_abs_error)
+	    min_abs_error = abs_error;
+	if(num_of_samples == 0 || abs_error > max_abs_error)
+	    max_abs_error = abs_error;
+
+	sum_of_abs_errors += abs_error;
+	sum_of_errors += error;
+	num_of_samples++;
     }
 
-    Byte_buffer_t obt_delta_buffer;
-    rle_compression(obt_delta.data(),
-		    obt_delta.size(),
-		    obt_delta_buffer);
+    // Merge the statistics collected by another accumulator
+    void add(const Error_accumulator_t & other) {
+	if(other.num_of_samples == 0)
+	    return;
 
-    Squeezer_chunk_header_t chunk_header;
-    chunk_header.number_of_bytes = obt_delta_buffer.buffer.size();
-    chunk_header.number_of_samples = obt_delta.size();
-    chunk_header.chunk_type = CHUNK_DELTA_OBT;
+	if(num_of_samples == 0 || other.min_abs_error < min_abs_error)
+	    min_abs_error = other.min_abs_error;
+	if(num_of_samples == 0 || other.max_abs_error > max_abs_error)
+	    max_abs_error = other.max_abs_error;
+
+	sum_of_abs_errors += other.sum_of_abs_errors;
+	sum_of_errors += other.sum_of_errors;
+	num_of_samples += other.num_of_samples;
+    }
+
+    void save(Error_t & compression_error) const {
+	compression_error.min_abs_error = min_abs_error;
+	compression_error.max_abs_error = max_abs_error;
+	if(num_of_samples > 0) {
+	    compression_error.mean_abs_error = sum_of_abs_errors / num_of_samples;
+	    compression_error.mean_error = sum_of_errors / num_of_samples;
+	} else {
+	    compression_error.mean_abs_error = 0.0;
+	    compression_error.mean_error = 0.0;
+	}
+    }
+
+private:
+    size_t num_of_samples;
+    double min_abs_error;
+    double max_abs_error;
+    double sum_of_abs_errors;
+    double sum_of_errors;
+};
 
-    chunk_header.compression_error.min_abs_error = 0.0;
-    chunk_header.compression_error.max_abs_error = 0.0;
-    chunk_header.compression_error.mean_abs_error = 0.0;
-    chunk_header.compression_error.mean_error = 0.0;
+//////////////////////////////////////////////////////////////////////
 
-    chunk_header.write_to_file(output_file);
-    obt_delta_buffer.write_to_file(output_file);
+// Destination of a compressed file. Chunks are appended as soon as
+// they are complete, but the file header, which contains the number
+// of chunks and the position of the table of contents, can only be
+// written at the end: "finish" puts it in front of the chunks.
+class Compressed_output_t {
+public:
+    virtual ~Compressed_output_t() {}
 
-    if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME
-		  << ": the size of the OBT times shrunk from "
-		  << obt.size() * sizeof(obt[0])
-		  << " to "
-		  << obt_delta_buffer.buffer.size()
-		  << " bytes (using run-length encoding)\n";
+    virtual void append(const uint8_t * data, size_t size) = 0;
+    virtual void finish(const Squeezer_file_header_t & file_header) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////
 
-	std::cerr << PROGRAM_NAME
-		  << ":     the overall compression factor for OBT times is "
-		  << (obt.size() * sizeof(obt[0])) * (1.0 / obt_delta_buffer.buffer.size())
-		  << '\n';
+// Return true if the file header can be written after the chunks by
+// going back to the beginning of "file"
+static bool
+is_seekable(FILE * file)
+{
+    const int fd = fileno(file);
+    struct stat file_info;
+    if(fd < 0 || fstat(fd, &file_info) != 0 || ! S_ISREG(file_info.st_mode))
+	return false;
+
+    // Files opened for appending are always written at the end
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && (flags & O_APPEND) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Write chunks directly in "output_file", leaving room for the file
+// header, which is written by seeking back once all the chunks are
+// known. If the file cannot be rewound (e.g., it is a pipe), chunks
+// are kept in a temporary file, or in memory if "use_temporary_files"
+// is false, and they are copied after the header at the end.
+class File_output_t : public Compressed_output_t {
+public:
+    File_output_t(FILE * a_output_file, bool use_temporary_files);
+    ~File_output_t() {
+	if(spill_file != NULL)
+	    std::fclose(spill_file);
     }
 
+    virtual void append(const uint8_t * data, size_t size);
+    virtual void finish(const Squeezer_file_header_t & file_header);
+
+private:
+    File_output_t(const File_output_t &);
+    File_output_t & operator=(const File_output_t &);
+
+    FILE * output_file;
+    // Position of the file header, or -1 if "output_file" cannot be
+    // rewound
+    off_t header_offset;
+    FILE * spill_file;
+    Byte_buffer_t memory_chunks;
+    size_t spilled_size;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+File_output_t::File_output_t(FILE * a_output_file, bool use_temporary_files)
+    : output_file(a_output_file),
+      header_offset(is_seekable(a_output_file) ? ftello(a_output_file) : -1),
+      spill_file(NULL),
+      memory_chunks(),
+      spilled_size(0)
+{
+    if(header_offset >= 0) {
+	const std::vector<uint8_t> placeholder(Squeezer_file_header_t::SIZE_IN_BYTES, 0);
+	write_bytes(output_file, placeholder.data(), placeholder.size());
+    } else if(use_temporary_files) {
+	spill_file = std::tmpfile();
+	if(spill_file == NULL)
+	    throw std::runtime_error(std::string("unable to create a temporary file: ")
+				     + std::strerror(errno));
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-estimate_scet_reconstruction_error(const std::vector<double> & scet,
-				   const std::vector<double> & obt,
-				   const std::vector<float> & scet_interp_error,
-				   Error_t & compression_error)
+File_output_t::append(const uint8_t * data, size_t size)
 {
-    const double slope = (scet.back() - scet.front()) / (obt.back() - obt.front());
+    if(header_offset >= 0)
+	write_bytes(output_file, data, size);
+    else if(spill_file != NULL)
+	write_bytes(spill_file, data, size);
+    else
+	memory_chunks.append_data_from_buffer(size, data);
+
+    spilled_size += size;
+}
 
-    compression_error.mean_abs_error = 0.0;
-    compression_error.mean_error = 0.0;
+//////////////////////////////////////////////////////////////////////
 
-    for(size_t idx = 0; idx < scet_interp_error.size(); ++idx) {
-	double reconstructed_scet =
-	    scet.front() + slope * (obt[idx] - obt.front())
-	    + scet_interp_error[idx];
+void
+File_output_t::finish(const Squeezer_file_header_t & file_header)
+{
+    if(header_offset >= 0) {
+	if(fseeko(output_file, header_offset, SEEK_SET) != 0)
+	    throw std::runtime_error(std::strerror(errno));
 
-	double error = reconstructed_scet - scet[idx];
-	double abs_error = fabs(error);
+	file_header.write_to_file(output_file);
 
-	compression_error.mean_abs_error += abs_error;
-	compression_error.mean_error += error;
+	if(fseeko(output_file, 0, SEEK_END) != 0)
+	    throw std::runtime_error(std::strerror(errno));
 
-	if(idx == 0) {
-	    compression_error.min_abs_error = abs_error;
-	    compression_error.max_abs_error = abs_error;
-	} else {
-	    if(abs_error < compression_error.min_abs_error)
-		compression_error.min_abs_error = abs_error;
+	return;
+    }
 
-	    if(abs_error > compression_error.max_abs_error)
-		compression_error.max_abs_error = abs_error;
-	}
+    file_header.write_to_file(output_file);
+    if(spill_file == NULL) {
+	memory_chunks.write_to_file(output_file);
+	return;
     }
 
-    compression_error.mean_abs_error /= scet_interp_error.size();
-    compression_error.mean_error /= scet_interp_error.size();
+    const size_t COPY_BUFFER_SIZE = 1024 * 1024;
+    Pooled_buffer_t copy_buffer(buffer_pool, COPY_BUFFER_SIZE);
+    copy_buffer->buffer.resize(COPY_BUFFER_SIZE);
+
+    if(fseeko(spill_file, 0, SEEK_SET) != 0)
+	throw std::runtime_error(std::strerror(errno));
+
+    for(size_t bytes_left = spilled_size; bytes_left > 0; ) {
+	const size_t count = std::min(bytes_left, COPY_BUFFER_SIZE);
+	read_bytes(spill_file, copy_buffer->buffer.data(), count);
+	write_bytes(output_file, copy_buffer->buffer.data(), count);
+	bytes_left -= count;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
 
+// Write chunks directly at the end of a vector, after the room left
+// for the file header, which is filled by "finish"
+class Buffer_output_t : public Compressed_output_t {
+public:
+    explicit Buffer_output_t(std::vector<uint8_t> & a_output)
+	: output(a_output) {
+	output.assign(Squeezer_file_header_t::SIZE_IN_BYTES, 0);
+    }
+
+    virtual void append(const uint8_t * data, size_t size) {
+	output.insert(output.end(), data, data + size);
+    }
+
+    virtual void finish(const Squeezer_file_header_t & file_header) {
+	file_header.write_to_buffer(output.data());
+    }
+
+private:
+    std::vector<uint8_t> & output;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Collect the blocks of a column, applying the filter and the backend
+// compressor to each of them. "write" saves the blocks collected so
+// far as one chunk, so that a long column is split in several chunks
+// and only the blocks that have not been written yet are kept in
+// memory.
+class Chunk_writer_t {
+public:
+    Chunk_writer_t(Chunk_type_t a_chunk_type,
+		   const Compression_parameters_t & a_params)
+	: params(a_params),
+	  chunk_type(a_chunk_type),
+	  backend(a_params.backend_for(a_chunk_type)),
+	  filter(a_params.filter_for(a_chunk_type)),
+	  pending_blocks(),
+	  pending_samples(0),
+	  pending_errors(),
+	  num_of_chunks(0),
+	  payload_size(0),
+	  raw_size(0) {}
+
+    // Apply the filter and the backend to "block_data", which contains
+    // the encoded samples as produced by the domain-specific encoders
+    // (run-length, polynomial fitting...), and save the result in
+    // "output" after the block header. This can be called by many
+    // threads at the same time.
+    void pack_block(const Byte_buffer_t & block_data,
+		    size_t number_of_samples,
+		    double first_obt,
+		    Byte_buffer_t & output) const;
+
+    // Append a block produced by "pack_block" to the next chunk. The
+    // encoded samples were "encoded_size" bytes long.
+    void add_block(const Byte_buffer_t & packed_block,
+		   size_t number_of_samples,
+		   size_t encoded_size,
+		   const Error_accumulator_t & errors);
+
+    // Size of the blocks that have not been written yet
+    size_t pending_size() const {
+	return pending_blocks.size();
+    }
+
+    // Size of the encoded samples before the filter and the backend
+    // compressor were applied
+    size_t size_of_encoded_samples() const {
+	return raw_size;
+    }
+
+    // Write the pending blocks as one chunk and add it to "toc". If
+    // there are no pending blocks, a chunk is written only if this
+    // column has none yet.
+    void write(Compressed_output_t & output, Squeezer_toc_t & toc);
+
+    void print_statistics() const;
+
+private:
+    Chunk_writer_t(const Chunk_writer_t &);
+    Chunk_writer_t & operator=(const Chunk_writer_t &);
+
+    const Compression_parameters_t & params;
+    Chunk_type_t chunk_type;
+    Backend_choice_t backend;
+    Filter_type_t filter;
+    Byte_buffer_t pending_blocks;
+    size_t pending_samples;
+    Error_accumulator_t pending_errors;
+    size_t num_of_chunks;
+    // Size of the payloads of all the chunks written so far
+    size_t payload_size;
+    size_t raw_size;
+};
+
+//////////////////////////////////////////////////////////////////////
+
 void
-compress_scet(const std::vector<double> & scet,
-	      const std::vector<double> & obt,
-	      FILE * output_file,
-	      const Compression_parameters_t & params)
+Chunk_writer_t::pack_block(const Byte_buffer_t & block_data,
+			   size_t number_of_samples,
+			   double first_obt,
+			   Byte_buffer_t & output) const
 {
-    std::vector<float> scet_interp_error;
-    scet_interp_error.resize(scet.size());
+    Pooled_buffer_t filtered_data(buffer_pool, block_data.size());
+    const Byte_buffer_t * cur_data = &block_data;
+    if(filter != FILTER_NONE) {
+	apply_filter(filter, block_data, *filtered_data);
+	cur_data = &(*filtered_data);
+    }
 
-    const double slope = (scet.back() - scet.front()) / (obt.back() - obt.front());
-    for(size_t idx = 0; idx < scet.size(); ++idx) {
+    Squeezer_block_header_t block_header;
+    block_header.number_of_samples = number_of_samples;
+    block_header.first_obt = first_obt;
+
+    // The size of the block is not known until the backend has done
+    // its job, so the header is written twice
+    output.buffer.clear();
+    output.cur_position = 0;
+    block_header.append_to_buffer(output);
+
+    // Blocks are already encoded in parallel (see
+    // Compression_pipeline_t), or inline when just one thread has
+    // been requested, so the backend must not start threads of its own
+    if(backend.type == BACKEND_NONE)
+	output.append_data_from_buffer(cur_data->size(), cur_data->buffer.data());
+    else
+	backend_compression(backend, *cur_data, output, 1);
+
+    const size_t block_size = output.size() - Squeezer_block_header_t::SIZE_IN_BYTES;
+    if(block_size > UINT32_MAX)
+	throw std::runtime_error("block too large, use a smaller block size");
+    block_header.number_of_bytes = block_size;
+    block_header.checksum =
+	block_header.compute_checksum(output.buffer.data()
+				      + Squeezer_block_header_t::SIZE_IN_BYTES);
+
+    Byte_buffer_t header_bytes;
+    block_header.append_to_buffer(header_bytes);
+    std::copy(header_bytes.buffer.begin(), header_bytes.buffer.end(),
+	      output.buffer.begin());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Chunk_writer_t::add_block(const Byte_buffer_t & packed_block,
+			  size_t number_of_samples,
+			  size_t encoded_size,
+			  const Error_accumulator_t & errors)
+{
+    pending_blocks.append_data_from_buffer(packed_block.size(),
+					   packed_block.buffer.data());
+    pending_samples += number_of_samples;
+    pending_errors.add(errors);
+    raw_size += encoded_size;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Chunk_writer_t::write(Compressed_output_t & output, Squeezer_toc_t & toc)
+{
+    if(pending_samples == 0 && num_of_chunks > 0)
+	return;
+
+    if(pending_samples > UINT32_MAX)
+	throw std::runtime_error("too many samples in one chunk, "
+				 "use a smaller chunk group size");
+
+    Squeezer_chunk_header_t chunk_header;
+    chunk_header.chunk_type = chunk_type;
+    chunk_header.backend = backend.type;
+    chunk_header.filter = filter;
+    chunk_header.number_of_samples = pending_samples;
+    chunk_header.number_of_bytes = pending_blocks.size();
+    pending_errors.save(chunk_header.compression_error);
+
+    uint8_t header_bytes[Squeezer_chunk_header_t::SIZE_IN_BYTES];
+    chunk_header.write_to_buffer(header_bytes);
+    output.append(header_bytes, sizeof(header_bytes));
+    output.append(pending_blocks.buffer.data(), pending_blocks.size());
+    toc.add_chunk(chunk_header);
+
+    num_of_chunks++;
+    payload_size += pending_blocks.size();
+
+    // The memory is reused by the next chunk
+    pending_blocks.buffer.clear();
+    pending_blocks.cur_position = 0;
+    pending_samples = 0;
+    pending_errors = Error_accumulator_t();
+}
 
-	double interpolated_scet =
-	    scet.front() + slope * (obt[idx] - obt.front());
-	scet_interp_error[idx] = scet[idx] - interpolated_scet;
+//////////////////////////////////////////////////////////////////////
 
+void
+Chunk_writer_t::print_statistics() const
+{
+    if(num_of_chunks > 1) {
+	params.log() << PROGRAM_NAME
+		     << ":     the column has been split in "
+		     << num_of_chunks
+		     << " chunks\n";
     }
 
-    Byte_buffer_t buffer;
-    for(auto value : scet_interp_error) {
-	buffer.append_float(value);
+    if(backend.type != BACKEND_NONE) {
+	params.log() << PROGRAM_NAME
+		     << ":     backend \""
+		     << backend_name(backend.type)
+		     << "\" further reduced the column to "
+		     << payload_size
+		     << " bytes (factor "
+		     << raw_size * (1.0 / payload_size)
+		     << ")\n";
     }
+}
 
-    Squeezer_chunk_header_t chunk_header;
-    chunk_header.number_of_bytes = buffer.buffer.size();
-    chunk_header.number_of_samples = scet_interp_error.size();
-    chunk_header.chunk_type = CHUNK_SCET_ERROR;
+//////////////////////////////////////////////////////////////////////
+
+// A block of a column, ready to be appended to its chunk, and the
+// statistics about its encoding
+struct Encoded_block_t {
+    // Block header and payload
+    Byte_buffer_t data;
+    size_t num_of_samples;
+    // Size of the encoded samples before the filter and the backend
+    // compressor were applied
+    size_t encoded_size;
+    Error_accumulator_t errors;
+    // Only used for angles
+    size_t num_of_frames;
+    size_t num_of_frames_encoded_directly;
+
+    Encoded_block_t()
+	: data(),
+	  num_of_samples(0),
+	  encoded_size(0),
+	  errors(),
+	  num_of_frames(0),
+	  num_of_frames_encoded_directly(0) {}
+};
 
-    estimate_scet_reconstruction_error(scet,
-				       obt,
-				       scet_interp_error,
-				       chunk_header.compression_error);
+//////////////////////////////////////////////////////////////////////
 
-    chunk_header.write_to_file(output_file);
-    buffer.write_to_file(output_file);
+// Encode the samples of one column, one block at a time, and collect
+// them in a chunk. There is one derived class for each kind of
+// column.
+class Column_encoder_t {
+public:
+    Column_encoder_t(Chunk_type_t chunk_type,
+		     const Compression_parameters_t & a_params)
+	: params(a_params),
+	  writer(chunk_type, a_params),
+	  errors(),
+	  num_of_samples(0),
+	  num_of_frames(0),
+	  num_of_frames_encoded_directly(0) {}
+    virtual ~Column_encoder_t() {}
+
+    // Encode the samples [first, first + count) of the column in
+    // "data". The encoder is not modified, so different threads can
+    // encode different blocks at the same time.
+    void encode(const Data_container_t & data,
+		size_t first,
+		size_t count,
+		Encoded_block_t & result) const {
+	Pooled_buffer_t block_data(buffer_pool);
+	result = Encoded_block_t();
+	encode_block(data, first, count, *block_data, result);
+	result.num_of_samples = count;
+	result.encoded_size = block_data->size();
+	writer.pack_block(*block_data, count, data.obt_times[first], result.data);
+    }
 
-    if(params.verbose_flag) {
-	std::cout << PROGRAM_NAME
-		  << ": the size of the SCET times shrunk from "
-		  << scet.size() * sizeof(scet[0])
-		  << " to "
-		  << buffer.buffer.size()
-		  << " bytes\n";
-
-	std::cout << PROGRAM_NAME
-		  << ":     the overall compression factor is "
-		  << (scet.size() * sizeof(scet[0])) * (1.0 / buffer.buffer.size())
-		  << '\n';
-
-	std::cout << PROGRAM_NAME
-		  << ":     the maximum error is "
-		  << chunk_header.compression_error.max_abs_error
-		  << " ms\n";
-
-	std::cerr << PROGRAM_NAME
-		  << ":     the average absolute error is "
-		  << chunk_header.compression_error.mean_abs_error
-		  << " ms\n";
+    // Append a block to the next chunk. Blocks must be added in the
+    // same order as the rows.
+    void add_block(const Encoded_block_t & block) {
+	writer.add_block(block.data, block.num_of_samples,
+			 block.encoded_size, block.errors);
+	errors.add(block.errors);
+	num_of_samples += block.num_of_samples;
+	num_of_frames += block.num_of_frames;
+	num_of_frames_encoded_directly += block.num_of_frames_encoded_directly;
+    }
+
+    size_t pending_size() const {
+	return writer.pending_size();
+    }
+
+    // Write the blocks added since the last call as one chunk
+    void write_chunk(Compressed_output_t & output, Squeezer_toc_t & toc) {
+	writer.write(output, toc);
+    }
+
+    // Print the statistics about the whole column, if verbose
+    // messages have been requested
+    void report() const {
+	if(! params.verbose_flag)
+	    return;
+
+	print_statistics();
+	writer.print_statistics();
+    }
+
+protected:
+    // Save the encoded samples in "output" and the statistics in
+    // "result"
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const = 0;
+    virtual void print_statistics() const = 0;
+
+    const Compression_parameters_t & params;
+    Chunk_writer_t writer;
+    Error_accumulator_t errors;
+    size_t num_of_samples;
+    size_t num_of_frames;
+    size_t num_of_frames_encoded_directly;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+class Obt_encoder_t : public Column_encoder_t {
+public:
+    Obt_encoder_t(const Compression_parameters_t & a_params)
+	: Column_encoder_t(CHUNK_DELTA_OBT, a_params) {}
+
+protected:
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const {
+	const double * obt = data.obt_times.data() + first;
+
+	// The first time is saved in the block header
+	std::vector<uint32_t> obt_delta(count - 1);
+	for(size_t idx = 0; idx < obt_delta.size(); ++idx) {
+	    obt_delta[idx] = obt[idx + 1] - obt[idx];
+	}
+
+	rle_compression(obt_delta.data(), obt_delta.size(), output);
+    }
+
+    virtual void print_statistics() const {
+	const size_t raw_size = num_of_samples * sizeof(double);
+
+	params.log() << PROGRAM_NAME
+		     << ": the size of the OBT times shrunk from "
+		     << raw_size
+		     << " to "
+		     << writer.size_of_encoded_samples()
+		     << " bytes (using run-length encoding)\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the overall compression factor for OBT times is "
+		     << raw_size * (1.0 / writer.size_of_encoded_samples())
+		     << '\n';
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// SCET times are saved as the difference with a straight line
+// connecting the first and the last time in the file header
+class Scet_encoder_t : public Column_encoder_t {
+public:
+    Scet_encoder_t(const Squeezer_file_header_t & file_header,
+		   const Compression_parameters_t & a_params)
+	: Column_encoder_t(CHUNK_SCET_ERROR, a_params),
+	  first_obt(file_header.first_obt),
+	  first_scet(file_header.first_scet_in_ms),
+	  slope((file_header.last_scet_in_ms - file_header.first_scet_in_ms) /
+		(file_header.last_obt - file_header.first_obt)) {}
+
+protected:
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const {
+	const double * obt = data.obt_times.data() + first;
+	const double * scet = data.scet_times.data() + first;
+
+	std::vector<float> scet_interp_errors(count);
+	for(size_t idx = 0; idx < count; ++idx) {
+	    const double interpolated_scet =
+		first_scet + slope * (obt[idx] - first_obt);
+	    scet_interp_errors[idx] = scet[idx] - interpolated_scet;
+	    result.errors.add(interpolated_scet + scet_interp_errors[idx]
+			      - scet[idx]);
+	}
+
+	output.append_floats(scet_interp_errors.data(), count);
+    }
+
+    virtual void print_statistics() const {
+	const size_t raw_size = num_of_samples * sizeof(double);
+	Error_t compression_error;
+	errors.save(compression_error);
+
+	params.log() << PROGRAM_NAME
+		     << ": the size of the SCET times shrunk from "
+		     << raw_size
+		     << " to "
+		     << writer.size_of_encoded_samples()
+		     << " bytes\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the overall compression factor is "
+		     << raw_size * (1.0 / writer.size_of_encoded_samples())
+		     << '\n';
+
+	params.log() << PROGRAM_NAME
+		     << ":     the maximum error is "
+		     << compression_error.max_abs_error
+		     << " ms\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the average absolute error is "
+		     << compression_error.mean_abs_error
+		     << " ms\n";
+    }
+
+private:
+    double first_obt;
+    double first_scet;
+    double slope;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+class Angle_encoder_t : public Column_encoder_t {
+public:
+    Angle_encoder_t(Chunk_type_t chunk_type,
+		    std::vector<double> Detector_pointings_t::* a_column,
+		    const Compression_parameters_t & a_params)
+	: Column_encoder_t(chunk_type, a_params),
+	  column(a_column) {}
+
+protected:
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const {
+	const std::vector<double> & angle =
+	    dynamic_cast<const Detector_pointings_t &>(data).*column;
+	const std::vector<double> block_angle(angle.begin() + first,
+					      angle.begin() + first + count);
+
+	// Frames encoded as polynomials need two bytes plus one float
+	// per coefficient
+	const size_t estimated_num_of_frames =
+	    count / params.elements_per_frame + 1;
+	output.buffer.reserve(estimated_num_of_frames *
+			      (2 + params.number_of_poly_terms * sizeof(float)));
+
+	poly_fit_encode(block_angle,
+			params.elements_per_frame,
+			params.number_of_poly_terms,
+			params.max_abs_error,
+			output,
+			result.num_of_frames,
+			result.num_of_frames_encoded_directly);
+
+	std::vector<double> reconstructed_angle;
+	Byte_view_t encoded_angle(output);
+	poly_fit_decode(count, encoded_angle, reconstructed_angle);
+
+	for(size_t idx = 0; idx < count; ++idx) {
+	    double error = block_angle[idx] - reconstructed_angle[idx];
+	    if(error > M_PI)
+		error -= M_PI * 2;
+	    else if(error < -M_PI)
+		error += M_PI * 2;
+
+	    result.errors.add(error);
+	}
+    }
+
+    virtual void print_statistics() const {
+	const size_t raw_size = num_of_samples * sizeof(double);
+	Error_t compression_error;
+	errors.save(compression_error);
+
+	params.log() << PROGRAM_NAME
+		     << ": the size of the angle vector shrunk from "
+		     << raw_size
+		     << " to "
+		     << writer.size_of_encoded_samples()
+		     << " bytes (using polynomial encoding)\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     "
+		     << num_of_frames
+		     << " frames written, of which "
+		     << num_of_frames_encoded_directly
+		     << " were uncompressed ("
+		     << (num_of_frames_encoded_directly * 100) / num_of_frames
+		     << "%)\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the overall compression factor is "
+		     << raw_size * (1.0 / writer.size_of_encoded_samples())
+		     << '\n';
+
+	params.log() << PROGRAM_NAME
+		     << ":     the absolute error ranges from "
+		     << rad2arcmin(compression_error.min_abs_error)
+		     << " to "
+		     << rad2arcmin(compression_error.max_abs_error)
+		     << " arcsec\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the average absolute error is "
+		     << rad2arcmin(compression_error.mean_abs_error)
+		     << " arcsec\n";
+    }
+
+private:
+    std::vector<double> Detector_pointings_t::* column;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Differenced data are saved in single precision
+class Sky_load_encoder_t : public Column_encoder_t {
+public:
+    Sky_load_encoder_t(const Compression_parameters_t & a_params)
+	: Column_encoder_t(CHUNK_DIFFERENCED_DATA, a_params) {}
+
+protected:
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const {
+	const double * sky_load =
+	    dynamic_cast<const Differenced_data_t &>(data).sky_load.data() + first;
+
+	std::vector<float> single_prec_data(sky_load, sky_load + count);
+	for(size_t idx = 0; idx < count; ++idx)
+	    result.errors.add(single_prec_data[idx] - sky_load[idx]);
+
+	output.append_floats(single_prec_data.data(), count);
+    }
+
+    virtual void print_statistics() const {
+	const size_t raw_size = num_of_samples * sizeof(double);
+
+	params.log() << PROGRAM_NAME
+		     << ": the size of the differenced data shrunk from "
+		     << raw_size
+		     << " to "
+		     << writer.size_of_encoded_samples()
+		     << " bytes (using single-precision numbers)\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the overall compression factor for differenced data is "
+		     << raw_size * (1.0 / writer.size_of_encoded_samples())
+		     << '\n';
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+
+class Quality_flags_encoder_t : public Column_encoder_t {
+public:
+    Quality_flags_encoder_t(const Compression_parameters_t & a_params)
+	: Column_encoder_t(CHUNK_QUALITY_FLAGS, a_params) {}
+
+protected:
+    virtual void encode_block(const Data_container_t & data,
+			      size_t first,
+			      size_t count,
+			      Byte_buffer_t & output,
+			      Encoded_block_t & result) const {
+	const uint32_t * flags =
+	    dynamic_cast<const Differenced_data_t &>(data).quality_flags.data() + first;
+	rle_compression(flags, count, output);
+    }
+
+    virtual void print_statistics() const {
+	const size_t raw_size = num_of_samples * sizeof(uint32_t);
+
+	params.log() << PROGRAM_NAME
+		     << ": the size of the quality flags shrunk from "
+		     << raw_size
+		     << " to "
+		     << writer.size_of_encoded_samples()
+		     << " bytes (using run-length encoding)\n";
+
+	params.log() << PROGRAM_NAME
+		     << ":     the overall compression factor for quality flags is "
+		     << raw_size * (1.0 / writer.size_of_encoded_samples())
+		     << '\n';
     }
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Write the blocks of each column that have not been written yet as
+// one chunk per column
+static void
+write_chunks(const std::vector<std::unique_ptr<Column_encoder_t> > & encoders,
+	     Compressed_output_t & output,
+	     Squeezer_toc_t & toc)
+{
+    for(auto & cur_encoder : encoders)
+	cur_encoder->write_chunk(output, toc);
 }
 
 //////////////////////////////////////////////////////////////////////
 
-void
-estimate_angle_reconstruction_error(const std::vector<double> angle,
-				    const std::vector<double> reconstructed_angle,
-				    Error_t & compression_error)
+// Add the encoded blocks of one block of rows to their columns, and
+// write the blocks that are waiting if they reach the size of a chunk
+// group
+static void
+add_encoded_blocks(const std::vector<std::unique_ptr<Column_encoder_t> > & encoders,
+		   std::vector<Encoded_block_t> & blocks,
+		   const Compression_parameters_t & params,
+		   Compressed_output_t & output,
+		   Squeezer_toc_t & toc)
 {
-    compression_error.mean_abs_error = 0.0;
-    compression_error.mean_error = 0.0;
+    size_t pending_size = 0;
+    for(size_t idx = 0; idx < encoders.size(); ++idx) {
+	encoders[idx]->add_block(blocks[idx]);
+	pending_size += encoders[idx]->pending_size();
+    }
+
+    if(pending_size >= params.chunk_group_size)
+	write_chunks(encoders, output, toc);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// The encoded blocks of all the columns for the same rows, in the
+// same order as the encoders
+typedef std::vector<std::future<Encoded_block_t> > Encoded_rows_t;
+
+// Compress blocks of rows in three stages, connected by bounded
+// queues: the thread that reads the rows queues them in "add_block",
+// a pool of threads encodes them, and a writer thread appends the
+// encoded blocks to their columns in the original order. Whenever the
+// blocks waiting to be written reach "params.chunk_group_size" bytes,
+// the writer thread saves them in the output, one chunk per column.
+// Reading, encoding and writing therefore overlap, and the number of
+// blocks held in memory at the same time is limited by the size of
+// the queues and of the chunk groups.
+//
+// Every column of a block is encoded by a separate job, as the
+// columns do not depend on each other (SCET times only need the
+// first and last OBT times, which are in the file header). Even a
+// file made by one block uses therefore several threads.
+class Compression_pipeline_t {
+public:
+    // "num_of_threads" is the number of threads that encode blocks
+    // and must be positive
+    Compression_pipeline_t(const std::vector<std::unique_ptr<Column_encoder_t> > & a_encoders,
+			   const Compression_parameters_t & a_params,
+			   Compressed_output_t & a_output,
+			   Squeezer_toc_t & a_toc,
+			   unsigned int num_of_threads);
+    ~Compression_pipeline_t() {
+	stop();
+    }
 
-    for(size_t idx = 0; idx < reconstructed_angle.size(); ++idx) {
+    // Queue a block of rows for encoding. Wait if too many blocks are
+    // still being processed.
+    void add_block(std::unique_ptr<Data_container_t> rows);
+
+    // Wait until all the blocks have been added to their columns, and
+    // rethrow the first error raised by the encoders or by the writer.
+    // The blocks of the last group are not written.
+    void finish();
+
+private:
+    Compression_pipeline_t(const Compression_pipeline_t &);
+    Compression_pipeline_t & operator=(const Compression_pipeline_t &);
+
+    // Encode one column of a block of rows
+    struct Job_t {
+	// Shared by the jobs of all the columns
+	std::shared_ptr<const Data_container_t> rows;
+	size_t column;
+	std::promise<Encoded_block_t> result;
+    };
+
+    void encode_blocks();
+    void write_blocks();
+    void stop();
+
+    const std::vector<std::unique_ptr<Column_encoder_t> > & encoders;
+    const Compression_parameters_t & params;
+    // Only used by the writer thread until "finish" returns
+    Compressed_output_t & output;
+    Squeezer_toc_t & toc;
+    Bounded_queue_t<Job_t> jobs;
+    // The writer waits for the results in the same order as the jobs
+    // have been queued
+    Bounded_queue_t<Encoded_rows_t> results;
+    std::vector<std::thread> encoding_threads;
+    std::thread writing_thread;
+    // Set by the writer thread before it stops
+    std::exception_ptr error;
+};
 
-	double error = angle[idx] - reconstructed_angle[idx];
-	if(error > M_PI)
-	    error -= M_PI * 2;
-	else if(error < -M_PI)
-	    error += M_PI * 2;
+//////////////////////////////////////////////////////////////////////
 
-	double abs_error = std::fabs(error);
+Compression_pipeline_t::Compression_pipeline_t(const std::vector<std::unique_ptr<Column_encoder_t> > & a_encoders,
+					       const Compression_parameters_t & a_params,
+					       Compressed_output_t & a_output,
+					       Squeezer_toc_t & a_toc,
+					       unsigned int num_of_threads)
+    : encoders(a_encoders),
+      params(a_params),
+      output(a_output),
+      toc(a_toc),
+      jobs(num_of_threads),
+      results(num_of_threads + 1),
+      encoding_threads(),
+      writing_thread(),
+      error()
+{
+    for(unsigned int idx = 0; idx < num_of_threads; ++idx)
+	encoding_threads.push_back(std::thread(&Compression_pipeline_t::encode_blocks, this));
 
-	compression_error.mean_abs_error += abs_error;
-	compression_error.mean_error += error;
+    writing_thread = std::thread(&Compression_pipeline_t::write_blocks, this);
+}
 
-	if(idx == 0) {
-	    compression_error.min_abs_error = abs_error;
-	    compression_error.max_abs_error = abs_error;
-	} else {
-	    if(compression_error.min_abs_error > abs_error)
-		compression_error.min_abs_error = abs_error;
-	    if(compression_error.max_abs_error < abs_error)
-		compression_error.max_abs_error = abs_error;
-	}
+//////////////////////////////////////////////////////////////////////
+
+void
+Compression_pipeline_t::add_block(std::unique_ptr<Data_container_t> rows)
+{
+    std::shared_ptr<const Data_container_t> shared_rows(std::move(rows));
+    std::vector<Job_t> column_jobs(encoders.size());
+    Encoded_rows_t result;
+
+    for(size_t idx = 0; idx < encoders.size(); ++idx) {
+	column_jobs[idx].rows = shared_rows;
+	column_jobs[idx].column = idx;
+	result.push_back(column_jobs[idx].result.get_future());
     }
 
-    compression_error.mean_abs_error /= angle.size();
-    compression_error.mean_error /= angle.size();
+    // The queues are closed only if the writer has stopped because of
+    // an error, which "finish" rethrows
+    if(! results.push(std::move(result)))
+	finish();
+
+    for(auto & cur_job : column_jobs) {
+	if(! jobs.push(std::move(cur_job)))
+	    finish();
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-compress_angle(const std::vector<double> & angle,
-	       Chunk_type_t chunk_type,
-	       FILE * output_file,
-	       const Compression_parameters_t & params)
+Compression_pipeline_t::encode_blocks()
 {
-    Byte_buffer_t output_buffer;
-    size_t num_of_frames = 0;
-    size_t num_of_frames_encoded_directly = 0;
-    poly_fit_encode(angle,
-		    params.elements_per_frame,
-		    params.number_of_poly_terms,
-		    params.max_abs_error,
-		    output_buffer,
-		    num_of_frames,
-		    num_of_frames_encoded_directly);
+    Job_t job;
+    while(jobs.pop(job)) {
+	try {
+	    Encoded_block_t encoded_block;
+	    encoders[job.column]->encode(*job.rows, 0,
+					 job.rows->obt_times.size(),
+					 encoded_block);
+
+	    job.result.set_value(std::move(encoded_block));
+	}
+	catch(...) {
+	    job.result.set_exception(std::current_exception());
+	}
 
-    Squeezer_chunk_header_t chunk_header;
-    chunk_header.number_of_bytes = output_buffer.size();
-    chunk_header.number_of_samples = angle.size();
-    chunk_header.chunk_type = chunk_type;
+	job.rows.reset();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Compression_pipeline_t::write_blocks()
+{
+    Encoded_rows_t result;
+    while(results.pop(result)) {
+	try {
+	    std::vector<Encoded_block_t> blocks(encoders.size());
+	    for(size_t idx = 0; idx < encoders.size(); ++idx)
+		blocks[idx] = result[idx].get();
+
+	    add_encoded_blocks(encoders, blocks, params, output, toc);
+	}
+	catch(...) {
+	    error = std::current_exception();
 
-    std::vector<double> reconstructed_angle;
-    poly_fit_decode(angle.size(),
-		    output_buffer,
-		    reconstructed_angle);
+	    // Make "add_block" fail, so that the reader stops too
+	    jobs.close();
+	    results.close();
+	    return;
+	}
+    }
+}
 
-    estimate_angle_reconstruction_error(angle,
-					reconstructed_angle,
-					chunk_header.compression_error);
+//////////////////////////////////////////////////////////////////////
 
-    chunk_header.write_to_file(output_file);
-    output_buffer.write_to_file(output_file);
+void
+Compression_pipeline_t::stop()
+{
+    jobs.close();
+    results.close();
 
-    if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME
-		  << ": the size of the angle vector shrunk from "
-		  << angle.size() * sizeof(angle[0])
-		  << " to "
-		  << output_buffer.size()
-		  << " bytes (using polynomial encoding)\n";
-
-	std::cerr << PROGRAM_NAME
-		  << ":     "
-		  << num_of_frames
-		  << " frames written, of which "
-		  << num_of_frames_encoded_directly
-		  << " were uncompressed ("
-		  << (num_of_frames_encoded_directly * 100) / num_of_frames
-		  << "%)\n";
-
-	std::cerr << PROGRAM_NAME
-		  << ":     the overall compression factor is "
-		  << (angle.size() * sizeof(angle[0])) * (1.0 / output_buffer.size())
-		  << '\n';
-
-	std::cerr << PROGRAM_NAME
-		  << ":     the absolute error ranges from "
-		  << rad2arcmin(chunk_header.compression_error.min_abs_error)
-		  << " to "
-		  << rad2arcmin(chunk_header.compression_error.max_abs_error)
-		  << " arcsec\n";
-
-	std::cerr << PROGRAM_NAME
-		  << ":     the average absolute error is "
-		  << rad2arcmin(chunk_header.compression_error.mean_abs_error)
-		  << " arcsec\n";
+    for(auto & cur_thread : encoding_threads) {
+	if(cur_thread.joinable())
+	    cur_thread.join();
     }
+
+    if(writing_thread.joinable())
+	writing_thread.join();
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-compress_scientific_data(const std::vector<double> & data,
-			 FILE * output_file,
-			 const Compression_parameters_t & params)
+Compression_pipeline_t::finish()
 {
-    Squeezer_chunk_header_t chunk_header;
-    auto & compr_error = chunk_header.compression_error;
+    stop();
+    if(error)
+	std::rethrow_exception(error);
+}
 
-    compr_error.min_abs_error = data.front();
-    compr_error.max_abs_error = 0.0;
-    compr_error.mean_abs_error = 0.0;
-    compr_error.mean_error = 0.0;
+//////////////////////////////////////////////////////////////////////
 
-    Byte_buffer_t data_buffer;
-    for(auto datum : data) {
-	float single_prec_datum = datum;
-	data_buffer.append_float(single_prec_datum);
+// Compress rows as soon as they are available and write them to
+// "output" as soon as they are encoded. Only the rows that do not
+// fill a block yet are kept in memory, together with the blocks that
+// are still in the pipeline or waiting to be written, so the memory
+// used does not depend on the length of the input file.
+//
+// If only one thread is allowed, no pipeline is created and blocks
+// are encoded by the thread that adds the rows. This way no thread is
+// started for each file, and the buffers kept by the thread (see
+// Byte_buffer_pool_t) are reused by the next files it compresses.
+class Streaming_compressor_t : public Row_batch_consumer_t {
+public:
+    Streaming_compressor_t(const Compression_parameters_t & a_params,
+			   Compressed_output_t & a_output)
+	: params(a_params),
+	  output(a_output),
+	  file_header(a_params.file_type),
+	  toc(),
+	  encoders(),
+	  pipeline(),
+	  pending_rows(),
+	  block_size(0) {}
+
+    virtual void start(size_t num_of_rows,
+		       const Data_container_t & time_span);
+    virtual void add_rows(const Data_container_t & rows);
+
+    // Encode the rows that are still pending, then write the last
+    // chunks, the table of contents and the file header
+    void finish();
+
+private:
+    Data_container_t * create_row_container() const;
+    void add_block(std::unique_ptr<Data_container_t> block);
+    void encode_block(const Data_container_t & data, size_t first, size_t count) {
+	std::unique_ptr<Data_container_t> block(create_row_container());
+	block->append_rows(data, first, count);
+	add_block(std::move(block));
+    }
 
-	double error = single_prec_datum - datum;
-	double abs_error = std::fabs(error);
+    const Compression_parameters_t & params;
+    Compressed_output_t & output;
+    Squeezer_file_header_t file_header;
+    Squeezer_toc_t toc;
+    std::vector<std::unique_ptr<Column_encoder_t> > encoders;
+    // Its threads use the encoders, so it must be destroyed first. It
+    // is NULL if blocks are encoded by the calling thread.
+    std::unique_ptr<Compression_pipeline_t> pipeline;
+    std::unique_ptr<Data_container_t> pending_rows;
+    size_t block_size;
+};
 
-	if(compr_error.min_abs_error > abs_error)
-	    compr_error.min_abs_error = abs_error;
-	if(compr_error.max_abs_error < abs_error)
-	    compr_error.max_abs_error = abs_error;
+//////////////////////////////////////////////////////////////////////
 
-	compr_error.mean_abs_error += abs_error;
-	compr_error.mean_error += error;
+Data_container_t *
+Streaming_compressor_t::create_row_container() const
+{
+    switch(params.file_type) {
+    case SQZ_DETECTOR_POINTINGS:
+	return new Detector_pointings_t();
+
+    case SQZ_DIFFERENCED_DATA:
+	return new Differenced_data_t(params.read_calibrated_data);
+
+    default:
+	abort();
     }
+}
 
-    compr_error.mean_abs_error /= data.size();
-    compr_error.mean_error /= data.size();
+//////////////////////////////////////////////////////////////////////
 
-    chunk_header.number_of_bytes = data_buffer.buffer.size();
-    chunk_header.number_of_samples = data.size();
-    chunk_header.chunk_type = CHUNK_DIFFERENCED_DATA;
+void
+Streaming_compressor_t::start(size_t num_of_rows,
+			      const Data_container_t & time_span)
+{
+    initialize_file_header(file_header, time_span, params);
+    block_size = samples_per_block(num_of_rows, params);
 
-    chunk_header.write_to_file(output_file);
-    data_buffer.write_to_file(output_file);
+    pipeline.reset();
+    toc = Squeezer_toc_t();
+    encoders.clear();
+    encoders.emplace_back(new Obt_encoder_t(params));
+    encoders.emplace_back(new Scet_encoder_t(file_header, params));
 
-    if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME
-		  << ": the size of the OBT times shrunk from "
-		  << data.size() * sizeof(data[0])
-		  << " to "
-		  << data_buffer.buffer.size()
-		  << " bytes (using run-length encoding)\n";
+    switch(params.file_type) {
+    case SQZ_DETECTOR_POINTINGS:
+	encoders.emplace_back(new Angle_encoder_t(CHUNK_THETA,
+						  &Detector_pointings_t::theta,
+						  params));
+	encoders.emplace_back(new Angle_encoder_t(CHUNK_PHI,
+						  &Detector_pointings_t::phi,
+						  params));
+	encoders.emplace_back(new Angle_encoder_t(CHUNK_PSI,
+						  &Detector_pointings_t::psi,
+						  params));
+	break;
+
+    case SQZ_DIFFERENCED_DATA:
+	encoders.emplace_back(new Sky_load_encoder_t(params));
+	encoders.emplace_back(new Quality_flags_encoder_t(params));
+	break;
 
-	std::cerr << PROGRAM_NAME
-		  << ":     the overall compression factor for OBT times is "
-		  << (data.size() * sizeof(data[0])) *
-	    (1.0 / data_buffer.buffer.size())
-		  << '\n';
+    default:
+	abort();
     }
 
+    pending_rows.reset(create_row_container());
+
+    const unsigned int num_of_threads = (params.num_of_threads > 0)
+	? params.num_of_threads
+	: default_num_of_threads();
+    if(num_of_threads > 1) {
+	pipeline.reset(new Compression_pipeline_t(encoders, params, output, toc,
+						  num_of_threads));
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-compress_quality_flags(const std::vector<uint32_t> & flags,
-		       FILE * output_file,
-		       const Compression_parameters_t & params)
+Streaming_compressor_t::add_block(std::unique_ptr<Data_container_t> block)
 {
-    Byte_buffer_t flags_buffer;
-    rle_compression(flags.data(),
-		    flags.size(),
-		    flags_buffer);
+    if(pipeline) {
+	pipeline->add_block(std::move(block));
+	return;
+    }
 
-    Squeezer_chunk_header_t chunk_header;
-    chunk_header.number_of_bytes = flags_buffer.buffer.size();
-    chunk_header.number_of_samples = flags.size();
-    chunk_header.chunk_type = CHUNK_QUALITY_FLAGS;
+    std::vector<Encoded_block_t> blocks(encoders.size());
+    for(size_t idx = 0; idx < encoders.size(); ++idx)
+	encoders[idx]->encode(*block, 0, block->obt_times.size(), blocks[idx]);
 
-    chunk_header.compression_error.min_abs_error = 0.0;
-    chunk_header.compression_error.max_abs_error = 0.0;
-    chunk_header.compression_error.mean_abs_error = 0.0;
-    chunk_header.compression_error.mean_error = 0.0;
+    add_encoded_blocks(encoders, blocks, params, output, toc);
+}
 
-    chunk_header.write_to_file(output_file);
-    flags_buffer.write_to_file(output_file);
+//////////////////////////////////////////////////////////////////////
 
-    if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME
-		  << ": the size of the quality flags shrunk from "
-		  << flags.size() * sizeof(flags[0])
-		  << " to "
-		  << flags_buffer.buffer.size()
-		  << " bytes (using run-length encoding)\n";
+void
+Streaming_compressor_t::add_rows(const Data_container_t & rows)
+{
+    const size_t num_of_rows = rows.obt_times.size();
+    size_t first = 0;
+
+    // Complete the block started by the previous batches
+    if(! pending_rows->obt_times.empty()) {
+	first = std::min(num_of_rows, block_size - pending_rows->obt_times.size());
+	pending_rows->append_rows(rows, 0, first);
+
+	if(pending_rows->obt_times.size() < block_size)
+	    return;
 
-	std::cerr << PROGRAM_NAME
-		  << ":     the overall compression factor for quality flags is "
-		  << (flags.size() * sizeof(flags[0])) *
-	    (1.0 / flags_buffer.buffer.size())
-		  << '\n';
+	add_block(std::move(pending_rows));
+	pending_rows.reset(create_row_container());
     }
 
+    for(; num_of_rows - first >= block_size; first += block_size)
+	encode_block(rows, first, block_size);
+
+    pending_rows->append_rows(rows, first, num_of_rows - first);
 }
 
 //////////////////////////////////////////////////////////////////////
 
-template <typename Dst, typename Src>
-std::unique_ptr<Dst> unique_dynamic_cast( std::unique_ptr<Src>& ptr )
+void
+Streaming_compressor_t::finish()
 {
-    Src *p = ptr.release();
-    std::unique_ptr<Dst> r(dynamic_cast<Dst*>(p));
-    if (!r) {
-        ptr.reset(p);
+    if(! pending_rows->obt_times.empty()) {
+	add_block(std::move(pending_rows));
+	pending_rows.reset(create_row_container());
     }
-    return r;
+
+    if(pipeline)
+	pipeline->finish();
+    write_chunks(encoders, output, toc);
+
+    std::vector<uint8_t> toc_bytes(toc.size_in_bytes());
+    toc.write_to_buffer(toc_bytes.data());
+    output.append(toc_bytes.data(), toc_bytes.size());
+
+    file_header.number_of_chunks = toc.entries.size();
+    file_header.toc_offset = toc.end_offset();
+    output.finish(file_header);
+
+    for(auto & cur_encoder : encoders)
+	cur_encoder->report();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -447,11 +1329,10 @@ compress_file_to_file(const std::string & input_file_name,
 		      const Compression_parameters_t & params)
 {
     if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME << ": reading data from "
-		  << input_file_name << '\n';
+	params.log() << PROGRAM_NAME << ": reading data from "
+		     << input_file_name << '\n';
     }
 
-    bool file_read = false;
     std::unique_ptr<Data_container_t> file_data;
 
     switch(params.file_type) {
@@ -467,56 +1348,91 @@ compress_file_to_file(const std::string & input_file_name,
 	abort();
     }
 
+    File_output_t output(output_file, params.use_temporary_files);
+    Streaming_compressor_t compressor(params, output);
+
 #if HAVE_TOODI
     if(input_file_name.compare(0, 6, "TOODI%") == 0) {
         file_data->read_from_database(input_file_name);
-        file_read = true;
+	compressor.start(file_data->obt_times.size(), *file_data);
+	compressor.add_rows(*file_data);
+	compressor.finish();
+	return;
     }
 #endif
 
-    if(! file_read) {
-        file_data->read_from_fits_file(input_file_name);
-    }
-
-    Squeezer_file_header_t file_header(params.file_type);
-    initialize_file_header(file_header, *file_data, params);
-    file_header.write_to_file(output_file);
-
-    switch(params.file_type) {
-    case SQZ_DETECTOR_POINTINGS: {
+    // Each batch of rows read by CFITSIO is compressed before the next
+    // one is read, and the encoded blocks are written while the next
+    // batches are read
+    file_data->read_from_fits_file_in_batches(input_file_name, compressor);
+    compressor.finish();
+}
 
-	std::unique_ptr<Detector_pointings_t> detpoints =
-	    unique_dynamic_cast<Detector_pointings_t, Data_container_t>
-	    (file_data);
+//////////////////////////////////////////////////////////////////////
 
-	compress_obt(detpoints->obt_times, output_file, params);
-	compress_scet(detpoints->scet_times,
-		      detpoints->obt_times,
-		      output_file,
-		      params);
-	compress_angle(detpoints->theta, CHUNK_THETA, output_file, params);
-	compress_angle(detpoints->phi,   CHUNK_PHI, output_file, params);
-	compress_angle(detpoints->psi,   CHUNK_PSI, output_file, params);
+// Throw a std::runtime_error unless "data" has the type required by
+// "file_type" and all its columns have the same length
+static void
+check_data_container(const Data_container_t & data,
+		     Squeezer_file_type_t file_type)
+{
+    const size_t num_of_samples = data.obt_times.size();
+    bool consistent = (data.scet_times.size() == num_of_samples);
 
-    } break;
+    switch(file_type) {
+    case SQZ_DETECTOR_POINTINGS: {
+	auto pointings = dynamic_cast<const Detector_pointings_t *>(&data);
+	if(pointings == NULL)
+	    throw std::runtime_error("detector pointings were expected");
+
+	consistent = consistent &&
+	    pointings->theta.size() == num_of_samples &&
+	    pointings->phi.size() == num_of_samples &&
+	    pointings->psi.size() == num_of_samples;
+	break;
+    }
 
     case SQZ_DIFFERENCED_DATA: {
+	auto datadiff = dynamic_cast<const Differenced_data_t *>(&data);
+	if(datadiff == NULL)
+	    throw std::runtime_error("differenced data were expected");
 
-	std::unique_ptr<Differenced_data_t> diffdata =
-	    unique_dynamic_cast<Differenced_data_t, Data_container_t>
-	    (file_data);
+	consistent = consistent &&
+	    datadiff->sky_load.size() == num_of_samples &&
+	    datadiff->quality_flags.size() == num_of_samples;
+	break;
+    }
 
-	compress_obt(diffdata->obt_times, output_file, params);
-	compress_scet(diffdata->scet_times,
-		      diffdata->obt_times,
-		      output_file,
-		      params);
-	compress_scientific_data(diffdata->sky_load, output_file, params);
-	compress_quality_flags(diffdata->quality_flags, output_file, params);
+    default:
+	throw std::runtime_error("unknown type of data");
+    }
 
-    } break;
+    if(! consistent)
+	throw std::runtime_error("the columns have different lengths");
+    if(num_of_samples == 0)
+	throw std::runtime_error("there are no samples to compress");
+}
 
-    default:
-	abort();
+//////////////////////////////////////////////////////////////////////
+
+void
+compress_data_to_buffer(const Data_container_t & data,
+			const Compression_parameters_t & params,
+			std::vector<uint8_t> & output)
+{
+    check_data_container(data, params.file_type);
+
+    // Chunks are appended to "output" as soon as they are written, so
+    // that the compressed file is never copied
+    try {
+	Buffer_output_t buffer_output(output);
+	Streaming_compressor_t compressor(params, buffer_output);
+	compressor.start(data.obt_times.size(), data);
+	compressor.add_rows(data);
+	compressor.finish();
+    }
+    catch(...) {
+	output.clear();
+	throw;
     }
 }
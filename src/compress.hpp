@@ -21,11 +21,28 @@
 #ifndef COMPRESS_HPP
 #define COMPRESS_HPP
 
+#include <cmath>
 #include <cstdio>
 #include <cstdint>
+#include <iostream>
+#include <map>
+#include <vector>
 #include "common_defs.hpp"
+#include "backends.hpp"
 
 class Detector_pointings_t;
+struct Data_container_t;
+
+// Number of samples in each block of a chunk, unless the user
+// specifies otherwise. Blocks are compressed and decompressed
+// independently, so smaller blocks mean more parallelism and finer
+// access granularity, but a worse compression ratio.
+const size_t DEFAULT_SAMPLES_PER_BLOCK = 1024 * 1024;
+
+// Encoded blocks are written to the output as soon as the blocks of
+// all the columns waiting to be written reach this size. The blocks
+// of each column are then saved as one chunk.
+const size_t DEFAULT_CHUNK_GROUP_SIZE = 16 * 1024 * 1024;
 
 struct Compression_parameters_t {
     Squeezer_file_type_t file_type;
@@ -35,7 +52,28 @@ struct Compression_parameters_t {
     unsigned int number_of_poly_terms;
     double max_abs_error;
     bool read_calibrated_data;
+    // Backend used for all the columns but the ones listed in
+    // "column_backends"
+    Backend_choice_t backend;
+    std::map<Chunk_type_t, Backend_choice_t> column_backends;
+    Filter_type_t filter;
+    // Zero means that each column is saved in one block
+    size_t samples_per_block;
+    // Number of threads that encode blocks while the input file is
+    // being read (zero means the number of cores). If it is one, the
+    // blocks are encoded by the thread that reads the file.
+    unsigned int num_of_threads;
+    // Size in bytes of the encoded blocks that are kept in memory
+    // before being written (see DEFAULT_CHUNK_GROUP_SIZE)
+    size_t chunk_group_size;
+    // If the output cannot be rewound to write the file header at the
+    // end (e.g., it is a pipe), the chunks are kept in a temporary
+    // file until the compression is complete. If false, they are kept
+    // in memory instead.
+    bool use_temporary_files;
     bool verbose_flag;
+    // Where verbose messages are written
+    std::ostream * log_stream;
 
     Compression_parameters_t()
 	: file_type(SQZ_NO_DATA),
@@ -45,7 +83,37 @@ struct Compression_parameters_t {
 	  number_of_poly_terms(3),
 	  max_abs_error(1.0 / 3600.0 * M_PI / 180.0),
 	  read_calibrated_data(false),
-	  verbose_flag(false) {}
+	  backend(),
+	  column_backends(),
+	  filter(FILTER_NONE),
+	  samples_per_block(DEFAULT_SAMPLES_PER_BLOCK),
+	  num_of_threads(0),
+	  chunk_group_size(DEFAULT_CHUNK_GROUP_SIZE),
+	  use_temporary_files(true),
+	  verbose_flag(false),
+	  log_stream(&std::cerr) {}
+
+    std::ostream & log() const {
+	return *log_stream;
+    }
+
+    Backend_choice_t backend_for(Chunk_type_t chunk_type) const {
+	auto choice = column_backends.find(chunk_type);
+	return (choice != column_backends.end()) ? choice->second : backend;
+    }
+
+    // The filters work on 32-bit elements, which would be misaligned
+    // in the frames of the angles: they start with two 8-bit fields
+    Filter_type_t filter_for(Chunk_type_t chunk_type) const {
+	switch(chunk_type) {
+	case CHUNK_THETA:
+	case CHUNK_PHI:
+	case CHUNK_PSI:
+	    return FILTER_NONE;
+	default:
+	    return filter;
+	}
+    }
 };
 
 void
@@ -53,4 +121,15 @@ compress_file_to_file(const std::string & input_file_name,
 		      FILE * output_file,
 		      const Compression_parameters_t & params);
 
+// Compress the rows in "data", which must be a Detector_pointings_t
+// or a Differenced_data_t according to "params.file_type", and
+// replace the contents of "output" with the compressed file. No
+// file is created, not even a temporary one, regardless of
+// "params.use_temporary_files". Throw a std::runtime_error if the
+// data cannot be compressed.
+void
+compress_data_to_buffer(const Data_container_t & data,
+			const Compression_parameters_t & params,
+			std::vector<uint8_t> & output);
+
 #endif
@@ -0,0 +1,141 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define USE_SSE42_CRC32 1
+#include <nmmintrin.h>
+#endif
+
+#include "crc32c.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+// Bit-reversed Castagnoli polynomial
+static const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+// Tables for the "slicing-by-8" algorithm: table[k][byte] is the CRC
+// of "byte" followed by k zero bytes
+struct Crc32c_tables_t {
+    uint32_t table[8][256];
+
+    Crc32c_tables_t() {
+	for(uint32_t byte = 0; byte < 256; ++byte) {
+	    uint32_t crc = byte;
+	    for(int bit = 0; bit < 8; ++bit)
+		crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+	    table[0][byte] = crc;
+	}
+
+	for(int k = 1; k < 8; ++k) {
+	    for(uint32_t byte = 0; byte < 256; ++byte) {
+		const uint32_t prev = table[k - 1][byte];
+		table[k][byte] = (prev >> 8) ^ table[0][prev & 0xFF];
+	    }
+	}
+    }
+};
+
+static const Crc32c_tables_t crc32c_tables;
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+crc32c_portable(const uint8_t * data, size_t size, uint32_t crc)
+{
+    const uint32_t (& table)[8][256] = crc32c_tables.table;
+
+    crc = ~crc;
+    while(size >= 8) {
+	// Load the bytes in little-endian order, whatever the CPU
+	const uint32_t low = crc ^ (data[0] | (data[1] << 8) |
+				    (data[2] << 16) | ((uint32_t) data[3] << 24));
+	crc = table[7][low & 0xFF] ^
+	    table[6][(low >> 8) & 0xFF] ^
+	    table[5][(low >> 16) & 0xFF] ^
+	    table[4][low >> 24] ^
+	    table[3][data[4]] ^
+	    table[2][data[5]] ^
+	    table[1][data[6]] ^
+	    table[0][data[7]];
+
+	data += 8;
+	size -= 8;
+    }
+
+    while(size-- > 0)
+	crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+
+    return ~crc;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+#if USE_SSE42_CRC32
+
+// The compiler is allowed to use SSE 4.2 only within this function,
+// so the program still runs on CPUs that lack it
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(const uint8_t * data, size_t size, uint32_t crc)
+{
+    uint64_t crc64 = ~crc;
+    while(size >= 8) {
+	uint64_t word;
+	std::memcpy(&word, data, sizeof(word));
+	crc64 = _mm_crc32_u64(crc64, word);
+	data += 8;
+	size -= 8;
+    }
+
+    uint32_t crc32 = crc64;
+    while(size-- > 0)
+	crc32 = _mm_crc32_u8(crc32, *data++);
+
+    return ~crc32;
+}
+
+static bool
+detect_sse42()
+{
+    // This runs before main(), so the CPU model might not have been
+    // initialized yet
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+static const bool cpu_has_sse42 = detect_sse42();
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+crc32c(const uint8_t * data, size_t size, uint32_t crc)
+{
+#if USE_SSE42_CRC32
+    if(cpu_has_sse42)
+	return crc32c_sse42(data, size, crc);
+#endif
+
+    return crc32c_portable(data, size, crc);
+}
@@ -0,0 +1,37 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+// Compute the CRC-32C (Castagnoli) checksum of "size" bytes. To
+// compute the checksum of data split in several pieces, pass the
+// result for the previous pieces as "crc". On x86-64 CPUs supporting
+// SSE 4.2 the CRC32 instruction is used.
+uint32_t crc32c(const uint8_t * data, size_t size, uint32_t crc = 0);
+
+// Same as crc32c, but never use special CPU instructions
+uint32_t crc32c_portable(const uint8_t * data, size_t size, uint32_t crc = 0);
+
+#endif
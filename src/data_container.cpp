@@ -0,0 +1,269 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include <stdexcept>
+
+#include "data_container.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+append_range(const std::vector<double> & source,
+	     size_t first,
+	     size_t count,
+	     std::vector<double> & dest)
+{
+    dest.insert(dest.end(),
+		source.begin() + first,
+		source.begin() + first + count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Data_container_t::append_rows(const Data_container_t & source,
+			      size_t first,
+			      size_t count)
+{
+    append_range(source.obt_times, first, count, obt_times);
+    append_range(source.scet_times, first, count, scet_times);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Data_container_t::clear_rows()
+{
+    obt_times.clear();
+    scet_times.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// State shared with the CFITSIO iterator
+struct Fits_iteration_t {
+    Copy_fits_rows_fn_t copy_rows;
+    Data_container_t * rows;
+    Row_batch_consumer_t * consumer;
+    std::exception_ptr error;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+static int
+pass_rows_to_consumer(long total_num,
+		      long offset,
+		      long first_num,
+		      long num_of_values,
+		      int num_of_arrays,
+		      iteratorCol * data,
+		      void * user_ptr)
+{
+    auto iteration = reinterpret_cast<Fits_iteration_t *>(user_ptr);
+
+    // Exceptions must not propagate through CFITSIO, which is written
+    // in C
+    try {
+	iteration->copy_rows(data, num_of_values, *iteration->rows);
+	iteration->consumer->add_rows(*iteration->rows);
+    }
+    catch(...) {
+	iteration->error = std::current_exception();
+
+	// Stop the iteration without setting an error status
+	return -1;
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Read the value of a column in the first and in the last row
+static void
+read_first_and_last_value(fitsfile * fptr,
+			  LONGLONG num_of_rows,
+			  const char * column_name,
+			  std::vector<double> & values,
+			  int & status)
+{
+    int column_number = 0;
+    fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(column_name),
+		    &column_number, &status);
+
+    values.resize(2);
+    fits_read_col(fptr, TDOUBLE, column_number, 1, 1, 1, NULL,
+		  &values[0], NULL, &status);
+    fits_read_col(fptr, TDOUBLE, column_number, num_of_rows, 1, 1, NULL,
+		  &values[1], NULL, &status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::exception_ptr
+iterate_over_fits_rows(fitsfile * fptr,
+		       int num_of_cols,
+		       iteratorCol * cols,
+		       Copy_fits_rows_fn_t copy_rows,
+		       Data_container_t & rows,
+		       Row_batch_consumer_t & consumer,
+		       int & status)
+{
+    LONGLONG num_of_rows;
+    if(fits_get_num_rowsll(fptr, &num_of_rows, &status) != 0)
+	return nullptr;
+
+    if(num_of_rows == 0) {
+	return std::make_exception_ptr(std::runtime_error("the FITS table "
+							  "contains no rows"));
+    }
+
+    read_first_and_last_value(fptr, num_of_rows, "OBT", rows.obt_times, status);
+    read_first_and_last_value(fptr, num_of_rows, "SCET", rows.scet_times, status);
+    if(status != 0)
+	return nullptr;
+
+    try {
+	consumer.start(num_of_rows, rows);
+    }
+    catch(...) {
+	return std::current_exception();
+    }
+
+    Fits_iteration_t iteration;
+    iteration.copy_rows = copy_rows;
+    iteration.rows = &rows;
+    iteration.consumer = &consumer;
+
+    fits_iterate_data(num_of_cols, cols, 0, 0,
+		      &pass_rows_to_consumer, &iteration, &status);
+
+    return iteration.error;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// State shared with the CFITSIO iterator when writing a table
+struct Fits_output_iteration_t {
+    Copy_rows_to_fits_fn_t copy_rows;
+    Data_container_t * rows;
+    Row_batch_producer_t * producer;
+    Data_container_t * time_span;
+    std::exception_ptr error;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+static int
+get_rows_from_producer(long total_num,
+		       long offset,
+		       long first_num,
+		       long num_of_values,
+		       int num_of_arrays,
+		       iteratorCol * data,
+		       void * user_ptr)
+{
+    auto iteration = reinterpret_cast<Fits_output_iteration_t *>(user_ptr);
+
+    try {
+	iteration->producer->get_rows(num_of_values, *iteration->rows);
+
+	const Data_container_t & rows = *iteration->rows;
+	if(rows.obt_times.size() != (size_t) num_of_values ||
+	   rows.scet_times.size() != (size_t) num_of_values)
+	    throw std::runtime_error("not enough rows to fill the FITS table");
+
+	iteration->copy_rows(rows, data);
+
+	Data_container_t & time_span = *iteration->time_span;
+	if(first_num == 1) {
+	    time_span.obt_times[0] = rows.obt_times.front();
+	    time_span.scet_times[0] = rows.scet_times.front();
+	}
+	time_span.obt_times[1] = rows.obt_times.back();
+	time_span.scet_times[1] = rows.scet_times.back();
+    }
+    catch(...) {
+	iteration->error = std::current_exception();
+	return -1;
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::exception_ptr
+iterate_over_fits_output_rows(fitsfile * fptr,
+			      int num_of_cols,
+			      iteratorCol * cols,
+			      Copy_rows_to_fits_fn_t copy_rows,
+			      Data_container_t & rows,
+			      Row_batch_producer_t & producer,
+			      Data_container_t & time_span,
+			      int & status)
+{
+    time_span.obt_times.assign(2, 0.0);
+    time_span.scet_times.assign(2, 0.0);
+
+    Fits_output_iteration_t iteration;
+    iteration.copy_rows = copy_rows;
+    iteration.rows = &rows;
+    iteration.producer = &producer;
+    iteration.time_span = &time_span;
+
+    fits_iterate_data(num_of_cols, cols, 0, 0,
+		      &get_rows_from_producer, &iteration, &status);
+
+    return iteration.error;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+write_common_fits_keywords(fitsfile * fptr,
+			   const Data_container_t & data,
+			   int & status)
+{
+    double firstobt = data.first_obt();
+    double lastobt = data.last_obt();
+    double firstsct = data.first_scet();
+    double lastsct = data.last_scet();
+    uint16_t od = data.od;
+    Radiometer_t radiometer = data.radiometer;
+
+    if(fits_write_key(fptr, TDOUBLE, "FIRSTOBT", 
+		      (void *) &firstobt, "First OBT time", &status) != 0 ||
+       fits_write_key(fptr, TDOUBLE, "LASTOBT", 
+		      (void *) &lastobt, "Last OBT time", &status) != 0 ||
+       fits_write_key(fptr, TDOUBLE, "FIRSTSCT", 
+		      (void *) &firstsct, "First SCET time [ms]", &status) != 0 ||
+       fits_write_key(fptr, TDOUBLE, "LASTSCT", 
+		      (void *) &lastsct, "Last SCET time [ms]", &status) != 0 ||
+       fits_write_key(fptr, TSHORT, "OD",
+		      (void *) &od, "Operational day", &status) != 0 ||
+       fits_write_key(fptr, TBYTE, "HORN",
+		      (void *) &radiometer.horn, "Horn number (18..28)", &status) != 0 ||
+       fits_write_key(fptr, TBYTE, "RAD",
+		      (void *) &radiometer.arm, "Radiometer number (0, 1)", &status) != 0 ||
+       fits_write_date(fptr, &status) != 0)
+	return;
+}
@@ -22,16 +22,48 @@
 #define DATA_CONTAINER_HPP
 
 #include <cstdint>
+#include <exception>
 #include <string>
+#include <vector>
 #include <fitsio.h>
 
-#include "config.hpp"
+#include "squeezer_config.hpp"
 #include "common_defs.hpp"
 
 #if HAVE_TOODI
 #include <LowLevelIO.h>
 #endif
 
+struct Data_container_t;
+
+// Receive the rows of a FITS file in batches, so that the file never
+// needs to be loaded in memory as a whole (see
+// Data_container_t::read_from_fits_file_in_batches)
+struct Row_batch_consumer_t {
+    virtual ~Row_batch_consumer_t() {}
+
+    // Called once before the first batch. Only the OBT and SCET times
+    // of "time_span" are set, and they contain the first and the last
+    // row of the file.
+    virtual void start(size_t num_of_rows,
+		       const Data_container_t & time_span) = 0;
+
+    // Called for each batch of consecutive rows, in order
+    virtual void add_rows(const Data_container_t & rows) = 0;
+};
+
+// Provide the rows to be written in a FITS file in batches (see
+// Data_container_t::write_to_fits_file_in_batches)
+struct Row_batch_producer_t {
+    virtual ~Row_batch_producer_t() {}
+
+    // Total number of rows that will be produced
+    virtual size_t number_of_rows() const = 0;
+
+    // Replace the contents of "rows" with the next "num_of_rows" rows
+    virtual void get_rows(size_t num_of_rows, Data_container_t & rows) = 0;
+};
+
 struct Data_container_t {
     std::vector<double> obt_times;
     std::vector<double> scet_times;
@@ -48,12 +80,84 @@ struct Data_container_t {
 
     virtual size_t number_of_columns() const = 0;
 
+    // Append rows [first, first + count) of "source", which must be a
+    // container of the same type
+    virtual void append_rows(const Data_container_t & source,
+			     size_t first,
+			     size_t count);
+
+    // Remove all the rows, but keep the memory allocated
+    virtual void clear_rows();
+
 #if HAVE_TOODI
     virtual void read_from_database(const std::string & obj_name) = 0;
 #endif
 
     virtual void read_from_fits_file(const std::string & file_name) = 0;
     virtual void write_to_fits_file(fitsfile * fptr, int & status) = 0;
+
+    // Read the file using the CFITSIO iterator. Each batch of rows is
+    // stored in this object, replacing the previous one, and passed
+    // to "consumer".
+    virtual void read_from_fits_file_in_batches(const std::string & file_name,
+						Row_batch_consumer_t & consumer) = 0;
+
+    // Create a table in "fptr" and fill it with the rows returned by
+    // "producer", one window of the CFITSIO iterator at a time. Each
+    // batch is stored in this object, replacing the previous one. An
+    // exception thrown by the producer is rethrown once the iteration
+    // has stopped.
+    virtual void write_to_fits_file_in_batches(fitsfile * fptr,
+					       Row_batch_producer_t & producer,
+					       int & status) = 0;
 };
 
+// Copy the rows in the current window of the CFITSIO iterator into
+// "rows", replacing their previous contents
+typedef void (* Copy_fits_rows_fn_t)(const iteratorCol * cols,
+				     long num_of_rows,
+				     Data_container_t & rows);
+
+// Helper for the implementations of read_from_fits_file_in_batches.
+// Pass the time span and then every batch of rows of the table in
+// "fptr" to "consumer". Errors reported by CFITSIO are saved in
+// "status"; if the consumer throws an exception, the iteration is
+// stopped and the exception is returned, so that the caller can close
+// the file before rethrowing it.
+std::exception_ptr
+iterate_over_fits_rows(fitsfile * fptr,
+		       int num_of_cols,
+		       iteratorCol * cols,
+		       Copy_fits_rows_fn_t copy_rows,
+		       Data_container_t & rows,
+		       Row_batch_consumer_t & consumer,
+		       int & status);
+
+// Write the keywords shared by all the tables created by squeezer:
+// first and last OBT/SCET times, OD and radiometer
+void
+write_common_fits_keywords(fitsfile * fptr,
+			   const Data_container_t & data,
+			   int & status);
+
+// Copy "rows" into the current window of the CFITSIO iterator, after
+// the null value of each array
+typedef void (* Copy_rows_to_fits_fn_t)(const Data_container_t & rows,
+					iteratorCol * cols);
+
+// Helper for the implementations of write_to_fits_file_in_batches.
+// Fill the output columns in "cols" with the rows returned by
+// "producer". The OBT and SCET times of the first and the last row
+// are saved in "time_span", so that they can be written in the
+// header. Errors are handled like in iterate_over_fits_rows.
+std::exception_ptr
+iterate_over_fits_output_rows(fitsfile * fptr,
+			      int num_of_cols,
+			      iteratorCol * cols,
+			      Copy_rows_to_fits_fn_t copy_rows,
+			      Data_container_t & rows,
+			      Row_batch_producer_t & producer,
+			      Data_container_t & time_span,
+			      int & status);
+
 #endif
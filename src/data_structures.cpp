@@ -23,12 +23,78 @@
 #include <cstring>
 #include <ctime>
 
+#include "crc32c.hpp"
 #include "file_io.hpp"
 #include "common_defs.hpp"
 #include "data_structures.hpp"
 
 //////////////////////////////////////////////////////////////////////
 
+// Unlike the payload of the chunks, floating-point values in the
+// headers are saved using the native endianness (see "write_double")
+static double
+read_native_double(Byte_view_t & in)
+{
+    double value;
+    in.read_buffer(sizeof(value), reinterpret_cast<uint8_t *>(&value));
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Helper functions used to serialize the headers in memory, so that
+// they can be written using one call to fwrite
+
+static inline uint8_t *
+put_uint8(uint8_t * dest, uint8_t value)
+{
+    *dest = value;
+    return dest + 1;
+}
+
+static inline uint8_t *
+put_uint16(uint8_t * dest, uint16_t value)
+{
+    dest = put_uint8(dest, value >> 8);
+    return put_uint8(dest, value & 0xFF);
+}
+
+static inline uint8_t *
+put_uint32(uint8_t * dest, uint32_t value)
+{
+    dest = put_uint16(dest, value >> 16);
+    return put_uint16(dest, value & 0xFFFF);
+}
+
+static inline uint8_t *
+put_uint64(uint8_t * dest, uint64_t value)
+{
+    dest = put_uint32(dest, value >> 32);
+    return put_uint32(dest, value & 0xFFFFFFFF);
+}
+
+static inline uint8_t *
+put_native_double(uint8_t * dest, double value)
+{
+    std::memcpy(dest, &value, sizeof(value));
+    return dest + sizeof(value);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Return true if the bytes pointed by "data" contain the
+// floating-point check of the file header. In files written by
+// version 1.0, it immediately follows the file mark.
+static bool
+is_floating_point_check(const uint8_t * data)
+{
+    uint8_t check_bytes[sizeof(double)];
+    put_native_double(check_bytes, 231250.0);
+    return std::memcmp(data, check_bytes, sizeof(check_bytes)) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 Squeezer_file_header_t::Squeezer_file_header_t(Squeezer_file_type_t type)
 {
     switch(type) {
@@ -69,6 +135,7 @@ Squeezer_file_header_t::Squeezer_file_header_t(Squeezer_file_type_t type)
     first_scet_in_ms = 0.0;
     last_scet_in_ms = 0.0;
     number_of_chunks = 0;
+    toc_offset = 0;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -76,29 +143,61 @@ Squeezer_file_header_t::Squeezer_file_header_t(Squeezer_file_type_t type)
 void 
 Squeezer_file_header_t::read_from_file(FILE * in)
 {
-    file_type_mark[0] = read_uint8(in);
-    file_type_mark[1] = read_uint8(in);
-    file_type_mark[2] = read_uint8(in);
-    file_type_mark[3] = read_uint8(in);
+    uint8_t bytes[SIZE_IN_BYTES];
+    size_t size = SIZE_WITHOUT_VERSION;
+    read_bytes(in, bytes, size);
+
+    if(! is_floating_point_check(bytes + 4)) {
+	read_bytes(in, bytes + size, SIZE_WITHOUT_TOC - size);
+	size = SIZE_WITHOUT_TOC;
+
+	// The version number follows the four-byte mark
+	const uint16_t version = (((uint16_t) bytes[4]) << 8) + bytes[5];
+	if(version >= FIRST_VERSION_WITH_TOC) {
+	    read_bytes(in, bytes + size, SIZE_IN_BYTES - size);
+	    size = SIZE_IN_BYTES;
+	}
+    }
 
-    floating_point_check = read_double(in);
+    Byte_view_t view(bytes, size);
+    read_from_buffer(view);
+}
 
-    date_year = read_uint16(in);
-    date_month = read_uint8(in);
-    date_day = read_uint8(in);
+//////////////////////////////////////////////////////////////////////
 
-    time_hour = read_uint8(in);
-    time_minute = read_uint8(in);
-    time_second = read_uint8(in);
+void 
+Squeezer_file_header_t::read_from_buffer(Byte_view_t & in)
+{
+    in.read_buffer(4, file_type_mark);
 
-    radiometer.horn = read_uint8(in);
-    radiometer.arm = read_uint8(in);
-    od = read_uint16(in);
-    first_obt = read_double(in);
-    last_obt = read_double(in);
-    first_scet_in_ms = read_double(in);
-    last_scet_in_ms = read_double(in);
-    number_of_chunks = read_uint32(in);
+    if(in.items_left() >= sizeof(double) &&
+       is_floating_point_check(in.cur_data()))
+	program_version = UNVERSIONED_FILE_VERSION;
+    else
+	program_version = in.read_uint16();
+    floating_point_check = read_native_double(in);
+
+    date_year = in.read_uint16();
+    date_month = in.read_uint8();
+    date_day = in.read_uint8();
+
+    time_hour = in.read_uint8();
+    time_minute = in.read_uint8();
+    time_second = in.read_uint8();
+
+    radiometer.horn = in.read_uint8();
+    radiometer.arm = in.read_uint8();
+    od = in.read_uint16();
+    first_obt = read_native_double(in);
+    last_obt = read_native_double(in);
+    first_scet_in_ms = read_native_double(in);
+    last_scet_in_ms = read_native_double(in);
+    number_of_chunks = in.read_uint32();
+
+    if(program_version >= FIRST_VERSION_WITH_TOC)
+	toc_offset = in.read_uint64();
+    else
+	toc_offset = 0;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -106,29 +205,43 @@ Squeezer_file_header_t::read_from_file(FILE * in)
 void 
 Squeezer_file_header_t::write_to_file(FILE * out) const
 {
-    write_uint8(out, file_type_mark[0]);
-    write_uint8(out, file_type_mark[1]);
-    write_uint8(out, file_type_mark[2]);
-    write_uint8(out, file_type_mark[3]);
-
-    write_double(out, floating_point_check);
-
-    write_uint16(out, date_year);
-    write_uint8(out, date_month);
-    write_uint8(out, date_day);
+    uint8_t bytes[SIZE_IN_BYTES];
+    write_to_buffer(bytes);
+    write_bytes(out, bytes, sizeof(bytes));
+}
 
-    write_uint8(out, time_hour);
-    write_uint8(out, time_minute);
-    write_uint8(out, time_second);
+//////////////////////////////////////////////////////////////////////
 
-    write_uint8(out, radiometer.horn);
-    write_uint8(out, radiometer.arm);
-    write_uint16(out, od);
-    write_double(out, first_obt);
-    write_double(out, last_obt);
-    write_double(out, first_scet_in_ms);
-    write_double(out, last_scet_in_ms);
-    write_uint32(out, number_of_chunks);
+uint8_t *
+Squeezer_file_header_t::write_to_buffer(uint8_t * dest) const
+{
+    dest = put_uint8(dest, file_type_mark[0]);
+    dest = put_uint8(dest, file_type_mark[1]);
+    dest = put_uint8(dest, file_type_mark[2]);
+    dest = put_uint8(dest, file_type_mark[3]);
+
+    dest = put_uint16(dest, program_version);
+    dest = put_native_double(dest, floating_point_check);
+
+    dest = put_uint16(dest, date_year);
+    dest = put_uint8(dest, date_month);
+    dest = put_uint8(dest, date_day);
+
+    dest = put_uint8(dest, time_hour);
+    dest = put_uint8(dest, time_minute);
+    dest = put_uint8(dest, time_second);
+
+    dest = put_uint8(dest, radiometer.horn);
+    dest = put_uint8(dest, radiometer.arm);
+    dest = put_uint16(dest, od);
+    dest = put_native_double(dest, first_obt);
+    dest = put_native_double(dest, last_obt);
+    dest = put_native_double(dest, first_scet_in_ms);
+    dest = put_native_double(dest, last_scet_in_ms);
+    dest = put_uint32(dest, number_of_chunks);
+    dest = put_uint64(dest, toc_offset);
+
+    return dest;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -159,13 +272,11 @@ Squeezer_file_header_t::is_valid() const
 bool
 Squeezer_file_header_t::is_compatible_version() const
 {
-    if(MAJOR_VERSION_FROM_UINT16(program_version) <= MAJOR_PROGRAM_VERSION)
+    if(program_version == UNVERSIONED_FILE_VERSION)
 	return true;
 
-    if(MINOR_VERSION_FROM_UINT16(program_version) <= MINOR_PROGRAM_VERSION)
-	return true;
-    else
-	return false;
+    return program_version >= OLDEST_COMPATIBLE_VERSION &&
+	program_version <= PROGRAM_VERSION;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -183,10 +294,22 @@ Error_t::Error_t()
 void
 Error_t::read_from_file(FILE * in)
 {
-    min_abs_error = read_double(in);
-    max_abs_error = read_double(in);
-    mean_abs_error = read_double(in);
-    mean_error = read_double(in);
+    uint8_t bytes[SIZE_IN_BYTES];
+    read_bytes(in, bytes, sizeof(bytes));
+
+    Byte_view_t view(bytes, sizeof(bytes));
+    read_from_buffer(view);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Error_t::read_from_buffer(Byte_view_t & in)
+{
+    min_abs_error = read_native_double(in);
+    max_abs_error = read_native_double(in);
+    mean_abs_error = read_native_double(in);
+    mean_error = read_native_double(in);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -194,10 +317,22 @@ Error_t::read_from_file(FILE * in)
 void
 Error_t::write_to_file(FILE * out) const
 {
-    write_double(out, min_abs_error);
-    write_double(out, max_abs_error);
-    write_double(out, mean_abs_error);
-    write_double(out, mean_error);
+    uint8_t bytes[SIZE_IN_BYTES];
+    write_to_buffer(bytes);
+    write_bytes(out, bytes, sizeof(bytes));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint8_t *
+Error_t::write_to_buffer(uint8_t * dest) const
+{
+    dest = put_native_double(dest, min_abs_error);
+    dest = put_native_double(dest, max_abs_error);
+    dest = put_native_double(dest, mean_abs_error);
+    dest = put_native_double(dest, mean_error);
+
+    return dest;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -223,24 +358,45 @@ Squeezer_chunk_header_t::Squeezer_chunk_header_t()
     number_of_samples = 0;
 
     chunk_type = 0;
+    backend = BACKEND_NONE;
+    filter = FILTER_NONE;
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-Squeezer_chunk_header_t::read_from_file(FILE * in)
+Squeezer_chunk_header_t::read_from_file(FILE * in,
+					uint16_t program_version)
 {
-    chunk_mark[0] = read_uint8(in);
-    chunk_mark[1] = read_uint8(in);
-    chunk_mark[2] = read_uint8(in);
-    chunk_mark[3] = read_uint8(in);
+    uint8_t bytes[SIZE_IN_BYTES];
+    const size_t size = size_in_bytes(program_version);
+    read_bytes(in, bytes, size);
 
-    number_of_bytes = read_uint64(in);
-    number_of_samples = read_uint32(in);
+    Byte_view_t view(bytes, size);
+    read_from_buffer(view, program_version);
+}
+
+//////////////////////////////////////////////////////////////////////
 
-    chunk_type = read_uint32(in);
+void
+Squeezer_chunk_header_t::read_from_buffer(Byte_view_t & in,
+					  uint16_t program_version)
+{
+    in.read_buffer(4, chunk_mark);
+
+    number_of_bytes = in.read_uint64();
+    number_of_samples = in.read_uint32();
+
+    chunk_type = in.read_uint32();
+    if(program_version == UNVERSIONED_FILE_VERSION) {
+	backend = BACKEND_NONE;
+	filter = FILTER_NONE;
+    } else {
+	backend = in.read_uint8();
+	filter = in.read_uint8();
+    }
 
-    compression_error.read_from_file(in);
+    compression_error.read_from_buffer(in);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -248,17 +404,29 @@ Squeezer_chunk_header_t::read_from_file(FILE * in)
 void
 Squeezer_chunk_header_t::write_to_file(FILE * out) const
 {
-    write_uint8(out, chunk_mark[0]);
-    write_uint8(out, chunk_mark[1]);
-    write_uint8(out, chunk_mark[2]);
-    write_uint8(out, chunk_mark[3]);
+    uint8_t bytes[SIZE_IN_BYTES];
+    write_to_buffer(bytes);
+    write_bytes(out, bytes, sizeof(bytes));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint8_t *
+Squeezer_chunk_header_t::write_to_buffer(uint8_t * dest) const
+{
+    dest = put_uint8(dest, chunk_mark[0]);
+    dest = put_uint8(dest, chunk_mark[1]);
+    dest = put_uint8(dest, chunk_mark[2]);
+    dest = put_uint8(dest, chunk_mark[3]);
 
-    write_uint64(out, number_of_bytes);
-    write_uint32(out, number_of_samples);
+    dest = put_uint64(dest, number_of_bytes);
+    dest = put_uint32(dest, number_of_samples);
 
-    write_uint32(out, chunk_type);
+    dest = put_uint32(dest, chunk_type);
+    dest = put_uint8(dest, backend);
+    dest = put_uint8(dest, filter);
 
-    compression_error.write_to_file(out);
+    return compression_error.write_to_buffer(dest);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -272,8 +440,245 @@ Squeezer_chunk_header_t::is_valid() const
        chunk_mark[3] != 0 ||
        number_of_bytes == 0 ||
        number_of_samples == 0 ||
-       chunk_type < CHUNK_DELTA_OBT || chunk_type > CHUNK_QUALITY_FLAGS)
+       chunk_type < CHUNK_DELTA_OBT || chunk_type > CHUNK_QUALITY_FLAGS ||
+       backend > BACKEND_LZ4 ||
+       filter > FILTER_BIT_SHUFFLE)
 	return false;
 
     return true;
 }
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_block_header_t::read_from_buffer(Byte_view_t & in,
+					  uint16_t program_version)
+{
+    number_of_samples = in.read_uint32();
+    number_of_bytes = in.read_uint32();
+    first_obt = in.read_double();
+    if(program_version >= FIRST_VERSION_WITH_CHECKSUMS)
+	checksum = in.read_uint32();
+    else
+	checksum = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_block_header_t::append_to_buffer(Byte_buffer_t & out) const
+{
+    out.append_uint32(number_of_samples);
+    out.append_uint32(number_of_bytes);
+    out.append_double(first_obt);
+    out.append_uint32(checksum);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint32_t
+Squeezer_block_header_t::compute_checksum(const uint8_t * block_data) const
+{
+    Byte_buffer_t header_bytes;
+    header_bytes.append_uint32(number_of_samples);
+    header_bytes.append_uint32(number_of_bytes);
+    header_bytes.append_double(first_obt);
+
+    const uint32_t header_crc = crc32c(header_bytes.buffer.data(),
+				       header_bytes.size());
+    return crc32c(block_data, number_of_bytes, header_crc);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Toc_entry_t::Toc_entry_t()
+{
+    chunk_type = 0;
+    offset = 0;
+    number_of_bytes = 0;
+    number_of_samples = 0;
+    backend = BACKEND_NONE;
+    filter = FILTER_NONE;
+    checksum = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Squeezer_toc_t::Squeezer_toc_t(uint64_t a_first_chunk_offset,
+			       size_t a_chunk_header_size)
+    : entries(),
+      first_chunk_offset(a_first_chunk_offset),
+      chunk_header_size(a_chunk_header_size)
+{
+    toc_mark[0] = 'T';
+    toc_mark[1] = 'O';
+    toc_mark[2] = 'C';
+    toc_mark[3] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_toc_t::add_chunk(const Squeezer_chunk_header_t & chunk_header)
+{
+    Toc_entry_t entry;
+    entry.chunk_type = chunk_header.chunk_type;
+    entry.offset = end_offset();
+    entry.number_of_bytes = chunk_header.number_of_bytes;
+    entry.number_of_samples = chunk_header.number_of_samples;
+    entry.backend = chunk_header.backend;
+    entry.filter = chunk_header.filter;
+
+    uint8_t header_bytes[Squeezer_chunk_header_t::SIZE_IN_BYTES];
+    chunk_header.write_to_buffer(header_bytes);
+    entry.checksum = crc32c(header_bytes, sizeof(header_bytes));
+
+    entries.push_back(entry);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint64_t
+Squeezer_toc_t::end_offset() const
+{
+    if(entries.empty())
+	return first_chunk_offset;
+
+    const Toc_entry_t & last_entry = entries.back();
+    return last_entry.offset
+	+ chunk_header_size
+	+ last_entry.number_of_bytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const Toc_entry_t *
+Squeezer_toc_t::find(Chunk_type_t chunk_type) const
+{
+    for(auto & cur_entry : entries) {
+	if(cur_entry.chunk_type == (uint32_t) chunk_type)
+	    return &cur_entry;
+    }
+
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_toc_t::read_from_file(FILE * in)
+{
+    uint8_t bytes[8];
+    read_bytes(in, bytes, sizeof(bytes));
+
+    Byte_view_t view(bytes, sizeof(bytes));
+    view.read_buffer(4, toc_mark);
+    const uint32_t num_of_entries = view.read_uint32();
+
+    // Do not trust "num_of_entries" to allocate memory: the file
+    // might be damaged
+    entries.clear();
+    for(uint32_t idx = 0; idx < num_of_entries; ++idx) {
+	uint8_t entry_bytes[Toc_entry_t::SIZE_IN_BYTES];
+	read_bytes(in, entry_bytes, sizeof(entry_bytes));
+
+	Byte_view_t entry_view(entry_bytes, sizeof(entry_bytes));
+	read_entries(entry_view, 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_toc_t::read_from_buffer(Byte_view_t & in)
+{
+    entries.clear();
+    in.read_buffer(4, toc_mark);
+    const uint32_t num_of_entries = in.read_uint32();
+
+    read_entries(in, num_of_entries);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Append "num_of_entries" entries to the table
+void
+Squeezer_toc_t::read_entries(Byte_view_t & in, size_t num_of_entries)
+{
+    if(num_of_entries > in.items_left() / Toc_entry_t::SIZE_IN_BYTES)
+	throw std::out_of_range("truncated table of contents");
+
+    for(size_t idx = 0; idx < num_of_entries; ++idx) {
+	Toc_entry_t entry;
+	entry.chunk_type = in.read_uint32();
+	entry.offset = in.read_uint64();
+	entry.number_of_bytes = in.read_uint64();
+	entry.number_of_samples = in.read_uint32();
+	entry.backend = in.read_uint8();
+	entry.filter = in.read_uint8();
+	entry.checksum = in.read_uint32();
+
+	entries.push_back(entry);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Squeezer_toc_t::write_to_file(FILE * out) const
+{
+    std::vector<uint8_t> bytes(size_in_bytes());
+    write_to_buffer(bytes.data());
+    write_bytes(out, bytes.data(), bytes.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint8_t *
+Squeezer_toc_t::write_to_buffer(uint8_t * dest) const
+{
+    dest = put_uint8(dest, toc_mark[0]);
+    dest = put_uint8(dest, toc_mark[1]);
+    dest = put_uint8(dest, toc_mark[2]);
+    dest = put_uint8(dest, toc_mark[3]);
+    dest = put_uint32(dest, entries.size());
+
+    for(auto & cur_entry : entries) {
+	dest = put_uint32(dest, cur_entry.chunk_type);
+	dest = put_uint64(dest, cur_entry.offset);
+	dest = put_uint64(dest, cur_entry.number_of_bytes);
+	dest = put_uint32(dest, cur_entry.number_of_samples);
+	dest = put_uint8(dest, cur_entry.backend);
+	dest = put_uint8(dest, cur_entry.filter);
+	dest = put_uint32(dest, cur_entry.checksum);
+    }
+
+    return dest;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+Squeezer_toc_t::is_valid(const Squeezer_file_header_t & file_header) const
+{
+    if(toc_mark[0] != 'T' ||
+       toc_mark[1] != 'O' ||
+       toc_mark[2] != 'C' ||
+       toc_mark[3] != 0 ||
+       entries.size() != file_header.number_of_chunks)
+	return false;
+
+    uint64_t min_offset = file_header.size_in_bytes();
+    for(auto & cur_entry : entries) {
+	if(cur_entry.offset < min_offset ||
+	   cur_entry.chunk_type < CHUNK_DELTA_OBT ||
+	   cur_entry.chunk_type > CHUNK_QUALITY_FLAGS)
+	    return false;
+
+	min_offset = cur_entry.offset
+	    + Squeezer_chunk_header_t::SIZE_IN_BYTES
+	    + cur_entry.number_of_bytes;
+    }
+
+    return min_offset <= file_header.toc_offset;
+}
@@ -24,7 +24,9 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <vector>
 #include "common_defs.hpp"
+#include "byte_buffer.hpp"
 
 extern const uint16_t program_version;
 
@@ -53,8 +55,24 @@ struct Squeezer_file_header_t {
     double first_scet_in_ms;
     double last_scet_in_ms;
 
+    // A long column can be split in several chunks of the same type,
+    // one for each group of rows, which must be concatenated. The
+    // chunks of a group are in the same order as the columns, and the
+    // OBT times always come first.
     uint32_t number_of_chunks;
 
+    // Position of the table of contents, counted from the first byte
+    // of this header. Zero if the file has no table of contents
+    // (e.g., because it was written to a pipe or by an old version).
+    uint64_t toc_offset;
+
+    // Number of bytes used by the header in a file. Files older than
+    // FIRST_VERSION_WITH_TOC lack the "toc_offset" field, and files
+    // written by version 1.0 lack "program_version" too.
+    static const size_t SIZE_WITHOUT_VERSION = 59;
+    static const size_t SIZE_WITHOUT_TOC = SIZE_WITHOUT_VERSION + 2;
+    static const size_t SIZE_IN_BYTES = SIZE_WITHOUT_TOC + 8;
+
     Squeezer_file_header_t(Squeezer_file_type_t type);
 
     Squeezer_file_type_t get_type() const {
@@ -66,8 +84,22 @@ struct Squeezer_file_header_t {
 	    return SQZ_NO_DATA;
     }
 
+    // Number of bytes actually used by this header, which depends on
+    // the version of the file
+    size_t size_in_bytes() const {
+	if(program_version == UNVERSIONED_FILE_VERSION)
+	    return SIZE_WITHOUT_VERSION;
+
+	return (program_version >= FIRST_VERSION_WITH_TOC) ?
+	    SIZE_IN_BYTES : SIZE_WITHOUT_TOC;
+    }
+
     void read_from_file(FILE * in);
+    void read_from_buffer(Byte_view_t & in);
     void write_to_file(FILE * out) const;
+    // Serialize the header into "dest", which must be at least
+    // SIZE_IN_BYTES long, and return a pointer past the last byte
+    uint8_t * write_to_buffer(uint8_t * dest) const;
 
     bool is_valid() const;
     bool is_compatible_version() const;
@@ -81,10 +113,14 @@ struct Error_t {
     double mean_abs_error;
     double mean_error;
 
+    static const size_t SIZE_IN_BYTES = 32;
+
     Error_t();
 
     void read_from_file(FILE * in);
+    void read_from_buffer(Byte_view_t & in);
     void write_to_file(FILE * out) const;
+    uint8_t * write_to_buffer(uint8_t * dest) const;
 
     bool is_valid() const;
 };
@@ -97,15 +133,139 @@ struct Squeezer_chunk_header_t {
     uint32_t number_of_samples;
 
     uint32_t chunk_type;
+    uint8_t backend;
+    uint8_t filter;
 
     Error_t compression_error;
 
+    // Files written by version 1.0 lack the "backend" and "filter"
+    // fields
+    static const size_t SIZE_WITHOUT_BACKEND = 20 + Error_t::SIZE_IN_BYTES;
+    static const size_t SIZE_IN_BYTES = SIZE_WITHOUT_BACKEND + 2;
+
     Squeezer_chunk_header_t();
 
-    void read_from_file(FILE * in);
+    static size_t size_in_bytes(uint16_t program_version) {
+	return (program_version == UNVERSIONED_FILE_VERSION) ?
+	    SIZE_WITHOUT_BACKEND : SIZE_IN_BYTES;
+    }
+
+    // The layout of the header depends on the version of the file
+    void read_from_file(FILE * in,
+			uint16_t program_version = PROGRAM_VERSION);
+    void read_from_buffer(Byte_view_t & in,
+			  uint16_t program_version = PROGRAM_VERSION);
     void write_to_file(FILE * out) const;
+    uint8_t * write_to_buffer(uint8_t * dest) const;
 
     bool is_valid() const;
 };
 
+//////////////////////////////////////////////////////////////////////
+
+// The samples of a chunk are split into blocks that can be decoded
+// independently. Each block is preceded by this header, which is part
+// of the payload of the chunk and is therefore saved in big-endian
+// order. The filter and the backend compressor are applied to each
+// block separately.
+struct Squeezer_block_header_t {
+    uint32_t number_of_samples;
+    // Size of the block, excluding this header
+    uint32_t number_of_bytes;
+    // OBT time of the first sample in the block
+    double first_obt;
+    // CRC-32C of the fields above followed by the "number_of_bytes"
+    // bytes of the block (see compute_checksum)
+    uint32_t checksum;
+
+    // Files older than FIRST_VERSION_WITH_CHECKSUMS lack the
+    // "checksum" field
+    static const size_t SIZE_WITHOUT_CHECKSUM = 16;
+    static const size_t SIZE_IN_BYTES = SIZE_WITHOUT_CHECKSUM + 4;
+
+    Squeezer_block_header_t()
+	: number_of_samples(0),
+	  number_of_bytes(0),
+	  first_obt(0.0),
+	  checksum(0) {}
+
+    // The layout of the header depends on the version of the file
+    void read_from_buffer(Byte_view_t & in,
+			  uint16_t program_version = PROGRAM_VERSION);
+    void append_to_buffer(Byte_buffer_t & out) const;
+
+    // Return the CRC-32C of the first SIZE_WITHOUT_CHECKSUM bytes of
+    // the header followed by the "number_of_bytes" bytes pointed by
+    // "block_data". The header is included, so that a damaged
+    // "first_obt" or "number_of_samples" is detected too.
+    uint32_t compute_checksum(const uint8_t * block_data) const;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Position and properties of a chunk, as recorded in the table of
+// contents
+struct Toc_entry_t {
+    uint32_t chunk_type;
+    // Position of the chunk header, counted from the first byte of
+    // the file header
+    uint64_t offset;
+    // Size of the payload (the chunk header is not included)
+    uint64_t number_of_bytes;
+    uint32_t number_of_samples;
+    uint8_t backend;
+    uint8_t filter;
+    // CRC-32C of the chunk header, zero if no checksum is available
+    uint32_t checksum;
+
+    static const size_t SIZE_IN_BYTES = 30;
+
+    Toc_entry_t();
+};
+
+// The table of contents is written after the last chunk, so that
+// single chunks can be found with one seek
+struct Squeezer_toc_t {
+    uint8_t toc_mark[4];
+    std::vector<Toc_entry_t> entries;
+
+    // Position of the first chunk (i.e., the size of the file
+    // header) and size of the chunk headers, which depend on the
+    // version of the file. These are not saved in the file.
+    uint64_t first_chunk_offset;
+    size_t chunk_header_size;
+
+    explicit Squeezer_toc_t(uint64_t a_first_chunk_offset =
+			    Squeezer_file_header_t::SIZE_IN_BYTES,
+			    size_t a_chunk_header_size =
+			    Squeezer_chunk_header_t::SIZE_IN_BYTES);
+
+    // Append an entry for a chunk that immediately follows the last
+    // one in the table (or the file header, if the table is empty)
+    void add_chunk(const Squeezer_chunk_header_t & chunk_header);
+
+    // Position of the first byte after the last chunk in the table
+    uint64_t end_offset() const;
+
+    // Return the first chunk of the given type, or NULL if there is
+    // none
+    const Toc_entry_t * find(Chunk_type_t chunk_type) const;
+
+    void read_from_file(FILE * in);
+    void read_from_buffer(Byte_view_t & in);
+    void write_to_file(FILE * out) const;
+    // Serialize the table into "dest", which must be at least
+    // size_in_bytes() long, and return a pointer past the last byte
+    uint8_t * write_to_buffer(uint8_t * dest) const;
+
+    size_t size_in_bytes() const {
+	return 8 + entries.size() * Toc_entry_t::SIZE_IN_BYTES;
+    }
+
+    bool is_valid(const Squeezer_file_header_t & file_header) const;
+
+private:
+    void read_entries(Byte_view_t & in, size_t num_of_entries);
+};
+
 #endif
@@ -151,6 +151,84 @@ throw_error:
 
 //////////////////////////////////////////////////////////////////////
 
+static void
+copy_datadiff_rows(const iteratorCol * cols,
+		   long num_of_rows,
+		   Data_container_t & rows)
+{
+    auto & datadiff = dynamic_cast<Differenced_data_t &>(rows);
+
+    // The first element of each array is the null value
+    const double * obt = ((const double *) cols[0].array) + 1;
+    const double * scet = ((const double *) cols[1].array) + 1;
+    const double * sky_load = ((const double *) cols[2].array) + 1;
+    const unsigned long * flags = ((const unsigned long *) cols[3].array) + 1;
+
+    datadiff.obt_times.assign(obt, obt + num_of_rows);
+    datadiff.scet_times.assign(scet, scet + num_of_rows);
+    datadiff.sky_load.assign(sky_load, sky_load + num_of_rows);
+    datadiff.quality_flags.assign(flags, flags + num_of_rows);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Differenced_data_t::read_from_fits_file_in_batches(const std::string & file_name,
+						   Row_batch_consumer_t & consumer)
+{
+    fitsfile * fptr;
+    int status = 0;
+    std::exception_ptr consumer_error;
+    char radiometer_name[FLEN_KEYWORD];
+
+    fits_open_table(&fptr, const_cast<char *>(file_name.c_str()),
+		    READONLY, &status);
+    if(status != 0)
+	goto throw_error;
+
+    fits_read_key_str(fptr, "EXTNAME", &radiometer_name[0], NULL, &status);
+    if(status != 0)
+	goto close_and_throw_error;
+
+    {
+	iteratorCol cols[4];
+	int n_cols = 4;
+	fits_iter_set_by_name(&cols[0], fptr, (char *) "OBT", TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[1], fptr, (char *) "SCET", TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[2], fptr, (char *) radiometer_name, TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[3], fptr, (char *) "flag", TULONG, InputCol);
+
+	consumer_error = iterate_over_fits_rows(fptr, n_cols, cols,
+						&copy_datadiff_rows,
+						*this, consumer, status);
+    }
+    if(status != 0)
+	goto close_and_throw_error;
+
+    fits_close_file(fptr, &status);
+    if(consumer_error)
+	std::rethrow_exception(consumer_error);
+    if(status != 0)
+	goto throw_error;
+
+    return;
+
+close_and_throw_error:
+    status = 0; // Reset the error status
+    fits_close_file(fptr, &status);
+    
+throw_error:
+    char error_msg[80];
+    std::string error_string;
+    while(fits_read_errmsg(error_msg) != 0) {
+	error_string += error_msg;
+	error_string += '\n';
+    }
+    throw std::runtime_error(error_string);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 static int
 save_data(long total_num,
 	  long offset,
@@ -188,11 +266,15 @@ save_data(long total_num,
 
 //////////////////////////////////////////////////////////////////////
 
-void
-Differenced_data_t::write_to_fits_file(fitsfile * fptr, int & status)
+// Create a binary table with "num_of_rows" rows and one column for
+// each field of Differenced_data_t. The column containing the data is
+// named after the radiometer.
+static int
+create_datadiff_table(fitsfile * fptr,
+		      LONGLONG num_of_rows,
+		      const Radiometer_t & radiometer,
+		      int & status)
 {
-    // Since we're going to use a few gotos, it is better to declare
-    // all the variables before the first goto
     std::vector<char *> ttype { (char *) "OBT", 
                                 (char *) "SCET", 
                                 (char *) "",
@@ -206,47 +288,129 @@ Differenced_data_t::write_to_fits_file(fitsfile * fptr, int & status)
 		       (char *) "V", 
 		       (char *) "dimensionless" };
 
-    double firstobt = obt_times.front();
-    double lastobt = obt_times.back();
-    double firstsct = scet_times.front();
-    double lastsct = scet_times.back();
-
     char extname[30];
 
     ttype[2] = (char *) alloca(12);
     std::strncpy(ttype[2], radiometer.to_str().c_str(), 12);
     std::strncpy(extname, radiometer.to_str().c_str(), sizeof(extname));
-    if(fits_create_tbl(fptr, BINARY_TBL, obt_times.size(), 4, 
-		       ttype.data(), tform, tunit, extname, &status) != 0)
+    return fits_create_tbl(fptr, BINARY_TBL, num_of_rows, 4, 
+			   ttype.data(), tform, tunit, extname, &status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+set_output_columns(fitsfile * fptr, iteratorCol * cols)
+{
+    fits_iter_set_by_num(&cols[0], fptr, 1, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[1], fptr, 2, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[2], fptr, 3, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[3], fptr, 4, TULONG, OutputCol);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Differenced_data_t::write_to_fits_file(fitsfile * fptr, int & status)
+{
+    if(create_datadiff_table(fptr, obt_times.size(), radiometer, status) != 0)
 	return;
 
     {
 	iteratorCol cols[4];
 	int n_cols = 4;
-	fits_iter_set_by_num(&cols[0], fptr, 1, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[1], fptr, 2, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[2], fptr, 3, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[3], fptr, 4, TULONG, OutputCol);
+	set_output_columns(fptr, cols);
 
 	fits_iterate_data(n_cols, cols, 0, 0, &save_data, this, &status);
     }
     if(status != 0)
 	return;
 
-    if(fits_write_key(fptr, TDOUBLE, "FIRSTOBT", 
-		      (void *) &firstobt, "First OBT time", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "LASTOBT", 
-		      (void *) &lastobt, "Last OBT time", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "FIRSTSCT", 
-		      (void *) &firstsct, "First SCET time [ms]", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "LASTSCT", 
-		      (void *) &lastsct, "Last SCET time [ms]", &status) != 0 ||
-       fits_write_key(fptr, TSHORT, "OD",
-		      (void *) &od, "Operational day", &status) != 0 ||
-       fits_write_key(fptr, TBYTE, "HORN",
-		      (void *) &radiometer.horn, "Horn number (18..28)", &status) != 0 ||
-       fits_write_key(fptr, TBYTE, "RAD",
-		      (void *) &radiometer.arm, "Radiometer number (0, 1)", &status) != 0 ||
-       fits_write_date(fptr, &status) != 0)
+    write_common_fits_keywords(fptr, *this, status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+copy_datadiff_rows_to_fits(const Data_container_t & rows,
+			   iteratorCol * cols)
+{
+    auto & datadiff = dynamic_cast<const Differenced_data_t &>(rows);
+    const std::vector<double> * columns[] = {
+	&datadiff.obt_times,
+	&datadiff.scet_times,
+	&datadiff.sky_load
+    };
+
+    for(size_t idx = 0; idx < 3; ++idx) {
+	double * values = (double *) cols[idx].array;
+	values[0] = DOUBLENULLVALUE;
+	std::copy(columns[idx]->begin(), columns[idx]->end(), values + 1);
+    }
+
+    unsigned long * flags = (unsigned long *) cols[3].array;
+    flags[0] = 0;
+    std::copy(datadiff.quality_flags.begin(), datadiff.quality_flags.end(),
+	      flags + 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Differenced_data_t::write_to_fits_file_in_batches(fitsfile * fptr,
+						  Row_batch_producer_t & producer,
+						  int & status)
+{
+    if(create_datadiff_table(fptr, producer.number_of_rows(),
+			     radiometer, status) != 0)
+	return;
+
+    Differenced_data_t time_span(calibrated);
+    std::exception_ptr producer_error;
+    {
+	iteratorCol cols[4];
+	int n_cols = 4;
+	set_output_columns(fptr, cols);
+
+	producer_error = iterate_over_fits_output_rows(fptr, n_cols, cols,
+						       &copy_datadiff_rows_to_fits,
+						       *this, producer,
+						       time_span, status);
+    }
+    if(producer_error)
+	std::rethrow_exception(producer_error);
+    if(status != 0)
 	return;
+
+    time_span.radiometer = radiometer;
+    time_span.od = od;
+    write_common_fits_keywords(fptr, time_span, status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Differenced_data_t::append_rows(const Data_container_t & source,
+				size_t first,
+				size_t count)
+{
+    Data_container_t::append_rows(source, first, count);
+
+    auto & datadiff = dynamic_cast<const Differenced_data_t &>(source);
+    sky_load.insert(sky_load.end(),
+		    datadiff.sky_load.begin() + first,
+		    datadiff.sky_load.begin() + first + count);
+    quality_flags.insert(quality_flags.end(),
+			 datadiff.quality_flags.begin() + first,
+			 datadiff.quality_flags.begin() + first + count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Differenced_data_t::clear_rows()
+{
+    Data_container_t::clear_rows();
+    sky_load.clear();
+    quality_flags.clear();
 }
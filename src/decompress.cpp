@@ -18,11 +18,16 @@
  * 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 
 #include <gsl/gsl_math.h>
 
@@ -31,6 +36,12 @@
 #include "byte_buffer.hpp"
 #include "run_length_encoding.hpp"
 #include "poly_fit_encoding.hpp"
+#include "backends.hpp"
+#include "byte_buffer_pool.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "shuffle.hpp"
+#include "crc32c.hpp"
 #include "datadiff.hpp"
 #include "detpoint.hpp"
 #include "decompress.hpp"
@@ -38,7 +49,7 @@
 //////////////////////////////////////////////////////////////////////
 
 void
-decompress_obt_times(Byte_buffer_t & buffer,
+decompress_obt_times(Byte_view_t & buffer,
 		     double first_obt,
 		     size_t num_of_samples,
 		     std::vector<double> & dest)
@@ -57,13 +68,16 @@ decompress_obt_times(Byte_buffer_t & buffer,
 //////////////////////////////////////////////////////////////////////
 
 void
-decompress_scet_times(Byte_buffer_t & buffer,
+decompress_scet_times(Byte_view_t & buffer,
 		      const Squeezer_file_header_t & file_header,
 		      const std::vector<double> & obt_times,
 		      std::vector<double> & dest)
 {
     dest.resize(obt_times.size());
 
+    std::vector<float> scet_corrections(obt_times.size());
+    buffer.read_floats(scet_corrections.data(), scet_corrections.size());
+
     const double slope = 
 	(file_header.last_scet_in_ms - file_header.first_scet_in_ms) / 
 	(file_header.last_obt - file_header.first_obt);
@@ -71,16 +85,15 @@ decompress_scet_times(Byte_buffer_t & buffer,
     for(size_t idx = 0; idx < obt_times.size(); ++idx) {
 	double interpolated_scet =
 	    file_header.first_scet_in_ms + slope * (obt_times[idx] - file_header.first_obt);
-	double scet_correction = buffer.read_float();
 
-	dest[idx] = interpolated_scet + scet_correction;
+	dest[idx] = interpolated_scet + scet_corrections[idx];
     }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-decompress_angles(Byte_buffer_t & buffer,
+decompress_angles(Byte_view_t & buffer,
 		  size_t num_of_samples,
 		  std::vector<double> & dest,
 		  const Decompression_parameters_t & params)
@@ -104,19 +117,20 @@ decompress_angles(Byte_buffer_t & buffer,
 //////////////////////////////////////////////////////////////////////
 
 void
-decompress_scientific_data(Byte_buffer_t & buffer,
+decompress_scientific_data(Byte_view_t & buffer,
 			   size_t num_of_samples,
 			   std::vector<double> & dest)
 {
-    dest.resize(num_of_samples);
-    for(size_t idx = 0; idx < num_of_samples; ++idx)
-	dest[idx] = buffer.read_float();
+    std::vector<float> single_prec_data(num_of_samples);
+    buffer.read_floats(single_prec_data.data(), num_of_samples);
+
+    dest.assign(single_prec_data.begin(), single_prec_data.end());
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-decompress_quality_flags(Byte_buffer_t & buffer,
+decompress_quality_flags(Byte_view_t & buffer,
 			 size_t num_of_samples,
 			 std::vector<uint32_t> & dest)
 {
@@ -125,130 +139,526 @@ decompress_quality_flags(Byte_buffer_t & buffer,
 
 //////////////////////////////////////////////////////////////////////
 
-void
-decompress_chunk(size_t chunk_idx,
-		 const Squeezer_file_header_t & file_header,
-		 const Squeezer_chunk_header_t & chunk_header,
-		 FILE * input_file,
-		 const Decompression_parameters_t & params,
+// Buffers used to hold the output of the backends and filters are
+// recycled across chunks and files
+static thread_local Byte_buffer_pool_t buffer_pool;
+
+//////////////////////////////////////////////////////////////////////
+
+// Return the vector that holds the samples of a column of type
+// "chunk_type". Throw an exception if the container does not have
+// such a column. (Quality flags are handled separately, as they are
+// integers.)
+static std::vector<double> &
+column_for_chunk(Chunk_type_t chunk_type,
 		 Data_container_t * data_container)
 {
-    if(! chunk_header.is_valid()) {
+    Detector_pointings_t * detpoints =
+	dynamic_cast<Detector_pointings_t *>(data_container);
+    Differenced_data_t * datadiff =
+	dynamic_cast<Differenced_data_t *>(data_container);
 
-	std::cerr << PROGRAM_NAME
-		  << ": the input file seems to have been corrupted.\n";
-	return;
+    switch(chunk_type) {
+    case CHUNK_DELTA_OBT: return data_container->obt_times;
+    case CHUNK_SCET_ERROR: return data_container->scet_times;
+    case CHUNK_THETA: if(detpoints) return detpoints->theta; break;
+    case CHUNK_PHI: if(detpoints) return detpoints->phi; break;
+    case CHUNK_PSI: if(detpoints) return detpoints->psi; break;
+    case CHUNK_DIFFERENCED_DATA: if(datadiff) return datadiff->sky_load; break;
+    default: break;
+    }
 
-    } else if(params.verbose_flag) {
+    throw std::runtime_error("unexpected chunk type \""
+			     + column_name(chunk_type) + "\"");
+}
 
-	std::cerr << PROGRAM_NAME
-		  << ": reading data chunk #"
-		  << chunk_idx + 1
-		  << " (";
+//////////////////////////////////////////////////////////////////////
 
-	switch(chunk_header.chunk_type) {
-	case CHUNK_DELTA_OBT: std::cerr << "OBT times"; break;
-	case CHUNK_SCET_ERROR: std::cerr << "SCET times"; break;
-	case CHUNK_THETA: std::cerr << "theta angle"; break;
-	case CHUNK_PHI: std::cerr << "phi angle"; break;
-	case CHUNK_PSI: std::cerr << "psi angle"; break;
-	default: std::cerr << "unknown chunk";
-	}
+static void
+resize_column(Chunk_type_t chunk_type,
+	      size_t num_of_samples,
+	      Data_container_t * data_container)
+{
+    if(chunk_type == CHUNK_QUALITY_FLAGS) {
+	Differenced_data_t * datadiff =
+	    dynamic_cast<Differenced_data_t *>(data_container);
+	if(datadiff == NULL)
+	    throw std::runtime_error("unexpected chunk type \"flags\"");
+
+	datadiff->quality_flags.resize(num_of_samples);
+    } else {
+	column_for_chunk(chunk_type, data_container).resize(num_of_samples);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
 
-	std::cerr << ")\n";
+// Return true if the chunk must be decoded. OBT times are needed to
+// decode SCET times, so they are implicitly selected together.
+static bool
+is_selected_chunk(Chunk_type_t chunk_type, unsigned int column_mask)
+{
+    if(chunk_type == CHUNK_DELTA_OBT &&
+       (column_mask & column_bit(CHUNK_SCET_ERROR)) != 0)
+	return true;
+
+    return (column_mask & column_bit(chunk_type)) != 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Return the arrays that hold the columns of "data_container", which
+// must already have their final size
+static Decompressed_arrays_t
+arrays_for_container(Data_container_t * data_container)
+{
+    Decompressed_arrays_t arrays;
+    arrays.obt_times = data_container->obt_times.data();
+    arrays.scet_times = data_container->scet_times.data();
+    arrays.capacity = data_container->obt_times.size();
 
+    Detector_pointings_t * detpoints =
+	dynamic_cast<Detector_pointings_t *>(data_container);
+    if(detpoints != NULL) {
+	arrays.theta = detpoints->theta.data();
+	arrays.phi = detpoints->phi.data();
+	arrays.psi = detpoints->psi.data();
     }
 
-    Byte_buffer_t chunk_data;
-    chunk_data.buffer.resize(chunk_header.number_of_bytes);
-    if(fread(chunk_data.buffer.data(), 
-	     1, 
-	     chunk_header.number_of_bytes, 
-	     input_file) < chunk_header.number_of_bytes) {
+    Differenced_data_t * datadiff =
+	dynamic_cast<Differenced_data_t *>(data_container);
+    if(datadiff != NULL) {
+	arrays.sky_load = datadiff->sky_load.data();
+	arrays.quality_flags = datadiff->quality_flags.data();
+    }
 
-	std::cerr << PROGRAM_NAME
-		  << ": unable to read the contents of chunk #"
-		  << chunk_idx + 1
-		  << ", perhaps the file is corrupted or disappeared "
-		  << "during reading\n";
-	return;
+    return arrays;
+}
 
+//////////////////////////////////////////////////////////////////////
+
+// Return the array in "arrays" for a column of type "chunk_type"
+// (quality flags are handled separately, as they are integers)
+static double *
+array_for_chunk(Chunk_type_t chunk_type,
+		const Decompressed_arrays_t & arrays)
+{
+    switch(chunk_type) {
+    case CHUNK_DELTA_OBT: return arrays.obt_times;
+    case CHUNK_SCET_ERROR: return arrays.scet_times;
+    case CHUNK_THETA: return arrays.theta;
+    case CHUNK_PHI: return arrays.phi;
+    case CHUNK_PSI: return arrays.psi;
+    case CHUNK_DIFFERENCED_DATA: return arrays.sky_load;
+    default: return NULL;
     }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Number of threads left to the backend of each block, when
+// "num_of_blocks" blocks are decoded in parallel using
+// "num_of_threads" threads: if there is just one block, the backend
+// can split it further
+static unsigned int
+threads_per_block(size_t num_of_blocks, unsigned int num_of_threads)
+{
+    return (num_of_blocks > 1) ? 1 : num_of_threads;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Undo the backend and the filter, then decode the samples in the
+// block and save them in the array of the column in "dest", starting
+// from "first_sample". The array must be large enough, so that this
+// function can be called for many blocks at the same time. SCET
+// times need the OBT times of the same samples in "dest". The
+// backend can use up to "backend_threads" threads.
+static void
+decompress_block(const Squeezer_file_header_t & file_header,
+		 const Squeezer_chunk_header_t & chunk_header,
+		 const Squeezer_block_header_t & block_header,
+		 Byte_view_t block_data,
+		 size_t first_sample,
+		 const Decompression_parameters_t & params,
+		 unsigned int backend_threads,
+		 const Decompressed_arrays_t & dest)
+{
+    if(file_header.program_version >= FIRST_VERSION_WITH_CHECKSUMS &&
+       block_header.compute_checksum(block_data.cur_data()) != block_header.checksum)
+	throw std::runtime_error("wrong checksum, the file is corrupted");
 
-    switch(chunk_header.chunk_type) {
+    // If no backend and no filter were used, the decoders read the
+    // payload directly from the input (e.g., a memory-mapped file)
+    Pooled_buffer_t decoded_data(buffer_pool);
+    Pooled_buffer_t unfiltered_data(buffer_pool);
+
+    if(chunk_header.backend != BACKEND_NONE) {
+	backend_decompression(static_cast<Backend_type_t>(chunk_header.backend),
+			      block_data, *decoded_data, backend_threads);
+	block_data = Byte_view_t(*decoded_data);
+    }
+
+    if(chunk_header.filter != FILTER_NONE) {
+	undo_filter(static_cast<Filter_type_t>(chunk_header.filter),
+		    block_data, *unfiltered_data);
+	block_data = Byte_view_t(*unfiltered_data);
+    }
+
+    const Chunk_type_t chunk_type =
+	static_cast<Chunk_type_t>(chunk_header.chunk_type);
+    const size_t num_of_samples = block_header.number_of_samples;
+
+    if(chunk_type == CHUNK_QUALITY_FLAGS) {
+	if(dest.quality_flags == NULL)
+	    throw std::runtime_error("unexpected chunk type \"flags\"");
+
+	std::vector<uint32_t> flags;
+	decompress_quality_flags(block_data, num_of_samples, flags);
+	std::copy(flags.begin(), flags.end(), dest.quality_flags + first_sample);
+	return;
+    }
+
+    double * dest_array = array_for_chunk(chunk_type, dest);
+    if(dest_array == NULL)
+	throw std::runtime_error("unexpected chunk type \""
+				 + column_name(chunk_type) + "\"");
+
+    std::vector<double> samples;
+    switch(chunk_type) {
     case CHUNK_DELTA_OBT:
-	decompress_obt_times(chunk_data, 
-			     file_header.first_obt,
-			     chunk_header.number_of_samples,
-			     data_container->obt_times);
+	decompress_obt_times(block_data,
+			     block_header.first_obt,
+			     num_of_samples - 1,
+			     samples);
 	break;
     case CHUNK_SCET_ERROR:
-	if(data_container->obt_times.empty()) {
-	    std::cerr << PROGRAM_NAME
-		      << ": malformed chunk #"
-		      << chunk_idx + 1
-		      << ", SCET times have been found here but no "
-		      << "OBT times have been read yet\n";
-
-	    return;
-	}
-
-	decompress_scet_times(chunk_data, 
-			      file_header,
-			      data_container->obt_times, 
-			      data_container->scet_times);
-	break;
-    case CHUNK_THETA:
     {
-	Detector_pointings_t * detpoints =
-	    dynamic_cast<Detector_pointings_t *>(data_container);
-	decompress_angles(chunk_data, 
-			  chunk_header.number_of_samples,
-			  detpoints->theta,
-			  params);
+	const double * first_obt = dest.obt_times + first_sample;
+	const std::vector<double> obt_times(first_obt, first_obt + num_of_samples);
+	decompress_scet_times(block_data,
+			      file_header,
+			      obt_times,
+			      samples);
 	break;
     }
+    case CHUNK_THETA:
     case CHUNK_PHI:
-    {
-	Detector_pointings_t * detpoints =
-	    dynamic_cast<Detector_pointings_t *>(data_container);
-	decompress_angles(chunk_data, 
-			  chunk_header.number_of_samples,
-			  detpoints->phi,
-			  params);
-	break;
-    }
     case CHUNK_PSI:
-    {
-	Detector_pointings_t * detpoints =
-	    dynamic_cast<Detector_pointings_t *>(data_container);
-	decompress_angles(chunk_data, 
-			  chunk_header.number_of_samples,
-			  detpoints->psi,
-			  params);
+	decompress_angles(block_data, num_of_samples, samples, params);
 	break;
-    }
     case CHUNK_DIFFERENCED_DATA:
-    {
-	Differenced_data_t * datadiff =
-	    dynamic_cast<Differenced_data_t *>(data_container);
-	decompress_scientific_data(chunk_data, 
-				   chunk_header.number_of_samples,
-				   datadiff->sky_load);
-	break;
-    }
-    case CHUNK_QUALITY_FLAGS:
-    {
-	Differenced_data_t * datadiff =
-	    dynamic_cast<Differenced_data_t *>(data_container);
-	decompress_quality_flags(chunk_data, 
-				 chunk_header.number_of_samples,
-				 datadiff->quality_flags);
+	decompress_scientific_data(block_data, num_of_samples, samples);
 	break;
-    }
     default:
 	abort();
     }
+
+    std::copy(samples.begin(), samples.end(), dest_array + first_sample);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Remove the blocks that cannot contain samples in the OBT range
+// specified by "params". Every column is split into blocks at the
+// same samples, so the same blocks are kept for all the chunks. The
+// OBT times of a block are bounded by the first time of the next
+// block (or the last time in the file).
+static void
+select_blocks_in_obt_range(const Squeezer_file_header_t & file_header,
+			   const Decompression_parameters_t & params,
+			   std::vector<Squeezer_block_header_t> & block_headers,
+			   std::vector<Byte_view_t> & block_data)
+{
+    std::vector<Squeezer_block_header_t> selected_headers;
+    std::vector<Byte_view_t> selected_data;
+
+    for(size_t idx = 0; idx < block_headers.size(); ++idx) {
+	const double block_end = (idx + 1 < block_headers.size())
+	    ? block_headers[idx + 1].first_obt
+	    : file_header.last_obt;
+
+	if(block_headers[idx].first_obt <= params.last_obt &&
+	   block_end >= params.first_obt) {
+	    selected_headers.push_back(block_headers[idx]);
+	    selected_data.push_back(block_data[idx]);
+	}
+    }
+
+    block_headers.swap(selected_headers);
+    block_data.swap(selected_data);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Keep only the samples whose OBT time is within the range specified
+// by "params". OBT times are sorted, and the other columns are
+// either empty or as long as the OBT column.
+static void
+trim_to_obt_range(const Decompression_parameters_t & params,
+		  Data_container_t * data_container)
+{
+    const std::vector<double> & obt_times = data_container->obt_times;
+    const size_t first_sample =
+	std::lower_bound(obt_times.begin(), obt_times.end(), params.first_obt)
+	- obt_times.begin();
+    const size_t end_sample =
+	std::upper_bound(obt_times.begin(), obt_times.end(), params.last_obt)
+	- obt_times.begin();
+    const size_t num_of_samples = obt_times.size();
+
+    const Chunk_type_t double_columns[] = {
+	CHUNK_DELTA_OBT, CHUNK_SCET_ERROR, CHUNK_THETA, CHUNK_PHI, CHUNK_PSI,
+	CHUNK_DIFFERENCED_DATA
+    };
+
+    for(Chunk_type_t chunk_type : double_columns) {
+	try {
+	    std::vector<double> & column =
+		column_for_chunk(chunk_type, data_container);
+	    if(column.size() == num_of_samples) {
+		column.erase(column.begin() + end_sample, column.end());
+		column.erase(column.begin(), column.begin() + first_sample);
+	    }
+	}
+	catch(std::runtime_error &) {
+	    // This container has no such column
+	}
+    }
+
+    Differenced_data_t * datadiff =
+	dynamic_cast<Differenced_data_t *>(data_container);
+    if(datadiff != NULL && datadiff->quality_flags.size() == num_of_samples) {
+	std::vector<uint32_t> & flags = datadiff->quality_flags;
+	flags.erase(flags.begin() + end_sample, flags.end());
+	flags.erase(flags.begin(), flags.begin() + first_sample);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Find the blocks in the payload of a chunk
+static void
+split_chunk_in_blocks(const Squeezer_file_header_t & file_header,
+		      const Squeezer_chunk_header_t & chunk_header,
+		      Byte_view_t chunk_data,
+		      std::vector<Squeezer_block_header_t> & block_headers,
+		      std::vector<Byte_view_t> & block_data)
+{
+    block_headers.clear();
+    block_data.clear();
+
+    if(file_header.program_version < FIRST_VERSION_WITH_BLOCKS) {
+
+	// The whole chunk is one block without a header. OBT times were
+	// saved as "number_of_samples" differences between consecutive
+	// times, starting from the first time in the file header.
+	Squeezer_block_header_t block_header;
+	block_header.number_of_samples = chunk_header.number_of_samples;
+	if(chunk_header.chunk_type == CHUNK_DELTA_OBT)
+	    block_header.number_of_samples++;
+	block_header.number_of_bytes = chunk_header.number_of_bytes;
+	block_header.first_obt = file_header.first_obt;
+
+	block_headers.push_back(block_header);
+	block_data.push_back(chunk_data);
+
+    } else {
+
+	size_t num_of_samples = 0;
+	while(num_of_samples < chunk_header.number_of_samples) {
+	    Squeezer_block_header_t block_header;
+	    block_header.read_from_buffer(chunk_data, file_header.program_version);
+	    if(block_header.number_of_samples == 0)
+		throw std::runtime_error("malformed block header");
+
+	    block_headers.push_back(block_header);
+	    block_data.push_back(chunk_data.read_view(block_header.number_of_bytes));
+	    num_of_samples += block_header.number_of_samples;
+	}
+
+	if(num_of_samples != chunk_header.number_of_samples)
+	    throw std::runtime_error("the blocks of a chunk do not match its header");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// The blocks of a column, taken from all the chunks of its type
+struct Column_blocks_t {
+    // Header of the first chunk, which tells the type of the column,
+    // the backend and the filter
+    Squeezer_chunk_header_t chunk_header;
+    std::vector<Squeezer_block_header_t> block_headers;
+    std::vector<Byte_view_t> block_data;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Append the blocks of a chunk to the column of the same type in
+// "columns", which is added if this is the first chunk of its type.
+// Columns are therefore kept in the order of their first chunk.
+static void
+add_chunk_to_columns(const Squeezer_file_header_t & file_header,
+		     const Squeezer_chunk_header_t & chunk_header,
+		     Byte_view_t chunk_data,
+		     std::vector<Column_blocks_t> & columns)
+{
+    std::vector<Squeezer_block_header_t> block_headers;
+    std::vector<Byte_view_t> block_data;
+    split_chunk_in_blocks(file_header, chunk_header, chunk_data,
+			  block_headers, block_data);
+
+    auto column = std::find_if(columns.begin(), columns.end(),
+			       [&](const Column_blocks_t & cur_column) {
+				   return cur_column.chunk_header.chunk_type ==
+				       chunk_header.chunk_type;
+			       });
+    if(column == columns.end()) {
+	columns.push_back(Column_blocks_t());
+	column = columns.end() - 1;
+	column->chunk_header = chunk_header;
+    } else if(column->chunk_header.backend != chunk_header.backend ||
+	      column->chunk_header.filter != chunk_header.filter) {
+	throw std::runtime_error("the chunks of column \""
+				 + column_name(static_cast<Chunk_type_t>(chunk_header.chunk_type))
+				 + "\" have been compressed in different ways");
+    }
+
+    column->block_headers.insert(column->block_headers.end(),
+				 block_headers.begin(), block_headers.end());
+    column->block_data.insert(column->block_data.end(),
+			      block_data.begin(), block_data.end());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Read the payload of chunk #"chunk_idx" from "input" and add its
+// blocks to "columns", unless the column is not selected by "params".
+// Return false if the chunk cannot be read, so that the chunks that
+// follow it cannot be found either.
+static bool
+read_chunk(size_t chunk_idx,
+	   const Squeezer_file_header_t & file_header,
+	   const Squeezer_chunk_header_t & chunk_header,
+	   Byte_view_t & input,
+	   const Decompression_parameters_t & params,
+	   std::vector<Column_blocks_t> & columns)
+{
+    if(! chunk_header.is_valid()) {
+
+	params.log() << PROGRAM_NAME
+		     << ": the input file seems to have been corrupted.\n";
+	return false;
+
+    } else if(params.verbose_flag) {
+
+	params.log() << PROGRAM_NAME
+		     << ": reading data chunk #"
+		     << chunk_idx + 1
+		     << " (";
+
+	switch(chunk_header.chunk_type) {
+	case CHUNK_DELTA_OBT: params.log() << "OBT times"; break;
+	case CHUNK_SCET_ERROR: params.log() << "SCET times"; break;
+	case CHUNK_THETA: params.log() << "theta angle"; break;
+	case CHUNK_PHI: params.log() << "phi angle"; break;
+	case CHUNK_PSI: params.log() << "psi angle"; break;
+	default: params.log() << "unknown chunk";
+	}
+
+	params.log() << ")\n";
+
+    }
+
+    if(chunk_header.number_of_bytes > input.items_left()) {
+
+	params.log() << PROGRAM_NAME
+		     << ": unable to read the contents of chunk #"
+		     << chunk_idx + 1
+		     << ", perhaps the file is corrupted or truncated\n";
+	input.skip(input.items_left());
+	return false;
+
+    }
+
+    Byte_view_t chunk_data = input.read_view(chunk_header.number_of_bytes);
+    if(! is_selected_chunk(static_cast<Chunk_type_t>(chunk_header.chunk_type),
+			   params.column_mask)) {
+	// If the file is memory-mapped, the payload is never loaded
+	if(params.verbose_flag) {
+	    params.log() << PROGRAM_NAME
+			 << ": skipping chunk #"
+			 << chunk_idx + 1
+			 << '\n';
+	}
+	return true;
+    }
+
+    add_chunk_to_columns(file_header, chunk_header, chunk_data, columns);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Keep only the blocks of "column" that can contain samples in the
+// OBT range of "params" (if any), and compute the position of the
+// first sample of each of them in the decoded column. Return the
+// number of samples in the blocks.
+static size_t
+locate_blocks(const Squeezer_file_header_t & file_header,
+	      const Decompression_parameters_t & params,
+	      Column_blocks_t & column,
+	      std::vector<size_t> & first_samples)
+{
+    if(params.obt_range_flag) {
+	select_blocks_in_obt_range(file_header, params,
+				   column.block_headers, column.block_data);
+    }
+
+    first_samples.resize(column.block_headers.size());
+    size_t num_of_samples = 0;
+    for(size_t idx = 0; idx < column.block_headers.size(); ++idx) {
+	first_samples[idx] = num_of_samples;
+	num_of_samples += column.block_headers[idx].number_of_samples;
+    }
+
+    return num_of_samples;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decode the blocks of "column" in parallel, each directly into its
+// place in "dest". The OBT times must have been decoded before the
+// SCET times.
+static void
+decode_blocks(const Squeezer_file_header_t & file_header,
+	      const Column_blocks_t & column,
+	      const std::vector<size_t> & first_samples,
+	      const Decompression_parameters_t & params,
+	      const Decompressed_arrays_t & dest)
+{
+    if(params.verbose_flag) {
+	params.log() << PROGRAM_NAME
+		     << ": decoding column \""
+		     << column_name(static_cast<Chunk_type_t>(column.chunk_header.chunk_type))
+		     << "\" ("
+		     << column.block_headers.size()
+		     << " blocks)\n";
+    }
+
+    const unsigned int backend_threads =
+	threads_per_block(column.block_headers.size(), params.num_of_threads);
+    parallel_for(column.block_headers.size(), params.num_of_threads,
+		 [&](size_t block_idx) {
+		     decompress_block(file_header, column.chunk_header,
+				      column.block_headers[block_idx],
+				      column.block_data[block_idx],
+				      first_samples[block_idx],
+				      params,
+				      backend_threads,
+				      dest);
+		 });
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -257,98 +667,778 @@ Data_container_t *
 decompress_from_file(FILE * input_file,
 		     const Decompression_parameters_t & params)
 {
-    Squeezer_file_header_t file_header(SQZ_NO_DATA);
-    file_header.read_from_file(input_file);
+    Mapped_file_t mapped_file(input_file);
+    Byte_view_t input = mapped_file.view();
+
+    return decompress_from_buffer(input, params);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Read the file header at the beginning of "input" and check that
+// this program can decode the file. If it cannot, print an error
+// message in "log" and return false.
+static bool
+read_file_header(Byte_view_t & input,
+		 Squeezer_file_header_t & file_header,
+		 std::ostream & log)
+{
+    file_header.read_from_buffer(input);
     if(! file_header.is_valid()) {
-	std::cerr << PROGRAM_NAME
-		  << ": the input file does not seem to have been "
-		  << "created by \"squeezer\". It might have been damaged.\n";
-	return nullptr;
+	log << PROGRAM_NAME
+	    << ": the input file does not seem to have been "
+	    << "created by \"squeezer\". It might have been damaged.\n";
+	return false;
     }
 
     if(! file_header.is_compatible_version()) {
-	std::cerr << PROGRAM_NAME
-		  << ": the input file seems to have been created by "
-		  << "a version of \"squeezer\" ("
-		  << MAJOR_VERSION_FROM_UINT16(file_header.program_version)
-		  << '.'
-		  << MINOR_VERSION_FROM_UINT16(file_header.program_version)
-		  << ") than this executable ("
-		  << MAJOR_PROGRAM_VERSION
-		  << '.'
-		  << MINOR_PROGRAM_VERSION
-		  << "). I will cowardly stop here.";
+	log << PROGRAM_NAME
+	    << ": the input file seems to have been created by "
+	    << "a version of \"squeezer\" ("
+	    << MAJOR_VERSION_FROM_UINT16(file_header.program_version)
+	    << '.'
+	    << MINOR_VERSION_FROM_UINT16(file_header.program_version)
+	    << ") which is not compatible with this executable ("
+	    << MAJOR_PROGRAM_VERSION
+	    << '.'
+	    << MINOR_PROGRAM_VERSION
+	    << "). I will cowardly stop here.\n";
 
-	return nullptr;
+	return false;
     }
 
-    Squeezer_file_type_t file_type = file_header.get_type();
-    Data_container_t * file_data;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Create an empty container for the data in a file of type
+// "file_type"
+static Data_container_t *
+create_data_container(Squeezer_file_type_t file_type)
+{
     switch(file_type) {
     case SQZ_DETECTOR_POINTINGS:
-	file_data = new Detector_pointings_t();
-	break;
+	return new Detector_pointings_t();
 
     case SQZ_DIFFERENCED_DATA:
-	file_data = new Differenced_data_t(false);
-	break;
+	return new Differenced_data_t(false);
 
     default:
 	abort();
     }
+}
 
-    file_data->radiometer = file_header.radiometer;
-    file_data->od = file_header.od;
+//////////////////////////////////////////////////////////////////////
+
+// Read the table of contents of the file that starts at
+// "whole_file", if it has one. Throw a std::runtime_error if it is
+// damaged.
+static void
+read_toc_from_buffer(const Byte_view_t & whole_file,
+		     const Squeezer_file_header_t & file_header,
+		     Squeezer_toc_t & toc)
+{
+    toc = Squeezer_toc_t(file_header.size_in_bytes());
+    if(file_header.toc_offset == 0)
+	return;
+
+    if(file_header.toc_offset > whole_file.size())
+	throw std::runtime_error("the table of contents is missing");
+
+    Byte_view_t toc_data(whole_file.cur_data() + file_header.toc_offset,
+			 whole_file.size() - file_header.toc_offset);
+    toc.read_from_buffer(toc_data);
+    if(! toc.is_valid(file_header))
+	throw std::runtime_error("the table of contents is corrupted");
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Read the header of chunk #"chunk_idx" from "input", which points
+// within "whole_file", and compare it with its checksum in "toc" (if
+// the file has a table of contents). Throw a std::runtime_error if
+// they do not match.
+static void
+read_chunk_header(Byte_view_t & input,
+		  const Byte_view_t & whole_file,
+		  const Squeezer_file_header_t & file_header,
+		  const Squeezer_toc_t & toc,
+		  size_t chunk_idx,
+		  Squeezer_chunk_header_t & chunk_header)
+{
+    const uint8_t * header_bytes = input.cur_data();
+    const uint64_t offset = header_bytes - whole_file.cur_data();
+    chunk_header.read_from_buffer(input, file_header.program_version);
+
+    if(toc.entries.empty())
+	return;
+
+    const Toc_entry_t & entry = toc.entries[chunk_idx];
+    if(entry.offset != offset ||
+       (entry.checksum != 0 &&
+	entry.checksum != crc32c(header_bytes,
+				 Squeezer_chunk_header_t::SIZE_IN_BYTES)))
+	throw std::runtime_error("wrong chunk header checksum, "
+				 "the file is corrupted");
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Read the file header and the chunks at the beginning of "input",
+// and collect the blocks of the columns selected by "params". Return
+// false if the file cannot be decoded by this program.
+static bool
+read_columns(Byte_view_t & input,
+	     const Decompression_parameters_t & params,
+	     Squeezer_file_header_t & file_header,
+	     std::vector<Column_blocks_t> & columns)
+{
+    const Byte_view_t whole_file = input;
+    if(! read_file_header(input, file_header, params.log()))
+	return false;
+
+    Squeezer_toc_t toc;
+    read_toc_from_buffer(whole_file, file_header, toc);
 
     if(params.verbose_flag) {
 	std::string data_type;
-	switch(file_type) {
+	switch(file_header.get_type()) {
 	case SQZ_DETECTOR_POINTINGS: data_type = "detector pointings"; break;
 	case SQZ_DIFFERENCED_DATA: data_type = "differenced data"; break;
 	default:
 	    data_type = "unknown data"; break;
 	}
 
-	std::cerr << PROGRAM_NAME << ": the file contains "
-		  << data_type
-		  << " for radiometer "
-		  << file_header.radiometer.to_str()
-		  << ", OD "
-		  << file_header.od
-		  << '\n';
+	params.log() << PROGRAM_NAME << ": the file contains "
+		     << data_type
+		     << " for radiometer "
+		     << file_header.radiometer.to_str()
+		     << ", OD "
+		     << file_header.od
+		     << '\n';
     }
 
+    // A column can be split in several chunks, so the blocks of all
+    // the chunks are collected before decoding
+    columns.clear();
     for(size_t idx = 0; idx < file_header.number_of_chunks; ++idx) {
 
 	Squeezer_chunk_header_t chunk_header;
-	chunk_header.read_from_file(input_file);
+	read_chunk_header(input, whole_file, file_header, toc, idx, chunk_header);
+
+	if(! read_chunk(idx, file_header, chunk_header, input,
+			params, columns))
+	    break;
+
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Data_container_t *
+decompress_from_buffer(Byte_view_t & input,
+		       const Decompression_parameters_t & params)
+{
+    // OBT times are needed to select samples within a range
+    Decompression_parameters_t actual_params(params);
+    if(params.obt_range_flag)
+	actual_params.column_mask |= column_bit(CHUNK_DELTA_OBT);
+
+    Squeezer_file_header_t file_header(SQZ_NO_DATA);
+    std::vector<Column_blocks_t> columns;
+    if(! read_columns(input, actual_params, file_header, columns))
+	return nullptr;
 
-	decompress_chunk(idx, 
-			 file_header,
-			 chunk_header, 
-			 input_file, 
-			 params, 
-			 file_data);
+    std::unique_ptr<Data_container_t> file_data(create_data_container(file_header.get_type()));
+    file_data->radiometer = file_header.radiometer;
+    file_data->od = file_header.od;
 
+    for(Column_blocks_t & column : columns) {
+	std::vector<size_t> first_samples;
+	const size_t num_of_samples =
+	    locate_blocks(file_header, actual_params, column, first_samples);
+	const Chunk_type_t chunk_type =
+	    static_cast<Chunk_type_t>(column.chunk_header.chunk_type);
+
+	if(chunk_type == CHUNK_SCET_ERROR &&
+	   file_data->obt_times.size() != num_of_samples) {
+	    params.log() << PROGRAM_NAME
+			 << ": malformed file, SCET times have been found "
+			 << "but no matching OBT times have been read\n";
+	    continue;
+	}
+
+	resize_column(chunk_type, num_of_samples, file_data.get());
+	decode_blocks(file_header, column, first_samples, actual_params,
+		      arrays_for_container(file_data.get()));
     }
 
-    return file_data;
+    if(params.obt_range_flag)
+	trim_to_obt_range(params, file_data.get());
+
+    return file_data.release();
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
+read_buffer_info(const uint8_t * data,
+		 size_t size,
+		 Squeezer_buffer_info_t & info)
+{
+    Byte_view_t input(data, size);
+    try {
+	Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	file_header.read_from_buffer(input);
+	if(! file_header.is_valid())
+	    throw std::runtime_error("the buffer does not contain a file "
+				     "created by \"squeezer\"");
+	if(! file_header.is_compatible_version())
+	    throw std::runtime_error("the file has been created by an "
+				     "incompatible version of \"squeezer\"");
+
+	info.file_type = file_header.get_type();
+	info.radiometer = file_header.radiometer;
+	info.od = file_header.od;
+	info.number_of_samples = 0;
+
+	// Every column has the same number of samples as the OBT times,
+	// which can be split in several chunks
+	for(size_t idx = 0; idx < file_header.number_of_chunks; ++idx) {
+	    Squeezer_chunk_header_t chunk_header;
+	    chunk_header.read_from_buffer(input, file_header.program_version);
+	    if(! chunk_header.is_valid())
+		throw std::runtime_error("chunk headers are inconsistent");
+
+	    if(chunk_header.chunk_type == CHUNK_DELTA_OBT) {
+		info.number_of_samples += chunk_header.number_of_samples;
+
+		// Old files saved the differences between the times
+		if(file_header.program_version < FIRST_VERSION_WITH_BLOCKS)
+		    info.number_of_samples++;
+	    }
+
+	    input.skip(chunk_header.number_of_bytes);
+	}
+    }
+    catch(std::out_of_range & exc) {
+	throw std::runtime_error("the file is truncated");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Move the samples [first, end) of "array" (if it is not NULL) to the
+// beginning of the array
+template<typename T>
+static void
+move_to_front(T * array, size_t first, size_t end)
+{
+    if(array != NULL && first > 0)
+	std::copy(array + first, array + end, array);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+decompress_buffer_to_arrays(const uint8_t * data,
+			    size_t size,
+			    const Decompression_parameters_t & params,
+			    const Decompressed_arrays_t & arrays)
+{
+    // OBT times are always decoded, as they tell the number of rows
+    Decompression_parameters_t actual_params(params);
+    actual_params.column_mask = column_bit(CHUNK_DELTA_OBT);
+    if(arrays.scet_times != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_SCET_ERROR);
+    if(arrays.theta != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_THETA);
+    if(arrays.phi != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_PHI);
+    if(arrays.psi != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_PSI);
+    if(arrays.sky_load != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_DIFFERENCED_DATA);
+    if(arrays.quality_flags != NULL)
+	actual_params.column_mask |= column_bit(CHUNK_QUALITY_FLAGS);
+
+    Byte_view_t input(data, size);
+    Squeezer_file_header_t file_header(SQZ_NO_DATA);
+    std::vector<Column_blocks_t> columns;
+    try {
+	if(! read_columns(input, actual_params, file_header, columns))
+	    throw std::runtime_error("the buffer does not contain a valid file");
+    }
+    catch(std::out_of_range & exc) {
+	throw std::runtime_error("the file is truncated");
+    }
+
+    const bool pointings_flag = (file_header.get_type() == SQZ_DETECTOR_POINTINGS);
+    if((pointings_flag &&
+	(arrays.sky_load != NULL || arrays.quality_flags != NULL)) ||
+       (! pointings_flag &&
+	(arrays.theta != NULL || arrays.phi != NULL || arrays.psi != NULL)))
+	throw std::runtime_error("some of the arrays refer to columns that "
+				 "are not part of the file");
+
+    // The samples are decoded directly into the arrays of the caller.
+    // Only the OBT times are decoded in a temporary array, if the
+    // caller does not want them.
+    Decompressed_arrays_t dest(arrays);
+    std::vector<double> obt_times;
+    size_t num_of_rows = 0;
+    unsigned int decoded_columns = 0;
+    for(Column_blocks_t & column : columns) {
+	std::vector<size_t> first_samples;
+	const size_t num_of_samples =
+	    locate_blocks(file_header, actual_params, column, first_samples);
+	const Chunk_type_t chunk_type =
+	    static_cast<Chunk_type_t>(column.chunk_header.chunk_type);
+
+	if(chunk_type == CHUNK_DELTA_OBT) {
+	    num_of_rows = num_of_samples;
+	    if(num_of_rows > arrays.capacity)
+		throw std::runtime_error("the arrays are too small for the "
+					 "decompressed samples");
+
+	    if(dest.obt_times == NULL) {
+		obt_times.resize(num_of_rows);
+		dest.obt_times = obt_times.data();
+	    }
+	} else if((decoded_columns & column_bit(CHUNK_DELTA_OBT)) == 0 ||
+		  num_of_samples != num_of_rows) {
+	    throw std::runtime_error("unable to decode the "
+				     + column_name(chunk_type)
+				     + " column, the file is damaged");
+	}
+
+	decode_blocks(file_header, column, first_samples, actual_params, dest);
+	decoded_columns |= column_bit(chunk_type);
+    }
+
+    if((decoded_columns & actual_params.column_mask) != actual_params.column_mask)
+	throw std::runtime_error("some columns are missing, the file is damaged");
+
+    if(! params.obt_range_flag)
+	return num_of_rows;
+
+    // Only the first and the last block can contain samples outside
+    // the range
+    const size_t first_row =
+	std::lower_bound(dest.obt_times, dest.obt_times + num_of_rows,
+			 params.first_obt) - dest.obt_times;
+    const size_t end_row =
+	std::upper_bound(dest.obt_times, dest.obt_times + num_of_rows,
+			 params.last_obt) - dest.obt_times;
+
+    move_to_front(arrays.obt_times, first_row, end_row);
+    move_to_front(arrays.scet_times, first_row, end_row);
+    move_to_front(arrays.theta, first_row, end_row);
+    move_to_front(arrays.phi, first_row, end_row);
+    move_to_front(arrays.psi, first_row, end_row);
+    move_to_front(arrays.sky_load, first_row, end_row);
+    move_to_front(arrays.quality_flags, first_row, end_row);
+
+    return end_row - first_row;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+read_table_of_contents(FILE * input_file,
+		       const Squeezer_file_header_t & file_header,
+		       Squeezer_toc_t & toc)
+{
+    if(file_header.toc_offset != 0) {
+	if(fseeko(input_file, file_header.toc_offset, SEEK_SET) != 0)
+	    throw std::runtime_error(std::strerror(errno));
+
+	toc.read_from_file(input_file);
+	if(! toc.is_valid(file_header))
+	    throw std::runtime_error("the table of contents is corrupted");
+
+	return;
+    }
+
+    // Walk through the chunk headers: mapping the file avoids a
+    // fseek/fread pair for each of them, and only the pages
+    // containing the headers are actually loaded from disk
+    Mapped_file_t mapped_file(input_file);
+    Byte_view_t input = mapped_file.view();
+
+    toc = Squeezer_toc_t(file_header.size_in_bytes(),
+			 Squeezer_chunk_header_t::size_in_bytes(file_header.program_version));
+    try {
+	for(size_t chunk_idx = 0;
+	    chunk_idx < file_header.number_of_chunks;
+	    ++chunk_idx) {
+
+	    Squeezer_chunk_header_t chunk_header;
+	    chunk_header.read_from_buffer(input, file_header.program_version);
+	    if(! chunk_header.is_valid())
+		throw std::runtime_error("chunk headers are inconsistent");
+
+	    input.skip(chunk_header.number_of_bytes);
+	    toc.add_chunk(chunk_header);
+	}
+    }
+    catch(std::out_of_range & exc) {
+	throw std::runtime_error("the file is truncated");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+read_chunk_headers(FILE * input_file,
+		   const Squeezer_file_header_t & file_header,
+		   std::vector<Squeezer_chunk_header_t> & chunk_headers)
+{
+    Squeezer_toc_t toc;
+    read_table_of_contents(input_file, file_header, toc);
+
+    chunk_headers.clear();
+    for(const Toc_entry_t & entry : toc.entries) {
+	if(fseeko(input_file, entry.offset, SEEK_SET) != 0)
+	    throw std::runtime_error(std::strerror(errno));
+
+	Squeezer_chunk_header_t chunk_header;
+	chunk_header.read_from_file(input_file, file_header.program_version);
+	if(! chunk_header.is_valid())
+	    throw std::runtime_error("chunk headers are inconsistent");
+
+	auto column = std::find_if(chunk_headers.begin(), chunk_headers.end(),
+				   [&](const Squeezer_chunk_header_t & cur_header) {
+				       return cur_header.chunk_type == chunk_header.chunk_type;
+				   });
+	if(column == chunk_headers.end()) {
+	    chunk_headers.push_back(chunk_header);
+	    continue;
+	}
+
+	// Merge the statistics of the chunks of the same column. Means
+	// are weighted by the number of samples.
+	Error_t & error = column->compression_error;
+	const Error_t & chunk_error = chunk_header.compression_error;
+	const double old_samples = column->number_of_samples;
+	const double new_samples = chunk_header.number_of_samples;
+	const double total_samples = old_samples + new_samples;
+
+	error.min_abs_error = std::min(error.min_abs_error, chunk_error.min_abs_error);
+	error.max_abs_error = std::max(error.max_abs_error, chunk_error.max_abs_error);
+	if(total_samples > 0) {
+	    error.mean_abs_error = (error.mean_abs_error * old_samples
+				    + chunk_error.mean_abs_error * new_samples)
+		/ total_samples;
+	    error.mean_error = (error.mean_error * old_samples
+				+ chunk_error.mean_error * new_samples)
+		/ total_samples;
+	}
+
+	column->number_of_bytes += chunk_header.number_of_bytes;
+	column->number_of_samples += chunk_header.number_of_samples;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Make the columns that have not been decoded as long as the OBT
+// column, so that they can be written in a FITS table
+static void
+fill_missing_columns(Data_container_t * data_container)
+{
+    const size_t num_of_samples = data_container->obt_times.size();
+    const Chunk_type_t double_columns[] = {
+	CHUNK_THETA, CHUNK_PHI, CHUNK_PSI, CHUNK_DIFFERENCED_DATA
+    };
+
+    for(Chunk_type_t chunk_type : double_columns) {
+	try {
+	    std::vector<double> & column =
+		column_for_chunk(chunk_type, data_container);
+	    if(column.empty())
+		column.assign(num_of_samples,
+			      std::numeric_limits<double>::quiet_NaN());
+	}
+	catch(std::runtime_error &) {
+	    // This container has no such column
+	}
+    }
+
+    Differenced_data_t * datadiff =
+	dynamic_cast<Differenced_data_t *>(data_container);
+    if(datadiff != NULL && datadiff->quality_flags.empty())
+	datadiff->quality_flags.assign(num_of_samples, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decode a file one block at a time, so that only the samples of
+// the current block are kept in memory. All the columns must be split
+// in blocks at the same samples, which is always true for the files
+// written by this program.
+class Streaming_decompressor_t : public Row_batch_producer_t {
+public:
+    Streaming_decompressor_t(Byte_view_t input,
+			     const Decompression_parameters_t & a_params);
+
+    virtual size_t number_of_rows() const {
+	return num_of_rows;
+    }
+
+    virtual void get_rows(size_t num_of_rows_to_get, Data_container_t & rows);
+
+    // Return an empty container that can hold the rows of the file
+    Data_container_t * create_row_container() const;
+
+private:
+    void decode_block(size_t block_idx,
+		      size_t num_of_columns,
+		      Data_container_t & dest) const;
+    void decode_next_block();
+    size_t count_rows() const;
+
+    Decompression_parameters_t params;
+    Squeezer_file_header_t file_header;
+    // The columns that must be decoded. The OBT column is always the
+    // first one.
+    std::vector<Column_blocks_t> columns;
+    size_t num_of_blocks;
+    size_t num_of_rows;
+    size_t next_block;
+    // Samples of the last block that has been decoded
+    std::unique_ptr<Data_container_t> block_rows;
+    size_t next_row;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+Streaming_decompressor_t::Streaming_decompressor_t(Byte_view_t input,
+						   const Decompression_parameters_t & a_params)
+    : params(a_params),
+      file_header(SQZ_NO_DATA),
+      columns(),
+      num_of_blocks(0),
+      num_of_rows(0),
+      next_block(0),
+      block_rows(),
+      next_row(0)
+{
+    const Byte_view_t whole_file = input;
+    if(! read_file_header(input, file_header, params.log()))
+	throw std::runtime_error("unable to decompress the file");
+
+    try {
+	Squeezer_toc_t toc;
+	read_toc_from_buffer(whole_file, file_header, toc);
+
+	for(size_t chunk_idx = 0;
+	    chunk_idx < file_header.number_of_chunks;
+	    ++chunk_idx) {
+
+	    Squeezer_chunk_header_t chunk_header;
+	    read_chunk_header(input, whole_file, file_header, toc, chunk_idx, chunk_header);
+	    if(! chunk_header.is_valid())
+		throw std::runtime_error("the input file seems to have been corrupted");
+
+	    Byte_view_t chunk_data = input.read_view(chunk_header.number_of_bytes);
+	    if(is_selected_chunk(static_cast<Chunk_type_t>(chunk_header.chunk_type),
+				 params.column_mask))
+		add_chunk_to_columns(file_header, chunk_header, chunk_data, columns);
+	}
+    }
+    catch(std::out_of_range & exc) {
+	throw std::runtime_error("the file is truncated");
+    }
+
+    if(columns.empty() || columns[0].chunk_header.chunk_type != CHUNK_DELTA_OBT)
+	throw std::runtime_error("the file does not contain OBT times");
+
+    // Blocks must be selected once all the chunks of a column are
+    // known, as the last time in a block is the first time of the
+    // next one
+    if(params.obt_range_flag) {
+	for(Column_blocks_t & column : columns) {
+	    select_blocks_in_obt_range(file_header, params,
+				       column.block_headers,
+				       column.block_data);
+	}
+    }
+
+    num_of_blocks = columns[0].block_headers.size();
+    for(const Column_blocks_t & column : columns) {
+	bool same_blocks = (column.block_headers.size() == num_of_blocks);
+	for(size_t idx = 0; same_blocks && idx < num_of_blocks; ++idx) {
+	    same_blocks = (column.block_headers[idx].number_of_samples ==
+			   columns[0].block_headers[idx].number_of_samples);
+	}
+
+	if(! same_blocks)
+	    throw std::runtime_error("the columns of the file are not split "
+				     "in the same blocks");
+    }
+
+    num_of_rows = count_rows();
+
+    if(params.verbose_flag) {
+	params.log() << PROGRAM_NAME
+		     << ": decoding "
+		     << num_of_rows
+		     << " rows, one block of "
+		     << columns.size()
+		     << " columns at a time ("
+		     << num_of_blocks
+		     << " blocks)\n";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Data_container_t *
+Streaming_decompressor_t::create_row_container() const
+{
+    Data_container_t * result = create_data_container(file_header.get_type());
+    result->radiometer = file_header.radiometer;
+    result->od = file_header.od;
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decode block #"block_idx" of the first "num_of_columns" columns
+// into "dest", which must be empty
+void
+Streaming_decompressor_t::decode_block(size_t block_idx,
+				       size_t num_of_columns,
+				       Data_container_t & dest) const
+{
+    const size_t num_of_samples =
+	columns[0].block_headers[block_idx].number_of_samples;
+    for(size_t col_idx = 0; col_idx < num_of_columns; ++col_idx) {
+	const Column_blocks_t & column = columns[col_idx];
+	resize_column(static_cast<Chunk_type_t>(column.chunk_header.chunk_type),
+		      num_of_samples, &dest);
+    }
+    const Decompressed_arrays_t dest_arrays = arrays_for_container(&dest);
+
+    // SCET times are computed from OBT times, so the latter must be
+    // decoded first. The other columns are independent.
+    decompress_block(file_header, columns[0].chunk_header,
+		     columns[0].block_headers[block_idx],
+		     columns[0].block_data[block_idx],
+		     0, params, params.num_of_threads, dest_arrays);
+
+    const unsigned int backend_threads =
+	threads_per_block(num_of_columns - 1, params.num_of_threads);
+    parallel_for(num_of_columns - 1, params.num_of_threads,
+		 [&](size_t idx) {
+		     const Column_blocks_t & column = columns[idx + 1];
+		     decompress_block(file_header, column.chunk_header,
+				      column.block_headers[block_idx],
+				      column.block_data[block_idx],
+				      0, params, backend_threads, dest_arrays);
+		 });
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Streaming_decompressor_t::decode_next_block()
+{
+    if(next_block >= num_of_blocks)
+	throw std::runtime_error("no more samples to decode");
+
+    block_rows.reset(create_data_container(file_header.get_type()));
+    decode_block(next_block, columns.size(), *block_rows);
+    ++next_block;
+
+    if(params.obt_range_flag)
+	trim_to_obt_range(params, block_rows.get());
+
+    fill_missing_columns(block_rows.get());
+    next_row = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+Streaming_decompressor_t::count_rows() const
+{
+    size_t result = 0;
+    for(const Squeezer_block_header_t & block_header : columns[0].block_headers)
+	result += block_header.number_of_samples;
+
+    if(! params.obt_range_flag || num_of_blocks == 0)
+	return result;
+
+    // Only the first and the last block can contain samples outside
+    // the range, and OBT times are enough to find them
+    std::vector<size_t> blocks_to_trim { 0 };
+    if(num_of_blocks > 1)
+	blocks_to_trim.push_back(num_of_blocks - 1);
+
+    for(size_t block_idx : blocks_to_trim) {
+	std::unique_ptr<Data_container_t> obt_times(create_data_container(file_header.get_type()));
+	decode_block(block_idx, 1, *obt_times);
+
+	const size_t num_of_samples = obt_times->obt_times.size();
+	trim_to_obt_range(params, obt_times.get());
+	result -= num_of_samples - obt_times->obt_times.size();
+    }
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Streaming_decompressor_t::get_rows(size_t num_of_rows_to_get,
+				   Data_container_t & rows)
+{
+    rows.clear_rows();
+
+    while(num_of_rows_to_get > 0) {
+	if(! block_rows || next_row == block_rows->obt_times.size()) {
+	    decode_next_block();
+	    continue;
+	}
+
+	const size_t count = std::min(num_of_rows_to_get,
+				      block_rows->obt_times.size() - next_row);
+	rows.append_rows(*block_rows, next_row, count);
+	next_row += count;
+	num_of_rows_to_get -= count;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
 decompress_file_from_file(FILE * input_file,
 			  const std::string & output_file_name,
 			  const Decompression_parameters_t & params)
 {
-    std::unique_ptr<Data_container_t> file_data(decompress_from_file(input_file, params));
+    // The FITS file needs the time columns in any case
+    Decompression_parameters_t actual_params(params);
+    actual_params.column_mask |=
+	column_bit(CHUNK_DELTA_OBT) | column_bit(CHUNK_SCET_ERROR);
+
+    Mapped_file_t mapped_file(input_file);
+    Streaming_decompressor_t decompressor(mapped_file.view(), actual_params);
+    if(decompressor.number_of_rows() == 0)
+	throw std::runtime_error("there are no samples to write");
+
+    std::unique_ptr<Data_container_t> rows(decompressor.create_row_container());
 
     if(params.verbose_flag) {
-	std::cerr << PROGRAM_NAME
-		  << ": writing detector pointings to file "
-		  << output_file_name
-		  << '\n';
+	params.log() << PROGRAM_NAME
+		     << ": writing detector pointings to file "
+		     << output_file_name
+		     << '\n';
     }
 
     fitsfile * fptr;
@@ -360,7 +1450,15 @@ decompress_file_from_file(FILE * input_file,
 
     if(status == 0) {
 
-	file_data->write_to_fits_file(fptr, status);
+	// Blocks are decoded while CFITSIO asks for new rows
+	try {
+	    rows->write_to_fits_file_in_batches(fptr, decompressor, status);
+	}
+	catch(...) {
+	    int close_status = 0;
+	    fits_close_file(fptr, &close_status);
+	    throw;
+	}
 	fits_close_file(fptr, &status);
     
     }
@@ -376,4 +1474,6 @@ decompress_file_from_file(FILE * input_file,
 	throw std::runtime_error(error_string);
 
     }
+
+    return decompressor.number_of_rows();
 }
@@ -21,24 +21,149 @@
 #ifndef DECOMPRESS_HPP
 #define DECOMPRESS_HPP
 
+#include <cstdint>
 #include <cstdio>
+#include <iostream>
 #include <string>
+#include <vector>
+
+#include "common_defs.hpp"
 
 struct Data_container_t;
+struct Squeezer_file_header_t;
+struct Squeezer_toc_t;
+struct Squeezer_chunk_header_t;
+class Byte_view_t;
 
 struct Decompression_parameters_t {
     bool verbose_flag;
+    // Number of threads used to decode the blocks of a chunk (zero
+    // means the number of cores)
+    unsigned int num_of_threads;
+    // Set of columns to decode (see column_bit). The payloads of the
+    // other chunks are skipped without being read, and the
+    // corresponding columns are left empty.
+    unsigned int column_mask;
+    // If true, only the samples whose OBT time falls within
+    // [first_obt, last_obt] are returned. Blocks that do not overlap
+    // the range are not decoded.
+    bool obt_range_flag;
+    double first_obt;
+    double last_obt;
+    // Where verbose messages and the description of the problems found
+    // in the file are written
+    std::ostream * log_stream;
 
     Decompression_parameters_t() {
 	verbose_flag = false;
+	num_of_threads = 0;
+	column_mask = ALL_COLUMNS;
+	obt_range_flag = false;
+	first_obt = 0.0;
+	last_obt = 0.0;
+	log_stream = &std::cerr;
+    }
+
+    std::ostream & log() const {
+	return *log_stream;
     }
 };
 
+// The file is memory-mapped whenever possible
 Data_container_t * decompress_from_file(FILE * input_file,
 					const Decompression_parameters_t & params);
 
-void decompress_file_from_file(FILE * input_file,
-			       const std::string & output_file_name,
-			       const Decompression_parameters_t & params);
+// Decompress a whole .sqz file that is already in memory
+Data_container_t * decompress_from_buffer(Byte_view_t & input,
+					  const Decompression_parameters_t & params);
+
+// Properties of a compressed file that is already in memory
+struct Squeezer_buffer_info_t {
+    Squeezer_file_type_t file_type;
+    Radiometer_t radiometer;
+    uint16_t od;
+    size_t number_of_samples;
+
+    Squeezer_buffer_info_t()
+	: file_type(SQZ_NO_DATA),
+	  radiometer(),
+	  od(0),
+	  number_of_samples(0) {}
+};
+
+// Read the file header and the chunk headers at the beginning of
+// "data", without decoding any sample. Throw a std::runtime_error if
+// "data" does not contain a file that can be decompressed.
+void read_buffer_info(const uint8_t * data,
+		      size_t size,
+		      Squeezer_buffer_info_t & info);
+
+// Arrays owned by the caller, where decompress_buffer_to_arrays
+// writes the samples. Each pointer is either NULL, and then the
+// column is not decoded at all, or it points to at least "capacity"
+// elements. The columns that are not part of the file (e.g., "theta"
+// for differenced data) must be NULL.
+struct Decompressed_arrays_t {
+    double * obt_times;
+    double * scet_times;
+    double * theta;
+    double * phi;
+    double * psi;
+    double * sky_load;
+    uint32_t * quality_flags;
+    size_t capacity;
+
+    Decompressed_arrays_t()
+	: obt_times(NULL),
+	  scet_times(NULL),
+	  theta(NULL),
+	  phi(NULL),
+	  psi(NULL),
+	  sky_load(NULL),
+	  quality_flags(NULL),
+	  capacity(0) {}
+};
+
+// Decompress the file in "data" into "arrays" and return the number
+// of samples written in each of them. The samples are decoded
+// directly into the arrays, without intermediate copies.
+// "params.column_mask" is ignored, as the columns are chosen by
+// "arrays"; the OBT range is honoured. Since whole blocks are decoded
+// before the samples outside the range are discarded, the arrays must
+// be large enough for all the samples in the blocks that overlap the
+// range: the number of samples returned by read_buffer_info is always
+// enough. Throw a std::runtime_error if the file is damaged or the
+// arrays are too small.
+size_t decompress_buffer_to_arrays(const uint8_t * data,
+				   size_t size,
+				   const Decompression_parameters_t & params,
+				   const Decompressed_arrays_t & arrays);
+
+// Read the table of contents of a file whose header has already been
+// read from "input_file". If the file has no table of contents (e.g.,
+// it was written to a pipe), it is rebuilt by reading all the chunk
+// headers. Throw a std::runtime_error if the file is damaged.
+void read_table_of_contents(FILE * input_file,
+			    const Squeezer_file_header_t & file_header,
+			    Squeezer_toc_t & toc);
+
+// Read the headers of all the chunks, which contain the statistics
+// about the compression error, using the table of contents to skip
+// the payloads. The chunks of a column split in several chunks are
+// merged, so that there is one header per column. Throw a
+// std::runtime_error if the file is damaged.
+void read_chunk_headers(FILE * input_file,
+			const Squeezer_file_header_t & file_header,
+			std::vector<Squeezer_chunk_header_t> & chunk_headers);
+
+// The OBT and SCET columns are always decoded. A std::runtime_error
+// is thrown if there are no samples to write. Columns excluded by
+// "params.column_mask" are filled with NaNs (or zeroes, for flags).
+// Blocks are decoded while the FITS table is being written, so only
+// one block of each column is kept in memory. Return the number of
+// rows written.
+size_t decompress_file_from_file(FILE * input_file,
+				 const std::string & output_file_name,
+				 const Decompression_parameters_t & params);
 
 #endif
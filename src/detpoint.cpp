@@ -170,6 +170,82 @@ throw_error:
 
 //////////////////////////////////////////////////////////////////////
 
+static void
+copy_pointing_rows(const iteratorCol * cols,
+		   long num_of_rows,
+		   Data_container_t & rows)
+{
+    auto & pointings = dynamic_cast<Detector_pointings_t &>(rows);
+    std::vector<double> * columns[] = {
+	&pointings.obt_times,
+	&pointings.scet_times,
+	&pointings.theta,
+	&pointings.phi,
+	&pointings.psi
+    };
+
+    for(size_t idx = 0; idx < 5; ++idx) {
+	// The first element of each array is the null value
+	const double * values = ((const double *) cols[idx].array) + 1;
+	columns[idx]->assign(values, values + num_of_rows);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Detector_pointings_t::read_from_fits_file_in_batches(const std::string & file_name,
+						     Row_batch_consumer_t & consumer)
+{
+    fitsfile * fptr;
+    int status = 0;
+    std::exception_ptr consumer_error;
+
+    fits_open_table(&fptr, const_cast<char *>(file_name.c_str()),
+		    READONLY, &status);
+    if(status != 0)
+	goto throw_error;
+
+    {
+	iteratorCol cols[5];
+	int n_cols = 5;
+	fits_iter_set_by_name(&cols[0], fptr, (char *) "OBT",   TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[1], fptr, (char *) "SCET",  TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[2], fptr, (char *) "THETA", TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[3], fptr, (char *) "PHI",   TDOUBLE, InputCol);
+	fits_iter_set_by_name(&cols[4], fptr, (char *) "PSI",   TDOUBLE, InputCol);
+
+	consumer_error = iterate_over_fits_rows(fptr, n_cols, cols,
+						&copy_pointing_rows,
+						*this, consumer, status);
+    }
+    if(status != 0)
+	goto close_and_throw_error;
+
+    fits_close_file(fptr, &status);
+    if(consumer_error)
+	std::rethrow_exception(consumer_error);
+    if(status != 0)
+	goto throw_error;
+
+    return;
+
+close_and_throw_error:
+    status = 0; // Reset the error status
+    fits_close_file(fptr, &status);
+    
+throw_error:
+    char error_msg[80];
+    std::string error_string;
+    while(fits_read_errmsg(error_msg) != 0) {
+	error_string += error_msg;
+	error_string += '\n';
+    }
+    throw std::runtime_error(error_string);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 static int
 save_data(long total_num,
 	  long offset,
@@ -212,11 +288,14 @@ save_data(long total_num,
 
 //////////////////////////////////////////////////////////////////////
 
-void
-Detector_pointings_t::write_to_fits_file(fitsfile * fptr, int & status)
+// Create a binary table with "num_of_rows" rows and one column for
+// each field of Detector_pointings_t
+static int
+create_pointings_table(fitsfile * fptr,
+		       LONGLONG num_of_rows,
+		       const Radiometer_t & radiometer,
+		       int & status)
 {
-    // Since we're going to use a few gotos, it is better to declare
-    // all the variables before the first goto
     char * ttype[] = { (char *) "OBT", 
 		       (char *) "SCET", 
 		       (char *) "THETA", 
@@ -233,46 +312,129 @@ Detector_pointings_t::write_to_fits_file(fitsfile * fptr, int & status)
 		       (char *) "rad", 
 		       (char *) "rad" };
 
-    double firstobt = obt_times.front();
-    double lastobt = obt_times.back();
-    double firstsct = scet_times.front();
-    double lastsct = scet_times.back();
-
     char extname[30];
 
     std::strncpy(extname, radiometer.to_str().c_str(), sizeof(extname));
-    if(fits_create_tbl(fptr, BINARY_TBL, obt_times.size(), 5, 
-		       ttype, tform, tunit, extname, &status) != 0)
+    return fits_create_tbl(fptr, BINARY_TBL, num_of_rows, 5, 
+			   ttype, tform, tunit, extname, &status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+set_output_columns(fitsfile * fptr, iteratorCol * cols)
+{
+    fits_iter_set_by_num(&cols[0], fptr, 1, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[1], fptr, 2, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[2], fptr, 3, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[3], fptr, 4, TDOUBLE, OutputCol);
+    fits_iter_set_by_num(&cols[4], fptr, 5, TDOUBLE, OutputCol);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Detector_pointings_t::write_to_fits_file(fitsfile * fptr, int & status)
+{
+    if(create_pointings_table(fptr, obt_times.size(), radiometer, status) != 0)
 	return;
 
     {
 	iteratorCol cols[5];
 	int n_cols = 5;
-	fits_iter_set_by_num(&cols[0], fptr, 1, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[1], fptr, 2, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[2], fptr, 3, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[3], fptr, 4, TDOUBLE, OutputCol);
-	fits_iter_set_by_num(&cols[4], fptr, 5, TDOUBLE, OutputCol);
+	set_output_columns(fptr, cols);
 
 	fits_iterate_data(n_cols, cols, 0, 0, &save_data, this, &status);
     }
     if(status != 0)
 	return;
 
-    if(fits_write_key(fptr, TDOUBLE, "FIRSTOBT", 
-		      (void *) &firstobt, "First OBT time", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "LASTOBT", 
-		      (void *) &lastobt, "Last OBT time", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "FIRSTSCT", 
-		      (void *) &firstsct, "First SCET time [ms]", &status) != 0 ||
-       fits_write_key(fptr, TDOUBLE, "LASTSCT", 
-		      (void *) &lastsct, "Last SCET time [ms]", &status) != 0 ||
-       fits_write_key(fptr, TSHORT, "OD",
-		      (void *) &od, "Operational day", &status) != 0 ||
-       fits_write_key(fptr, TBYTE, "HORN",
-		      (void *) &radiometer.horn, "Horn number (18..28)", &status) != 0 ||
-       fits_write_key(fptr, TBYTE, "RAD",
-		      (void *) &radiometer.arm, "Radiometer number (0, 1)", &status) != 0 ||
-       fits_write_date(fptr, &status) != 0)
+    write_common_fits_keywords(fptr, *this, status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+copy_pointing_rows_to_fits(const Data_container_t & rows,
+			   iteratorCol * cols)
+{
+    auto & pointings = dynamic_cast<const Detector_pointings_t &>(rows);
+    const std::vector<double> * columns[] = {
+	&pointings.obt_times,
+	&pointings.scet_times,
+	&pointings.theta,
+	&pointings.phi,
+	&pointings.psi
+    };
+
+    for(size_t idx = 0; idx < 5; ++idx) {
+	double * values = (double *) cols[idx].array;
+	values[0] = DOUBLENULLVALUE;
+	std::copy(columns[idx]->begin(), columns[idx]->end(), values + 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Detector_pointings_t::write_to_fits_file_in_batches(fitsfile * fptr,
+						    Row_batch_producer_t & producer,
+						    int & status)
+{
+    if(create_pointings_table(fptr, producer.number_of_rows(),
+			      radiometer, status) != 0)
+	return;
+
+    Detector_pointings_t time_span;
+    std::exception_ptr producer_error;
+    {
+	iteratorCol cols[5];
+	int n_cols = 5;
+	set_output_columns(fptr, cols);
+
+	producer_error = iterate_over_fits_output_rows(fptr, n_cols, cols,
+						       &copy_pointing_rows_to_fits,
+						       *this, producer,
+						       time_span, status);
+    }
+    if(producer_error)
+	std::rethrow_exception(producer_error);
+    if(status != 0)
 	return;
+
+    time_span.radiometer = radiometer;
+    time_span.od = od;
+    write_common_fits_keywords(fptr, time_span, status);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Detector_pointings_t::append_rows(const Data_container_t & source,
+				  size_t first,
+				  size_t count)
+{
+    Data_container_t::append_rows(source, first, count);
+
+    auto & pointings = dynamic_cast<const Detector_pointings_t &>(source);
+    theta.insert(theta.end(),
+		 pointings.theta.begin() + first,
+		 pointings.theta.begin() + first + count);
+    phi.insert(phi.end(),
+	       pointings.phi.begin() + first,
+	       pointings.phi.begin() + first + count);
+    psi.insert(psi.end(),
+	       pointings.psi.begin() + first,
+	       pointings.psi.begin() + first + count);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Detector_pointings_t::clear_rows()
+{
+    Data_container_t::clear_rows();
+    theta.clear();
+    phi.clear();
+    psi.clear();
 }
@@ -26,7 +26,7 @@
 
 #include <fitsio.h>
 
-#include "config.hpp"
+#include "squeezer_config.hpp"
 #include "common_defs.hpp"
 #include "data_container.hpp"
 
@@ -41,12 +41,22 @@ struct Detector_pointings_t : public Data_container_t {
 
     virtual size_t number_of_columns() const { return 5; }
 
+    virtual void append_rows(const Data_container_t & source,
+			     size_t first,
+			     size_t count);
+    virtual void clear_rows();
+
 #if HAVE_TOODI
     virtual void read_from_database(const std::string & obj_name);
 #endif
 
     virtual void read_from_fits_file(const std::string & file_name);
     virtual void write_to_fits_file(fitsfile * fptr, int & status);
+    virtual void read_from_fits_file_in_batches(const std::string & file_name,
+						Row_batch_consumer_t & consumer);
+    virtual void write_to_fits_file_in_batches(fitsfile * fptr,
+					       Row_batch_producer_t & producer,
+					       int & status);
 };
 
 #endif
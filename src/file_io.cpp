@@ -18,6 +18,7 @@
  * 02110-1301, USA.
  */
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
@@ -27,6 +28,50 @@
 
 //////////////////////////////////////////////////////////////////////
 
+void
+read_bytes(FILE * in, uint8_t * bytes, size_t length)
+{
+    if(std::fread(bytes, 1, length, in) < length) {
+	if(std::feof(in))
+	    throw std::runtime_error("unexpected end of file");
+	else
+	    throw std::runtime_error(std::strerror(errno));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+write_bytes(FILE * out, const uint8_t * bytes, size_t length)
+{
+    if(std::fwrite(bytes, 1, length, out) < length)
+	throw std::runtime_error(std::strerror(errno));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decode the first "length" bytes of "bytes" as a big-endian integer
+static uint64_t
+decode_big_endian(const uint8_t * bytes, size_t length)
+{
+    uint64_t result = 0;
+    for(size_t idx = 0; idx < length; ++idx)
+	result = (result << 8) | bytes[idx];
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+encode_big_endian(uint64_t value, size_t length, uint8_t * bytes)
+{
+    for(size_t idx = 0; idx < length; ++idx)
+	bytes[idx] = (value >> (8 * (length - 1 - idx))) & 0xFF;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 uint8_t
 read_uint8(FILE * in)
 {
@@ -42,10 +87,9 @@ read_uint8(FILE * in)
 uint16_t
 read_uint16(FILE * in)
 {
-    uint8_t byte1 = read_uint8(in);
-    uint8_t byte2 = read_uint8(in);
-
-    return (((uint16_t) byte1) << 8) + byte2;
+    uint8_t bytes[2];
+    read_bytes(in, bytes, sizeof(bytes));
+    return decode_big_endian(bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -53,10 +97,9 @@ read_uint16(FILE * in)
 uint32_t
 read_uint32(FILE * in)
 {
-    uint16_t word1 = read_uint16(in);
-    uint16_t word2 = read_uint16(in);
-
-    return (((uint32_t) word1) << 16) + word2;
+    uint8_t bytes[4];
+    read_bytes(in, bytes, sizeof(bytes));
+    return decode_big_endian(bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -64,10 +107,9 @@ read_uint32(FILE * in)
 uint64_t
 read_uint64(FILE * in)
 {
-    uint32_t double_word1 = read_uint32(in);
-    uint32_t double_word2 = read_uint32(in);
-
-    return (((uint64_t) double_word1) << 32) + double_word2;
+    uint8_t bytes[8];
+    read_bytes(in, bytes, sizeof(bytes));
+    return decode_big_endian(bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -76,10 +118,7 @@ double
 read_double(FILE * in)
 {
     double value;
-    if(fread((void *) &value, sizeof(value), 1, in) < 1) {
-	throw std::runtime_error(std::strerror(errno));
-    }
-
+    read_bytes(in, reinterpret_cast<uint8_t *>(&value), sizeof(value));
     return value;
 }
 
@@ -97,8 +136,9 @@ write_uint8(FILE * out, uint8_t value)
 void
 write_uint16(FILE * out, uint16_t value)
 {
-    write_uint8(out, (value & 0xFF00) >> 8); 
-    write_uint8(out, (uint8_t) (value & 0xFF)); 
+    uint8_t bytes[2];
+    encode_big_endian(value, sizeof(bytes), bytes);
+    write_bytes(out, bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -106,8 +146,9 @@ write_uint16(FILE * out, uint16_t value)
 void
 write_uint32(FILE * out, uint32_t value)
 {
-    write_uint16(out, (value & 0xFFFF0000) >> 16); 
-    write_uint16(out, (uint16_t) (value & 0xFFFF)); 
+    uint8_t bytes[4];
+    encode_big_endian(value, sizeof(bytes), bytes);
+    write_bytes(out, bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -115,8 +156,9 @@ write_uint32(FILE * out, uint32_t value)
 void
 write_uint64(FILE * out, uint64_t value)
 {
-    write_uint32(out, (value & 0xFFFFFFFF00000000) >> 32);
-    write_uint32(out, (uint32_t) (value & 0xFFFFFFFF)); 
+    uint8_t bytes[8];
+    encode_big_endian(value, sizeof(bytes), bytes);
+    write_bytes(out, bytes, sizeof(bytes));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -124,7 +166,5 @@ write_uint64(FILE * out, uint64_t value)
 void
 write_double(FILE * out, double value)
 {
-    if(fwrite((const void *) &value, sizeof(value), 1, out) < 1) {
-	throw std::runtime_error(std::strerror(errno));
-    }
+    write_bytes(out, reinterpret_cast<const uint8_t *>(&value), sizeof(value));
 }
@@ -21,6 +21,15 @@
 #ifndef FILE_IO_HPP
 #define FILE_IO_HPP
 
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+// Read or write "length" bytes with one call to the C library. A
+// std::runtime_error is thrown if the file is too short.
+void read_bytes(FILE * in, uint8_t * bytes, size_t length);
+void write_bytes(FILE * out, const uint8_t * bytes, size_t length);
+
 uint8_t read_uint8(FILE * in);
 uint16_t read_uint16(FILE * in);
 uint32_t read_uint32(FILE * in);
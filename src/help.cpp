@@ -33,7 +33,11 @@ const char * help_text_general =
     "    squeezer compress [options] RADIOMETER OD INPUT_FILE OUTPUT_FILE\n"
     "    squeezer compress [options] PARAMETER_FILE\n"
     "    squeezer decompress [options] INPUT_FILE OUTPUT_FILE\n"
+    "    squeezer extract [options] --obt-range START END INPUT_FILE OUTPUT_FILE\n"
     "    squeezer statistics [options] INPUT_FILE OUTPUT_FILE\n"
+    "    squeezer verify [options] INPUT_FILE...\n"
+    "    squeezer serve [options] --socket PATH\n"
+    "    squeezer client --socket PATH COMMAND [parameters...]\n"
     "    squeezer help [COMMAND]\n"
     "    squeezer help version\n"
     "\n"
@@ -63,6 +67,12 @@ const char * help_text_compress =
     "   LFI18M 91 LFI18M_0091_pointings.fits 18M_0091.pntz\n"
     "   LFI18M 92 LFI18M_0092_pointings.fits 18M_0092.pntz\n"
     "\n"
+    "While the files are being compressed, the lines that have been\n"
+    "completed are listed in PARAMETER_FILE.journal, which is deleted\n"
+    "if no file fails. Every file is written under a temporary name and\n"
+    "renamed once complete, so that an interrupted run never leaves\n"
+    "truncated files behind.\n"
+    "\n"
     "Data are read from INPUT_FILE file, which can be either a FITS\n"
     "file or a DMC object. The code determines the data source\n"
     "depending on the following rules:\n"
@@ -81,6 +91,46 @@ const char * help_text_compress =
     "   --datadiff      Assume that the input data are differenced voltages.\n"
     "   --uncalibrated  Read uncalibrated data (voltages; this is the default).\n"
     "   --calibrated    Read calibrated data (Kelvin).\n"
+    "   --archive       Compress every chunk further using an adaptive\n"
+    "                   arithmetic coder. This is much slower (although it\n"
+    "                   uses all the available cores) but produces smaller\n"
+    "                   files: use it for long-term archival. This is the\n"
+    "                   same as \"--backend arith\".\n"
+    "   --backend SPEC  Compress chunks further using a general-purpose\n"
+    "                   compressor. SPEC is either NAME[:LEVEL], which applies\n"
+    "                   to every column, or COLUMN=NAME[:LEVEL], which applies\n"
+    "                   to one column only (obt, scet, theta, phi, psi, data,\n"
+    "                   flags). NAME can be none, arith, zlib and, if they were\n"
+    "                   available when squeezer was built, zstd and lz4. The\n"
+    "                   option can be repeated.\n"
+    "   --shuffle       Before applying the backend compressor, reorder the\n"
+    "                   bytes of each chunk so that the bytes with the same\n"
+    "                   significance are stored together. This is useful\n"
+    "                   only when a backend compressor is used. Angles are\n"
+    "                   never shuffled.\n"
+    "   --bitshuffle    Like --shuffle, but group together single bits\n"
+    "                   instead of bytes.\n"
+    "   --incremental   Only with a PARAMETER_FILE: skip the lines whose\n"
+    "                   OUTPUT_FILE was created by a previous run with the\n"
+    "                   same input and options and has not changed since.\n"
+    "                   The size, time and checksum of every input are kept\n"
+    "                   in PARAMETER_FILE.state. TOODI objects are always\n"
+    "                   compressed.\n"
+    "   --resume        Only with a PARAMETER_FILE: skip the lines listed\n"
+    "                   in PARAMETER_FILE.journal by a previous run with\n"
+    "                   the same options that was interrupted or where some\n"
+    "                   files failed.\n"
+    "   -b NUM          Split each column into blocks of NUM samples, which\n"
+    "                   are compressed separately and can be decompressed in\n"
+    "                   parallel. Zero means one block per column. The\n"
+    "                   default is 1048576.\n"
+    "   -j NUM          Use NUM threads (zero means one per core). With a\n"
+    "                   PARAMETER_FILE, up to NUM files are compressed at\n"
+    "                   the same time, each using one thread; a file that\n"
+    "                   cannot be compressed is reported and does not stop\n"
+    "                   the others. With a single file, NUM threads encode\n"
+    "                   its columns and blocks. The default is 1 with a\n"
+    "                   PARAMETER_FILE and one thread per core otherwise.\n"
     "   -n NUM          When compressing angles, this specifies the number of\n"
     "                   elements in a \"frame\". This value must always be\n"
     "                   greater than the one specified using -p.\n"
@@ -95,7 +145,8 @@ const char * help_text_compress =
     "   -v              Be verbose.\n";
 
 const char * help_text_decompress =
-    "Usage: squeezer decompress INPUT_FILE OUTPUT_FITS_FILE\n"
+    "Usage: squeezer decompress [options] INPUT_FILE OUTPUT_FITS_FILE\n"
+    "   or: squeezer decompress [options] PARAMETER_FILE\n"
     "\n"
     "Decompress a binary file into a FITS file. This is the\n"
     "opposite of \"squeezer compress\". A few caveats:\n"
@@ -110,9 +161,51 @@ const char * help_text_decompress =
     "     has been lost, use \"squeezer statistics\". (Run the command\n"
     "     \"squeezer help statistics\" for more information.)\n"
     "\n"
+    "PARAMETER_FILE has the same format used by \"squeezer compress\",\n"
+    "but INPUT_FILE is the compressed file and OUTPUT_FILE is the FITS\n"
+    "file to create. RADIOMETER and OD are ignored, as they are saved\n"
+    "in the compressed file. A file that cannot be decompressed is\n"
+    "reported and does not stop the others. At the end, the number of\n"
+    "files, rows and bytes processed per second is printed. As with\n"
+    "\"squeezer compress\", completed lines are listed in\n"
+    "PARAMETER_FILE.journal.\n"
+    "\n"
+    "Possible options are:\n"
+    "\n"
+    "   --columns LIST  Decode only the columns in LIST, a comma-separated\n"
+    "                   list of names (obt, scet, theta, phi, psi, data,\n"
+    "                   flags). Times are always decoded; the other\n"
+    "                   columns are filled with NaNs (zeroes for flags).\n"
+    "   -j NUM          Use NUM threads (zero means one per core). With a\n"
+    "                   PARAMETER_FILE, up to NUM files are decompressed\n"
+    "                   at the same time, each using one thread. Every file\n"
+    "                   is decoded one block at a time, so the memory used\n"
+    "                   does not depend on the size of the files. With a\n"
+    "                   single file, NUM threads decode its blocks. The\n"
+    "                   default is 1 with a PARAMETER_FILE and one thread\n"
+    "                   per core otherwise.\n"
+    "   --resume        Only with a PARAMETER_FILE: skip the lines completed\n"
+    "                   by a previous run with the same options (see\n"
+    "                   \"squeezer help compress\").\n"
+    "   -v              Be verbose.\n";
+
+const char * help_text_extract =
+    "Usage: squeezer extract [options] --obt-range START END INPUT_FILE OUTPUT_FITS_FILE\n"
+    "   or: squeezer extract [options] --obt-range START END PARAMETER_FILE\n"
+    "\n"
+    "Like \"squeezer decompress\", but write only the samples whose OBT\n"
+    "time is between START and END (inclusive, in clock ticks). Only the\n"
+    "blocks that overlap the range are decompressed, so this is much\n"
+    "faster than decompressing the whole file.\n"
+    "\n"
     "Possible options are:\n"
     "\n"
-    "   -v      Be verbose.\n";
+    "   --columns LIST  Decode only the columns in LIST (see \"squeezer\n"
+    "                   help decompress\").\n"
+    "   -j NUM          Number of threads (see \"squeezer help decompress\").\n"
+    "   --resume        Skip the lines completed by a previous run (see\n"
+    "                   \"squeezer help decompress\").\n"
+    "   -v              Be verbose.\n";
 
 const char * help_text_statistics =
     "Usage: squeezer statistics [options] BINARY_FILE\n"
@@ -126,6 +219,55 @@ const char * help_text_statistics =
     "\n"
     "   -html    Output a report in HTML format.\n";
 
+const char * help_text_verify =
+    "Usage: squeezer verify [options] BINARY_FILE...\n"
+    "\n"
+    "Check the integrity of one or more compressed binary files without\n"
+    "decompressing them. The checksum of every block is computed and\n"
+    "compared with the one saved in the file, and all the headers are\n"
+    "checked for consistency. Files created by versions of \"squeezer\"\n"
+    "older than 1.6 contain no checksums, so only their headers are\n"
+    "checked. The exit status is nonzero if any file is damaged.\n"
+    "\n"
+    "Possible options are:\n"
+    "\n"
+    "   -j NUM   Number of files to check in parallel. The default is\n"
+    "            the number of cores.\n"
+    "   -v       Print a line for every file that is not damaged.\n";
+
+const char * help_text_serve =
+    "Usage: squeezer serve [options] --socket PATH\n"
+    "\n"
+    "Wait for \"squeezer client\" to connect to the Unix domain socket\n"
+    "PATH, and run the commands it sends. Since the server keeps its\n"
+    "threads and their buffers from one request to the next, this is\n"
+    "faster than starting \"squeezer\" for every file. The commands\n"
+    "\"compress\", \"decompress\", \"extract\" and \"statistics\" are\n"
+    "supported; they use one thread unless -j is specified, and they\n"
+    "cannot read from standard input or write to standard output.\n"
+    "\n"
+    "Only the user running the server can connect to the socket. The\n"
+    "server stops when it receives SIGINT or SIGTERM, after completing\n"
+    "the requests that are being run, and removes the socket.\n"
+    "\n"
+    "Possible options are:\n"
+    "\n"
+    "   -j NUM   Number of requests run at the same time. The default\n"
+    "            is the number of cores.\n"
+    "   -v       Print a line for every request.\n";
+
+const char * help_text_client =
+    "Usage: squeezer client --socket PATH COMMAND [parameters...]\n"
+    "\n"
+    "Ask the server listening on PATH (see \"squeezer help serve\") to\n"
+    "run COMMAND, and print its output. Relative file names are\n"
+    "interpreted with respect to the current directory of the client.\n"
+    "The exit status is the one of COMMAND.\n"
+    "\n"
+    "Example:\n"
+    "\n"
+    "    squeezer client --socket /tmp/squeezer.sock compress files.txt\n";
+
 const char * help_text_help =
     "Print command-line help.\n";
 
@@ -147,6 +289,14 @@ print_help_on_decompress_command()
 
 //////////////////////////////////////////////////////////////////////
 
+void
+print_help_on_extract_command()
+{
+    std::cout << help_text_extract;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void
 print_help_on_statistics_command()
 {
@@ -155,6 +305,30 @@ print_help_on_statistics_command()
 
 //////////////////////////////////////////////////////////////////////
 
+void
+print_help_on_verify_command()
+{
+    std::cout << help_text_verify;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+print_help_on_serve_command()
+{
+    std::cout << help_text_serve;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+print_help_on_client_command()
+{
+    std::cout << help_text_client;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 void
 print_help_on_help_command()
 {
@@ -179,10 +353,26 @@ print_help(const std::vector<std::string> & list_of_arguments)
 
 	    print_help_on_decompress_command();
 
+	} else if(list_of_arguments.at(1) == "extract") {
+
+	    print_help_on_extract_command();
+
 	} else if(list_of_arguments.at(1) == "statistics") {
 
 	    print_help_on_statistics_command();
 
+	} else if(list_of_arguments.at(1) == "verify") {
+
+	    print_help_on_verify_command();
+
+	} else if(list_of_arguments.at(1) == "serve") {
+
+	    print_help_on_serve_command();
+
+	} else if(list_of_arguments.at(1) == "client") {
+
+	    print_help_on_client_command();
+
 	} else if(list_of_arguments.at(1) == "help") {
 
 	    print_help_on_help_command();
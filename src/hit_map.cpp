@@ -75,9 +75,12 @@ add_hits_from_pointings(hpix_map_t * map,
     std::unique_ptr<Detector_pointings_t> detpoints;
     Decompression_parameters_t params;
 
+    // Only the angles are needed to build the map
+    params.column_mask = column_bit(CHUNK_THETA) | column_bit(CHUNK_PHI);
+
     std::cerr << PROGRAM_NAME << ": reading file " << input_file_name << "\n";
 
-#ifdef HAVE_TOODI
+#if HAVE_TOODI
     if(input_file_name.substr(0, 6) == "TOODI%") {
         detpoints.reset(new Detector_pointings_t());
 	detpoints->read_from_database(input_file_name);
@@ -120,7 +123,7 @@ main(int argc, const char * argv[])
 
     hpix_map_t * hit_map = hpix_create_map(config.nside, HPIX_ORDER_SCHEME_RING);
 
-#ifdef HAVE_TOODI
+#if HAVE_TOODI
     ObjectHandle init_handle;
     toodiInitializeLLIO("TOODI%file", &init_handle);
 #endif
@@ -0,0 +1,105 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+Mapped_file_t::Mapped_file_t(FILE * file)
+    : mapped_address(NULL),
+      mapped_length(0),
+      contents(),
+      data(NULL),
+      length(0)
+{
+    const int fd = fileno(file);
+    struct stat file_info;
+    const off_t cur_offset = ftello(file);
+
+    if(fd < 0 ||
+       fstat(fd, &file_info) != 0 ||
+       ! S_ISREG(file_info.st_mode) ||
+       cur_offset < 0 ||
+       cur_offset >= file_info.st_size) {
+
+	read_whole_stream(file);
+	return;
+    }
+
+    mapped_length = file_info.st_size;
+    mapped_address = mmap(NULL, mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped_address == MAP_FAILED) {
+	mapped_address = NULL;
+	mapped_length = 0;
+	read_whole_stream(file);
+	return;
+    }
+
+    // The file is going to be read sequentially
+    madvise(mapped_address, mapped_length, MADV_SEQUENTIAL);
+
+    data = static_cast<const uint8_t *>(mapped_address) + cur_offset;
+    length = mapped_length - cur_offset;
+
+    fseeko(file, 0, SEEK_END);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+Mapped_file_t::~Mapped_file_t()
+{
+    if(mapped_address != NULL)
+	munmap(mapped_address, mapped_length);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+Mapped_file_t::read_whole_stream(FILE * file)
+{
+    const size_t chunk_size = 1 << 20;
+    size_t bytes_read = 0;
+
+    while(true) {
+	contents.resize(bytes_read + chunk_size);
+	const size_t result = fread(contents.data() + bytes_read, 1,
+				    chunk_size, file);
+	bytes_read += result;
+
+	if(result < chunk_size) {
+	    if(ferror(file))
+		throw std::runtime_error(std::strerror(errno));
+
+	    break;
+	}
+    }
+
+    contents.resize(bytes_read);
+    data = contents.data();
+    length = contents.size();
+}
@@ -0,0 +1,62 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+#include "byte_buffer.hpp"
+
+// Make the contents of a file available in memory, from the current
+// position of the stream up to its end. Regular files are mapped
+// using mmap; other streams (e.g., pipes and the standard input) are
+// read completely into memory. In both cases the stream is left at
+// its end.
+class Mapped_file_t {
+public:
+    explicit Mapped_file_t(FILE * file);
+    ~Mapped_file_t();
+
+    Byte_view_t view() const {
+	return Byte_view_t(data, length);
+    }
+
+    bool is_memory_mapped() const {
+	return mapped_address != NULL;
+    }
+
+private:
+    Mapped_file_t(const Mapped_file_t &);
+    Mapped_file_t & operator=(const Mapped_file_t &);
+
+    void read_whole_stream(FILE * file);
+
+    void * mapped_address;
+    size_t mapped_length;
+    std::vector<uint8_t> contents;
+
+    const uint8_t * data;
+    size_t length;
+};
+
+#endif
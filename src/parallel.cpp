@@ -0,0 +1,113 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+unsigned int
+default_num_of_threads()
+{
+    unsigned int result = std::thread::hardware_concurrency();
+    return (result > 0) ? result : 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+parallel_for(size_t num_of_items,
+	     unsigned int num_of_threads,
+	     const std::function<void (size_t)> & fn)
+{
+    if(num_of_threads == 0)
+	num_of_threads = default_num_of_threads();
+
+    num_of_threads = std::min<size_t>(num_of_threads, num_of_items);
+    if(num_of_threads <= 1) {
+	for(size_t idx = 0; idx < num_of_items; ++idx)
+	    fn(idx);
+
+	return;
+    }
+
+    std::atomic<size_t> next_item(0);
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+	size_t idx;
+	while((idx = next_item++) < num_of_items) {
+	    try {
+		fn(idx);
+	    } catch(...) {
+		std::lock_guard<std::mutex> lock(error_mutex);
+		if(! first_error)
+		    first_error = std::current_exception();
+
+		// Prevent the other threads from starting new items
+		next_item = num_of_items;
+	    }
+	}
+    };
+
+    std::vector<std::thread> threads;
+    for(unsigned int idx = 0; idx < num_of_threads; ++idx)
+	threads.push_back(std::thread(worker));
+
+    for(auto & cur_thread : threads)
+	cur_thread.join();
+
+    if(first_error)
+	std::rethrow_exception(first_error);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::vector<unsigned int>
+balance_by_weight(const std::vector<uint64_t> & weights,
+		  unsigned int num_of_workers)
+{
+    std::vector<size_t> items(weights.size());
+    for(size_t idx = 0; idx < items.size(); ++idx)
+	items[idx] = idx;
+
+    // Items with the same weight keep their order, so that the result
+    // is the same on every machine
+    std::stable_sort(items.begin(), items.end(),
+		     [&](size_t a, size_t b) { return weights[a] > weights[b]; });
+
+    std::vector<uint64_t> loads(std::max(num_of_workers, 1U), 0);
+    std::vector<unsigned int> result(weights.size());
+    for(size_t item : items) {
+	const size_t worker =
+	    std::min_element(loads.begin(), loads.end()) - loads.begin();
+	result[item] = worker;
+	loads[worker] += weights[item];
+    }
+
+    return result;
+}
@@ -0,0 +1,47 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Number of threads to use when the user does not specify it
+unsigned int default_num_of_threads();
+
+// Call "fn" once for every index in [0, num_of_items), spreading the
+// calls over "num_of_threads" threads (0 means the value returned by
+// default_num_of_threads). If any call throws an exception, the first
+// one is rethrown once all the threads have finished.
+void parallel_for(size_t num_of_items,
+		  unsigned int num_of_threads,
+		  const std::function<void (size_t)> & fn);
+
+// Split a set of items among "num_of_workers" workers so that the sum
+// of the weights of the items is roughly the same for every worker.
+// Heavier items are assigned first, each to the worker with the
+// smallest load. Return the index of the worker of each item.
+std::vector<unsigned int> balance_by_weight(const std::vector<uint64_t> & weights,
+					    unsigned int num_of_workers);
+
+#endif
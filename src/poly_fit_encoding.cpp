@@ -44,7 +44,7 @@ Frame_t::write_to_buffer(Byte_buffer_t & output_buffer)
 //////////////////////////////////////////////////////////////////////
 
 void
-Frame_t::read_from_buffer(Byte_buffer_t & input_buffer)
+Frame_t::read_from_buffer(Byte_view_t & input_buffer)
 {
     num_of_elements = input_buffer.read_uint8();
 
@@ -216,7 +216,9 @@ poly_fit_encode(const std::vector<double> & values,
 		size_t & num_of_frames_encoded_directly)
 {
     Vector_of_frames_t frames;
-    Multifit_workspace workspace;
+    // The GSL matrices are reused as long as the size of the frames
+    // does not change
+    static thread_local Multifit_workspace workspace;
 
     num_of_frames = 0;
     num_of_frames_encoded_directly = 0;
@@ -267,7 +269,7 @@ poly_fit_encode(const std::vector<double> & values,
 
 void
 poly_fit_decode(size_t num_of_elements_to_decode,
-		Byte_buffer_t & input_buffer,
+		Byte_view_t & input_buffer,
 		std::vector<double> & values)
 {
     values.resize(num_of_elements_to_decode);
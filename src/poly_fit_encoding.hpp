@@ -41,7 +41,7 @@ struct Frame_t {
 	  parameters(a_parameters) {}
 
     void write_to_buffer(Byte_buffer_t & output_buffer);
-    void read_from_buffer(Byte_buffer_t & input_buffer);
+    void read_from_buffer(Byte_view_t & input_buffer);
 
     bool is_encoded_as_a_polynomial() const {
 	return num_of_elements > parameters.size();
@@ -58,7 +58,7 @@ void poly_fit_encode(const std::vector<double> & values,
 		     size_t & num_of_frames,
 		     size_t & num_of_frames_encoded_directly);
 void poly_fit_decode(size_t num_of_elements_to_decode,
-		     Byte_buffer_t & input_buffer,
+		     Byte_view_t & input_buffer,
 		     std::vector<double> & values);
 
 #endif
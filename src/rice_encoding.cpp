@@ -0,0 +1,164 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "byte_buffer.hpp"
+#include "bit_stream.hpp"
+#include "rice_encoding.hpp"
+
+/* Every block of RICE_BLOCK_SIZE samples starts with a 5-bit Rice
+ * parameter k. Each (zigzag-encoded) sample u is then written as the
+ * quotient q = u >> k in unary form (q zeroes followed by a one),
+ * followed by the k least significant bits of u. If q is equal to or
+ * larger than RICE_ESCAPE_QUOTIENT, the unary code for
+ * RICE_ESCAPE_QUOTIENT is written instead, and it is followed by the
+ * 32 bits of u. The bit stream is padded with zeroes up to the next
+ * byte boundary. */
+
+const unsigned int RICE_PARAMETER_BITS = 5;
+const unsigned int RICE_MAX_PARAMETER = 31;
+
+//////////////////////////////////////////////////////////////////////
+
+static size_t
+rice_code_length(uint32_t value, unsigned int k)
+{
+    uint32_t quotient = value >> k;
+    if(quotient >= RICE_ESCAPE_QUOTIENT)
+	return RICE_ESCAPE_QUOTIENT + 1 + 32;
+    else
+	return quotient + 1 + k;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static unsigned int
+best_rice_parameter(const uint32_t * values, size_t num_of_values)
+{
+    uint64_t sum = 0;
+    for(size_t idx = 0; idx < num_of_values; ++idx)
+	sum += values[idx];
+
+    // The optimal parameter is close to log2 of the mean value. We
+    // refine this guess by computing the exact length of the block
+    // for the neighbouring parameters too.
+    uint64_t mean = sum / num_of_values;
+    unsigned int guess = 0;
+    while(guess < RICE_MAX_PARAMETER && (mean >> (guess + 1)) > 0)
+	++guess;
+
+    unsigned int first_k = (guess > 0) ? guess - 1 : 0;
+    unsigned int last_k = std::min(guess + 1, RICE_MAX_PARAMETER);
+
+    unsigned int best_k = first_k;
+    size_t best_length = SIZE_MAX;
+    for(unsigned int k = first_k; k <= last_k; ++k) {
+	size_t length = 0;
+	for(size_t idx = 0; idx < num_of_values; ++idx)
+	    length += rice_code_length(values[idx], k);
+
+	if(length < best_length) {
+	    best_length = length;
+	    best_k = k;
+	}
+    }
+
+    return best_k;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+rice_compression(const int32_t * input_stream,
+		 size_t input_size,
+		 Byte_buffer_t & output_stream)
+{
+    Bit_writer_t writer(output_stream);
+    uint32_t block[RICE_BLOCK_SIZE];
+
+    for(size_t first = 0; first < input_size; first += RICE_BLOCK_SIZE) {
+	const size_t block_size = std::min(RICE_BLOCK_SIZE, input_size - first);
+	for(size_t idx = 0; idx < block_size; ++idx)
+	    block[idx] = zigzag_encode(input_stream[first + idx]);
+
+	const unsigned int k = best_rice_parameter(block, block_size);
+	writer.write_bits(k, RICE_PARAMETER_BITS);
+
+	for(size_t idx = 0; idx < block_size; ++idx) {
+	    const uint32_t quotient = block[idx] >> k;
+
+	    // The unary code of the quotient and the remainder are
+	    // written at once, as they never exceed 64 bits
+	    if(quotient < RICE_ESCAPE_QUOTIENT) {
+		const uint64_t remainder = block[idx] & ((UINT64_C(1) << k) - 1);
+		writer.write_bits((UINT64_C(1) << k) | remainder, quotient + 1 + k);
+	    } else {
+		writer.write_bits((UINT64_C(1) << 32) | block[idx],
+				  RICE_ESCAPE_QUOTIENT + 1 + 32);
+	    }
+	}
+    }
+
+    writer.flush();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+rice_decompression(Byte_view_t & input_stream,
+		   size_t output_size,
+		   std::vector<int32_t> & output)
+{
+    output.resize(output_size);
+
+    Bit_reader_t reader(input_stream);
+
+    for(size_t first = 0; first < output_size; first += RICE_BLOCK_SIZE) {
+	const size_t block_size = std::min(RICE_BLOCK_SIZE, output_size - first);
+	const unsigned int k = reader.read_bits(RICE_PARAMETER_BITS);
+
+	for(size_t idx = 0; idx < block_size; ++idx) {
+	    const uint64_t window = reader.peek_bits();
+
+	    // Both the regular code and the escape sequence are decoded
+	    // from the same window, and the right one is selected at
+	    // the end: this keeps the loop free of hard-to-predict
+	    // branches.
+	    const unsigned int quotient =
+		std::min(static_cast<unsigned int>(__builtin_clzll(window | 1)),
+			 RICE_ESCAPE_QUOTIENT);
+	    const uint32_t remainder =
+		((window << (quotient + 1)) >> 1) >> (63 - k);
+	    const uint32_t regular_value = (quotient << k) | remainder;
+	    const uint32_t escaped_value =
+		(window << (RICE_ESCAPE_QUOTIENT + 1)) >> 32;
+
+	    const bool is_escape = (quotient == RICE_ESCAPE_QUOTIENT);
+	    output[first + idx] =
+		zigzag_decode(is_escape ? escaped_value : regular_value);
+	    reader.skip_bits(is_escape ? (RICE_ESCAPE_QUOTIENT + 1 + 32) : (quotient + 1 + k));
+	}
+    }
+
+    reader.finish();
+}
@@ -0,0 +1,61 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef RICE_ENCODING_HPP
+#define RICE_ENCODING_HPP
+
+#include <cstdint>
+#include <vector>
+#include <cstddef>
+
+#include "byte_buffer.hpp"
+
+// Number of consecutive samples that share the same Rice parameter
+const size_t RICE_BLOCK_SIZE = 64;
+
+// Quotients equal or larger than this are not written in unary
+// form: the value is written verbatim after an escape sequence
+const unsigned int RICE_ESCAPE_QUOTIENT = 24;
+
+// Map signed integers into unsigned ones, so that numbers with a
+// small magnitude get a small code: 0, -1, 1, -2, 2... become 0, 1,
+// 2, 3, 4...
+inline uint32_t
+zigzag_encode(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^
+	static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t
+zigzag_decode(uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (0U - (value & 1)));
+}
+
+void rice_compression(const int32_t * input_stream,
+		      size_t input_size,
+		      Byte_buffer_t & output_stream);
+
+void rice_decompression(Byte_view_t & input_stream,
+			size_t output_size,
+			std::vector<int32_t> & output);
+
+#endif
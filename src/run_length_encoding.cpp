@@ -31,6 +31,9 @@ rle_compression(const uint32_t * input_stream,
 {
     const uint32_t * ptr_to_cur_dword = input_stream;
 
+    // Pairs of (count, value)
+    std::vector<uint32_t> runs;
+
     while((size_t) (ptr_to_cur_dword - input_stream + 1) <= input_size) {
 	uint32_t first_dword_in_the_run = *ptr_to_cur_dword++;
 
@@ -42,23 +45,27 @@ rle_compression(const uint32_t * input_stream,
 	    count++;
 	}
 
-	output_stream.append_uint32(count);
-	output_stream.append_uint32(first_dword_in_the_run);
-    }    
+	runs.push_back(count);
+	runs.push_back(first_dword_in_the_run);
+    }
+
+    output_stream.append_uint32s(runs.data(), runs.size());
 }
 
 //////////////////////////////////////////////////////////////////////
 
 void
-rle_decompression(Byte_buffer_t & input_stream,
+rle_decompression(Byte_view_t & input_stream,
 		  size_t output_size,
 		  std::vector<uint32_t> & output)
 {
     output.resize(output_size);
     size_t output_idx = 0;
     while(output_idx < output_size) {
-	uint32_t count = input_stream.read_uint32();
-	uint32_t value = input_stream.read_uint32();
+	uint32_t run[2];
+	input_stream.read_uint32s(run, 2);
+	const uint32_t count = run[0];
+	const uint32_t value = run[1];
 
 	std::fill(output.begin() + output_idx,
 		  output.begin() + output_idx + count,
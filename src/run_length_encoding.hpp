@@ -31,7 +31,7 @@ void rle_compression(const uint32_t * input_stream,
 		     size_t input_size,
 		     Byte_buffer_t & output_stream);
 
-void rle_decompression(Byte_buffer_t & input_stream,
+void rle_decompression(Byte_view_t & input_stream,
 		       size_t output_size,
 		       std::vector<uint32_t> & output);
 
@@ -0,0 +1,597 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bounded_queue.hpp"
+#include "commands.hpp"
+#include "common_defs.hpp"
+#include "parallel.hpp"
+#include "serve.hpp"
+#include "tasks.hpp"
+
+// The first string of every request. It must be changed whenever the
+// format of the messages changes.
+static const char * protocol_version = "squeezer-1";
+
+// A client that connects but does not send its request within this
+// time is dropped, so that it does not keep a worker busy
+static const int REQUEST_TIMEOUT_S = 60;
+
+// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t stop_requested = 0;
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+handle_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+system_error(const std::string & what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+write_all(int fd, const void * data, size_t size)
+{
+    const char * cur = static_cast<const char *>(data);
+    while(size > 0) {
+	ssize_t result = write(fd, cur, size);
+	if(result < 0) {
+	    if(errno == EINTR)
+		continue;
+
+	    throw std::runtime_error(system_error("unable to write to the socket"));
+	}
+
+	cur += result;
+	size -= result;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Return false if the connection was closed before the first byte
+static bool
+read_all(int fd, void * data, size_t size)
+{
+    char * cur = static_cast<char *>(data);
+    size_t bytes_read = 0;
+    while(bytes_read < size) {
+	ssize_t result = read(fd, cur + bytes_read, size - bytes_read);
+	if(result < 0) {
+	    if(errno == EINTR)
+		continue;
+
+	    throw std::runtime_error(system_error("unable to read from the socket"));
+	}
+
+	if(result == 0) {
+	    if(bytes_read == 0)
+		return false;
+
+	    throw std::runtime_error("the connection was closed in the "
+				     "middle of a message");
+	}
+
+	bytes_read += result;
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+write_message(int fd, const std::vector<std::string> & fields)
+{
+    std::string buffer;
+    auto append_uint32 = [&buffer](uint32_t value) {
+	const uint32_t big_endian_value = htonl(value);
+	buffer.append(reinterpret_cast<const char *>(&big_endian_value),
+		      sizeof(big_endian_value));
+    };
+
+    append_uint32(fields.size());
+    for(const auto & cur_field : fields) {
+	append_uint32(cur_field.size());
+	buffer.append(cur_field);
+    }
+
+    if(buffer.size() > MAX_MESSAGE_SIZE)
+	throw std::runtime_error("message too long");
+
+    write_all(fd, buffer.data(), buffer.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t
+read_uint32(int fd)
+{
+    uint32_t value;
+    if(! read_all(fd, &value, sizeof(value)))
+	throw std::runtime_error("the connection was closed in the "
+				 "middle of a message");
+
+    return ntohl(value);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool
+read_message(int fd, std::vector<std::string> & fields)
+{
+    uint32_t num_of_fields;
+    if(! read_all(fd, &num_of_fields, sizeof(num_of_fields)))
+	return false;
+
+    num_of_fields = ntohl(num_of_fields);
+    if(num_of_fields > MAX_MESSAGE_SIZE / sizeof(uint32_t))
+	throw std::runtime_error("message too long");
+
+    uint64_t total_size = 0;
+    fields.resize(num_of_fields);
+    for(auto & cur_field : fields) {
+	const uint32_t size = read_uint32(fd);
+	total_size += size;
+	if(total_size > MAX_MESSAGE_SIZE)
+	    throw std::runtime_error("message too long");
+
+	cur_field.resize(size);
+	if(size > 0)
+	    read_all(fd, &cur_field[0], size);
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+make_socket_address(const std::string & socket_path,
+		    struct sockaddr_un & address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+	throw std::runtime_error("invalid socket name \"" + socket_path + "\"");
+
+    std::strcpy(address.sun_path, socket_path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Return the descriptor of a socket connected to "socket_path", or -1
+// if nobody is listening there
+static int
+connect_to_server(const std::string & socket_path)
+{
+    struct sockaddr_un address;
+    make_socket_address(socket_path, address);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+	throw std::runtime_error(system_error("unable to create a socket"));
+
+    if(connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+	       sizeof(address)) != 0) {
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// A socket left behind by a server that was killed is removed, but
+// the server refuses to replace a socket that is still in use or a
+// file that is not a socket
+static int
+create_server_socket(const std::string & socket_path)
+{
+    struct sockaddr_un address;
+    make_socket_address(socket_path, address);
+
+    struct stat file_info;
+    if(lstat(socket_path.c_str(), &file_info) == 0) {
+	if(! S_ISSOCK(file_info.st_mode))
+	    throw std::runtime_error("\"" + socket_path + "\" already exists "
+				     "and is not a socket");
+
+	int fd = connect_to_server(socket_path);
+	if(fd >= 0) {
+	    close(fd);
+	    throw std::runtime_error("another server is listening on \""
+				     + socket_path + "\"");
+	}
+
+	unlink(socket_path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+	throw std::runtime_error(system_error("unable to create a socket"));
+
+    // Only the user running the server can connect to it, as requests
+    // are run with the permissions of the server. The socket is
+    // created with these permissions, so that nobody can connect to it
+    // before they are set. (No other thread is running yet, so
+    // changing the umask of the process is safe.)
+    const mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+    const int bind_result = bind(fd, reinterpret_cast<struct sockaddr *>(&address),
+				 sizeof(address));
+    umask(old_umask);
+
+    if(bind_result != 0 ||
+       listen(fd, SOMAXCONN) != 0 ||
+       fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+
+	const std::string message =
+	    system_error("unable to listen on \"" + socket_path + "\"");
+	close(fd);
+	unlink(socket_path.c_str());
+	throw std::runtime_error(message);
+
+    }
+
+    return fd;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Run the command in "request" and fill the fields of the reply
+static void
+run_request(const std::vector<std::string> & request,
+	    std::vector<std::string> & reply)
+{
+    std::ostringstream log;
+    char * output_buffer = NULL;
+    size_t output_size = 0;
+    FILE * output = open_memstream(&output_buffer, &output_size);
+    if(output == NULL)
+	throw std::runtime_error(system_error("unable to allocate memory"));
+
+    // Unless the client asks for more threads with -j, each request
+    // is run by the worker thread alone: the server runs many
+    // requests at the same time, no thread is started for a request,
+    // and the buffers kept by the worker are reused by the next
+    // requests. Files are always written to paths which can be
+    // rewound, so there is no need for temporary files.
+    Command_context_t context;
+    context.log_stream = &log;
+    context.output = output;
+    context.working_directory = request.at(1);
+    context.default_num_of_threads = 1;
+    context.standard_streams_flag = false;
+    context.use_temporary_files = false;
+
+    const std::string & command = request.at(2);
+    const std::vector<std::string> command_args(request.begin() + 3,
+						request.end());
+    int status = 1;
+    try {
+	if(command == "compress") {
+	    status = compress_command(command_args, context);
+	} else if(command == "decompress") {
+	    status = decompress_command(command_args, false, context);
+	} else if(command == "extract") {
+	    status = decompress_command(command_args, true, context);
+	} else if(command == "statistics") {
+	    status = statistics_command(command_args, context);
+	} else {
+	    log << PROGRAM_NAME
+		<< ": command \""
+		<< command
+		<< "\" cannot be run by the server\n";
+	}
+    }
+    catch(std::exception & exc) {
+	log << PROGRAM_NAME << ": " << exc.what() << '\n';
+	status = 1;
+    }
+
+    std::fclose(output);
+    const std::string output_text(output_buffer, output_size);
+    std::free(output_buffer);
+
+    reply.clear();
+    reply.push_back(std::to_string(status));
+    reply.push_back(output_text);
+    reply.push_back(log.str());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+handle_connection(int fd,
+		  bool verbose_flag,
+		  std::mutex & output_mutex)
+{
+    struct timeval timeout;
+    timeout.tv_sec = REQUEST_TIMEOUT_S;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<std::string> request;
+    if(! read_message(fd, request))
+	return;
+
+    std::vector<std::string> reply;
+    if(request.size() < 3 || request[0] != protocol_version) {
+	reply.push_back("1");
+	reply.push_back("");
+	reply.push_back(std::string(PROGRAM_NAME)
+			+ ": the client and the server use different versions "
+			+ "of the protocol\n");
+	write_message(fd, reply);
+	return;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    run_request(request, reply);
+    write_message(fd, reply);
+
+    if(verbose_flag) {
+	const std::chrono::duration<double> elapsed_time =
+	    std::chrono::steady_clock::now() - start_time;
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cerr << PROGRAM_NAME << ": \"" << request[2];
+	for(size_t idx = 3; idx < request.size(); ++idx)
+	    std::cerr << ' ' << request[idx];
+	std::cerr << "\" in "
+		  << request[1]
+		  << ": exit status "
+		  << reply[0]
+		  << ", "
+		  << std::fixed << std::setprecision(2)
+		  << elapsed_time.count()
+		  << " s\n";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+run_server(const std::string & socket_path,
+	   unsigned int num_of_workers,
+	   bool verbose_flag)
+{
+    const int server_fd = create_server_socket(socket_path);
+
+    // A client that disconnects early must not kill the server
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    // No SA_RESTART, so that pselect returns as soon as a signal
+    // arrives
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // SIGINT and SIGTERM are only delivered to this thread, and only
+    // while it waits in pselect: this way, a signal cannot arrive
+    // between the test of "stop_requested" and the wait
+    sigset_t stop_signals, original_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &original_mask);
+
+    Bounded_queue_t<int> connections(num_of_workers);
+    std::mutex output_mutex;
+    std::vector<std::thread> workers;
+    for(unsigned int idx = 0; idx < num_of_workers; ++idx) {
+	workers.push_back(std::thread([&]() {
+		    int fd;
+		    while(connections.pop(fd)) {
+			try {
+			    handle_connection(fd, verbose_flag, output_mutex);
+			}
+			catch(std::exception & exc) {
+			    std::lock_guard<std::mutex> lock(output_mutex);
+			    std::cerr << PROGRAM_NAME
+				      << ": error while serving a client: "
+				      << exc.what()
+				      << '\n';
+			}
+			close(fd);
+		    }
+		}));
+    }
+
+    if(verbose_flag) {
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cerr << PROGRAM_NAME
+		  << ": listening on "
+		  << socket_path
+		  << " with "
+		  << num_of_workers
+		  << " workers\n";
+    }
+
+    while(! stop_requested) {
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	FD_SET(server_fd, &read_fds);
+
+	if(pselect(server_fd + 1, &read_fds, NULL, NULL, NULL,
+		   &original_mask) < 0) {
+	    if(errno == EINTR)
+		continue;
+
+	    std::cerr << PROGRAM_NAME << ": " << system_error("pselect") << '\n';
+	    break;
+	}
+
+	int client_fd = accept(server_fd, NULL, NULL);
+	if(client_fd < 0)
+	    continue;
+
+	int fd_to_queue = client_fd;
+	connections.push(std::move(fd_to_queue));
+    }
+
+    // Requests that have already been accepted are completed
+    close(server_fd);
+    unlink(socket_path.c_str());
+    connections.close();
+    for(auto & cur_worker : workers)
+	cur_worker.join();
+
+    pthread_sigmask(SIG_SETMASK, &original_mask, NULL);
+    if(verbose_flag)
+	std::cerr << PROGRAM_NAME << ": server stopped\n";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+serve_command(const std::vector<std::string> & list_of_arguments)
+{
+    std::string socket_path;
+    unsigned int num_of_workers = 0;
+    bool verbose_flag = false;
+    size_t cur_argument = 0;
+
+    while(cur_argument < list_of_arguments.size()) {
+	const std::string & flag = list_of_arguments.at(cur_argument);
+	if(flag == "-v") {
+	    verbose_flag = true;
+	    cur_argument++;
+	} else if(flag == "--socket" &&
+		  cur_argument + 1 < list_of_arguments.size()) {
+	    socket_path = list_of_arguments.at(cur_argument + 1);
+	    cur_argument += 2;
+	} else if(flag == "-j" &&
+		  cur_argument + 1 < list_of_arguments.size()) {
+	    std::stringstream ss(list_of_arguments.at(cur_argument + 1));
+	    if(! (ss >> num_of_workers))
+		throw std::runtime_error("invalid number of threads \""
+					 + list_of_arguments.at(cur_argument + 1)
+					 + "\"");
+	    cur_argument += 2;
+	} else {
+	    throw std::runtime_error("invalid argument \"" + flag
+				     + "\". Run \"squeezer help serve\".");
+	}
+    }
+
+    if(socket_path.empty())
+	throw std::runtime_error("you must specify the name of the socket "
+				 "using --socket");
+
+    if(num_of_workers == 0)
+	num_of_workers = default_num_of_threads();
+    num_of_workers = number_of_fits_jobs(num_of_workers, std::cerr);
+
+    run_server(socket_path, num_of_workers, verbose_flag);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+client_command(const std::vector<std::string> & list_of_arguments)
+{
+    if(list_of_arguments.size() < 3 || list_of_arguments.at(0) != "--socket")
+	throw std::runtime_error("wrong number of arguments. "
+				 "Run \"squeezer help client\".");
+
+    const std::string & socket_path = list_of_arguments.at(1);
+
+    // Relative file names are resolved by the server using the
+    // directory of the client
+    std::vector<char> buffer(4096);
+    while(getcwd(buffer.data(), buffer.size()) == NULL) {
+	if(errno != ERANGE)
+	    throw std::runtime_error(system_error("unable to determine the "
+						  "current directory"));
+	buffer.resize(buffer.size() * 2);
+    }
+
+    std::vector<std::string> request;
+    request.push_back(protocol_version);
+    request.push_back(buffer.data());
+    request.insert(request.end(),
+		   list_of_arguments.begin() + 2,
+		   list_of_arguments.end());
+
+    const int fd = connect_to_server(socket_path);
+    if(fd < 0)
+	throw std::runtime_error(system_error("unable to connect to \""
+					      + socket_path + "\""));
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::vector<std::string> reply;
+    try {
+	write_message(fd, request);
+	if(! read_message(fd, reply) || reply.size() != 3)
+	    throw std::runtime_error("the server did not reply");
+    }
+    catch(...) {
+	close(fd);
+	throw;
+    }
+    close(fd);
+
+    std::fwrite(reply[1].data(), 1, reply[1].size(), stdout);
+    std::fflush(stdout);
+    std::cerr << reply[2];
+
+    return std::atoi(reply[0].c_str());
+}
@@ -0,0 +1,69 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef SERVE_HPP
+#define SERVE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// "squeezer serve" runs the "compress", "decompress", "extract" and
+// "statistics" commands on behalf of the clients that connect to a
+// Unix domain socket. Requests are run by a fixed set of worker
+// threads, which are started once. Each worker runs a request by
+// itself (unless the client passes -j), so the buffers that a worker
+// keeps for encoding and decoding blocks are reused by the next
+// requests it runs, and no thread is started for a request.
+// "squeezer client" sends a command and prints the messages it
+// produced.
+//
+// Each message exchanged over the socket is a list of strings,
+// encoded as the number of strings followed by the length and the
+// bytes of each string (all numbers are 32-bit big-endian integers).
+// A request is made of the protocol version, the working directory of
+// the client, the name of the command and its arguments; the reply
+// contains the exit status, the standard output and the standard
+// error of the command.
+
+// Longer messages are rejected, so that a wrong client cannot make
+// the server allocate an unbounded amount of memory
+const uint32_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+// Send "fields" as one message. Throw a std::runtime_error if the
+// message is longer than MAX_MESSAGE_SIZE or it cannot be written.
+void write_message(int fd, const std::vector<std::string> & fields);
+
+// Read a message into "fields". Return false if the connection was
+// closed before the message started. Throw a std::runtime_error if
+// the message is longer than MAX_MESSAGE_SIZE or it is truncated.
+bool read_message(int fd, std::vector<std::string> & fields);
+
+// Implement "squeezer serve". Return when SIGINT or SIGTERM is
+// received. Throw a std::runtime_error if the arguments are not valid
+// or the socket cannot be created.
+int serve_command(const std::vector<std::string> & list_of_arguments);
+
+// Implement "squeezer client" and return the exit status of the
+// command run by the server. Throw a std::runtime_error if the server
+// cannot be reached.
+int client_command(const std::vector<std::string> & list_of_arguments);
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "shuffle.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+#ifdef __SSE2__
+
+// Split the bytes of "a" and "b" (32 bytes) into the even-numbered
+// ones and the odd-numbered ones
+static inline void
+unzip_bytes(__m128i a, __m128i b, __m128i & even, __m128i & odd)
+{
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+
+    even = _mm_packus_epi16(_mm_and_si128(a, low_bytes),
+			    _mm_and_si128(b, low_bytes));
+    odd = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+			   _mm_srli_epi16(b, 8));
+}
+
+// Shuffle groups of 16 elements, 4 bytes each, and return the number
+// of elements that have been processed
+static size_t
+shuffle_4_bytes_sse2(const uint8_t * input,
+		     size_t num_of_elements,
+		     uint8_t * output)
+{
+    const size_t num_of_groups = num_of_elements / 16;
+    for(size_t group = 0; group < num_of_groups; ++group) {
+	const __m128i * src = reinterpret_cast<const __m128i *>(input + group * 64);
+	__m128i even_ab, odd_ab, even_cd, odd_cd;
+	__m128i plane0, plane1, plane2, plane3;
+
+	unzip_bytes(_mm_loadu_si128(src), _mm_loadu_si128(src + 1),
+		    even_ab, odd_ab);
+	unzip_bytes(_mm_loadu_si128(src + 2), _mm_loadu_si128(src + 3),
+		    even_cd, odd_cd);
+
+	unzip_bytes(even_ab, even_cd, plane0, plane2);
+	unzip_bytes(odd_ab, odd_cd, plane1, plane3);
+
+	uint8_t * dest = output + group * 16;
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dest), plane0);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + num_of_elements), plane1);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 2 * num_of_elements), plane2);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 3 * num_of_elements), plane3);
+    }
+
+    return num_of_groups * 16;
+}
+
+// The inverse of shuffle_4_bytes_sse2
+static size_t
+unshuffle_4_bytes_sse2(const uint8_t * input,
+		       size_t num_of_elements,
+		       uint8_t * output)
+{
+    const size_t num_of_groups = num_of_elements / 16;
+    for(size_t group = 0; group < num_of_groups; ++group) {
+	const uint8_t * src = input + group * 16;
+	const __m128i plane0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	const __m128i plane1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + num_of_elements));
+	const __m128i plane2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * num_of_elements));
+	const __m128i plane3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * num_of_elements));
+
+	const __m128i even_ab = _mm_unpacklo_epi8(plane0, plane2);
+	const __m128i even_cd = _mm_unpackhi_epi8(plane0, plane2);
+	const __m128i odd_ab = _mm_unpacklo_epi8(plane1, plane3);
+	const __m128i odd_cd = _mm_unpackhi_epi8(plane1, plane3);
+
+	__m128i * dest = reinterpret_cast<__m128i *>(output + group * 64);
+	_mm_storeu_si128(dest, _mm_unpacklo_epi8(even_ab, odd_ab));
+	_mm_storeu_si128(dest + 1, _mm_unpackhi_epi8(even_ab, odd_ab));
+	_mm_storeu_si128(dest + 2, _mm_unpacklo_epi8(even_cd, odd_cd));
+	_mm_storeu_si128(dest + 3, _mm_unpackhi_epi8(even_cd, odd_cd));
+    }
+
+    return num_of_groups * 16;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+void
+shuffle_bytes(const uint8_t * input,
+	      size_t size,
+	      size_t element_size,
+	      uint8_t * output)
+{
+    const size_t num_of_elements = size / element_size;
+    size_t first_element = 0;
+
+#ifdef __SSE2__
+    if(element_size == 4)
+	first_element = shuffle_4_bytes_sse2(input, num_of_elements, output);
+#endif
+
+    for(size_t elem = first_element; elem < num_of_elements; ++elem) {
+	for(size_t byte = 0; byte < element_size; ++byte)
+	    output[byte * num_of_elements + elem] = input[elem * element_size + byte];
+    }
+
+    const size_t shuffled_size = num_of_elements * element_size;
+    std::copy(input + shuffled_size, input + size, output + shuffled_size);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+unshuffle_bytes(const uint8_t * input,
+		size_t size,
+		size_t element_size,
+		uint8_t * output)
+{
+    const size_t num_of_elements = size / element_size;
+    size_t first_element = 0;
+
+#ifdef __SSE2__
+    if(element_size == 4)
+	first_element = unshuffle_4_bytes_sse2(input, num_of_elements, output);
+#endif
+
+    for(size_t elem = first_element; elem < num_of_elements; ++elem) {
+	for(size_t byte = 0; byte < element_size; ++byte)
+	    output[elem * element_size + byte] = input[byte * num_of_elements + elem];
+    }
+
+    const size_t shuffled_size = num_of_elements * element_size;
+    std::copy(input + shuffled_size, input + size, output + shuffled_size);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Transpose a 8x8 matrix of bits, where each byte is a row (see
+// "Hacker's delight", section 7-3). The transformation is its own
+// inverse.
+static inline uint64_t
+transpose_8x8_bits(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+
+    return x;
+}
+
+// Split each of the "element_size" sequences of "num_of_elements"
+// bytes in "input" into bit planes. If "inverse" is true, do the
+// opposite. Bytes in excess of a multiple of 8 are copied unchanged.
+static void
+transpose_bit_planes(const uint8_t * input,
+		     size_t num_of_elements,
+		     size_t element_size,
+		     bool inverse,
+		     uint8_t * output)
+{
+    const size_t num_of_groups = num_of_elements / 8;
+
+    for(size_t plane = 0; plane < element_size; ++plane) {
+	const uint8_t * src = input + plane * num_of_elements;
+	uint8_t * dest = output + plane * num_of_elements;
+
+	for(size_t group = 0; group < num_of_groups; ++group) {
+	    uint64_t rows = 0;
+	    for(size_t bit = 0; bit < 8; ++bit) {
+		const uint8_t byte = inverse ? src[bit * num_of_groups + group] : src[group * 8 + bit];
+		rows = (rows << 8) | byte;
+	    }
+
+	    rows = transpose_8x8_bits(rows);
+
+	    for(size_t bit = 0; bit < 8; ++bit) {
+		const uint8_t byte = (rows >> (56 - 8 * bit)) & 0xFF;
+		if(inverse)
+		    dest[group * 8 + bit] = byte;
+		else
+		    dest[bit * num_of_groups + group] = byte;
+	    }
+	}
+
+	std::copy(src + num_of_groups * 8, src + num_of_elements,
+		  dest + num_of_groups * 8);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+shuffle_bits(const uint8_t * input,
+	     size_t size,
+	     size_t element_size,
+	     uint8_t * output)
+{
+    const size_t num_of_elements = size / element_size;
+    std::vector<uint8_t> byte_planes(size);
+
+    shuffle_bytes(input, size, element_size, byte_planes.data());
+    transpose_bit_planes(byte_planes.data(), num_of_elements, element_size,
+			 false, output);
+
+    const size_t shuffled_size = num_of_elements * element_size;
+    std::copy(input + shuffled_size, input + size, output + shuffled_size);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+unshuffle_bits(const uint8_t * input,
+	       size_t size,
+	       size_t element_size,
+	       uint8_t * output)
+{
+    const size_t num_of_elements = size / element_size;
+    std::vector<uint8_t> byte_planes(size);
+
+    transpose_bit_planes(input, num_of_elements, element_size,
+			 true, byte_planes.data());
+
+    const size_t shuffled_size = num_of_elements * element_size;
+    std::copy(input + shuffled_size, input + size,
+	      byte_planes.begin() + shuffled_size);
+
+    unshuffle_bytes(byte_planes.data(), size, element_size, output);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+apply_filter(Filter_type_t filter,
+	     const Byte_buffer_t & input,
+	     Byte_buffer_t & output)
+{
+    output.buffer.resize(input.size());
+    output.cur_position = 0;
+
+    switch(filter) {
+    case FILTER_NONE:
+	output.buffer = input.buffer;
+	break;
+    case FILTER_BYTE_SHUFFLE:
+	shuffle_bytes(input.buffer.data(), input.size(),
+		      SHUFFLE_ELEMENT_SIZE, output.buffer.data());
+	break;
+    case FILTER_BIT_SHUFFLE:
+	shuffle_bits(input.buffer.data(), input.size(),
+		     SHUFFLE_ELEMENT_SIZE, output.buffer.data());
+	break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+undo_filter(Filter_type_t filter,
+	    const Byte_view_t & input,
+	    Byte_buffer_t & output)
+{
+    const uint8_t * input_data = input.cur_data();
+    const size_t input_size = input.items_left();
+
+    output.buffer.resize(input_size);
+    output.cur_position = 0;
+
+    switch(filter) {
+    case FILTER_NONE:
+	std::copy(input_data, input_data + input_size, output.buffer.begin());
+	break;
+    case FILTER_BYTE_SHUFFLE:
+	unshuffle_bytes(input_data, input_size,
+			SHUFFLE_ELEMENT_SIZE, output.buffer.data());
+	break;
+    case FILTER_BIT_SHUFFLE:
+	unshuffle_bits(input_data, input_size,
+		       SHUFFLE_ELEMENT_SIZE, output.buffer.data());
+	break;
+    }
+}
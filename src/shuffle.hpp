@@ -0,0 +1,69 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef SHUFFLE_HPP
+#define SHUFFLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "common_defs.hpp"
+#include "byte_buffer.hpp"
+
+// The encoders of times, differenced data and quality flags write
+// 32-bit quantities (integers or single-precision floating-point
+// numbers). Angles are not filtered, as each frame of the polynomial
+// encoding starts with two 8-bit fields (see
+// Compression_parameters_t::filter_for).
+const size_t SHUFFLE_ELEMENT_SIZE = 4;
+
+// Reorder a sequence of elements, each "element_size" bytes wide, so
+// that the first bytes of all the elements come first, then all the
+// second bytes, and so on. Bytes after the last whole element are
+// copied unchanged.
+void shuffle_bytes(const uint8_t * input,
+		   size_t size,
+		   size_t element_size,
+		   uint8_t * output);
+void unshuffle_bytes(const uint8_t * input,
+		     size_t size,
+		     size_t element_size,
+		     uint8_t * output);
+
+// Like shuffle_bytes, but each sequence of bytes is further split in
+// bit planes: the most significant bits of the bytes come first, etc.
+void shuffle_bits(const uint8_t * input,
+		  size_t size,
+		  size_t element_size,
+		  uint8_t * output);
+void unshuffle_bits(const uint8_t * input,
+		    size_t size,
+		    size_t element_size,
+		    uint8_t * output);
+
+// Apply the filter to the whole buffer, using SHUFFLE_ELEMENT_SIZE
+void apply_filter(Filter_type_t filter,
+		  const Byte_buffer_t & input,
+		  Byte_buffer_t & output);
+void undo_filter(Filter_type_t filter,
+		 const Byte_view_t & input,
+		 Byte_buffer_t & output);
+
+#endif
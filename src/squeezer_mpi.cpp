@@ -0,0 +1,554 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+// This program splits the files listed in a parameter file among the
+// processes of an MPI job. Each process compresses (or decompresses)
+// its own files like "squeezer compress PARAMETER_FILE" would, then
+// rank 0 collects the statistics of every file and prints a report.
+
+#include "config.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+
+#include <mpi.h>
+
+#include "data_structures.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "common_defs.hpp"
+#include "parallel.hpp"
+#include "tasks.hpp"
+
+const char * help_text_mpi =
+    "Usage: mpirun -n N squeezer_mpi compress [options] PARAMETER_FILE\n"
+    "   or: mpirun -n N squeezer_mpi decompress [options] PARAMETER_FILE\n"
+    "\n"
+    "Compress or decompress the files listed in PARAMETER_FILE using N\n"
+    "MPI processes. The files are split so that every process reads\n"
+    "roughly the same number of bytes. Once all the files have been\n"
+    "processed, the first process prints a report with the size and the\n"
+    "compression error of each file.\n"
+    "\n"
+    "PARAMETER_FILE and the options are the same as for \"squeezer\n"
+    "compress\" and \"squeezer decompress\" (run \"squeezer help compress\").\n"
+    "The option -j NUM sets the number of files that each process\n"
+    "handles at the same time (the default is 1). Every process must be\n"
+    "able to read PARAMETER_FILE and the files listed in it.\n";
+
+// Chunks beyond this number are not included in the report
+const size_t MAX_CHUNKS_IN_REPORT = 8;
+const size_t MAX_ERROR_MESSAGE_LENGTH = 256;
+
+//////////////////////////////////////////////////////////////////////
+
+// What happened to one of the files listed in the parameter file.
+// Reports are sent to rank 0 as raw bytes, so they contain no
+// pointers.
+struct File_report_t {
+    uint32_t line_number;
+    int32_t rank;
+    uint8_t failed;
+    uint64_t input_size;
+    uint64_t output_size;
+    uint64_t num_of_rows;
+    double elapsed_time;
+    uint32_t num_of_chunks;
+    // The headers of the chunks in the compressed file (the output of
+    // "compress", or the input of "decompress")
+    Squeezer_chunk_header_t chunks[MAX_CHUNKS_IN_REPORT];
+    char error_message[MAX_ERROR_MESSAGE_LENGTH];
+
+    File_report_t()
+	: line_number(0),
+	  rank(0),
+	  failed(0),
+	  input_size(0),
+	  output_size(0),
+	  num_of_rows(0),
+	  elapsed_time(0.0),
+	  num_of_chunks(0) {
+	error_message[0] = '\0';
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+
+struct Mpi_task_t {
+    bool compress_flag;
+    Compression_parameters_t compression_params;
+    Decompression_parameters_t decompression_params;
+    // Number of files processed at the same time by each rank
+    unsigned int num_of_jobs;
+    std::string parameter_file_name;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Print an error message and stop all the ranks
+static void
+abort_all_ranks(const std::string & message)
+{
+    std::cerr << PROGRAM_NAME << ": " << message << '\n';
+    MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+parse_command_line(const std::vector<std::string> & list_of_arguments,
+		   Mpi_task_t & task)
+{
+    if(list_of_arguments.empty() ||
+       (list_of_arguments.at(0) != "compress" &&
+	list_of_arguments.at(0) != "decompress")) {
+	std::cerr << help_text_mpi;
+	std::exit(1);
+    }
+
+    const std::vector<std::string> command_args(list_of_arguments.begin() + 1,
+						list_of_arguments.end());
+    Batch_options_t batch_options;
+    size_t cur_argument;
+
+    task.compress_flag = (list_of_arguments.at(0) == "compress");
+    try {
+	if(task.compress_flag) {
+	    cur_argument = parse_compression_flags(command_args,
+						   task.compression_params,
+						   batch_options);
+	} else {
+	    cur_argument = parse_decompression_flags(command_args,
+						     false,
+						     task.decompression_params,
+						     batch_options);
+	}
+    }
+    catch(std::runtime_error & exc) {
+	std::cerr << PROGRAM_NAME << ": " << exc.what() << '\n';
+	std::exit(1);
+    }
+    task.num_of_jobs = batch_options.num_of_threads;
+
+    // The state file and the journal would be written by many
+    // processes at once
+    if(batch_options.incremental || batch_options.resume) {
+	std::cerr << PROGRAM_NAME
+		  << ": --incremental and --resume are not supported by "
+		  << "squeezer_mpi\n";
+	std::exit(1);
+    }
+
+    if(command_args.size() - cur_argument != 1) {
+	std::cerr << PROGRAM_NAME
+		  << ": wrong number of arguments. Run \"squeezer_mpi\" "
+		  << "without arguments for help.\n";
+	std::exit(1);
+    }
+
+    task.parameter_file_name = command_args.at(cur_argument);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+read_compressed_file_statistics(const std::string & file_name,
+				File_report_t & report)
+{
+    FILE * input_file = std::fopen(file_name.c_str(), "rb");
+    if(input_file == NULL)
+	throw std::runtime_error("unable to open file \"" + file_name + "\": "
+				 + std::strerror(errno));
+
+    std::vector<Squeezer_chunk_header_t> chunk_headers;
+    try {
+	Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	file_header.read_from_file(input_file);
+	read_chunk_headers(input_file, file_header, chunk_headers);
+    }
+    catch(...) {
+	std::fclose(input_file);
+	throw;
+    }
+    std::fclose(input_file);
+
+    report.num_of_chunks = std::min(chunk_headers.size(), MAX_CHUNKS_IN_REPORT);
+    std::copy(chunk_headers.begin(),
+	      chunk_headers.begin() + report.num_of_chunks,
+	      report.chunks);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Compress or decompress the file in "line", writing verbose messages
+// in "log". Errors are saved in the report instead of being thrown.
+static void
+run_job(const Mpi_task_t & task,
+	const Parameter_file_line_t & line,
+	bool parallel_jobs,
+	std::ostream & log,
+	File_report_t & report)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+
+    report.line_number = line.line_number;
+    try {
+	if(line.output_file_name.empty())
+	    throw std::runtime_error("expected RADIOMETER OD "
+				     "INPUT_FILE OUTPUT_FILE");
+	if(line.input_file_name == "-" || line.output_file_name == "-")
+	    throw std::runtime_error("standard input and output cannot be "
+				     "used with MPI");
+
+	report.input_size = size_of_file(line.input_file_name);
+
+	if(task.compress_flag) {
+	    Compression_parameters_t params(task.compression_params);
+	    params.log_stream = &log;
+	    if(parallel_jobs)
+		params.num_of_threads = 1;
+
+	    run_compression_task_for_one_file(line.radiometer_str,
+					      line.od_str,
+					      line.input_file_name,
+					      line.output_file_name,
+					      params);
+	    read_compressed_file_statistics(line.output_file_name, report);
+
+	    // The first chunk contains the OBT times
+	    if(report.num_of_chunks > 0)
+		report.num_of_rows = report.chunks[0].number_of_samples;
+	} else {
+	    Decompression_parameters_t params(task.decompression_params);
+	    params.log_stream = &log;
+	    if(parallel_jobs)
+		params.num_of_threads = 1;
+
+	    report.num_of_rows =
+		run_decompression_task_for_one_file(line.input_file_name,
+						    line.output_file_name,
+						    params);
+	    read_compressed_file_statistics(line.input_file_name, report);
+	}
+
+	report.output_size = size_of_file(line.output_file_name);
+    }
+    catch(std::exception & exc) {
+	report.failed = 1;
+	std::strncpy(report.error_message, exc.what(),
+		     MAX_ERROR_MESSAGE_LENGTH - 1);
+	report.error_message[MAX_ERROR_MESSAGE_LENGTH - 1] = '\0';
+    }
+
+    const std::chrono::duration<double> elapsed_time =
+	std::chrono::steady_clock::now() - start_time;
+    report.elapsed_time = elapsed_time.count();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Decide which rank processes each line. Rank 0 reads the size of the
+// input files and sends the result to the other ranks.
+static std::vector<unsigned int>
+assign_lines_to_ranks(const std::vector<Parameter_file_line_t> & lines,
+		      int rank,
+		      int num_of_ranks)
+{
+    // Every rank must have read the same parameter file
+    unsigned long num_of_lines = lines.size();
+    MPI_Bcast(&num_of_lines, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    if(num_of_lines != lines.size())
+	abort_all_ranks("the ranks have read different parameter files");
+
+    std::vector<unsigned int> ranks(lines.size());
+    if(rank == 0) {
+	// Empty or unreadable files must be spread too
+	std::vector<uint64_t> weights(lines.size());
+	for(size_t idx = 0; idx < lines.size(); ++idx)
+	    weights[idx] = std::max<uint64_t>(size_of_file(lines[idx].input_file_name), 1);
+
+	ranks = balance_by_weight(weights, num_of_ranks);
+    }
+
+    MPI_Bcast(ranks.data(), ranks.size(), MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    return ranks;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Send the reports of every rank to rank 0, which receives them in the
+// result. The other ranks receive an empty vector.
+static std::vector<File_report_t>
+gather_reports(std::vector<File_report_t> & local_reports,
+	       int rank,
+	       int num_of_ranks)
+{
+    int local_size = local_reports.size() * sizeof(File_report_t);
+    std::vector<int> sizes(num_of_ranks);
+    MPI_Gather(&local_size, 1, MPI_INT,
+	       sizes.data(), 1, MPI_INT,
+	       0, MPI_COMM_WORLD);
+
+    std::vector<int> displacements(num_of_ranks, 0);
+    size_t total_size = 0;
+    if(rank == 0) {
+	for(int idx = 0; idx < num_of_ranks; ++idx) {
+	    displacements[idx] = total_size;
+	    total_size += sizes[idx];
+	}
+    }
+
+    std::vector<File_report_t> all_reports(total_size / sizeof(File_report_t));
+    MPI_Gatherv(local_reports.data(), local_size, MPI_BYTE,
+		all_reports.data(), sizes.data(), displacements.data(), MPI_BYTE,
+		0, MPI_COMM_WORLD);
+
+    std::sort(all_reports.begin(), all_reports.end(),
+	      [](const File_report_t & a, const File_report_t & b) {
+		  return a.line_number < b.line_number;
+	      });
+
+    return all_reports;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Statistics of all the chunks of the same type
+struct Column_summary_t {
+    uint64_t number_of_bytes;
+    uint64_t number_of_samples;
+    double max_abs_error;
+    double sum_of_abs_errors;
+
+    Column_summary_t()
+	: number_of_bytes(0),
+	  number_of_samples(0),
+	  max_abs_error(0.0),
+	  sum_of_abs_errors(0.0) {}
+};
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+print_report(const Mpi_task_t & task,
+	     const std::vector<Parameter_file_line_t> & lines,
+	     const std::vector<File_report_t> & reports,
+	     int num_of_ranks,
+	     double elapsed_time)
+{
+    std::map<size_t, const Parameter_file_line_t *> line_from_number;
+    for(const Parameter_file_line_t & line : lines)
+	line_from_number[line.line_number] = &line;
+
+    std::map<uint32_t, Column_summary_t> columns;
+    std::vector<uint64_t> bytes_per_rank(num_of_ranks, 0);
+    std::vector<double> time_per_rank(num_of_ranks, 0.0);
+    size_t num_of_failures = 0;
+    uint64_t total_input_size = 0;
+    uint64_t total_output_size = 0;
+
+    std::printf("# %s %s: %lu files, %d ranks\n",
+		"squeezer_mpi",
+		task.compress_flag ? "compress" : "decompress",
+		(unsigned long) reports.size(),
+		num_of_ranks);
+    std::printf("# %-6s %-5s %-9s %-14s %-14s %-12s %s\n",
+		"LINE", "RANK", "SECONDS", "INPUT_BYTES", "OUTPUT_BYTES",
+		"ROWS", "INPUT_FILE");
+
+    for(const File_report_t & report : reports) {
+	const std::string & input_file_name =
+	    line_from_number[report.line_number]->input_file_name;
+
+	bytes_per_rank[report.rank] += report.input_size;
+	time_per_rank[report.rank] += report.elapsed_time;
+
+	if(report.failed) {
+	    std::printf("  %-6u %-5d FAILED    %s: %s\n",
+			report.line_number,
+			report.rank,
+			input_file_name.c_str(),
+			report.error_message);
+	    num_of_failures++;
+	    continue;
+	}
+
+	std::printf("  %-6u %-5d %-9.2f %-14llu %-14llu %-12llu %s\n",
+		    report.line_number,
+		    report.rank,
+		    report.elapsed_time,
+		    (unsigned long long) report.input_size,
+		    (unsigned long long) report.output_size,
+		    (unsigned long long) report.num_of_rows,
+		    input_file_name.c_str());
+
+	total_input_size += report.input_size;
+	total_output_size += report.output_size;
+
+	for(size_t idx = 0; idx < report.num_of_chunks; ++idx) {
+	    const Squeezer_chunk_header_t & chunk = report.chunks[idx];
+	    const Error_t & error = chunk.compression_error;
+	    Column_summary_t & summary = columns[chunk.chunk_type];
+
+	    std::printf("      %-6s %12llu bytes, abs. error: max %g, mean %g\n",
+			column_name(static_cast<Chunk_type_t>(chunk.chunk_type)).c_str(),
+			(unsigned long long) chunk.number_of_bytes,
+			error.max_abs_error,
+			error.mean_abs_error);
+
+	    summary.number_of_bytes += chunk.number_of_bytes;
+	    summary.number_of_samples += chunk.number_of_samples;
+	    summary.max_abs_error = std::max(summary.max_abs_error,
+					     error.max_abs_error);
+	    summary.sum_of_abs_errors += error.mean_abs_error * chunk.number_of_samples;
+	}
+    }
+
+    std::printf("#\n# Columns (all the files)\n");
+    std::printf("# %-6s %-14s %-14s %-14s %s\n",
+		"COLUMN", "BYTES", "SAMPLES", "MAX_ABS_ERR", "MEAN_ABS_ERR");
+    for(const auto & cur_column : columns) {
+	const Column_summary_t & summary = cur_column.second;
+	const double mean_abs_error = (summary.number_of_samples > 0)
+	    ? summary.sum_of_abs_errors / summary.number_of_samples
+	    : 0.0;
+
+	std::printf("  %-6s %-14llu %-14llu %-14g %g\n",
+		    column_name(static_cast<Chunk_type_t>(cur_column.first)).c_str(),
+		    (unsigned long long) summary.number_of_bytes,
+		    (unsigned long long) summary.number_of_samples,
+		    summary.max_abs_error,
+		    mean_abs_error);
+    }
+
+    std::printf("#\n# Load of each rank\n");
+    std::printf("# %-6s %-14s %s\n", "RANK", "INPUT_BYTES", "SECONDS");
+    for(int idx = 0; idx < num_of_ranks; ++idx) {
+	std::printf("  %-6d %-14llu %.2f\n",
+		    idx,
+		    (unsigned long long) bytes_per_rank[idx],
+		    time_per_rank[idx]);
+    }
+
+    std::printf("#\n# %lu files processed, %lu failed, "
+		"%llu bytes read, %llu bytes written in %.2f s\n",
+		(unsigned long) (reports.size() - num_of_failures),
+		(unsigned long) num_of_failures,
+		(unsigned long long) total_input_size,
+		(unsigned long long) total_output_size,
+		elapsed_time);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+
+    int rank, num_of_ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_of_ranks);
+
+    std::vector<std::string> list_of_arguments;
+    for(int i = 1; i < argc; ++i) {
+	list_of_arguments.push_back(argv[i]);
+    }
+
+    Mpi_task_t task;
+    parse_command_line(list_of_arguments, task);
+
+#if HAVE_TOODI
+    ObjectHandle init_handle;
+    toodiInitializeLLIO("TOODI%file", &init_handle);
+#endif
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<Parameter_file_line_t> lines;
+    try {
+	read_parameter_file(task.parameter_file_name, lines);
+    }
+    catch(std::runtime_error & exc) {
+	abort_all_ranks(exc.what());
+    }
+    const std::vector<unsigned int> ranks =
+	assign_lines_to_ranks(lines, rank, num_of_ranks);
+
+    std::vector<size_t> local_lines;
+    for(size_t idx = 0; idx < lines.size(); ++idx) {
+	if(ranks[idx] == (unsigned int) rank)
+	    local_lines.push_back(idx);
+    }
+
+    // The verbose messages about each file are printed together
+    const unsigned int num_of_jobs = number_of_fits_jobs(task.num_of_jobs,
+								 std::cerr);
+    std::vector<File_report_t> local_reports(local_lines.size());
+    std::mutex output_mutex;
+    parallel_for(local_lines.size(), num_of_jobs,
+		 [&](size_t idx) {
+		     std::ostringstream job_log;
+		     File_report_t & report = local_reports[idx];
+
+		     run_job(task, lines[local_lines[idx]],
+			     num_of_jobs != 1, job_log, report);
+		     report.rank = rank;
+
+		     std::lock_guard<std::mutex> lock(output_mutex);
+		     std::cerr << job_log.str();
+		 });
+
+    const std::vector<File_report_t> all_reports =
+	gather_reports(local_reports, rank, num_of_ranks);
+
+    if(rank == 0) {
+	const std::chrono::duration<double> elapsed_time =
+	    std::chrono::steady_clock::now() - start_time;
+	print_report(task, lines, all_reports, num_of_ranks,
+		     elapsed_time.count());
+    }
+
+    int local_failures = 0;
+    for(const File_report_t & report : local_reports)
+	local_failures += report.failed;
+
+    int num_of_failures = 0;
+    MPI_Allreduce(&local_failures, &num_of_failures, 1, MPI_INT,
+		  MPI_SUM, MPI_COMM_WORLD);
+
+#if HAVE_TOODI
+    toodiCloseLLIO(init_handle);
+#endif
+
+    MPI_Finalize();
+    return (num_of_failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,517 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "config.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include <fitsio.h>
+
+#include "backends.hpp"
+#include "tasks.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+std::string
+temporary_output_file_name(const std::string & file_name)
+{
+    const size_t slash_pos = file_name.rfind('/');
+    const size_t base_name_pos = (slash_pos == std::string::npos) ? 0 : slash_pos + 1;
+
+    return file_name.substr(0, base_name_pos)
+	+ ".partial."
+	+ file_name.substr(base_name_pos);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Rename "temporary_file_name", or remove it and throw an exception
+static void
+rename_temporary_file(const std::string & temporary_file_name,
+		      const std::string & file_name)
+{
+    if(std::rename(temporary_file_name.c_str(), file_name.c_str()) != 0) {
+	const std::string reason = std::strerror(errno);
+	std::remove(temporary_file_name.c_str());
+	throw std::runtime_error("unable to rename \"" + temporary_file_name
+				 + "\" into \"" + file_name + "\": " + reason);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+run_compression_task_for_one_file(const std::string radiometer_str,
+				  const std::string od_str,
+				  const std::string input_file_name,
+				  const std::string output_file_name,
+				  Compression_parameters_t & params)
+{
+    Radiometer_t radiometer;
+    radiometer.parse_from_name(radiometer_str);
+    params.radiometer = radiometer;
+
+    std::stringstream ss(od_str);
+    if(! (ss >> params.od_number))
+	throw std::runtime_error("invalid OD \"" + od_str + "\"");
+
+    FILE * output_file = NULL;
+    bool write_to_stdout = false;
+    const std::string temporary_file_name =
+	temporary_output_file_name(output_file_name);
+    if(output_file_name == "-") {
+	write_to_stdout = true;
+	output_file = stdout;
+    } else {
+	output_file = std::fopen(temporary_file_name.c_str(), "wb");
+	if(output_file == NULL)
+	    throw std::runtime_error("unable to create file \""
+				     + temporary_file_name + "\": "
+				     + std::strerror(errno));
+    }
+
+    try {
+	compress_file_to_file(input_file_name,
+			      output_file,
+			      params);
+    }
+    catch(...) {
+	if(! write_to_stdout) {
+	    std::fclose(output_file);
+	    std::remove(temporary_file_name.c_str());
+	}
+	throw;
+    }
+
+    if(! write_to_stdout) {
+	if(std::fclose(output_file) != 0) {
+	    const std::string reason = std::strerror(errno);
+	    std::remove(temporary_file_name.c_str());
+	    throw std::runtime_error("unable to write file \""
+				     + output_file_name + "\": " + reason);
+	}
+
+	rename_temporary_file(temporary_file_name, output_file_name);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void
+read_parameter_file(const std::string & file_name,
+		    std::vector<Parameter_file_line_t> & lines)
+{
+    std::ifstream input_stream(file_name);
+    if(! input_stream)
+	throw std::runtime_error("unable to open file \"" + file_name + "\"");
+
+    size_t line_number = 0;
+    while(input_stream.good()) {
+	std::string cur_line;
+	getline(input_stream, cur_line);
+	line_number++;
+
+	if(cur_line.empty() || cur_line.at(0) == '#')
+	  continue;
+
+	Parameter_file_line_t line;
+	line.line_number = line_number;
+
+	std::stringstream ss (cur_line);
+	ss >> line.radiometer_str;
+	ss >> line.od_str;
+	ss >> line.input_file_name;
+	ss >> line.output_file_name;
+
+	lines.push_back(line);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+unsigned int
+number_of_fits_jobs(unsigned int num_of_jobs,
+		    std::ostream & log)
+{
+    // CFITSIO can be used by many threads only if it was built with
+    // --enable-reentrant
+    if(num_of_jobs != 1 && ! fits_is_reentrant()) {
+	log << PROGRAM_NAME
+	    << ": CFITSIO is not reentrant, files will be "
+	    << "processed one at a time\n";
+	return 1;
+    }
+
+    return num_of_jobs;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+run_decompression_task_for_one_file(const std::string & input_file_name,
+				    const std::string & output_file_name,
+				    const Decompression_parameters_t & params)
+{
+    FILE * input_file = NULL;
+    bool read_from_stdin = false;
+    if(input_file_name == "-") {
+	read_from_stdin = true;
+	input_file = stdin;
+    } else {
+	input_file = std::fopen(input_file_name.c_str(), "rb");
+	if(input_file == NULL)
+	    throw std::runtime_error("unable to open file \""
+				     + input_file_name + "\": "
+				     + std::strerror(errno));
+    }
+
+    // A leading "!" tells CFITSIO to overwrite the file. Names using
+    // other parts of the extended syntax (e.g., a template in
+    // parentheses) are passed to CFITSIO unchanged.
+    const bool overwrite = (! output_file_name.empty()) && output_file_name[0] == '!';
+    const std::string file_name = overwrite ? output_file_name.substr(1) : output_file_name;
+    const bool use_temporary_file =
+	file_name != "-" &&
+	file_name.find_first_of("[(") == std::string::npos &&
+	file_name.find("://") == std::string::npos;
+    const std::string temporary_file_name = temporary_output_file_name(file_name);
+
+    size_t num_of_rows;
+    try {
+	if(use_temporary_file) {
+	    struct stat file_info;
+	    if(! overwrite && stat(file_name.c_str(), &file_info) == 0)
+		throw std::runtime_error("file \"" + file_name + "\" already exists");
+
+	    num_of_rows = decompress_file_from_file(input_file,
+						    "!" + temporary_file_name,
+						    params);
+	    rename_temporary_file(temporary_file_name, file_name);
+	} else {
+	    num_of_rows = decompress_file_from_file(input_file,
+						    output_file_name,
+						    params);
+	}
+    }
+    catch(...) {
+	if(use_temporary_file)
+	    std::remove(temporary_file_name.c_str());
+	if(! read_from_stdin)
+	    std::fclose(input_file);
+	throw;
+    }
+
+    if(! read_from_stdin) {
+	std::fclose(input_file);
+    }
+
+    return num_of_rows;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+uint64_t
+size_of_file(const std::string & file_name)
+{
+    struct stat file_info;
+    if(stat(file_name.c_str(), &file_info) != 0)
+	return 0;
+
+    return file_info.st_size;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+parse_compression_flags(const std::vector<std::string> & list_of_arguments,
+			Compression_parameters_t & params,
+			Batch_options_t & batch_options)
+{
+    size_t cur_argument = 0;
+
+    params.file_type = SQZ_DETECTOR_POINTINGS;
+
+    while((! list_of_arguments.empty()) &&
+	  list_of_arguments.at(cur_argument)[0] == '-') {
+
+	if(list_of_arguments.at(cur_argument) == "-v") {
+
+	    params.verbose_flag = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--pointings") {
+
+	    params.file_type = SQZ_DETECTOR_POINTINGS;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--datadiff") {
+
+	    params.file_type = SQZ_DIFFERENCED_DATA;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--calibrated") {
+
+	    params.read_calibrated_data = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--uncalibrated") {
+
+	    params.read_calibrated_data = false;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--archive") {
+
+	    params.backend = Backend_choice_t(BACKEND_ARITHMETIC, 0);
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--backend") {
+
+	    // Either "NAME[:LEVEL]" or "COLUMN=NAME[:LEVEL]"
+	    const std::string & spec = list_of_arguments.at(++cur_argument);
+	    const size_t equal_pos = spec.find('=');
+	    Chunk_type_t column = CHUNK_DELTA_OBT;
+	    Backend_choice_t choice;
+
+	    if(equal_pos != std::string::npos &&
+	       ! parse_column_name(spec.substr(0, equal_pos), column)) {
+		throw std::runtime_error("unknown column \""
+					 + spec.substr(0, equal_pos)
+					 + "\" in --backend "
+					 + spec);
+	    }
+
+	    const std::string backend_spec =
+		(equal_pos != std::string::npos) ? spec.substr(equal_pos + 1) : spec;
+	    if(! parse_backend_choice(backend_spec, choice)) {
+		throw std::runtime_error("invalid backend \""
+					 + backend_spec
+					 + "\", the available backends are: "
+					 + list_of_available_backends());
+	    }
+
+	    if(equal_pos != std::string::npos)
+		params.column_backends[column] = choice;
+	    else
+		params.backend = choice;
+
+	    ++cur_argument;
+
+	} else if(list_of_arguments.at(cur_argument) == "--incremental") {
+
+	    batch_options.incremental = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--resume") {
+
+	    batch_options.resume = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--shuffle") {
+
+	    params.filter = FILTER_BYTE_SHUFFLE;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--bitshuffle") {
+
+	    params.filter = FILTER_BIT_SHUFFLE;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "-b") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    size_t number;
+	    if(! (ss >> number) || number > UINT32_MAX) {
+		throw std::runtime_error("invalid number of samples per block \""
+					 + list_of_arguments.at(cur_argument)
+					 + "\"");
+	    }
+
+	    params.samples_per_block = number;
+	    ++cur_argument;
+
+	} else if(list_of_arguments.at(cur_argument) == "-j") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    if(! (ss >> batch_options.num_of_threads)) {
+		throw std::runtime_error("invalid number of threads \""
+					 + list_of_arguments.at(cur_argument)
+					 + "\"");
+	    }
+	    batch_options.num_of_threads_specified = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "-n") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    size_t number;
+	    ss >> number;
+	    if(number > UINT8_MAX) {
+		params.log() << PROGRAM_NAME
+			     << ": the maximum value allowed for the -n parameter is "
+			     << UINT8_MAX
+			     << " (you provided "
+			     << number
+			     << ")\n";
+	    } else {
+		params.elements_per_frame = number;
+	    }
+
+	    ++cur_argument;
+
+	} else if(list_of_arguments.at(cur_argument) == "-p") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    unsigned number;
+	    ss >> number;
+	    if(number > UINT8_MAX) {
+		params.log() << PROGRAM_NAME
+			     << ": the maximum value allowed for the -p parameter is "
+			     << UINT8_MAX
+			     << " (you provided "
+			     << number
+			     << ")\n";
+	    } else {
+		params.number_of_poly_terms = number;
+	    }
+
+	    ++cur_argument;
+
+	} else if(list_of_arguments.at(cur_argument) == "-s") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    double number;
+	    ss >> number;
+	    if(number < 0.0) {
+		params.log() << PROGRAM_NAME
+			     << ": the value passed to -s is negative. "
+			     << "This will disable compression for angles.\n";
+	    }
+
+	    params.max_abs_error = number / 3600.0 * M_PI / 180.0;
+
+	    ++cur_argument;
+
+	} else {
+
+	    throw std::runtime_error("unknown flag \""
+				     + list_of_arguments.at(cur_argument)
+				     + "\"");
+
+	}
+    }
+
+    if(params.number_of_poly_terms >= params.elements_per_frame) {
+	params.log() << PROGRAM_NAME
+		     << ": invalid numbers specified using -n ("
+		     << params.elements_per_frame
+		     << ") and -p ("
+		     << params.number_of_poly_terms
+		     << ")\n";
+    }
+
+    return cur_argument;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+parse_decompression_flags(const std::vector<std::string> & list_of_arguments,
+			  bool extract_flag,
+			  Decompression_parameters_t & params,
+			  Batch_options_t & batch_options)
+{
+    size_t cur_argument = 0;
+
+    while((! list_of_arguments.empty()) &&
+	  list_of_arguments.at(cur_argument)[0] == '-') {
+
+	if(list_of_arguments.at(cur_argument) == "-v") {
+
+	    params.verbose_flag = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--resume") {
+
+	    batch_options.resume = true;
+	    cur_argument++;
+
+	} else if(list_of_arguments.at(cur_argument) == "--columns") {
+
+	    const std::string & list = list_of_arguments.at(++cur_argument);
+	    if(! parse_column_list(list, params.column_mask)) {
+		throw std::runtime_error("invalid list of columns \"" + list + "\"");
+	    }
+	    cur_argument++;
+
+	} else if(extract_flag &&
+		  list_of_arguments.at(cur_argument) == "--obt-range") {
+
+	    std::stringstream ss(list_of_arguments.at(cur_argument + 1) + ' ' +
+				 list_of_arguments.at(cur_argument + 2));
+	    if(! (ss >> params.first_obt >> params.last_obt) ||
+	       params.first_obt > params.last_obt) {
+		throw std::runtime_error("invalid OBT range \""
+					 + list_of_arguments.at(cur_argument + 1)
+					 + ' '
+					 + list_of_arguments.at(cur_argument + 2)
+					 + "\"");
+	    }
+	    params.obt_range_flag = true;
+	    cur_argument += 3;
+
+	} else if(list_of_arguments.at(cur_argument) == "-j") {
+
+	    std::stringstream ss(list_of_arguments.at(++cur_argument));
+	    if(! (ss >> batch_options.num_of_threads)) {
+		throw std::runtime_error("invalid number of threads \""
+					 + list_of_arguments.at(cur_argument)
+					 + "\"");
+	    }
+	    batch_options.num_of_threads_specified = true;
+	    cur_argument++;
+
+	} else {
+
+	    if(list_of_arguments.at(cur_argument) == "-")
+		break;
+
+	    throw std::runtime_error("unknown flag \""
+				     + list_of_arguments.at(cur_argument)
+				     + "\"");
+
+	}
+    }
+
+    if(extract_flag && ! params.obt_range_flag)
+	throw std::runtime_error("the --obt-range flag is mandatory. "
+				 "Run \"squeezer help extract\".");
+
+    return cur_argument;
+}
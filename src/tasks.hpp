@@ -0,0 +1,117 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef TASKS_HPP
+#define TASKS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compress.hpp"
+#include "decompress.hpp"
+
+// Operations shared by the programs that implement the command-line
+// interface ("squeezer" and "squeezer_mpi")
+
+// One of the lines in a parameter file, in the form "RADIOMETER OD
+// INPUT_FILE OUTPUT_FILE". Fields that are missing are left empty.
+struct Parameter_file_line_t {
+    size_t line_number;
+    std::string radiometer_str;
+    std::string od_str;
+    std::string input_file_name;
+    std::string output_file_name;
+};
+
+// Options of the "compress" and "decompress" commands that do not
+// change how each file is processed
+struct Batch_options_t {
+    // With a parameter file, the number of files processed at the
+    // same time; otherwise, the number of threads encoding or
+    // decoding the blocks of the file
+    unsigned int num_of_threads;
+    bool num_of_threads_specified;
+    // Skip the lines of a parameter file whose output is up to date
+    bool incremental;
+    // Skip the lines completed by a previous run that was interrupted
+    bool resume;
+
+    Batch_options_t()
+	: num_of_threads(1),
+	  num_of_threads_specified(false),
+	  incremental(false),
+	  resume(false) {}
+};
+
+// Read all the lines of a parameter file, skipping comments and
+// empty lines. Throw a std::runtime_error if the file cannot be
+// read.
+void read_parameter_file(const std::string & file_name,
+			 std::vector<Parameter_file_line_t> & lines);
+
+// Return the number of files that can be read or written at the same
+// time by "num_of_jobs" threads, which is 1 if CFITSIO is not
+// reentrant (in this case, a warning is written to "log")
+unsigned int number_of_fits_jobs(unsigned int num_of_jobs,
+				 std::ostream & log);
+
+// Return zero if the size of the file cannot be determined
+uint64_t size_of_file(const std::string & file_name);
+
+// Return the name of the file where "file_name" is written before
+// being renamed: a hidden file in the same directory, with the same
+// extension (CFITSIO uses it to decide whether to compress the file)
+std::string temporary_output_file_name(const std::string & file_name);
+
+// Throw a std::runtime_error if the file cannot be compressed. The
+// output is written to a temporary file which is renamed only if
+// compression succeeds, so that OUTPUT_FILE is never left truncated.
+void run_compression_task_for_one_file(const std::string radiometer_str,
+				       const std::string od_str,
+				       const std::string input_file_name,
+				       const std::string output_file_name,
+				       Compression_parameters_t & params);
+
+// Throw a std::runtime_error if the file cannot be decompressed.
+// Return the number of rows written in the FITS file. Unless
+// CFITSIO's extended syntax is used in "output_file_name", the file
+// is written under a temporary name and renamed once it is complete.
+size_t run_decompression_task_for_one_file(const std::string & input_file_name,
+					   const std::string & output_file_name,
+					   const Decompression_parameters_t & params);
+
+// Parse the flags at the beginning of the arguments of the "compress"
+// command and return the index of the first argument that is not a
+// flag. Throw a std::runtime_error if a flag is not valid. Warnings
+// are written to "params.log()".
+size_t parse_compression_flags(const std::vector<std::string> & list_of_arguments,
+			       Compression_parameters_t & params,
+			       Batch_options_t & batch_options);
+
+// The same for the "decompress" and "extract" commands
+size_t parse_decompression_flags(const std::vector<std::string> & list_of_arguments,
+				 bool extract_flag,
+				 Decompression_parameters_t & params,
+				 Batch_options_t & batch_options);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "common_defs.hpp"
+#include "byte_buffer.hpp"
+#include "crc32c.hpp"
+#include "data_structures.hpp"
+#include "mapped_file.hpp"
+#include "verify.hpp"
+
+//////////////////////////////////////////////////////////////////////
+
+static void
+verification_error(size_t chunk_idx, const std::string & msg)
+{
+    std::stringstream ss;
+    ss << "chunk #" << chunk_idx + 1 << ": " << msg;
+    throw std::runtime_error(ss.str());
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Check the blocks in the payload of a chunk and return the number
+// of checksums that have been verified
+static size_t
+verify_blocks(size_t chunk_idx,
+	      const Squeezer_file_header_t & file_header,
+	      const Squeezer_chunk_header_t & chunk_header,
+	      Byte_view_t chunk_data)
+{
+    if(file_header.program_version < FIRST_VERSION_WITH_BLOCKS)
+	return 0;
+
+    const bool has_checksums =
+	file_header.program_version >= FIRST_VERSION_WITH_CHECKSUMS;
+    size_t num_of_samples = 0;
+    size_t num_of_checksums = 0;
+    while(chunk_data.items_left() > 0) {
+	Squeezer_block_header_t block_header;
+	block_header.read_from_buffer(chunk_data, file_header.program_version);
+	if(block_header.number_of_bytes > chunk_data.items_left())
+	    verification_error(chunk_idx, "a block is truncated");
+
+	Byte_view_t block_data = chunk_data.read_view(block_header.number_of_bytes);
+	if(has_checksums) {
+	    if(block_header.compute_checksum(block_data.cur_data()) != block_header.checksum)
+		verification_error(chunk_idx, "wrong block checksum");
+
+	    num_of_checksums++;
+	}
+
+	num_of_samples += block_header.number_of_samples;
+    }
+
+    if(num_of_samples != chunk_header.number_of_samples)
+	verification_error(chunk_idx, "the blocks do not match the chunk header");
+
+    return num_of_checksums;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+size_t
+verify_file(FILE * input_file)
+{
+    Mapped_file_t mapped_file(input_file);
+    const Byte_view_t whole_file = mapped_file.view();
+    Byte_view_t input = whole_file;
+
+    try {
+	Squeezer_file_header_t file_header(SQZ_NO_DATA);
+	file_header.read_from_buffer(input);
+	if(! file_header.is_valid())
+	    throw std::runtime_error("the file header is damaged");
+
+	if(! file_header.is_compatible_version())
+	    throw std::runtime_error("the file was written by an incompatible "
+				     "version of " PROGRAM_NAME);
+
+	Squeezer_toc_t toc(file_header.size_in_bytes());
+	if(file_header.toc_offset != 0) {
+	    if(file_header.toc_offset > whole_file.size())
+		throw std::runtime_error("the table of contents is missing");
+
+	    Byte_view_t toc_data(whole_file.cur_data() + file_header.toc_offset,
+				 whole_file.size() - file_header.toc_offset);
+	    toc.read_from_buffer(toc_data);
+	    if(! toc.is_valid(file_header))
+		throw std::runtime_error("the table of contents is damaged");
+	}
+
+	size_t num_of_checksums = 0;
+	for(size_t chunk_idx = 0;
+	    chunk_idx < file_header.number_of_chunks;
+	    ++chunk_idx) {
+
+	    const size_t offset = input.size() - input.items_left();
+	    const uint8_t * header_bytes = input.cur_data();
+
+	    Squeezer_chunk_header_t chunk_header;
+	    chunk_header.read_from_buffer(input, file_header.program_version);
+	    if(! chunk_header.is_valid())
+		verification_error(chunk_idx, "the chunk header is damaged");
+
+	    if(! toc.entries.empty()) {
+		const Toc_entry_t & entry = toc.entries[chunk_idx];
+		if(entry.offset != offset ||
+		   entry.number_of_bytes != chunk_header.number_of_bytes)
+		    verification_error(chunk_idx, "the table of contents does "
+				       "not match the chunk header");
+
+		if(entry.checksum != 0 &&
+		   entry.checksum != crc32c(header_bytes,
+					    Squeezer_chunk_header_t::SIZE_IN_BYTES))
+		    verification_error(chunk_idx, "wrong chunk header checksum");
+	    }
+
+	    if(chunk_header.number_of_bytes > input.items_left())
+		verification_error(chunk_idx, "the chunk is truncated");
+
+	    num_of_checksums += verify_blocks(chunk_idx, file_header, chunk_header,
+					      input.read_view(chunk_header.number_of_bytes));
+	}
+
+	return num_of_checksums;
+    }
+    catch(std::out_of_range &) {
+	throw std::runtime_error("the file is truncated");
+    }
+}
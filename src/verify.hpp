@@ -0,0 +1,36 @@
+/*
+ * Squeezer - compress LFI detector pointings and differenced data
+ * Copyright (C) 2013 Maurizio Tomasi (Planck collaboration)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#ifndef VERIFY_HPP
+#define VERIFY_HPP
+
+#include <cstdio>
+#include <cstddef>
+
+// Check the integrity of a compressed file without decoding it: the
+// headers must be consistent with each other and with the table of
+// contents, and the checksum of each block must match. Return the
+// number of checksums that have been verified (zero for files older
+// than FIRST_VERSION_WITH_CHECKSUMS). Throw a std::runtime_error
+// describing the first problem found.
+size_t verify_file(FILE * input_file);
+
+#endif